@@ -25,11 +25,25 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <inttypes.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <utime.h>
+#include <fcntl.h>
 #include "FtpClient.h"
+#include "FtpClientPort.h"
+#include "FtpClientText.h"
+#include "FtpClientList.h"
+#include "FtpClientDeflate.h"
+#include "FtpClientHash.h"
+#include "FtpClientMem.h"
+#include "FtpClientSock.h"
 
 #include "netdb.h"
 
@@ -43,35 +57,318 @@
 #define FTP_CLIENT_READ						1
 #define FTP_CLIENT_WRITE					2
 
+/* adaptive data chunk size */
+#define FTP_CLIENT_ADAPT_WINDOW_US			100000
+#define FTP_CLIENT_ADAPT_MIN_CHUNKS			4
+#define FTP_CLIENT_ADAPT_LOW_HEAP			32768
+
+/* login data kept for opening more connections to the same server */
+#define FTP_CLIENT_HOST_SIZE				128
+#define FTP_CLIENT_CWD_SIZE					256
+#define FTP_CLIENT_LOGIN_SIZE				64
+
+/* credit of a rate limiter, see rateRefill() */
+typedef struct {
+	int64_t credit;				/* bytes * 1000000, negative after a large chunk */
+	int64_t stamp;				/* us of the last refill, 0 for a full bucket */
+} RateBucket_t;
+
+/* remote metadata cache, see metaFind() */
+#if (FTP_CLIENT_METACACHE_ENTRIES < 2) || \
+	(FTP_CLIENT_METACACHE_ENTRIES & (FTP_CLIENT_METACACHE_ENTRIES - 1))
+#error "FTP_CLIENT_METACACHE_ENTRIES must be a power of two"
+#endif
+#define META_SIZE							0x01
+#define META_MODDATE						0x02
+
+typedef struct {
+	uint64_t key;				/* hash of the absolute path, 0 if unused */
+	int64_t stored;				/* ms */
+	uint64_t size;
+	char modDate[FTP_CLIENT_METACACHE_DATE_SIZE];
+	uint8_t facts;
+} MetaEntry_t;
+
+/* compression of a transfer, see codecRead() */
+typedef struct {
+	int method;					/* FTP_CLIENT_COMPRESS_MODEZ or _GZIP */
+	FtpClientDeflate_t* deflate;
+	FtpClientInflate_t* inflate;
+	const FtpClientSource_t* source;
+	NetBuf_t* nData;
+	uint64_t raw;				/* uncompressed bytes */
+	int64_t us;					/* time in the codec */
+	int64_t ioUs;				/* of that, time reading its input */
+} Codec_t;
+
+/*
+ * Data connections only use the fields up to started, and are allocated
+ * with NETBUF_DATA_SIZE bytes from the slab of netBufAlloc(). Code reached
+ * with a data connection must not touch the fields from data on.
+ */
 struct NetBuf {
 	char* cput;
 	char* cget;
 	int handle;
 	int cavail, cleft;
 	char* buf;
+	int bufsize;
+	char crlf;
 	int dir;
 	NetBuf_t* ctrl;
-	NetBuf_t* data;
-	int cmode;
 	struct timeval idletime;
 	FtpClientCallback_t idlecb;
 	void* idlearg;
 	unsigned long int xfered;
 	unsigned long int cbbytes;
 	unsigned long int xfered1;
+	int aborted;				/* stopped by the callback or a socket error */
+	Codec_t* codec;
+	int64_t throttled;
+	int64_t started;
+	/* control connection only */
+	FtpClientPortMutex_t* lock;	/* held by the public functions, see sessionLock() */
+	int users;					/* tasks holding or waiting for the lock */
+	volatile int closing;		/* quit or close has begun, see sessionClose() */
+	NetBuf_t* data;
+	int cmode;
+	int dbufsize;
+	int dbufadaptive;
+	int pipeline;
+	int segments;
+	int resume;
+	unsigned long int checkpoint;
+	int cmdWindow;
+	uint64_t restOffset;
+	int compress;
+	char xmode;					/* MODE the server is in */
+	char xmodeNext;				/* MODE of the next transfer, 0 for S */
+	char noModeZ;				/* the server refused MODE Z */
+	char modeZSent;				/* MODE Z was sent, transfers after it would repeat MODE */
+	int hashAlg;
+	FtpClientHash_t hash;
+	char hashPrimed;			/* hash holds the kept part of a resumed file */
+	char hashSel;				/* algorithm selected with OPTS HASH */
+	uint8_t hashNo;				/* 1 << alg: HASH refused, 0x10 << alg: XCRC etc. refused */
+	int sockControl;			/* FTP_CLIENT_SOCK_* profiles */
+	int sockData;
+	int sockBufSize;
+	int sockTimeout;
+	char host[FTP_CLIENT_HOST_SIZE];
+	uint16_t port;
+	char user[FTP_CLIENT_LOGIN_SIZE];
+	char pass[FTP_CLIENT_LOGIN_SIZE];
+	char type;
+	char cwdFrom;
+	char cwd[FTP_CLIENT_CWD_SIZE];
+	unsigned long int rttSaved;
+	MetaEntry_t* meta;
+	long metaTtl;
+	FtpClientMetaCacheStats_t mstats;
+	FtpClientStats_t stats;
+	volatile long rateLimit;
+	volatile long rateBurst;
+	NetBuf_t* rateFrom;
+	int rateShare;
+	RateBucket_t bucket;
+	FtpClientXferStats_t xstats;
+	char response[FTP_CLIENT_RESPONSE_BUFFER_SIZE];
+};
+
+#define NETBUF_DATA_SIZE 					offsetof(NetBuf_t, data)
+
+/* slab of the data connections, see netBufAlloc() */
+typedef union NetBufSlot {
+	union NetBufSlot* next;
+	char data[NETBUF_DATA_SIZE];
+	max_align_t align;
+} NetBufSlot_t;
+
+/* pipelined transfer, see xferSinkPipelined() */
+typedef struct {
+	char* data;
+	int len;
+} PipeBuf_t;
+
+typedef struct {
+	FtpClientPortQueue_t* freeq;
+	FtpClientPortQueue_t* fullq;
+	PipeBuf_t bufs[FTP_CLIENT_PIPELINE_MAX_BUFFERS];
+	int count;
+	int size;
+	const FtpClientSink_t* sink;
+	const FtpClientSource_t* source;
+	volatile int failed;
+	volatile int stop;
+} Pipe_t;
+
+/* local file of xfer(), see fileSinkWrite() */
+typedef struct {
+	int fd;
+	uint64_t pos;
+	uint64_t checkpoint;
+	unsigned long int interval;
+	const char* journal;
+	const char* path;
+	char op;
+	char mode;
+} FileEndpoint_t;
+
+/* memory of the buffer transfers, see memSinkGetBuffer() */
+typedef struct {
+	char* buf;
+	size_t size;				/* usable bytes of buf */
+	size_t len;					/* bytes received or sent */
+	size_t max;					/* limit of a growable buffer */
+	int grow;
+	int overflow;				/* the file did not fit */
+	char spill[16];				/* receives data beyond a full buffer */
+} MemEndpoint_t;
+
+/* one byte range of a segmented download, see segmentRun() */
+typedef struct {
+	NetBuf_t* main;
+	NetBuf_t* nControl;
+	const char* path;
+	int fd;
+	uint64_t offset;
+	uint64_t length;
+	int rv;
 	char response[FTP_CLIENT_RESPONSE_BUFFER_SIZE];
+} Segment_t;
+
+/* listing that also fills the metadata cache, see listMetaEntry() */
+typedef struct {
+	FtpClientListCallback_t cb;
+	void* arg;
+	uint64_t dir;
+	NetBuf_t* nControl;
+} ListMeta_t;
+
+/* one entry of a listing compared by mirrorDir() */
+typedef struct {
+	const char* name;
+	size_t off;
+	uint64_t size;
+	uint32_t mtime;
+	uint32_t slack;
+	int type;
+	int match;
+	int state;
+} MirrorEntry_t;
+
+typedef struct {
+	MirrorEntry_t* e;
+	int count;
+	int max;
+	char* names;
+	size_t used;
+	size_t size;
+	int nomem;
+} MirrorList_t;
+
+/* MirrorEntry_t states of a source directory */
+#define MIRROR_EXISTS						1
+#define MIRROR_CREATE						2
+#define MIRROR_SKIP							3
+
+/* directory waiting to be compared, rel is relative to the top */
+typedef struct MirrorDir MirrorDir_t;
+struct MirrorDir {
+	MirrorDir_t* next;
+	int missing;
+	char rel[];
 };
 
-static bool isInitilized = false;
+/* file to copy, see mirrorWorker() */
+typedef struct {
+	int action;
+	uint64_t size;
+	uint32_t mtime;
+	char local[FTP_CLIENT_MIRROR_PATH_SIZE];
+	char remote[FTP_CLIENT_MIRROR_PATH_SIZE];
+} MirrorJob_t;
+
+typedef struct {
+	NetBuf_t* nControl;
+	const FtpClientMirrorOptions_t* opt;
+	FtpClientMirrorStats_t* stats;
+	const char* local;
+	const char* remote;
+	int compare;
+	int listFormat;
+	volatile int mfmt;
+	FtpClientPortMutex_t* lock;
+	FtpClientPortQueue_t* jobs;
+	int workers;
+} Mirror_t;
+
+/* data chunk size of one transfer, see chunkUpdate() */
+typedef struct {
+	int size;
+	int adaptive;
+	int growing;
+	int chunks;
+	int64_t windowStart;
+	uint64_t windowBytes;
+	uint64_t bestRate;
+} ChunkSizer_t;
+
+static FtpClientPortOnce_t isInitilized = FTP_CLIENT_PORT_ONCE_INIT;
 static FtpClient ftpClient_;
 
+/* connection pool, see poolAcquireFtpClient() */
+typedef struct {
+	NetBuf_t* nControl;
+	int inUse;
+	int64_t lastUsed;
+} PoolEntry_t;
+
+static PoolEntry_t pool[FTP_CLIENT_POOL_SIZE];
+static FtpClientPoolStats_t poolStats;
+static FtpClientPortMutex_t* poolLock;
+
+/* counters of the sessions that were closed or returned to the pool */
+static FtpClientStats_t statsTotal;
+static FtpClientPortMutex_t* statsLock;
+
+/* limit shared by all sessions (FTP_CLIENT_GLOBALRATE) */
+static volatile long rateGlobalLimit;
+static volatile long rateGlobalBurst;
+static RateBucket_t rateGlobal;
+static FtpClientPortMutex_t* rateLock;
+
+#if FTP_CLIENT_NETBUF_POOL_SIZE > 0
+static NetBufSlot_t netBufSlots[FTP_CLIENT_NETBUF_POOL_SIZE];
+#endif
+static NetBufSlot_t* netBufFreeList;
+static FtpClientMemStats_t netBufStats;
+static FtpClientPortMutex_t* netBufLock;
+
+static const char* const statsVerbs[FTP_CLIENT_STATS_VERBS] = {
+	"USER", "PASS", "SYST", "TYPE", "CWD", "CDUP", "PWD", "MKD", "RMD", "PASV",
+	"PORT", "REST", "RETR", "STOR", "APPE", "LIST", "NLST", "MLSD", "SIZE", "MDTM",
+	"MFMT", "DELE", "RNFR", "RNTO", "SITE", "NOOP", "QUIT", "other"
+};
+
+static const char* const statsStages[FTP_CLIENT_STAGES] = {
+	"type", "port", "rest", "command", "accept", "firstByte", "close"
+};
+
 /*Internal use functions*/
 static int socketWait(NetBuf_t* ctl);
 static int readResponse(char c, NetBuf_t* nControl);
 static int readLine(char* buffer, int max, NetBuf_t* ctl);
+static int readCount(NetBuf_t* nData, int bytes);
 static int sendCommand(const char* cmd, char expresp, NetBuf_t* nControl);
+static int sizeCommand(const char* path, unsigned int* size, char mode,
+	NetBuf_t* nControl);
 static int xfer(const char* localfile, const char* path,
 	NetBuf_t* nControl, int typ, int mode);
+static int xferSink(const FtpClientSink_t* sink, const char* path,
+	NetBuf_t* nControl, int typ, int mode);
+static int xferSource(const FtpClientSource_t* source, const char* path,
+	NetBuf_t* nControl, int typ, int mode);
 static int openPort(NetBuf_t* nControl, NetBuf_t** nData, int mode, int dir);
 static int writeLine(const char* buf, int len, NetBuf_t* nData);
 static int acceptConnection(NetBuf_t* nData, NetBuf_t* nControl);
@@ -86,11 +383,28 @@ static int getModDateFtpClient(const char* path, char* dt,
 	int max, NetBuf_t* nControl);
 static int setCallbackFtpClient(const FtpClientCallbackOptions_t* opt, NetBuf_t* nControl);
 static int clearCallbackFtpClient(NetBuf_t* nControl);
+static int getXferStatsFtpClient(FtpClientXferStats_t* stats, NetBuf_t* nControl);
+static unsigned long getRoundTripsSavedFtpClient(NetBuf_t* nControl);
+static int getMetaCacheStatsFtpClient(FtpClientMetaCacheStats_t* stats, NetBuf_t* nControl);
+static int getStatsFtpClient(FtpClientStats_t* stats, NetBuf_t* nControl);
+static void resetStatsFtpClient(NetBuf_t* nControl);
+static int statsJsonFtpClient(char* buf, int max, NetBuf_t* nControl);
+static const char* statsVerbFtpClient(int index);
 /*Server connection*/
 static int connectFtpClient(const char* host, uint16_t port, NetBuf_t** nControl);
 static int loginFtpClient(const char* user, const char* pass, NetBuf_t* nControl);
 static void quitFtpClient(NetBuf_t* nControl);
 static int setOptionsFtpClient(int opt, long val, NetBuf_t* nControl);
+/*Connection Pool*/
+static int poolAcquireFtpClient(const char* host, uint16_t port, const char* user,
+	const char* pass, NetBuf_t** nControl);
+static void poolReleaseFtpClient(NetBuf_t* nControl);
+static void poolFlushFtpClient(void);
+static int poolGetStatsFtpClient(FtpClientPoolStats_t* stats);
+/*Memory Pools*/
+static int memGetStatsFtpClient(FtpClientMemStats_t* stats);
+static int memReserveFtpClient(int size, int count);
+static void memFlushFtpClient(void);
 /*Directory Functions*/
 static int changeDirFtpClient(const char* path, NetBuf_t* nControl);
 static int makeDirFtpClient(const char* path, NetBuf_t* nControl);
@@ -100,6 +414,8 @@ static int nlstFtpClient(const char* outputfile, const char* path,
 	NetBuf_t* nControl);
 static int mlsdFtpClient(const char* outputfile, const char* path,
 	NetBuf_t* nControl);
+static int listFtpClient(const char* path, int format, FtpClientListCallback_t cb,
+	void* arg, NetBuf_t* nControl);
 static int changeDirUpFtpClient(NetBuf_t* nControl);
 static int pwdFtpClient(char* path, int max, NetBuf_t* nControl);
 /*File to File Transfer*/
@@ -107,8 +423,30 @@ static int getDataFtpClient(const char* outputfile, const char* path,
 	char mode, NetBuf_t* nControl);
 static int putDataFtpClient(const char* inputfile, const char* path, char mode,
 	NetBuf_t* nControl);
+static int getSegmentedFtpClient(const char* outputfile, const char* path,
+	char mode, NetBuf_t* nControl);
+static int resumeFtpClient(const char* localfile, NetBuf_t* nControl);
 static int deleteDataFtpClient(const char* fnm, NetBuf_t* nControl);
 static int renameFtpClient(const char* src, const char* dst, NetBuf_t* nControl);
+static int batchFtpClient(FtpClientBatchCmd_t* cmds, int count, NetBuf_t* nControl);
+static int mirrorFtpClient(const char* localDir, const char* remoteDir,
+	const FtpClientMirrorOptions_t* opt, FtpClientMirrorStats_t* stats, NetBuf_t* nControl);
+/*File to Stream Transfer*/
+static int getToSinkFtpClient(const FtpClientSink_t* sink, const char* path,
+	char mode, NetBuf_t* nControl);
+static int putFromSourceFtpClient(const FtpClientSource_t* source, const char* path,
+	char mode, NetBuf_t* nControl);
+/*File to Memory Transfer*/
+static int getToBufferFtpClient(void* buf, size_t size, size_t* len, const char* path,
+	char mode, NetBuf_t* nControl);
+static int getToMemoryFtpClient(char** buf, size_t* len, size_t max, const char* path,
+	char mode, NetBuf_t* nControl);
+static int putFromBufferFtpClient(const void* buf, size_t len, const char* path,
+	char mode, NetBuf_t* nControl);
+static int getToStreamFtpClient(FtpClientPortStream_t* stream, const char* path,
+	char mode, NetBuf_t* nControl);
+static int putFromStreamFtpClient(FtpClientPortStream_t* stream, const char* path,
+	char mode, NetBuf_t* nControl);
 /*File to Program Transfer*/
 static int accessFtpClient(const char* path, int typ, int mode, NetBuf_t* nControl,
 	NetBuf_t** nData);
@@ -117,6 +455,348 @@ static int writeFtpClient(const void* buf, int len, NetBuf_t* nData);
 static int closeFtpClient(NetBuf_t* nData);
 
 
+/*
+ * statsOf - statistics of the session a connection belongs to
+ */
+static FtpClientStats_t* statsOf(NetBuf_t* ctl)
+{
+	return (ctl->dir == FTP_CLIENT_CONTROL) ? &ctl->stats : &ctl->ctrl->stats;
+}
+
+
+
+/*
+ * statsTime - add a duration to a timer
+ */
+static void statsTime(FtpClientStatsTimer_t* t, int64_t us)
+{
+	t->count++;
+	t->totalUs += us;
+	if (us > t->maxUs)
+		t->maxUs = us;
+}
+
+
+
+/*
+ * statsHist - count a recv() or send() in its size class
+ */
+static void statsHist(uint32_t* hist, int bytes)
+{
+	int i = 0;
+	int limit = 16;
+	while ((bytes > limit) && (i < FTP_CLIENT_STATS_HIST_SIZE - 1)) {
+		limit <<= 2;
+		i++;
+	}
+	hist[i]++;
+}
+
+
+
+/*
+ * statsStage - record that the current transfer reached a stage
+ */
+static void statsStage(NetBuf_t* nControl, int stage)
+{
+	#if FTP_CLIENT_STATS_STAGES
+	nControl->stats.stageUs[stage] = ftpClientPortTimeUs() - nControl->stats.stageStart;
+	#else
+	(void) nControl;
+	(void) stage;
+	#endif
+}
+
+
+
+/*
+ * statsVerb - index of the command of a command line in the statistics
+ */
+static int statsVerb(const char* cmd)
+{
+	size_t l = strcspn(cmd, " ");
+	for (int i = 0; i < FTP_CLIENT_STATS_VERBS - 1; i++) {
+		if ((strlen(statsVerbs[i]) == l) && (strncmp(cmd, statsVerbs[i], l) == 0))
+			return i;
+	}
+	return FTP_CLIENT_STATS_VERBS - 1;
+}
+
+
+
+/*
+ * rateRefill - add the credit earned since the last refill of a bucket
+ *
+ * The credit is kept in bytes * 1000000 so that slow rates refilled often
+ * lose nothing to rounding. It is capped at the burst.
+ *
+ * return us to wait until the credit is positive, 0 to go ahead
+ */
+static int64_t rateRefill(RateBucket_t* b, long rate, long burst, int64_t now)
+{
+	if (rate <= 0)
+		return 0;
+	if (burst <= 0)
+		burst = (rate * FTP_CLIENT_RATE_BURST_MS) / 1000 + 1;
+	int64_t max = (int64_t)burst * 1000000;
+	int64_t dt = now - b->stamp;
+	if ((b->stamp == 0) || (dt > 60000000))
+		b->credit = max;
+	else
+		b->credit += dt * rate;
+	if (b->credit > max)
+		b->credit = max;
+	b->stamp = now;
+	if (b->credit > 0)
+		return 0;
+	return -b->credit / rate + 1;
+}
+
+
+
+/*
+ * rateLimited - check if a data connection has a rate limit
+ */
+static int rateLimited(NetBuf_t* nData)
+{
+	NetBuf_t* from = nData->ctrl->rateFrom ? nData->ctrl->rateFrom : nData->ctrl;
+	return (from->rateLimit > 0) || (rateGlobalLimit > 0);
+}
+
+
+
+/*
+ * rateWait - sleep until the session and the global limits allow more data
+ *
+ * Sleeps are computed from the missing credit and bounded by
+ * FTP_CLIENT_RATE_SLEEP_MAX_MS, so a changed limit applies quickly. A
+ * session can take its limit from another one and get a share of it, as
+ * the connections of a segmented download do.
+ *
+ * return number of bytes to ask recv() for at most
+ */
+static int rateWait(NetBuf_t* nData, int len)
+{
+	NetBuf_t* nControl = nData->ctrl;
+	NetBuf_t* from = nControl->rateFrom ? nControl->rateFrom : nControl;
+	int share = (nControl->rateShare > 1) ? nControl->rateShare : 1;
+	while (1) {
+		long rate = from->rateLimit / share;
+		long burst = from->rateBurst / share;
+		int64_t now = ftpClientPortTimeUs();
+		int64_t wait = rateRefill(&nControl->bucket, rate, burst, now);
+		if ((burst > 0) && (burst < len))
+			len = burst;
+		if (rateGlobalLimit > 0) {
+			ftpClientPortMutexLock(rateLock);
+			int64_t w = rateRefill(&rateGlobal, rateGlobalLimit, rateGlobalBurst, now);
+			ftpClientPortMutexUnlock(rateLock);
+			if (w > wait)
+				wait = w;
+			if ((rateGlobalBurst > 0) && (rateGlobalBurst < len))
+				len = rateGlobalBurst;
+		}
+		if (wait == 0)
+			break;
+		if (wait > FTP_CLIENT_RATE_SLEEP_MAX_MS * 1000)
+			wait = FTP_CLIENT_RATE_SLEEP_MAX_MS * 1000;
+		ftpClientPortSleepUs(wait);
+		int64_t slept = ftpClientPortTimeUs() - now;
+		nData->throttled += slept;
+		nControl->stats.throttleUs += slept;
+	}
+	return (len > 0) ? len : 1;
+}
+
+
+
+/*
+ * rateTake - charge the session and the global limit for moved bytes
+ */
+static void rateTake(NetBuf_t* nData, int bytes)
+{
+	nData->ctrl->bucket.credit -= (int64_t)bytes * 1000000;
+	if (rateGlobalLimit > 0) {
+		ftpClientPortMutexLock(rateLock);
+		rateGlobal.credit -= (int64_t)bytes * 1000000;
+		ftpClientPortMutexUnlock(rateLock);
+	}
+}
+
+
+
+/*
+ * netBufAlloc - a zeroed data connection
+ *
+ * Data connections come from a static slab while it lasts, the heap gives
+ * the others. Neither allocates the control fields.
+ */
+static NetBuf_t* netBufAlloc(void)
+{
+	ftpClientPortMutexLock(netBufLock);
+	NetBufSlot_t* slot = netBufFreeList;
+	if (slot)
+		netBufFreeList = slot->next;
+	else
+		netBufStats.netBufsOverflow++;
+	if (++netBufStats.netBufsInUse > netBufStats.netBufsHighWater)
+		netBufStats.netBufsHighWater = netBufStats.netBufsInUse;
+	ftpClientPortMutexUnlock(netBufLock);
+	if (slot == NULL) {
+		if ((slot = malloc(sizeof(NetBufSlot_t))) == NULL) {
+			ftpClientPortMutexLock(netBufLock);
+			netBufStats.netBufsInUse--;
+			ftpClientPortMutexUnlock(netBufLock);
+			return NULL;
+		}
+	}
+	memset(slot, 0, sizeof(NetBufSlot_t));
+	return (NetBuf_t*)slot;
+}
+
+
+
+static void netBufRelease(NetBuf_t* nData)
+{
+	NetBufSlot_t* slot = (NetBufSlot_t*)nData;
+	ftpClientPortMutexLock(netBufLock);
+	netBufStats.netBufsInUse--;
+#if FTP_CLIENT_NETBUF_POOL_SIZE > 0
+	if ((slot >= netBufSlots) && (slot < netBufSlots + FTP_CLIENT_NETBUF_POOL_SIZE)) {
+		slot->next = netBufFreeList;
+		netBufFreeList = slot;
+		slot = NULL;
+	}
+#endif
+	ftpClientPortMutexUnlock(netBufLock);
+	free(slot);
+}
+
+
+
+/*
+ * netRecv - recv() counted in the statistics of the session
+ *
+ * Data connections go through the rate limiter.
+ */
+static int netRecv(NetBuf_t* ctl, void* buf, int len)
+{
+	int limited = (ctl->dir != FTP_CLIENT_CONTROL) && rateLimited(ctl);
+	if (limited)
+		len = rateWait(ctl, len);
+	int x = recv(ctl->handle, buf, len, 0);
+	if (limited && (x > 0))
+		rateTake(ctl, x);
+	FtpClientStats_t* st = statsOf(ctl);
+	st->recvCalls++;
+	if (x > 0) {
+		st->bytesIn += x;
+		statsHist(st->recvHist, x);
+		if (ctl->started) {
+			statsTime(&st->ttfb, ftpClientPortTimeUs() - ctl->started);
+			statsStage(ctl->ctrl, FTP_CLIENT_STAGE_FIRST_BYTE);
+			ctl->started = 0;
+		}
+	}
+	return x;
+}
+
+
+
+/*
+ * netSend - send() counted in the statistics of the session
+ *
+ * Data connections go through the rate limiter. A chunk larger than the
+ * burst is sent whole and paid for by waiting longer before the next one.
+ */
+static int netSend(NetBuf_t* ctl, const void* buf, int len)
+{
+	int limited = (ctl->dir != FTP_CLIENT_CONTROL) && rateLimited(ctl);
+	if (limited)
+		rateWait(ctl, len);
+	int x = send(ctl->handle, buf, len, 0);
+	if (limited && (x > 0))
+		rateTake(ctl, x);
+	FtpClientStats_t* st = statsOf(ctl);
+	st->sendCalls++;
+	if (x > 0) {
+		st->bytesOut += x;
+		statsHist(st->sendHist, x);
+		if (ctl->started) {
+			statsStage(ctl->ctrl, FTP_CLIENT_STAGE_FIRST_BYTE);
+			ctl->started = 0;
+		}
+	}
+	return x;
+}
+
+
+
+/*
+ * netSelect - select() with the time blocked counted in the statistics
+ */
+static int netSelect(NetBuf_t* ctl, int n, fd_set* rfd, fd_set* wfd, struct timeval* tv)
+{
+	int64_t start = ftpClientPortTimeUs();
+	int rv = select(n, rfd, wfd, NULL, tv);
+	statsOf(ctl)->selectUs += ftpClientPortTimeUs() - start;
+	return rv;
+}
+
+
+
+/*
+ * statsAddTimer - add a timer to another one
+ */
+static void statsAddTimer(FtpClientStatsTimer_t* t, const FtpClientStatsTimer_t* s)
+{
+	t->count += s->count;
+	t->totalUs += s->totalUs;
+	if (s->maxUs > t->maxUs)
+		t->maxUs = s->maxUs;
+}
+
+
+
+/*
+ * statsFold - move the statistics of a session into the global ones
+ */
+static void statsFold(NetBuf_t* nControl)
+{
+	FtpClientStats_t* s = &nControl->stats;
+	ftpClientPortMutexLock(statsLock);
+	FtpClientStats_t* t = &statsTotal;
+	t->bytesIn += s->bytesIn;
+	t->bytesOut += s->bytesOut;
+	t->recvCalls += s->recvCalls;
+	t->sendCalls += s->sendCalls;
+	for (int i = 0; i < FTP_CLIENT_STATS_HIST_SIZE; i++) {
+		t->recvHist[i] += s->recvHist[i];
+		t->sendHist[i] += s->sendHist[i];
+	}
+	t->selectUs += s->selectUs;
+	statsAddTimer(&t->connect, &s->connect);
+	statsAddTimer(&t->login, &s->login);
+	statsAddTimer(&t->pasv, &s->pasv);
+	statsAddTimer(&t->ttfb, &s->ttfb);
+	for (int i = 0; i < FTP_CLIENT_STATS_VERBS; i++)
+		statsAddTimer(&t->verb[i], &s->verb[i]);
+	t->transfers += s->transfers;
+	t->retries += s->retries;
+	t->xferBytes += s->xferBytes;
+	t->xferUs += s->xferUs;
+	t->throttleUs += s->throttleUs;
+	/* the stages are those of the latest transfer */
+	if (s->stageStart > t->stageStart) {
+		t->stageStart = s->stageStart;
+		memcpy(t->stageUs, s->stageUs, sizeof(t->stageUs));
+	}
+	ftpClientPortMutexUnlock(statsLock);
+	memset(s, 0, sizeof(*s));
+}
+
+
+
 /*
  * socket_wait - wait for socket to receive or flush data
  *
@@ -142,11 +822,10 @@ static int socketWait(NetBuf_t* ctl)
 	{
 		FD_SET(ctl->handle, &fd);
 		tv = ctl->idletime;
-		rv = select((ctl->handle + 1), rfd, wfd, NULL, &tv);
+		rv = netSelect(ctl, (ctl->handle + 1), rfd, wfd, &tv);
 		if (rv == -1) {
 			rv = 0;
-			strncpy(ctl->ctrl->response, strerror(errno),
-						sizeof(ctl->ctrl->response));
+			snprintf(ctl->ctrl->response, sizeof(ctl->ctrl->response), "%s", strerror(errno));
 			break;
 		}
 		else if (rv > 0) {
@@ -155,6 +834,8 @@ static int socketWait(NetBuf_t* ctl)
 		}
 	}
 	while ((rv = ctl->idlecb(ctl, ctl->xfered, ctl->idlearg)));
+	if (!rv)
+		ctl->aborted = 1;
 	return rv;
 }
 
@@ -177,7 +858,7 @@ static int readLine(char* buffer, int max, NetBuf_t* ctl)
 	int eof = 0;
 	while (1) {
 		if (ctl->cavail > 0) {
-			x = (max >= ctl->cavail) ? ctl->cavail : (max-1);
+			x = (max > ctl->cavail) ? ctl->cavail : (max-1);
 			end = memccpy(bp, ctl->cget, '\n',x);
 			if (end != NULL)
 				x = end - bp;
@@ -189,23 +870,22 @@ static int readLine(char* buffer, int max, NetBuf_t* ctl)
 			ctl->cavail -= x;
 			if (end != NULL)
 			{
-				bp -= 2;
-				if (strcmp(bp,"\r\n") == 0) {
-					*bp++ = '\n';
-					*bp++ = '\0';
+				if ((bp - buffer >= 2) && (bp[-2] == '\r')) {
+					bp[-2] = '\n';
+					bp[-1] = '\0';
 					--retval;
 				}
 				break;
 			}
 		}
 		if (max == 1) {
-			*buffer = '\0';
+			*bp = '\0';
 			break;
 		}
 		if (ctl->cput == ctl->cget) {
 			ctl->cput = ctl->cget = ctl->buf;
 			ctl->cavail = 0;
-			ctl->cleft = FTP_CLIENT_BUFFER_SIZE;
+			ctl->cleft = ctl->bufsize;
 		}
 		if (eof) {
 			if (retval == 0)
@@ -214,7 +894,7 @@ static int readLine(char* buffer, int max, NetBuf_t* ctl)
 		}
 		if (!socketWait(ctl))
 			return retval;
-		if ((x = recv(ctl->handle, ctl->cput,ctl->cleft, 0)) == -1) {
+		if ((x = netRecv(ctl, ctl->cput, ctl->cleft)) == -1) {
 			#if FTP_CLIENT_DEBUG
 			perror("FTP Client Error: realLine, read");
 			#endif
@@ -223,6 +903,9 @@ static int readLine(char* buffer, int max, NetBuf_t* ctl)
 		}
 		if (x == 0)
 			eof = 1;
+		/* Linux leaves quick ACK mode again, the next reply must not wait for the ACK */
+		if ((ctl->dir == FTP_CLIENT_CONTROL) && (ctl->sockControl & FTP_CLIENT_SOCK_LOWLATENCY))
+			ftpClientSockQuickAck(ctl->handle);
 		ctl->cleft -= x;
 		ctl->cavail += x;
 		ctl->cput += x;
@@ -232,6 +915,68 @@ static int readLine(char* buffer, int max, NetBuf_t* ctl)
 
 
 
+/*
+ * stateClear - forget the cached TYPE and working directory
+ */
+static void stateClear(NetBuf_t* nControl)
+{
+	nControl->type = 0;
+	nControl->cwdFrom = 0;
+	nControl->cwd[0] = '\0';
+}
+
+
+
+/*
+ * setType - set the representation type unless it is already set
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int setType(char mode, NetBuf_t* nControl)
+{
+	if (nControl->type == mode) {
+		nControl->rttSaved++;
+		return 1;
+	}
+	char cmd[8];
+	sprintf(cmd, "TYPE %c", mode);
+	if (!sendCommand(cmd, '2', nControl)) {
+		nControl->type = 0;
+		return 0;
+	}
+	nControl->type = mode;
+	return 1;
+}
+
+
+
+/*
+ * setMode - set the transfer mode unless it is already set
+ *
+ * Until MODE Z is used every transfer runs in the default MODE S, which
+ * is not counted as a saved round trip.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int setMode(char mode, NetBuf_t* nControl)
+{
+	if (nControl->xmode == mode) {
+		if (nControl->modeZSent)
+			nControl->rttSaved++;
+		return 1;
+	}
+	char cmd[8];
+	sprintf(cmd, "MODE %c", mode);
+	if (!sendCommand(cmd, '2', nControl))
+		return 0;
+	nControl->xmode = mode;
+	if (mode == 'Z')
+		nControl->modeZSent = 1;
+	return 1;
+}
+
+
+
 /*
  * read a response from the server
  *
@@ -246,6 +991,7 @@ static int readResponse(char c, NetBuf_t* nControl)
 		#if FTP_CLIENT_DEBUG
 		perror("FTP Client Error: readResponse, read failed");
 		#endif
+		stateClear(nControl);
 		return 0;
 	}
 	#if FTP_CLIENT_DEBUG == 2
@@ -253,7 +999,7 @@ static int readResponse(char c, NetBuf_t* nControl)
 	#endif
 	if (nControl->response[3] == '-')
 	{
-		strncpy(match, nControl->response, 3);
+		memcpy(match, nControl->response, 3);
 		match[3] = ' ';
 		match[4] = '\0';
 		do {
@@ -262,6 +1008,7 @@ static int readResponse(char c, NetBuf_t* nControl)
 				#if FTP_CLIENT_DEBUG
 				perror("FTP Client Error: readResponse, read failed");
 				#endif
+				stateClear(nControl);
 				return 0;
 			}
 			#if FTP_CLIENT_DEBUG == 2
@@ -270,6 +1017,9 @@ static int readResponse(char c, NetBuf_t* nControl)
 		}
 		while (strncmp(nControl->response, match, 4));
 	}
+	/* the server is closing the session */
+	if (strncmp(nControl->response, "421", 3) == 0)
+		stateClear(nControl);
 	if(nControl->response[0] == c)
 		return 1;
 	else
@@ -294,393 +1044,3167 @@ static int sendCommand(const char* cmd, char expresp, NetBuf_t* nControl)
 	if ((strlen(cmd) + 3) > sizeof(buf))
 		return 0;
 	sprintf(buf, "%s\r\n", cmd);
-	if (send(nControl->handle, buf, strlen(buf), 0) <= 0) {
+	int64_t start = ftpClientPortTimeUs();
+	if (netSend(nControl, buf, strlen(buf)) <= 0) {
 		#if FTP_CLIENT_DEBUG
 		perror("FTP Client sendCommand: write");
 		#endif
 		return 0;
 	}
-	return readResponse(expresp, nControl);
+	int rv = readResponse(expresp, nControl);
+	statsTime(&nControl->stats.verb[statsVerb(cmd)], ftpClientPortTimeUs() - start);
+	return rv;
 }
 
 
 
 /*
- * Xfer - issue a command and transfer data
+ * journalWrite - record the progress of a resumable transfer
  *
- * return 1 if successful, 0 otherwise
+ * The journal is a single line next to the local file:
+ *   FTPJ <G|P> <mode> <offset> <remote path>
  */
-static int xfer(const char* localfile, const char* path,
-	NetBuf_t* nControl, int typ, int mode)
+static void journalWrite(FileEndpoint_t* fe)
 {
-	FILE* local = NULL;
-	NetBuf_t* nData;
-
-	if (localfile != NULL) {
-		char ac[4];
-		memset( ac, 0, sizeof(ac) );
-		if (typ == FTP_CLIENT_FILE_WRITE)
-			ac[0] = 'r';
-		else
-			ac[0] = 'w';
-		if (mode == FTP_CLIENT_IMAGE)
-			ac[1] = 'b';
-		local = fopen(localfile, ac);
-		if (local == NULL) {
-			strncpy(nControl->response, strerror(errno),
-						sizeof(nControl->response));
-			return 0;
-		}
-	}
-	if(local == NULL)
-		local = (typ == FTP_CLIENT_FILE_WRITE) ? stdin : stdout;
-	if (!accessFtpClient(path, typ, mode, nControl, &nData)) {
-		if (localfile) {
-			fclose(local);
-			if (typ == FTP_CLIENT_FILE_READ)
-				unlink(localfile);
-		}
-		return 0;
-	}
-
-	int rv = 1;
-	int l = 0;
-	char* dbuf = malloc(FTP_CLIENT_BUFFER_SIZE);
-	if (dbuf != NULL) {
-		if (typ == FTP_CLIENT_FILE_WRITE) {
-			while ((l = fread(dbuf, 1, FTP_CLIENT_BUFFER_SIZE, local)) > 0) {
-				int c = writeFtpClient(dbuf, l, nData);
-				if (c < l) {
-					#if FTP_CLIENT_DEBUG
-					//printf("Ftp Client xfer short write: passed %d, wrote %d\n", l, c);
-					char tempbuf[128];
-					sprintf(tempbuf, "Ftp Client xfer short write: passed %d, wrote %d\n", l, c);
-					perror(tempbuf);
-					#endif
-					rv = 0;
-					break;
-				}
-			}
-		}
-		else {
-			while ((l = readFtpClient(dbuf, FTP_CLIENT_BUFFER_SIZE, nData)) > 0) {
-				if (fwrite(dbuf, 1, l, local) == 0) {
-					#if FTP_CLIENT_DEBUG
-					perror("FTP Client xfer localfile write");
-					#endif
-					rv = 0;
-					break;
-				}
-			}
-		}
-		free(dbuf);
-	} else {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client xfer malloc dbuf");
-		#endif
-		rv = 0;
-	}
-	fflush(local);
-	if(localfile != NULL){
-		fclose(local);
-		if(rv != 1 && typ == FTP_CLIENT_FILE_READ)
-			unlink(localfile);
-	}
-	closeFtpClient(nData);
-	return rv;
+	char line[FTP_CLIENT_TEMP_BUFFER_SIZE + 64];
+	int l = snprintf(line, sizeof(line), "FTPJ %c %c %" PRIu64 " %s\n",
+		fe->op, fe->mode, fe->pos, fe->path);
+	if ((l < 0) || ((size_t)l >= sizeof(line)))
+		return;
+	int fd = open(fe->journal, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return;
+	if (write(fd, line, l) == l)
+		fsync(fd);
+	close(fd);
 }
 
 
 
 /*
- * openPort - set up data connection
+ * journalRead - read the journal of an interrupted transfer
  *
- * return 1 if successful, 0 otherwise
+ * return 1 if a valid journal was found, 0 otherwise
  */
-static int openPort(NetBuf_t* nControl, NetBuf_t** nData, int mode, int dir)
+static int journalRead(const char* journal, char* op, char* mode,
+	uint64_t* offset, char* path, int max)
 {
-	union
-	{
-		struct sockaddr sa;
-		struct sockaddr_in in;
-	} sin;
+	char line[FTP_CLIENT_TEMP_BUFFER_SIZE + 64];
+	int fd = open(journal, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	int l = read(fd, line, sizeof(line) - 1);
+	close(fd);
+	if (l <= 0)
+		return 0;
+	line[l] = '\0';
+	char* nl = strchr(line, '\n');
+	if (nl == NULL)
+		return 0;
+	*nl = '\0';
+	int n = 0;
+	if ((sscanf(line, "FTPJ %c %c %" SCNu64 " %n", op, mode, offset, &n) != 3) ||
+			(n == 0) || ((*op != 'G') && (*op != 'P')) ||
+			(strlen(&line[n]) >= (size_t)max))
+		return 0;
+	strcpy(path, &line[n]);
+	return 1;
+}
 
-	if (nControl->dir != FTP_CLIENT_CONTROL)
-		return -1;
-	if ((dir != FTP_CLIENT_READ) && (dir != FTP_CLIENT_WRITE)) {
-		sprintf(nControl->response, "Invalid direction %d\n", dir);
-		return -1;
-	}
-	if ((mode != FTP_CLIENT_ASCII) && (mode != FTP_CLIENT_IMAGE)) {
-		sprintf(nControl->response, "Invalid mode %c\n", mode);
-		return -1;
-	}
-	//unsigned int l = sizeof(sin);
-	socklen_t l = sizeof(sin);
-	if (nControl->cmode == FTP_CLIENT_PASSIVE) {
-		memset(&sin, 0, l);
-		sin.in.sin_family = AF_INET;
-		if (!sendCommand("PASV", '2', nControl))
-			return -1;
-		char* cp = strchr(nControl->response,'(');
-		if (cp == NULL)
+
+
+/*
+ * file backend of xfer() - raw descriptors, no stdio buffering
+ *
+ * With a journal the position is recorded every interval bytes. A GET
+ * flushes the file first so the journal never claims data that is lost
+ * on power failure.
+ */
+static int fileSinkWrite(const void* buf, int len, void* arg)
+{
+	FileEndpoint_t* fe = arg;
+	const char* p = buf;
+	int done = 0;
+	while (done < len) {
+		int w = write(fe->fd, p + done, len - done);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
 			return -1;
-		cp++;
-		unsigned int v[6];
-		sscanf(cp,"%u,%u,%u,%u,%u,%u",&v[2],&v[3],&v[4],&v[5],&v[0],&v[1]);
-		sin.sa.sa_data[2] = v[2];
-		sin.sa.sa_data[3] = v[3];
-		sin.sa.sa_data[4] = v[4];
-		sin.sa.sa_data[5] = v[5];
-		sin.sa.sa_data[0] = v[0];
-		sin.sa.sa_data[1] = v[1];
+		done += w;
 	}
-	else {
-		if(getsockname(nControl->handle, &sin.sa, &l) < 0) {
-			#if FTP_CLIENT_DEBUG
-			perror("FTP Client openPort: getsockname");
-			#endif
-			return -1;
+	fe->pos += done;
+	if (fe->journal && (fe->pos >= fe->checkpoint)) {
+		fsync(fe->fd);
+		journalWrite(fe);
+		fe->checkpoint = fe->pos + fe->interval;
+	}
+	return done;
+}
+
+static int fileSourceRead(void* buf, int max, void* arg)
+{
+	FileEndpoint_t* fe = arg;
+	int r;
+	do
+		r = read(fe->fd, buf, max);
+	while (r < 0 && errno == EINTR);
+	if (r > 0) {
+		fe->pos += r;
+		if (fe->journal && (fe->pos >= fe->checkpoint)) {
+			journalWrite(fe);
+			fe->checkpoint = fe->pos + fe->interval;
 		}
 	}
-	int sData = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (sData == -1) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client openPort: socket");
-		#endif
+	return r;
+}
+
+
+
+/*
+ * memory backend of the buffer transfers
+ *
+ * The data connection is read into the buffer and sent from it directly.
+ * A growable buffer doubles until it holds max + 1 bytes, one more than
+ * allowed, so a file that does not fit is noticed without reading it all.
+ * A full buffer hands out spill, whatever lands there is an overflow.
+ */
+static void* memSinkGetBuffer(int* size, void* arg)
+{
+	MemEndpoint_t* me = arg;
+	size_t want = (*size > 0) ? (size_t)*size : FTP_CLIENT_BUFFER_SIZE;
+	if (me->grow && (me->size - me->len < want) && (me->size <= me->max)) {
+		size_t n = me->size ? me->size : FTP_CLIENT_BUFFER_SIZE;
+		while (n - me->len < want)
+			n *= 2;
+		if (n > me->max + 1)
+			n = me->max + 1;
+		/* and room for the terminating NUL */
+		char* b = realloc(me->buf, n + 1);
+		if (b == NULL)
+			return NULL;
+		me->buf = b;
+		me->size = n;
+	}
+	if (me->len == me->size) {
+		*size = sizeof(me->spill);
+		return me->spill;
+	}
+	if ((*size <= 0) || ((size_t)*size > me->size - me->len))
+		*size = me->size - me->len;
+	return me->buf + me->len;
+}
+
+static int memSinkWrite(const void* buf, int len, void* arg)
+{
+	MemEndpoint_t* me = arg;
+	size_t limit = me->grow ? me->max : me->size;
+	if ((buf == me->spill) || (me->len + len > limit) || (me->len + len > me->size)) {
+		me->overflow = 1;
 		return -1;
 	}
-	if (nControl->cmode == FTP_CLIENT_PASSIVE) {
-		if (connect(sData, &sin.sa, sizeof(sin.sa)) == -1) {
-			#if FTP_CLIENT_DEBUG
-			perror("FTP Client openPort: connect");
-			#endif
-			closesocket(sData);
-			return -1;
+	if (buf != me->buf + me->len)
+		memcpy(me->buf + me->len, buf, len);
+	me->len += len;
+	return len;
+}
+
+static void* memSourceGetBuffer(int* size, void* arg)
+{
+	MemEndpoint_t* me = arg;
+	if ((size_t)*size > me->size - me->len)
+		*size = me->size - me->len;
+	return me->buf + me->len;
+}
+
+static int memSourceRead(void* buf, int max, void* arg)
+{
+	MemEndpoint_t* me = arg;
+	size_t n = me->size - me->len;
+	if (n > (size_t)max)
+		n = max;
+	if (buf != me->buf + me->len)
+		memcpy(buf, me->buf + me->len, n);
+	me->len += n;
+	return n;
+}
+
+static int streamSinkWrite(const void* buf, int len, void* arg)
+{
+	return ftpClientPortStreamSend(arg, buf, len);
+}
+
+static int streamSourceRead(void* buf, int max, void* arg)
+{
+	return ftpClientPortStreamReceive(arg, buf, max);
+}
+
+
+
+/*
+ * readText - read a chunk of an ASCII transfer and turn CRLF into LF
+ *
+ * Data buffered by readFtpClient() is used first. A CR at the end of a
+ * chunk is held back in nData->crlf until the next byte is known.
+ *
+ * return -1 on error or bytecount, 0 at end of data
+ */
+static int readText(char* buf, int max, NetBuf_t* nData)
+{
+	int l = 0;
+	while (l == 0) {
+		int off = 0;
+		int x;
+		if (nData->crlf)
+			buf[off++] = '\r';
+		if (nData->cavail > 0) {
+			x = (nData->cavail < max - off) ? nData->cavail : (max - off);
+			memcpy(buf + off, nData->cget, x);
+			nData->cget += x;
+			nData->cavail -= x;
 		}
-	}
-	else {
-		sin.in.sin_port = 0;
-		if (bind(sData, &sin.sa, sizeof(sin)) == -1) {
-			#if FTP_CLIENT_DEBUG
-			perror("FTP Client openPort: bind");
-			#endif
-			closesocket(sData);
-			return -1;
+		else {
+			if (!socketWait(nData))
+				return 0;
+			x = netRecv(nData, buf + off, max - off);
+			if (x == -1) {
+				#if FTP_CLIENT_DEBUG
+				perror("FTP Client Error: readText, read");
+				#endif
+				return -1;
+			}
+			if (x == 0) {
+				/* a CR held back at the end of the data is kept */
+				nData->crlf = 0;
+				return off;
+			}
+			if (!readCount(nData, x))
+				return 0;
 		}
-		if (listen(sData, 1) < 0) {
-			#if FTP_CLIENT_DEBUG
-			perror("FTP Client openPort: listen");
-			#endif
-			closesocket(sData);
-			return -1;
+		l = ftpClientTextFromCrlf(buf, off + x, buf, &nData->crlf);
+	}
+	return l;
+}
+
+
+
+/*
+ * readChunk - read up to max bytes from a data connection
+ *
+ * return -1 on error or bytecount, 0 at end of data
+ */
+static int readChunk(char* buf, int max, NetBuf_t* nData)
+{
+	int l;
+	Codec_t* c = nData->codec;
+	if (nData->buf)
+		l = readText(buf, max, nData);
+	else if (c) {
+		int64_t t = ftpClientPortTimeUs();
+		l = ftpClientInflateRead(c->inflate, buf, max);
+		c->us += ftpClientPortTimeUs() - t;
+		if (l > 0)
+			c->raw += l;
+	}
+	else
+		l = readFtpClient(buf, max, nData);
+	/* a stopped transfer did not reach the end of the data */
+	if ((l == 0) && nData->aborted)
+		return -1;
+	return l;
+}
+
+
+
+/*
+ * chunkInit - start sizing the data chunks of a transfer
+ */
+static void chunkInit(ChunkSizer_t* cs, NetBuf_t* nControl)
+{
+	memset(cs, 0, sizeof(*cs));
+	cs->size = nControl->dbufsize;
+	cs->adaptive = nControl->dbufadaptive;
+	cs->growing = 1;
+	cs->windowStart = ftpClientPortTimeUs();
+	while ((cs->size > FTP_CLIENT_DATABUF_MIN_SIZE) &&
+			(ftpClientPortFreeHeap() < FTP_CLIENT_ADAPT_LOW_HEAP + (size_t)cs->size))
+		cs->size /= 2;
+	nControl->xstats.bytes = 0;
+	nControl->xstats.bytesPerSec = 0;
+	nControl->xstats.throttledMs = 0;
+	nControl->xstats.chunkSize = cs->size;
+	nControl->xstats.chunkSizeMax = cs->size;
+	nControl->xstats.rawBytes = 0;
+	nControl->xstats.ratioPct = 100;
+	nControl->xstats.codecUs = 0;
+	nControl->xstats.compression = FTP_CLIENT_COMPRESS_OFF;
+}
+
+
+
+/*
+ * chunkUpdate - account for a chunk and adapt the chunk size
+ *
+ * In adaptive mode the chunk size is doubled after each measurement
+ * window in which the throughput improved, and stays put once it stops
+ * improving. It is halved whenever free heap runs low.
+ *
+ * return the size of the next chunk
+ */
+static int chunkUpdate(ChunkSizer_t* cs, int bytes)
+{
+	if (!cs->adaptive)
+		return cs->size;
+	cs->windowBytes += bytes;
+	cs->chunks++;
+	int64_t now = ftpClientPortTimeUs();
+	int64_t elapsed = now - cs->windowStart;
+	if ((elapsed < FTP_CLIENT_ADAPT_WINDOW_US) || (cs->chunks < FTP_CLIENT_ADAPT_MIN_CHUNKS))
+		return cs->size;
+
+	uint64_t rate = cs->windowBytes * 1000000 / (uint64_t)elapsed;
+	if ((ftpClientPortFreeHeap() < FTP_CLIENT_ADAPT_LOW_HEAP + (size_t)cs->size) &&
+			(cs->size > FTP_CLIENT_DATABUF_MIN_SIZE)) {
+		cs->size /= 2;
+		cs->growing = 0;
+	}
+	else if (cs->growing) {
+		if (rate > cs->bestRate + cs->bestRate / 20) {
+			cs->bestRate = rate;
+			if (cs->size < FTP_CLIENT_DATABUF_MAX_SIZE)
+				cs->size *= 2;
+			else
+				cs->growing = 0;
 		}
-		if (getsockname(sData, &sin.sa, &l) < 0)
-			return -1;
-		char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-		sprintf(buf, "PORT %d,%d,%d,%d,%d,%d",
-			(unsigned char) sin.sa.sa_data[2],
-			(unsigned char) sin.sa.sa_data[3],
-			(unsigned char) sin.sa.sa_data[4],
-			(unsigned char) sin.sa.sa_data[5],
-			(unsigned char) sin.sa.sa_data[0],
-			(unsigned char) sin.sa.sa_data[1]);
-		if (!sendCommand(buf, '2', nControl)) {
-			closesocket(sData);
-			return -1;
+		else {
+			/* the last step did not pay off, go back */
+			if (cs->size > FTP_CLIENT_DATABUF_MIN_SIZE)
+				cs->size /= 2;
+			cs->growing = 0;
 		}
 	}
-	NetBuf_t* ctrl = calloc(1, sizeof(NetBuf_t));
-	if (ctrl == NULL) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client openPort: calloc ctrl");
-		#endif
-		closesocket(sData);
-		return -1;
+	cs->windowStart = now;
+	cs->windowBytes = 0;
+	cs->chunks = 0;
+	return cs->size;
+}
+
+
+
+/*
+ * chunkBuffer - make dbuf hold at least size bytes
+ *
+ * return the usable size, which is smaller than size if growing failed
+ */
+static int chunkBuffer(char** dbuf, int* dbufsize, int size)
+{
+	if (size <= *dbufsize)
+		return size;
+	/* the content does not survive, every chunk fills the buffer anew */
+	int capacity;
+	char* b = ftpClientMemAlloc(size, &capacity);
+	if (b == NULL)
+		return *dbufsize;
+	ftpClientMemFree(*dbuf);
+	*dbuf = b;
+	*dbufsize = capacity;
+	return size;
+}
+
+
+
+/*
+ * xferDone - record the statistics of a finished transfer
+ */
+static void xferDone(NetBuf_t* nControl, NetBuf_t* nData, ChunkSizer_t* cs, int64_t start)
+{
+	int64_t elapsed = ftpClientPortTimeUs() - start;
+	nControl->xstats.bytes = nData->xfered;
+	nControl->xstats.elapsedMs = elapsed / 1000;
+	nControl->xstats.chunkSize = cs->size;
+	nControl->xstats.bytesPerSec = elapsed ? (nData->xfered * 1000000) / elapsed : 0;
+	nControl->xstats.throttledMs = nData->throttled / 1000;
+	Codec_t* c = nData->codec;
+	if (c) {
+		nControl->xstats.rawBytes = c->raw;
+		nControl->xstats.ratioPct = c->raw ? (nData->xfered * 100) / c->raw : 100;
+		nControl->xstats.codecUs = c->us - c->ioUs;
+		nControl->xstats.compression = c->method;
 	}
+	else
+		nControl->xstats.rawBytes = nData->xfered;
+}
 
-	/*
-	ctrl->buf is only used with ASCII mode.
 
-	With ASCII mode:
-	readFtpClient() uses readLine().
-	writeFtpClient() uses writeLine().
-	These functions use this memory.
-	This memory will be released in closeFtpClient().
 
-	With BINARY mode:
-	readFtpClient() uses recv().
-	writeFtpClient() uses send().
-	*/
+/*
+ * pipeOpen - allocate the buffers and queues of a pipelined transfer
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int pipeOpen(Pipe_t* pipe, int count, int size)
+{
+	memset(pipe, 0, sizeof(*pipe));
+	pipe->size = size;
+	pipe->freeq = ftpClientPortQueueCreate(count);
+	pipe->fullq = ftpClientPortQueueCreate(count + 1);
+	if ((pipe->freeq == NULL) || (pipe->fullq == NULL))
+		return 0;
+	for (pipe->count = 0; pipe->count < count; pipe->count++) {
+		PipeBuf_t* pb = &pipe->bufs[pipe->count];
+		if ((pb->data = ftpClientMemAlloc(size, NULL)) == NULL)
+			break;
+		ftpClientPortQueueSend(pipe->freeq, pb);
+	}
+	/* two buffers are the least that can overlap */
+	return pipe->count >= 2;
+}
 
-	if ((mode == 'A') && ((ctrl->buf = malloc(FTP_CLIENT_BUFFER_SIZE)) == NULL)) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client openPort: malloc ctrl->buf");
-		#endif
-		closesocket(sData);
-		free(ctrl);
+
+
+static void pipeClose(Pipe_t* pipe)
+{
+	for (int i = 0; i < pipe->count; i++)
+		ftpClientMemFree(pipe->bufs[i].data);
+	if (pipe->freeq)
+		ftpClientPortQueueDelete(pipe->freeq);
+	if (pipe->fullq)
+		ftpClientPortQueueDelete(pipe->fullq);
+}
+
+
+
+/*
+ * pipeWriter - storage side of a pipelined GET
+ *
+ * Hands filled buffers to the sink until an empty one marks the end. After
+ * a sink error buffers are still recycled so the network side never blocks.
+ */
+static void pipeWriter(void* arg)
+{
+	Pipe_t* pipe = arg;
+	while (1) {
+		PipeBuf_t* pb = ftpClientPortQueueReceive(pipe->fullq);
+		if (pb->len <= 0)
+			break;
+		if (!pipe->failed && (pipe->sink->write(pb->data, pb->len, pipe->sink->arg) != pb->len))
+			pipe->failed = 1;
+		ftpClientPortQueueSend(pipe->freeq, pb);
+	}
+}
+
+
+
+/*
+ * pipeReader - storage side of a pipelined PUT
+ *
+ * Fills free buffers from the source. A buffer with len 0 (end of data)
+ * or -1 (error) ends the stream.
+ */
+static void pipeReader(void* arg)
+{
+	Pipe_t* pipe = arg;
+	while (1) {
+		PipeBuf_t* pb = ftpClientPortQueueReceive(pipe->freeq);
+		if (pipe->stop)
+			break;
+		pb->len = pipe->source->read(pb->data, pipe->size, pipe->source->arg);
+		ftpClientPortQueueSend(pipe->fullq, pb);
+		if (pb->len <= 0)
+			break;
+	}
+}
+
+
+
+/*
+ * xferSinkPipelined - receive into one buffer while another is written
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xferSinkPipelined(const FtpClientSink_t* sink, NetBuf_t* nControl,
+	NetBuf_t* nData, ChunkSizer_t* cs)
+{
+	Pipe_t pipe;
+	if (!pipeOpen(&pipe, nControl->pipeline, cs->size)) {
+		pipeClose(&pipe);
 		return -1;
 	}
-	ctrl->handle = sData;
-	ctrl->dir = dir;
-	ctrl->idletime = nControl->idletime;
-	ctrl->idlearg = nControl->idlearg;
-	ctrl->xfered = 0;
-	ctrl->xfered1 = 0;
-	ctrl->cbbytes = nControl->cbbytes;
-	ctrl->ctrl = nControl;
+	pipe.sink = sink;
+	FtpClientPortThread_t* writer = ftpClientPortThreadCreate(pipeWriter, &pipe,
+		"ftpWriter", FTP_CLIENT_PIPELINE_STACK_SIZE, 0);
+	if (writer == NULL) {
+		pipeClose(&pipe);
+		return -1;
+	}
+
+	int rv = 1;
+	while (!pipe.failed) {
+		PipeBuf_t* pb = ftpClientPortQueueReceive(pipe.freeq);
+		int l = readChunk(pb->data, pipe.size, nData);
+		if (l <= 0) {
+			ftpClientPortQueueSend(pipe.freeq, pb);
+			if (l < 0)
+				rv = 0;
+			break;
+		}
+		ftpClientHashUpdate(&nControl->hash, pb->data, l);
+		pb->len = l;
+		ftpClientPortQueueSend(pipe.fullq, pb);
+	}
+	PipeBuf_t end = { NULL, 0 };
+	ftpClientPortQueueSend(pipe.fullq, &end);
+	ftpClientPortThreadJoin(writer);
+	if (pipe.failed) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client xfer sink write");
+		#endif
+		rv = 0;
+	}
+	pipeClose(&pipe);
+	return rv;
+}
+
+
+
+/*
+ * xferSourcePipelined - send one buffer while the next is read
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xferSourcePipelined(const FtpClientSource_t* source, NetBuf_t* nControl,
+	NetBuf_t* nData, ChunkSizer_t* cs)
+{
+	Pipe_t pipe;
+	if (!pipeOpen(&pipe, nControl->pipeline, cs->size)) {
+		pipeClose(&pipe);
+		return -1;
+	}
+	pipe.source = source;
+	FtpClientPortThread_t* reader = ftpClientPortThreadCreate(pipeReader, &pipe,
+		"ftpReader", FTP_CLIENT_PIPELINE_STACK_SIZE, 0);
+	if (reader == NULL) {
+		pipeClose(&pipe);
+		return -1;
+	}
+
+	int rv = 1;
+	while (1) {
+		PipeBuf_t* pb = ftpClientPortQueueReceive(pipe.fullq);
+		if (pb->len <= 0) {
+			rv = (pb->len == 0);
+			break;
+		}
+		/* compressed data was hashed before the compressor */
+		if (nData->codec == NULL)
+			ftpClientHashUpdate(&nControl->hash, pb->data, pb->len);
+		int c = writeFtpClient(pb->data, pb->len, nData);
+		if (c < pb->len) {
+			#if FTP_CLIENT_DEBUG
+			char tempbuf[128];
+			sprintf(tempbuf, "Ftp Client xfer short write: passed %d, wrote %d\n", pb->len, c);
+			perror(tempbuf);
+			#endif
+			rv = 0;
+			pipe.stop = 1;
+			ftpClientPortQueueSend(pipe.freeq, pb);
+			break;
+		}
+		ftpClientPortQueueSend(pipe.freeq, pb);
+	}
+	ftpClientPortThreadJoin(reader);
+	pipeClose(&pipe);
+	return rv;
+}
+
+
+
+/*
+ * codecRecv - read compressed data from the data connection
+ */
+static int codecRecv(void* buf, int max, void* arg)
+{
+	Codec_t* c = arg;
+	int64_t t = ftpClientPortTimeUs();
+	int l = readFtpClient(buf, max, c->nData);
+	c->ioUs += ftpClientPortTimeUs() - t;
+	/* a stopped transfer is not a truncated stream */
+	if ((l == 0) && c->nData->aborted)
+		return -1;
+	return l;
+}
+
+
+
+/*
+ * codecSourceRead - read uncompressed data from the source of a transfer
+ */
+static int codecSourceRead(void* buf, int max, void* arg)
+{
+	Codec_t* c = arg;
+	const FtpClientSource_t* source = c->source;
+	int64_t t = ftpClientPortTimeUs();
+	int l;
+	if (source->getBuffer) {
+		int size = max;
+		char* b = source->getBuffer(&size, source->arg);
+		if (b == NULL)
+			l = -1;
+		else {
+			l = source->read(b, (size < max) ? size : max, source->arg);
+			if (l > 0)
+				memcpy(buf, b, l);
+		}
+	}
+	else
+		l = source->read(buf, max, source->arg);
+	c->ioUs += ftpClientPortTimeUs() - t;
+	if (l > 0) {
+		c->raw += l;
+		ftpClientHashUpdate(&c->nData->ctrl->hash, buf, l);
+	}
+	return l;
+}
+
+
+
+/*
+ * codecRead - the compressed source of a transfer
+ */
+static int codecRead(void* buf, int max, void* arg)
+{
+	Codec_t* c = arg;
+	int64_t t = ftpClientPortTimeUs();
+	int l = ftpClientDeflateRead(c->deflate, buf, max);
+	c->us += ftpClientPortTimeUs() - t;
+	return l;
+}
+
+
+
+/*
+ * codecBegin - choose the compression of a file transfer
+ *
+ * MODE Z is tried once per session. Without it the remote file is a gzip
+ * file, path with FTP_CLIENT_GZIP_SUFFIX appended, which a GET with the
+ * same option reads back. Resumable and restarted transfers, ASCII mode
+ * and listings are not compressed.
+ *
+ * return the FTP_CLIENT_COMPRESS method, FTP_CLIENT_COMPRESS_OFF for none,
+ * -1 if MODE Z was refused and required
+ */
+static int codecBegin(const char** path, char* gzpath, int typ, int mode, NetBuf_t* nControl)
+{
+	int c = nControl->compress;
+	if ((c == FTP_CLIENT_COMPRESS_OFF) || (mode != FTP_CLIENT_IMAGE) || nControl->resume ||
+			nControl->restOffset || (*path == NULL) ||
+			((typ != FTP_CLIENT_FILE_READ) && (typ != FTP_CLIENT_FILE_WRITE)))
+		return FTP_CLIENT_COMPRESS_OFF;
+	if ((c == FTP_CLIENT_COMPRESS_AUTO) || (c == FTP_CLIENT_COMPRESS_MODEZ)) {
+		if (!nControl->noModeZ) {
+			if (setMode('Z', nControl)) {
+				nControl->xmodeNext = 'Z';
+				return FTP_CLIENT_COMPRESS_MODEZ;
+			}
+			if (nControl->response[0] != '5')
+				return -1;
+			ESP_LOGD(__FUNCTION__, "no MODE Z, %s", nControl->response);
+			nControl->noModeZ = 1;
+		}
+		if (c == FTP_CLIENT_COMPRESS_MODEZ)
+			return -1;
+	}
+	size_t len = strlen(*path);
+	size_t slen = strlen(FTP_CLIENT_GZIP_SUFFIX);
+	if ((len < slen) || strcmp(*path + len - slen, FTP_CLIENT_GZIP_SUFFIX)) {
+		if (len + slen >= FTP_CLIENT_TEMP_BUFFER_SIZE)
+			return -1;
+		sprintf(gzpath, "%s%s", *path, FTP_CLIENT_GZIP_SUFFIX);
+		*path = gzpath;
+	}
+	return FTP_CLIENT_COMPRESS_GZIP;
+}
+
+
+
+/*
+ * hashBegin - start the hash of a file transfer
+ *
+ * A resumed transfer goes on with the hash of the part it keeps, see
+ * hashPrime().
+ */
+static void hashBegin(int typ, NetBuf_t* nControl)
+{
+	int primed = nControl->hashPrimed;
+	nControl->hashPrimed = 0;
+	if (primed)
+		return;
+	int file = (typ == FTP_CLIENT_FILE_READ) || (typ == FTP_CLIENT_FILE_WRITE) ||
+		(typ == FTP_CLIENT_FILE_APPEND);
+	ftpClientHashInit(&nControl->hash, file ? nControl->hashAlg : FTP_CLIENT_HASH_NONE);
+}
+
+
+
+/*
+ * hashPrime - hash the first len bytes of a local file
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int hashPrime(int fd, uint64_t len, NetBuf_t* nControl)
+{
+	ftpClientHashInit(&nControl->hash, nControl->hashAlg);
+	nControl->hashPrimed = 1;
+	if ((nControl->hashAlg == FTP_CLIENT_HASH_NONE) || (len == 0))
+		return 1;
+	char* buf = ftpClientMemAlloc(nControl->dbufsize, NULL);
+	if (buf == NULL)
+		return 0;
+	uint64_t pos = 0;
+	while (pos < len) {
+		size_t n = (len - pos < (uint64_t)nControl->dbufsize) ? len - pos : (size_t)nControl->dbufsize;
+		ssize_t l = pread(fd, buf, n, pos);
+		if (l <= 0)
+			break;
+		ftpClientHashUpdate(&nControl->hash, buf, l);
+		pos += l;
+	}
+	ftpClientMemFree(buf);
+	return (pos == len);
+}
+
+
+
+/*
+ * hashRemote - ask the server for the hash of a remote file
+ *
+ * HASH is tried first, then XCRC, XMD5 or XSHA256. Commands the server
+ * does not know are not sent again in this session.
+ *
+ * return 1 if the reply is in nControl->response, 0 otherwise
+ */
+static int hashRemote(const char* path, int alg, NetBuf_t* nControl)
+{
+	static const char* const xcmd[] = { NULL, "XCRC", "XMD5", "XSHA256" };
+	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if (strlen(path) + 9 >= sizeof(cmd))
+		return 0;
+	if (!(nControl->hashNo & (1 << alg))) {
+		int ok = (nControl->hashSel == alg);
+		if (!ok) {
+			sprintf(cmd, "OPTS HASH %s", ftpClientHashName(alg));
+			ok = sendCommand(cmd, '2', nControl);
+			if (ok)
+				nControl->hashSel = alg;
+		}
+		const char* name = ftpClientHashName(alg);
+		if (ok) {
+			sprintf(cmd, "HASH %s", path);
+			ok = sendCommand(cmd, '2', nControl);
+			/* the reply names the algorithm, which the server may not have changed */
+			if (ok && (strncasecmp(nControl->response + 4, name, strlen(name)) == 0))
+				return 1;
+		}
+		/* 50x: not implemented, 550 and the like concern the file */
+		if (!ok && strncmp(nControl->response, "50", 2))
+			return 0;
+		nControl->hashNo |= 1 << alg;
+	}
+	if (!(nControl->hashNo & (0x10 << alg))) {
+		sprintf(cmd, "%s %s", xcmd[alg], path);
+		if (sendCommand(cmd, '2', nControl))
+			return 1;
+		if (strncmp(nControl->response, "50", 2) == 0)
+			nControl->hashNo |= 0x10 << alg;
+	}
+	return 0;
+}
+
+
+
+/*
+ * hashEnd - finish the hash of a transfer and compare it with the server's
+ *
+ * Only image mode transfers of files stored as they are sent can be
+ * compared, and only with a server that has one of the hash commands.
+ *
+ * return rv, 0 if the hashes differ
+ */
+static int hashEnd(int rv, const char* path, int mode, int compare, NetBuf_t* nControl)
+{
+	FtpClientXferStats_t* xs = &nControl->xstats;
+	xs->hashAlg = nControl->hash.alg;
+	xs->hashLen = ftpClientHashFinal(&nControl->hash, xs->hash);
+	xs->hashVerified = 0;
+	if (!rv || (xs->hashLen == 0) || (mode != FTP_CLIENT_IMAGE) || !compare ||
+			!hashRemote(path, xs->hashAlg, nControl))
+		return rv;
+	char hex[2 * FTP_CLIENT_HASH_SIZE_MAX + 1];
+	for (int i = 0; i < xs->hashLen; i++)
+		sprintf(hex + 2 * i, "%02x", xs->hash[i]);
+	/* the digest is the hex word of the right length, before the path of HASH */
+	const char* p = nControl->response + 3;
+	while (*p) {
+		p += strspn(p, " ");
+		size_t n = strspn(p, "0123456789abcdefABCDEF");
+		if ((n == 2 * (size_t)xs->hashLen) && ((p[n] == '\0') || strchr(" \r\n", p[n]))) {
+			if (strncasecmp(p, hex, n) == 0) {
+				xs->hashVerified = 1;
+				return rv;
+			}
+			xs->hashVerified = -1;
+			snprintf(nControl->response, sizeof(nControl->response),
+				"Hash mismatch, %s of the data is %s\n", ftpClientHashName(xs->hashAlg), hex);
+			return 0;
+		}
+		p += strcspn(p, " ");
+	}
+	return rv;
+}
+
+
+
+/*
+ * xferSink - issue a read command and pass received data to a sink
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xferSink(const FtpClientSink_t* sink, const char* path,
+	NetBuf_t* nControl, int typ, int mode)
+{
+	int64_t start = ftpClientPortTimeUs();
+	char gzpath[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	const char* remote = path;
+	Codec_t codec = { 0 };
+	hashBegin(typ, nControl);
+	codec.method = codecBegin(&path, gzpath, typ, mode, nControl);
+	if (codec.method < 0)
+		return hashEnd(0, remote, mode, 0, nControl);
+	if (codec.method != FTP_CLIENT_COMPRESS_OFF) {
+		codec.inflate = ftpClientInflateCreate((codec.method == FTP_CLIENT_COMPRESS_GZIP) ?
+			FTP_CLIENT_GZIP : FTP_CLIENT_ZLIB, codecRecv, &codec);
+		if (codec.inflate == NULL) {
+			nControl->xmodeNext = 0;
+			snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(ENOMEM));
+			return hashEnd(0, remote, mode, 0, nControl);
+		}
+	}
+	NetBuf_t* nData;
+	if (!accessFtpClient(path, typ, mode, nControl, &nData)) {
+		if (codec.inflate)
+			ftpClientInflateDelete(codec.inflate);
+		return hashEnd(0, remote, mode, 0, nControl);
+	}
+	if (codec.inflate) {
+		codec.nData = nData;
+		nData->codec = &codec;
+	}
+
+	int rv = 1;
+	ChunkSizer_t cs;
+	chunkInit(&cs, nControl);
+	if ((nControl->pipeline >= 2) && (sink->getBuffer == NULL)) {
+		rv = xferSinkPipelined(sink, nControl, nData, &cs);
+		if (rv != -1) {
+			xferDone(nControl, nData, &cs, start);
+			closeFtpClient(nData);
+			if (codec.inflate)
+				ftpClientInflateDelete(codec.inflate);
+			return hashEnd(rv, remote, mode, codec.method != FTP_CLIENT_COMPRESS_GZIP, nControl);
+		}
+		/* not enough memory for the pipeline, fall back */
+		rv = 1;
+	}
+	char* dbuf = NULL;
+	int dbufsize = cs.size;
+	if ((sink->getBuffer == NULL) && ((dbuf = ftpClientMemAlloc(dbufsize, &dbufsize)) == NULL)) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client xfer malloc dbuf");
+		#endif
+		closeFtpClient(nData);
+		if (codec.inflate)
+			ftpClientInflateDelete(codec.inflate);
+		return hashEnd(0, remote, mode, 0, nControl);
+	}
+	while (1) {
+		int size = cs.size;
+		char* b;
+		if (sink->getBuffer)
+			b = sink->getBuffer(&size, sink->arg);
+		else {
+			size = chunkBuffer(&dbuf, &dbufsize, size);
+			b = dbuf;
+		}
+		if ((b == NULL) || (size <= 0)) {
+			rv = 0;
+			break;
+		}
+		int l = readChunk(b, size, nData);
+		if (l <= 0) {
+			if (l < 0)
+				rv = 0;
+			break;
+		}
+		ftpClientHashUpdate(&nControl->hash, b, l);
+		if (sink->write(b, l, sink->arg) != l) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client xfer sink write");
+			#endif
+			rv = 0;
+			break;
+		}
+		if (cs.size > (int)nControl->xstats.chunkSizeMax)
+			nControl->xstats.chunkSizeMax = cs.size;
+		chunkUpdate(&cs, l);
+	}
+	ftpClientMemFree(dbuf);
+	xferDone(nControl, nData, &cs, start);
+	closeFtpClient(nData);
+	if (codec.inflate)
+		ftpClientInflateDelete(codec.inflate);
+	return hashEnd(rv, remote, mode, codec.method != FTP_CLIENT_COMPRESS_GZIP, nControl);
+}
+
+
+
+/*
+ * xferSource - issue a write command and send data taken from a source
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xferSource(const FtpClientSource_t* source, const char* path,
+	NetBuf_t* nControl, int typ, int mode)
+{
+	int64_t start = ftpClientPortTimeUs();
+	char gzpath[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	const char* remote = path;
+	Codec_t codec = { 0 };
+	FtpClientSource_t zsource = { NULL, codecRead, &codec };
+	hashBegin(typ, nControl);
+	codec.method = codecBegin(&path, gzpath, typ, mode, nControl);
+	if (codec.method < 0)
+		return hashEnd(0, remote, mode, 0, nControl);
+	if (codec.method != FTP_CLIENT_COMPRESS_OFF) {
+		codec.source = source;
+		codec.deflate = ftpClientDeflateCreate((codec.method == FTP_CLIENT_COMPRESS_GZIP) ?
+			FTP_CLIENT_GZIP : FTP_CLIENT_ZLIB, codecSourceRead, &codec);
+		if (codec.deflate == NULL) {
+			nControl->xmodeNext = 0;
+			snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(ENOMEM));
+			return hashEnd(0, remote, mode, 0, nControl);
+		}
+		source = &zsource;
+	}
+	NetBuf_t* nData;
+	if (!accessFtpClient(path, typ, mode, nControl, &nData)) {
+		if (codec.deflate)
+			ftpClientDeflateDelete(codec.deflate);
+		return hashEnd(0, remote, mode, 0, nControl);
+	}
+	if (codec.deflate) {
+		codec.nData = nData;
+		nData->codec = &codec;
+	}
+
+	int rv = 1;
+	ChunkSizer_t cs;
+	chunkInit(&cs, nControl);
+	if ((nControl->pipeline >= 2) && (source->getBuffer == NULL)) {
+		rv = xferSourcePipelined(source, nControl, nData, &cs);
+		if (rv != -1) {
+			xferDone(nControl, nData, &cs, start);
+			closeFtpClient(nData);
+			if (codec.deflate)
+				ftpClientDeflateDelete(codec.deflate);
+			return hashEnd(rv, remote, mode, codec.method != FTP_CLIENT_COMPRESS_GZIP, nControl);
+		}
+		/* not enough memory for the pipeline, fall back */
+		rv = 1;
+	}
+	char* dbuf = NULL;
+	int dbufsize = cs.size;
+	if ((source->getBuffer == NULL) && ((dbuf = ftpClientMemAlloc(dbufsize, &dbufsize)) == NULL)) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client xfer malloc dbuf");
+		#endif
+		closeFtpClient(nData);
+		if (codec.deflate)
+			ftpClientDeflateDelete(codec.deflate);
+		return hashEnd(0, remote, mode, 0, nControl);
+	}
+	while (1) {
+		int size = cs.size;
+		char* b;
+		if (source->getBuffer)
+			b = source->getBuffer(&size, source->arg);
+		else {
+			size = chunkBuffer(&dbuf, &dbufsize, size);
+			b = dbuf;
+		}
+		if (b == NULL) {
+			rv = 0;
+			break;
+		}
+		int l = source->read(b, size, source->arg);
+		if (l == 0)
+			break;
+		if (l < 0) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client xfer source read");
+			#endif
+			rv = 0;
+			break;
+		}
+		if (codec.deflate == NULL)
+			ftpClientHashUpdate(&nControl->hash, b, l);
+		int c = writeFtpClient(b, l, nData);
+		if (c < l) {
+			#if FTP_CLIENT_DEBUG
+			char tempbuf[128];
+			sprintf(tempbuf, "Ftp Client xfer short write: passed %d, wrote %d\n", l, c);
+			perror(tempbuf);
+			#endif
+			rv = 0;
+			break;
+		}
+		if (cs.size > (int)nControl->xstats.chunkSizeMax)
+			nControl->xstats.chunkSizeMax = cs.size;
+		chunkUpdate(&cs, l);
+	}
+	ftpClientMemFree(dbuf);
+	xferDone(nControl, nData, &cs, start);
+	closeFtpClient(nData);
+	if (codec.deflate)
+		ftpClientDeflateDelete(codec.deflate);
+	return hashEnd(rv, remote, mode, codec.method != FTP_CLIENT_COMPRESS_GZIP, nControl);
+}
+
+
+
+/*
+ * resumeGet - prepare the local file of a resumable GET
+ *
+ * The transfer continues from the size of the local file, or from the
+ * journal when that is smaller.
+ *
+ * return 1 to transfer, 2 if the file is already complete, 0 on error
+ */
+static int resumeGet(FileEndpoint_t* fe, const char* localfile, NetBuf_t* nControl)
+{
+	/* readable for hashPrime() */
+	fe->fd = open(localfile, O_RDWR | O_CREAT, 0666);
+	if (fe->fd < 0)
+		return 0;
+	struct stat st;
+	uint64_t offset = (fstat(fe->fd, &st) == 0) ? st.st_size : 0;
+	char op, mode;
+	uint64_t joffset;
+	char jpath[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if (journalRead(fe->journal, &op, &mode, &joffset, jpath, sizeof(jpath)) &&
+			(op == 'G') && (strcmp(jpath, fe->path) == 0) && (joffset < offset))
+		offset = joffset;
+
+	unsigned int size;
+	if ((offset > 0) && sizeCommand(fe->path, &size, FTP_CLIENT_IMAGE, nControl)) {
+		if (offset == size) {
+			ftruncate(fe->fd, offset);
+			return 2;
+		}
+		/* larger than the remote file, it is not a part of it */
+		if (offset > size)
+			offset = 0;
+	}
+	if ((ftruncate(fe->fd, offset) != 0) || (lseek(fe->fd, offset, SEEK_SET) < 0))
+		return 0;
+	if (offset > 0)
+		nControl->stats.retries++;
+	fe->pos = offset;
+	nControl->restOffset = offset;
+	return 1;
+}
+
+
+
+/*
+ * resumePut - prepare the local file of a resumable PUT
+ *
+ * The transfer continues with APPE from the size of the remote file.
+ *
+ * return 1 to transfer, 2 if the file is already complete, 0 on error
+ */
+static int resumePut(FileEndpoint_t* fe, const char* localfile, NetBuf_t* nControl, int* typ)
+{
+	fe->fd = open(localfile, O_RDONLY);
+	if (fe->fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fe->fd, &st) != 0)
+		return 0;
+	unsigned int size;
+	uint64_t offset = 0;
+	if (sizeCommand(fe->path, &size, FTP_CLIENT_IMAGE, nControl)) {
+		offset = size;
+		if (offset == (uint64_t)st.st_size)
+			return 2;
+	}
+	/* larger than the local file, it is not a part of it */
+	if (offset > (uint64_t)st.st_size)
+		offset = 0;
+	if (lseek(fe->fd, offset, SEEK_SET) < 0)
+		return 0;
+	if (offset > 0)
+		nControl->stats.retries++;
+	fe->pos = offset;
+	*typ = offset ? FTP_CLIENT_FILE_APPEND : FTP_CLIENT_FILE_WRITE;
+	return 1;
+}
+
+
+
+/*
+ * resumeComplete - check the hash of a file a resumed transfer found complete
+ *
+ * A downloaded file that does not match is emptied, so the next attempt
+ * starts over.
+ *
+ * return 1 if it matches or cannot be compared, 0 otherwise
+ */
+static int resumeComplete(FileEndpoint_t* fe, NetBuf_t* nControl)
+{
+	struct stat st;
+	if (nControl->hashAlg == FTP_CLIENT_HASH_NONE)
+		return 1;
+	if ((fstat(fe->fd, &st) != 0) || !hashPrime(fe->fd, st.st_size, nControl)) {
+		nControl->hashPrimed = 0;
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+		return 0;
+	}
+	nControl->hashPrimed = 0;
+	if (hashEnd(1, fe->path, fe->mode, 1, nControl))
+		return 1;
+	if (fe->op == 'G')
+		ftruncate(fe->fd, 0);
+	return 0;
+}
+
+
+
+/*
+ * xferResume - transfer a file, continuing an earlier attempt
+ *
+ * On failure the local file is kept and the journal records how far the
+ * transfer came, so a later call (even after a reboot) picks it up.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xferResume(const char* localfile, const char* path,
+	NetBuf_t* nControl, int typ, int mode)
+{
+	char journal[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	int l = snprintf(journal, sizeof(journal), "%s%s", localfile, FTP_CLIENT_JOURNAL_SUFFIX);
+	if ((l < 0) || ((size_t)l >= sizeof(journal)))
+		return 0;
+	FileEndpoint_t fe = { .fd = -1, .journal = journal, .path = path,
+		.interval = nControl->checkpoint, .mode = mode };
+	int rv;
+	if (typ == FTP_CLIENT_FILE_READ) {
+		fe.op = 'G';
+		rv = resumeGet(&fe, localfile, nControl);
+	}
+	else {
+		fe.op = 'P';
+		rv = resumePut(&fe, localfile, nControl, &typ);
+	}
+	if (rv == 0)
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+	else if ((rv == 2) && !resumeComplete(&fe, nControl))
+		rv = 0;
+	if (rv != 1) {
+		if (fe.fd >= 0)
+			close(fe.fd);
+		if (rv == 2)
+			unlink(journal);
+		return (rv == 2);
+	}
+	uint64_t start = fe.pos;
+	fe.checkpoint = fe.pos + fe.interval;
+	journalWrite(&fe);
+	if (!hashPrime(fe.fd, fe.pos, nControl)) {
+		nControl->hashPrimed = 0;
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+		close(fe.fd);
+		return 0;
+	}
+
+	if (fe.op == 'G') {
+		FtpClientSink_t sink = { NULL, fileSinkWrite, &fe };
+		rv = xferSink(&sink, path, nControl, typ, mode);
+		if (!rv && (start > 0) && (fe.pos == start) && (nControl->response[0] == '5')) {
+			/* the server refused the restart, start over */
+			if ((ftruncate(fe.fd, 0) == 0) && (lseek(fe.fd, 0, SEEK_SET) == 0)) {
+				fe.pos = 0;
+				rv = xferSink(&sink, path, nControl, typ, mode);
+			}
+		}
+		fsync(fe.fd);
+	}
+	else {
+		FtpClientSource_t source = { NULL, fileSourceRead, &fe };
+		rv = xferSource(&source, path, nControl, typ, mode);
+	}
+	/* a download that fails its hash starts over */
+	if (!rv && (nControl->xstats.hashVerified < 0) && (fe.op == 'G') &&
+			(ftruncate(fe.fd, 0) == 0))
+		fe.pos = 0;
+	close(fe.fd);
+	if (rv)
+		unlink(journal);
+	else
+		journalWrite(&fe);
+	return rv;
+}
+
+
+
+/*
+ * Xfer - issue a command and transfer data
+ *
+ * The local file is accessed through open()/read()/write(), so each byte
+ * is copied once between the data socket and the file system.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int xfer(const char* localfile, const char* path,
+	NetBuf_t* nControl, int typ, int mode)
+{
+	if (nControl->resume && (localfile != NULL) && (mode == FTP_CLIENT_IMAGE) &&
+			((typ == FTP_CLIENT_FILE_READ) || (typ == FTP_CLIENT_FILE_WRITE)))
+		return xferResume(localfile, path, nControl, typ, mode);
+
+	FileEndpoint_t fe = { .fd = -1 };
+	if (localfile != NULL) {
+		if (typ == FTP_CLIENT_FILE_WRITE)
+			fe.fd = open(localfile, O_RDONLY);
+		else
+			fe.fd = open(localfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fe.fd < 0) {
+			snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+			return 0;
+		}
+	}
+	else
+		fe.fd = (typ == FTP_CLIENT_FILE_WRITE) ? STDIN_FILENO : STDOUT_FILENO;
+
+	int rv;
+	if (typ == FTP_CLIENT_FILE_WRITE) {
+		FtpClientSource_t source = { NULL, fileSourceRead, &fe };
+		rv = xferSource(&source, path, nControl, typ, mode);
+	}
+	else {
+		FtpClientSink_t sink = { NULL, fileSinkWrite, &fe };
+		rv = xferSink(&sink, path, nControl, typ, mode);
+	}
+	if (localfile != NULL) {
+		close(fe.fd);
+		if (rv != 1 && typ == FTP_CLIENT_FILE_READ)
+			unlink(localfile);
+	}
+	return rv;
+}
+
+
+
+/*
+ * socketInherit - take the socket options of another session
+ *
+ * The control connection gets the profile at once, data connections
+ * when they are opened.
+ */
+static void socketInherit(NetBuf_t* nControl, const NetBuf_t* from)
+{
+	nControl->sockData = from->sockData;
+	nControl->sockBufSize = from->sockBufSize;
+	nControl->sockTimeout = from->sockTimeout;
+	if (nControl->sockControl != from->sockControl) {
+		nControl->sockControl = from->sockControl;
+		ftpClientSockProfile(nControl->handle, nControl->sockControl, nControl->sockBufSize,
+			nControl->sockTimeout);
+	}
+}
+
+
+
+/*
+ * openPort - set up data connection
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int openPort(NetBuf_t* nControl, NetBuf_t** nData, int mode, int dir)
+{
+	union
+	{
+		struct sockaddr sa;
+		struct sockaddr_in in;
+	} sin;
+
+	if (nControl->dir != FTP_CLIENT_CONTROL)
+		return -1;
+	if ((dir != FTP_CLIENT_READ) && (dir != FTP_CLIENT_WRITE)) {
+		sprintf(nControl->response, "Invalid direction %d\n", dir);
+		return -1;
+	}
+	if ((mode != FTP_CLIENT_ASCII) && (mode != FTP_CLIENT_IMAGE)) {
+		sprintf(nControl->response, "Invalid mode %c\n", mode);
+		return -1;
+	}
+	//unsigned int l = sizeof(sin);
+	socklen_t l = sizeof(sin);
+	int64_t start = ftpClientPortTimeUs();
+	if (nControl->cmode == FTP_CLIENT_PASSIVE) {
+		memset(&sin, 0, l);
+		sin.in.sin_family = AF_INET;
+		if (!sendCommand("PASV", '2', nControl))
+			return -1;
+		char* cp = strchr(nControl->response,'(');
+		if (cp == NULL)
+			return -1;
+		cp++;
+		unsigned int v[6];
+		sscanf(cp,"%u,%u,%u,%u,%u,%u",&v[2],&v[3],&v[4],&v[5],&v[0],&v[1]);
+		sin.sa.sa_data[2] = v[2];
+		sin.sa.sa_data[3] = v[3];
+		sin.sa.sa_data[4] = v[4];
+		sin.sa.sa_data[5] = v[5];
+		sin.sa.sa_data[0] = v[0];
+		sin.sa.sa_data[1] = v[1];
+	}
+	else {
+		if(getsockname(nControl->handle, &sin.sa, &l) < 0) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client openPort: getsockname");
+			#endif
+			return -1;
+		}
+	}
+	int sData = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sData == -1) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client openPort: socket");
+		#endif
+		return -1;
+	}
+	/* before connect() and listen(), the buffer sizes decide the window scale */
+	if (nControl->sockData != FTP_CLIENT_SOCK_DEFAULT)
+		ftpClientSockProfile(sData, nControl->sockData, nControl->sockBufSize, nControl->sockTimeout);
+	if (nControl->cmode == FTP_CLIENT_PASSIVE) {
+		if (connect(sData, &sin.sa, sizeof(sin.sa)) == -1) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client openPort: connect");
+			#endif
+			closesocket(sData);
+			return -1;
+		}
+	}
+	else {
+		sin.in.sin_port = 0;
+		if (bind(sData, &sin.sa, sizeof(sin)) == -1) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client openPort: bind");
+			#endif
+			closesocket(sData);
+			return -1;
+		}
+		if (listen(sData, 1) < 0) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client openPort: listen");
+			#endif
+			closesocket(sData);
+			return -1;
+		}
+		if (getsockname(sData, &sin.sa, &l) < 0)
+			return -1;
+		char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+		sprintf(buf, "PORT %d,%d,%d,%d,%d,%d",
+			(unsigned char) sin.sa.sa_data[2],
+			(unsigned char) sin.sa.sa_data[3],
+			(unsigned char) sin.sa.sa_data[4],
+			(unsigned char) sin.sa.sa_data[5],
+			(unsigned char) sin.sa.sa_data[0],
+			(unsigned char) sin.sa.sa_data[1]);
+		if (!sendCommand(buf, '2', nControl)) {
+			closesocket(sData);
+			return -1;
+		}
+	}
+	NetBuf_t* ctrl = netBufAlloc();
+	if (ctrl == NULL) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client openPort: netBufAlloc ctrl");
+		#endif
+		closesocket(sData);
+		return -1;
+	}
+
+	/*
+	ctrl->buf is only used with ASCII mode.
+
+	With ASCII mode:
+	readFtpClient() uses readLine().
+	writeFtpClient() uses writeLine().
+	These functions use this memory.
+	This memory will be released in closeFtpClient().
+
+	With BINARY mode:
+	readFtpClient() uses recv().
+	writeFtpClient() uses send().
+	*/
+
+	if ((mode == 'A') && ((ctrl->buf = ftpClientMemAlloc(nControl->dbufsize, NULL)) == NULL)) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client openPort: ftpClientMemAlloc ctrl->buf");
+		#endif
+		closesocket(sData);
+		netBufRelease(ctrl);
+		return -1;
+	}
+	ctrl->handle = sData;
+	ctrl->bufsize = nControl->dbufsize;
+	ctrl->dir = dir;
+	ctrl->idletime = nControl->idletime;
+	ctrl->idlearg = nControl->idlearg;
+	ctrl->xfered = 0;
+	ctrl->xfered1 = 0;
+	ctrl->cbbytes = nControl->cbbytes;
+	ctrl->ctrl = nControl;
 	if (ctrl->idletime.tv_sec || ctrl->idletime.tv_usec || ctrl->cbbytes)
 		ctrl->idlecb = nControl->idlecb;
 	else
-		ctrl->idlecb = NULL;
-	nControl->data = ctrl;
-	*nData = ctrl;
+		ctrl->idlecb = NULL;
+	nControl->data = ctrl;
+	*nData = ctrl;
+	/* each transfer starts with a full burst */
+	nControl->bucket.stamp = 0;
+	statsTime(&nControl->stats.pasv, ftpClientPortTimeUs() - start);
+	return 1;
+}
+
+
+
+/*
+ * write lines of text
+ *
+ * return -1 on error or bytecount
+ */
+static int writeLine(const char* buf, int len, NetBuf_t* nData)
+{
+	if (nData->dir != FTP_CLIENT_WRITE)
+		return -1;
+	int nb = 0;
+	int x = 0;
+	int w = 0;
+
+	while (x < len) {
+		size_t n = len - x;
+		nb += ftpClientTextToCrlf(buf + x, &n, nData->buf + nb, nData->bufsize - nb,
+			&nData->crlf);
+		x += n;
+		if ((x < len) || (nb == nData->bufsize)) {
+			if (!socketWait(nData))
+				return x;
+			w = netSend(nData, nData->buf, nb);
+			if (w != nb) {
+				#if FTP_CLIENT_DEBUG
+				printf("Ftp client write line: net_write(1) returned %d, errno = %d\n",
+						w, errno);
+				#endif
+				return(-1);
+			}
+			nb = 0;
+		}
+	}
+	if (nb){
+		if (!socketWait(nData))
+			return x;
+		w = netSend(nData, nData->buf, nb);
+		if (w != nb) {
+			#if FTP_CLIENT_DEBUG
+			printf("Ftp client write line: net_write(2) returned %d, errno = %d\n",
+					w, errno);
+			#endif
+			return(-1);
+		}
+	}
+	return len;
+}
+
+
+
+/*
+ * acceptConnection - accept connection from server
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int acceptConnection(NetBuf_t* nData, NetBuf_t* nControl)
+{
+	int rv = 0;
+	fd_set mask;
+	FD_ZERO(&mask);
+	FD_SET(nControl->handle, &mask);
+	FD_SET(nData->handle, &mask);
+	struct timeval tv;
+	tv.tv_usec = 0;
+	tv.tv_sec = FTP_CLIENT_ACCEPT_TIMEOUT ;
+	int i = nControl->handle;
+	if (i < nData->handle)
+		i = nData->handle;
+	i = netSelect(nControl, i+1, &mask, NULL, &tv);
+	if (i == -1) {
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+		closesocket(nData->handle);
+		nData->handle = 0;
+		rv = 0;
+	}
+	else if (i == 0) {
+		strcpy(nControl->response, "FTP Client accept connection "
+				"timed out waiting for connection");
+		closesocket(nData->handle);
+		nData->handle = 0;
+		rv = 0;
+	}
+	else {
+		if (FD_ISSET(nData->handle, &mask)) {
+			struct sockaddr addr;
+			//unsigned int l = sizeof(addr);
+			socklen_t l = sizeof(addr);
+			int sData = accept(nData->handle, &addr, &l);
+			i = errno;
+			closesocket(nData->handle);
+			if (sData > 0) {
+				rv = 1;
+				nData->handle = sData;
+				/* not every stack passes them on from the listening socket */
+				if (nControl->sockData != FTP_CLIENT_SOCK_DEFAULT)
+					ftpClientSockProfile(sData, nControl->sockData, nControl->sockBufSize,
+						nControl->sockTimeout);
+			}
+			else {
+				snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(i));
+				nData->handle = 0;
+				rv = 0;
+			}
+		}
+		else if (FD_ISSET(nControl->handle, &mask)) {
+			closesocket(nData->handle);
+			nData->handle = 0;
+			readResponse('2', nControl);
+			rv = 0;
+		}
+	}
+	return rv;
+}
+
+
+
+/*
+ * siteFtpClient - send a SITE command
+ *
+ * return 1 if command successful, 0 otherwise
+ */
+static int siteFtpClient(const char* cmd, NetBuf_t* nControl)
+{
+	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(cmd) + 7) > sizeof(buf))
+		return 0;
+	sprintf(buf, "SITE %s", cmd);
+	if (!sendCommand(buf, '2', nControl))
+		return 0;
+	else
+		return 1;
+}
+
+
+
+/*
+ * getLastResponseFtpClient - return a pointer to the last response received
+ */
+static char* getLastResponseFtpClient(NetBuf_t* nControl)
+{
+	if ((nControl) && (nControl->dir == FTP_CLIENT_CONTROL))
+		return nControl->response;
+	else
+		return NULL;
+}
+
+
+
+/*
+ * getSysTypeFtpClient - send a SYST command
+ *
+ * Fills in the user buffer with the remote system type.  If more
+ * information from the response is required, the user can parse
+ * it out of the response buffer returned by FtpLastResponse().
+ *
+ * return 1 if command successful, 0 otherwise
+ */
+static int getSysTypeFtpClient(char* buf, int max, NetBuf_t* nControl)
+{
+	if (!sendCommand("SYST", '2', nControl))
+		return 0;
+	char* s = &nControl->response[4];
+	int l = max;
+	char* b = buf;
+	while ((--l) && (*s != ' '))
+		*b++ = *s++;
+	*b++ = '\0';
+	return 1;
+}
+
+
+
+/*
+ * metaHash - add the components of a path to a path hash
+ *
+ * Empty and "." components are skipped, so "/a//b/" and "/a/./b" hash
+ * like "/a/b". A ".." component cannot be resolved without the server.
+ *
+ * return the hash, 0 if the path has a ".." component
+ */
+static uint64_t metaHash(uint64_t h, const char* s, size_t len)
+{
+	size_t i = 0;
+	while (i < len) {
+		while ((i < len) && (s[i] == '/'))
+			i++;
+		size_t b = i;
+		while ((i < len) && (s[i] != '/'))
+			i++;
+		if ((i == b) || ((i - b == 1) && (s[b] == '.')))
+			continue;
+		if ((i - b == 2) && (s[b] == '.') && (s[b + 1] == '.'))
+			return 0;
+		h = (h ^ '/') * 1099511628211ULL;
+		for (; b < i; b++)
+			h = (h ^ (uint8_t)s[b]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+
+
+/*
+ * metaKey - cache key of a remote path
+ *
+ * A relative path is resolved against the working directory, which costs
+ * one PWD when the directory is not known.
+ *
+ * return the key, 0 if the cache is off or the path cannot be resolved
+ */
+static uint64_t metaKey(const char* path, NetBuf_t* nControl)
+{
+	if (nControl->meta == NULL)
+		return 0;
+	uint64_t h = 14695981039346656037ULL;
+	if ((path == NULL) || (path[0] != '/')) {
+		char cwd[FTP_CLIENT_CWD_SIZE];
+		if (nControl->cwdFrom == 0)
+			pwdFtpClient(cwd, sizeof(cwd), nControl);
+		if (nControl->cwdFrom == 0)
+			return 0;
+		h = metaHash(h, nControl->cwd, strlen(nControl->cwd));
+	}
+	if ((path != NULL) && h)
+		h = metaHash(h, path, strlen(path));
+	return h;
+}
+
+
+
+/*
+ * metaFind - look up a key in the metadata cache
+ *
+ * A key has two slots to choose from. Entries older than the TTL are
+ * dropped when they are found.
+ *
+ * return the entry, NULL if the key is not cached
+ */
+static MetaEntry_t* metaFind(uint64_t key, NetBuf_t* nControl)
+{
+	MetaEntry_t* e = &nControl->meta[key & (FTP_CLIENT_METACACHE_ENTRIES - 2)];
+	for (int i = 0; i < 2; i++, e++) {
+		if (e->key != key)
+			continue;
+		if ((ftpClientPortTimeUs() / 1000 - e->stored) < nControl->metaTtl)
+			return e;
+		e->key = 0;
+		nControl->mstats.expired++;
+		nControl->mstats.entries--;
+		return NULL;
+	}
+	return NULL;
+}
+
+
+
+/*
+ * metaStore - put the size or the modification date of a path into the cache
+ *
+ * A new fact does not extend the lifetime of an entry, the TTL runs from
+ * the first fact stored.
+ */
+static void metaStore(uint64_t key, int facts, uint64_t size, const char* modDate,
+	NetBuf_t* nControl)
+{
+	if ((key == 0) || (nControl->meta == NULL))
+		return;
+	MetaEntry_t* e = metaFind(key, nControl);
+	if (e == NULL) {
+		e = &nControl->meta[key & (FTP_CLIENT_METACACHE_ENTRIES - 2)];
+		if (e[0].key && (!e[1].key || (e[1].stored < e[0].stored)))
+			e++;
+		if (e->key)
+			nControl->mstats.evictions++;
+		else
+			nControl->mstats.entries++;
+		e->key = key;
+		e->stored = ftpClientPortTimeUs() / 1000;
+		e->facts = 0;
+	}
+	if (facts & META_SIZE)
+		e->size = size;
+	if (facts & META_MODDATE)
+		snprintf(e->modDate, sizeof(e->modDate), "%s", modDate);
+	e->facts |= facts;
+	nControl->mstats.stores++;
+}
+
+
+
+/*
+ * metaFlush - drop every entry of the metadata cache
+ */
+static void metaFlush(NetBuf_t* nControl)
+{
+	if (nControl->meta == NULL)
+		return;
+	memset(nControl->meta, 0, FTP_CLIENT_METACACHE_ENTRIES * sizeof(MetaEntry_t));
+	nControl->mstats.invalidations += nControl->mstats.entries;
+	nControl->mstats.entries = 0;
+}
+
+
+
+/*
+ * metaForget - drop a path that is about to change at the server
+ *
+ * The whole cache is dropped when the path cannot be resolved.
+ *
+ * return 1 if the path was cached, 0 otherwise
+ */
+static int metaForget(const char* path, NetBuf_t* nControl)
+{
+	if ((nControl->meta == NULL) || (nControl->mstats.entries == 0))
+		return 0;
+	uint64_t key = metaKey(path, nControl);
+	if (key == 0) {
+		metaFlush(nControl);
+		return 0;
+	}
+	MetaEntry_t* e = metaFind(key, nControl);
+	if (e == NULL)
+		return 0;
+	e->key = 0;
+	nControl->mstats.invalidations++;
+	nControl->mstats.entries--;
+	return 1;
+}
+
+
+
+/*
+ * sizeCommand - ask the server for the size of a remote file
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int sizeCommand(const char* path, unsigned int* size, char mode,
+	NetBuf_t* nControl)
+{
+	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(path) + 7) > sizeof(cmd))
+		return 0;
+	if (!setType(mode, nControl))
+		return 0;
+	int rv = 1;
+	sprintf(cmd,"SIZE %s", path);
+	if(!sendCommand(cmd, '2', nControl))
+		rv = 0;
+	else {
+		int resp;
+		unsigned int sz;
+		if (sscanf(nControl->response, "%d %u", &resp, &sz) == 2)
+			*size = sz;
+		else
+			rv = 0;
+	}
+	return rv;
+}
+
+
+
+/*
+ * getFileSizeFtpClient - determine the size of a remote file
+ *
+ * Only IMAGE sizes are cached, the ASCII size depends on the server.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getFileSizeFtpClient(const char* path,
+		unsigned int* size, char mode, NetBuf_t* nControl)
+{
+	uint64_t key = 0;
+	if ((nControl->meta != NULL) && (mode == FTP_CLIENT_IMAGE)) {
+		key = metaKey(path, nControl);
+		MetaEntry_t* e = key ? metaFind(key, nControl) : NULL;
+		if ((e != NULL) && (e->facts & META_SIZE)) {
+			nControl->mstats.hits++;
+			*size = (unsigned int) e->size;
+			return 1;
+		}
+		nControl->mstats.misses++;
+	}
+	if (!sizeCommand(path, size, mode, nControl))
+		return 0;
+	metaStore(key, META_SIZE, *size, NULL, nControl);
+	return 1;
+}
+
+
+
+/*
+ * getModDateFtpClient - determine the modification date of a remote file
+ *
+ * dt receives the date as sent by the server, without the line end.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getModDateFtpClient(const char* path, char* dt,
+		int max, NetBuf_t* nControl)
+{
+	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(path) + 7) > sizeof(buf))
+		return 0;
+	uint64_t key = 0;
+	if (nControl->meta != NULL) {
+		key = metaKey(path, nControl);
+		MetaEntry_t* e = key ? metaFind(key, nControl) : NULL;
+		if ((e != NULL) && (e->facts & META_MODDATE)) {
+			nControl->mstats.hits++;
+			strncpy(dt, e->modDate, max);
+			return 1;
+		}
+		nControl->mstats.misses++;
+	}
+	sprintf(buf, "MDTM %s", path);
+	if (!sendCommand(buf, '2', nControl))
+		return 0;
+	char* date = &nControl->response[4];
+	date[strcspn(date, "\r\n")] = '\0';
+	strncpy(dt, date, max);
+	if (strlen(date) < FTP_CLIENT_METACACHE_DATE_SIZE)
+		metaStore(key, META_MODDATE, 0, date, nControl);
+	return 1;
+}
+
+
+
+static int setCallbackFtpClient(const FtpClientCallbackOptions_t* opt, NetBuf_t* nControl)
+{
+   nControl->idlecb = opt->cbFunc;
+   nControl->idlearg = opt->cbArg;
+   nControl->idletime.tv_sec = opt->idleTime / 1000;
+   nControl->idletime.tv_usec = (opt->idleTime % 1000) * 1000;
+   nControl->cbbytes = opt->bytesXferred;
+   return 1;
+}
+
+
+
+static int clearCallbackFtpClient(NetBuf_t* nControl)
+{
+   nControl->idlecb = NULL;
+   nControl->idlearg = NULL;
+   nControl->idletime.tv_sec = 0;
+   nControl->idletime.tv_usec = 0;
+   nControl->cbbytes = 0;
+   return 1;
+}
+
+
+
+/*
+ * getXferStatsFtpClient - statistics of the last transfer
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getXferStatsFtpClient(FtpClientXferStats_t* stats, NetBuf_t* nControl)
+{
+	if ((nControl == NULL) || (nControl->dir != FTP_CLIENT_CONTROL))
+		return 0;
+	*stats = nControl->xstats;
+	return 1;
+}
+
+
+
+/*
+ * getRoundTripsSavedFtpClient - commands answered from the TYPE/CWD cache
+ */
+static unsigned long getRoundTripsSavedFtpClient(NetBuf_t* nControl)
+{
+	return nControl->rttSaved;
+}
+
+
+
+/*
+ * getMetaCacheStatsFtpClient - counters of the metadata cache
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getMetaCacheStatsFtpClient(FtpClientMetaCacheStats_t* stats, NetBuf_t* nControl)
+{
+	if ((nControl == NULL) || (nControl->dir != FTP_CLIENT_CONTROL))
+		return 0;
+	*stats = nControl->mstats;
+	return 1;
+}
+
+
+
+/*
+ * getStatsFtpClient - counters of a session, or of all sessions with NULL
+ *
+ * The global counters add up the sessions that were closed or returned to
+ * the pool.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getStatsFtpClient(FtpClientStats_t* stats, NetBuf_t* nControl)
+{
+	if (nControl == NULL) {
+		ftpClientPortMutexLock(statsLock);
+		*stats = statsTotal;
+		ftpClientPortMutexUnlock(statsLock);
+		return 1;
+	}
+	if (nControl->dir != FTP_CLIENT_CONTROL)
+		return 0;
+	*stats = nControl->stats;
+	return 1;
+}
+
+
+
+/*
+ * resetStatsFtpClient - clear the counters of a session, or the global ones with NULL
+ */
+static void resetStatsFtpClient(NetBuf_t* nControl)
+{
+	if (nControl == NULL) {
+		ftpClientPortMutexLock(statsLock);
+		memset(&statsTotal, 0, sizeof(statsTotal));
+		ftpClientPortMutexUnlock(statsLock);
+	}
+	else if (nControl->dir == FTP_CLIENT_CONTROL)
+		memset(&nControl->stats, 0, sizeof(nControl->stats));
+}
+
+
+
+/*
+ * jsonAppend - append formatted text to a JSON buffer
+ *
+ * Once the buffer is full *len stays at or above max.
+ */
+static void jsonAppend(char* buf, int max, int* len, const char* fmt, ...)
+{
+	if (*len >= max)
+		return;
+	va_list ap;
+	va_start(ap, fmt);
+	int l = vsnprintf(buf + *len, max - *len, fmt, ap);
+	va_end(ap);
+	*len += (l < 0) ? max : l;
+}
+
+
+
+/*
+ * jsonTimer - append a timer as a JSON member
+ */
+static void jsonTimer(char* buf, int max, int* len, const char* name,
+	const FtpClientStatsTimer_t* t)
+{
+	jsonAppend(buf, max, len, "\"%s\":{\"count\":%" PRIu32 ",\"avgUs\":%" PRIu64
+		",\"maxUs\":%" PRIu32 "}", name, t->count,
+		t->count ? t->totalUs / t->count : 0, t->maxUs);
+}
+
+
+
+/*
+ * statsJsonFtpClient - snapshot of the counters as a JSON object
+ *
+ * Commands that were never sent and stages that were not reached are left
+ * out. FTP_CLIENT_STATS_JSON_SIZE bytes are always enough.
+ *
+ * return length of the text, 0 if it does not fit into max bytes
+ */
+static int statsJsonFtpClient(char* buf, int max, NetBuf_t* nControl)
+{
+	FtpClientStats_t st;
+	if (!getStatsFtpClient(&st, nControl))
+		return 0;
+	int len = 0;
+	jsonAppend(buf, max, &len, "{\"timeUs\":%" PRId64 ",\"bytesIn\":%" PRIu64
+		",\"bytesOut\":%" PRIu64 ",\"selectUs\":%" PRIu64,
+		ftpClientPortTimeUs(), st.bytesIn, st.bytesOut, st.selectUs);
+	for (int d = 0; d < 2; d++) {
+		jsonAppend(buf, max, &len, ",\"%s\":{\"calls\":%" PRIu32 ",\"hist\":[",
+			d ? "send" : "recv", d ? st.sendCalls : st.recvCalls);
+		for (int i = 0; i < FTP_CLIENT_STATS_HIST_SIZE; i++)
+			jsonAppend(buf, max, &len, "%s%" PRIu32, i ? "," : "",
+				d ? st.sendHist[i] : st.recvHist[i]);
+		jsonAppend(buf, max, &len, "]}");
+	}
+	jsonAppend(buf, max, &len, ",");
+	jsonTimer(buf, max, &len, "connect", &st.connect);
+	jsonAppend(buf, max, &len, ",");
+	jsonTimer(buf, max, &len, "login", &st.login);
+	jsonAppend(buf, max, &len, ",");
+	jsonTimer(buf, max, &len, "pasv", &st.pasv);
+	jsonAppend(buf, max, &len, ",");
+	jsonTimer(buf, max, &len, "ttfb", &st.ttfb);
+	jsonAppend(buf, max, &len, ",\"commands\":{");
+	int n = 0;
+	for (int i = 0; i < FTP_CLIENT_STATS_VERBS; i++) {
+		if (st.verb[i].count == 0)
+			continue;
+		jsonAppend(buf, max, &len, "%s", n++ ? "," : "");
+		jsonTimer(buf, max, &len, statsVerbs[i], &st.verb[i]);
+	}
+	jsonAppend(buf, max, &len, "},\"transfers\":%" PRIu32 ",\"retries\":%" PRIu32
+		",\"xferBytes\":%" PRIu64 ",\"xferUs\":%" PRIu64 ",\"bytesPerSec\":%" PRIu64
+		",\"throttleUs\":%" PRIu64,
+		st.transfers, st.retries, st.xferBytes, st.xferUs,
+		st.xferUs ? st.xferBytes * 1000000 / st.xferUs : 0, st.throttleUs);
+	jsonAppend(buf, max, &len, ",\"stageStartUs\":%" PRId64 ",\"stages\":{", st.stageStart);
+	n = 0;
+	for (int i = 0; i < FTP_CLIENT_STAGES; i++) {
+		if ((st.stageStart == 0) || (st.stageUs[i] < 0))
+			continue;
+		jsonAppend(buf, max, &len, "%s\"%s\":%" PRId64, n++ ? "," : "",
+			statsStages[i], st.stageUs[i]);
+	}
+	jsonAppend(buf, max, &len, "}}");
+	if (len >= max)
+		return 0;
+	return len;
+}
+
+
+
+/*
+ * statsVerbFtpClient - name of a command of FtpClientStats_t.verb
+ */
+static const char* statsVerbFtpClient(int index)
+{
+	if ((index < 0) || (index >= FTP_CLIENT_STATS_VERBS))
+		return NULL;
+	return statsVerbs[index];
+}
+
+
+
+/*
+ * connect - connect to remote server
+ *
+ * return 1 if connected, 0 if not
+ */
+static int connectFtpClient(const char* host, uint16_t port, NetBuf_t** nControl)
+{
+	ESP_LOGD(__FUNCTION__, "host=%s", host);
+	struct sockaddr_in sin;
+	memset(&sin,0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = inet_addr(host);
+	ESP_LOGD(__FUNCTION__, "sin.sin_addr.s_addr=%"PRIx32, sin.sin_addr.s_addr);
+	if (sin.sin_addr.s_addr == 0xffffffff) {
+		/* getaddrinfo() and not gethostbyname(), which is not reentrant */
+		struct addrinfo hints, *res;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		if ((getaddrinfo(host, NULL, &hints, &res) != 0) || (res == NULL)) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client Error: Connect, getaddrinfo");
+			#endif
+			return 0;
+		}
+		sin.sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+		freeaddrinfo(res);
+		ESP_LOGD(__FUNCTION__, "sin.sin_addr.s_addr=%"PRIx32, sin.sin_addr.s_addr);
+	}
+
+	int sControl = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	ESP_LOGD(__FUNCTION__, "sControl=%d", sControl);
+	if (sControl == -1) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client Error: Connect, socket");
+		#endif
+		return 0;
+	}
+	if (FTP_CLIENT_SOCK_CONTROL_DEFAULT != FTP_CLIENT_SOCK_DEFAULT)
+		ftpClientSockProfile(sControl, FTP_CLIENT_SOCK_CONTROL_DEFAULT, FTP_CLIENT_SOCK_BUFFER_SIZE,
+			FTP_CLIENT_SOCK_TIMEOUT);
+	int64_t start = ftpClientPortTimeUs();
+	if(connect(sControl, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client Error: Connect, connect");
+		#endif
+		closesocket(sControl);
+		return 0;
+	}
+	NetBuf_t* ctrl = calloc(1, sizeof(NetBuf_t));
+	if (ctrl == NULL) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client Error: Connect, calloc ctrl");
+		#endif
+		closesocket(sControl);
+		return 0;
+	}
+	ctrl->buf = malloc(FTP_CLIENT_BUFFER_SIZE);
+	ctrl->bufsize = FTP_CLIENT_BUFFER_SIZE;
+	ctrl->lock = ftpClientPortMutexCreateRecursive();
+	if ((ctrl->buf == NULL) || (ctrl->lock == NULL)) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client Error: Connect, malloc ctrl->buf");
+		#endif
+		closesocket(sControl);
+		if (ctrl->lock)
+			ftpClientPortMutexDelete(ctrl->lock);
+		free(ctrl->buf);
+		free(ctrl);
+		return 0;
+	}
+	ctrl->handle = sControl;
+	ctrl->dir = FTP_CLIENT_CONTROL;
+	ctrl->ctrl = NULL;
+	ctrl->data = NULL;
+	ctrl->cmode = FTP_CLIENT_DEFAULT_MODE;
+	ctrl->idlecb = NULL;
+	ctrl->idletime.tv_sec = ctrl->idletime.tv_usec = 0;
+	ctrl->idlearg = NULL;
+	ctrl->xfered = 0;
+	ctrl->xfered1 = 0;
+	ctrl->cbbytes = 0;
+	ctrl->dbufsize = FTP_CLIENT_BUFFER_SIZE;
+	ctrl->dbufadaptive = 0;
+	ctrl->pipeline = 0;
+	ctrl->segments = 1;
+	ctrl->resume = 0;
+	ctrl->checkpoint = FTP_CLIENT_CHECKPOINT_DEFAULT;
+	ctrl->cmdWindow = FTP_CLIENT_CMD_WINDOW;
+	ctrl->restOffset = 0;
+	ctrl->compress = FTP_CLIENT_COMPRESS_OFF;
+	ctrl->xmode = 'S';
+	ctrl->sockControl = FTP_CLIENT_SOCK_CONTROL_DEFAULT;
+	ctrl->sockData = FTP_CLIENT_SOCK_DEFAULT;
+	ctrl->sockBufSize = FTP_CLIENT_SOCK_BUFFER_SIZE;
+	ctrl->sockTimeout = FTP_CLIENT_SOCK_TIMEOUT;
+	ctrl->rttSaved = 0;
+	stateClear(ctrl);
+	snprintf(ctrl->host, sizeof(ctrl->host), "%s", host);
+	ctrl->port = port;
+	if (readResponse('2', ctrl) == 0) {
+		closesocket(sControl);
+		ftpClientPortMutexDelete(ctrl->lock);
+		free(ctrl->buf);
+		free(ctrl);
+		return 0;
+	}
+	statsTime(&ctrl->stats.connect, ftpClientPortTimeUs() - start);
+	*nControl = ctrl;
+	return 1;
+}
+
+/*
+ * login - log in to remote server
+ *
+ * return 1 if logged in, 0 otherwise
+ */
+static int loginFtpClient(const char* user, const char* pass, NetBuf_t* nControl)
+{
+	char tempbuf[64];
+	if (((strlen(user) + 7) > sizeof(tempbuf)) ||
+			((strlen(pass) + 7) > sizeof(tempbuf)))
+		return 0;
+	stateClear(nControl);
+	metaFlush(nControl);
+	snprintf(nControl->user, sizeof(nControl->user), "%s", user);
+	snprintf(nControl->pass, sizeof(nControl->pass), "%s", pass);
+	int64_t start = ftpClientPortTimeUs();
+	int rv;
+	sprintf(tempbuf,"USER %s",user);
+	if (!sendCommand(tempbuf, '3', nControl))
+		rv = (nControl->response[0] == '2');
+	else {
+		sprintf(tempbuf, "PASS %s", pass);
+		rv = sendCommand(tempbuf, '2', nControl);
+	}
+	statsTime(&nControl->stats.login, ftpClientPortTimeUs() - start);
+	return rv;
+}
+
+
+
+/*
+ * quitFtpClient - disconnect from remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static void quitFtpClient(NetBuf_t* nControl)
+{
+	if (nControl->dir != FTP_CLIENT_CONTROL)
+		return;
+	sendCommand("QUIT", '2', nControl);
+	statsFold(nControl);
+	closesocket(nControl->handle);
+	/* held since sessionClose(), nobody waits for it any more */
+	if (nControl->closing)
+		ftpClientPortMutexUnlock(nControl->lock);
+	ftpClientPortMutexDelete(nControl->lock);
+	free(nControl->meta);
+	free(nControl->buf);
+	free(nControl);
+}
+
+
+
+/*
+ * setOptionsFtpClient - change connection options
+ *
+ * returns 1 if successful, 0 on error
+ */
+static int setOptionsFtpClient(int opt, long val, NetBuf_t* nControl)
+{
+	int v,rv = 0;
+	switch (opt)
+	{
+		case FTP_CLIENT_CONNMODE:
+		{
+			v = (int) val;
+			if ((v == FTP_CLIENT_PASSIVE)
+					|| (v == FTP_CLIENT_ACTIVE)) {
+				nControl->cmode = v;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_CALLBACK:
+		{
+			nControl->idlecb = (FtpClientCallback_t) val;
+			rv = 1;
+		}
+		break;
+
+		case FTP_CLIENT_IDLETIME:
+		{
+			v = (int) val;
+			rv = 1;
+			nControl->idletime.tv_sec = v / 1000;
+			nControl->idletime.tv_usec = (v % 1000) * 1000;
+		}
+		break;
+
+		case FTP_CLIENT_CALLBACKARG:
+		{
+			rv = 1;
+			nControl->idlearg = (void *) val;
+		}
+		break;
+
+		case FTP_CLIENT_CALLBACKBYTES:
+		{
+			rv = 1;
+			nControl->cbbytes = (int) val;
+		}
+		break;
+
+		case FTP_CLIENT_DATABUFSIZE:
+		{
+			if ((val >= FTP_CLIENT_DATABUF_MIN_SIZE) &&
+					(val <= FTP_CLIENT_DATABUF_MAX_SIZE)) {
+				nControl->dbufsize = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_DATABUFADAPTIVE:
+		{
+			rv = 1;
+			nControl->dbufadaptive = (val != 0);
+		}
+		break;
+
+		case FTP_CLIENT_PIPELINE:
+		{
+			if ((val >= 0) && (val <= FTP_CLIENT_PIPELINE_MAX_BUFFERS)) {
+				nControl->pipeline = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_SEGMENTS:
+		{
+			if ((val >= 1) && (val <= FTP_CLIENT_SEGMENTS_MAX)) {
+				nControl->segments = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_RESUME:
+		{
+			rv = 1;
+			nControl->resume = (val != 0);
+		}
+		break;
+
+		case FTP_CLIENT_CHECKPOINT:
+		{
+			if (val > 0) {
+				nControl->checkpoint = val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_CMDPIPELINE:
+		{
+			if ((val >= 0) && (val <= FTP_CLIENT_CMD_WINDOW_MAX)) {
+				nControl->cmdWindow = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_RATELIMIT:
+		case FTP_CLIENT_RATEBURST:
+		{
+			if (val >= 0) {
+				if (opt == FTP_CLIENT_RATELIMIT)
+					nControl->rateLimit = val;
+				else
+					nControl->rateBurst = val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_GLOBALRATE:
+		case FTP_CLIENT_GLOBALBURST:
+		{
+			if (val >= 0) {
+				ftpClientPortMutexLock(rateLock);
+				if (opt == FTP_CLIENT_GLOBALRATE)
+					rateGlobalLimit = val;
+				else
+					rateGlobalBurst = val;
+				ftpClientPortMutexUnlock(rateLock);
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_COMPRESS:
+		{
+			if ((val >= FTP_CLIENT_COMPRESS_OFF) && (val <= FTP_CLIENT_COMPRESS_GZIP)) {
+				nControl->compress = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_HASH:
+		{
+			if ((val >= FTP_CLIENT_HASH_NONE) && (val <= FTP_CLIENT_HASH_SHA256)) {
+				nControl->hashAlg = (int) val;
+				rv = 1;
+			}
+		}
+		break;
+
+		case FTP_CLIENT_SOCKCONTROL:
+		case FTP_CLIENT_SOCKDATA:
+		case FTP_CLIENT_SOCKBUFSIZE:
+		case FTP_CLIENT_SOCKTIMEOUT:
+		{
+			const long profiles = FTP_CLIENT_SOCK_LOWLATENCY | FTP_CLIENT_SOCK_BULK |
+				FTP_CLIENT_SOCK_KEEPALIVE;
+			if ((val < 0) || (((opt == FTP_CLIENT_SOCKCONTROL) || (opt == FTP_CLIENT_SOCKDATA)) &&
+					(val & ~profiles)) || ((opt == FTP_CLIENT_SOCKBUFSIZE) && (val == 0)) ||
+					(val > INT32_MAX))
+				break;
+			if (opt == FTP_CLIENT_SOCKCONTROL)
+				nControl->sockControl = (int) val;
+			else if (opt == FTP_CLIENT_SOCKDATA)
+				nControl->sockData = (int) val;
+			else if (opt == FTP_CLIENT_SOCKBUFSIZE)
+				nControl->sockBufSize = (int) val;
+			else
+				nControl->sockTimeout = (int) val;
+			/* the control connection is open already, data connections take it when opened */
+			if (opt != FTP_CLIENT_SOCKDATA)
+				ftpClientSockProfile(nControl->handle, nControl->sockControl, nControl->sockBufSize,
+					nControl->sockTimeout);
+			rv = 1;
+		}
+		break;
+
+		case FTP_CLIENT_METACACHE:
+		{
+			if (val == 0) {
+				metaFlush(nControl);
+				free(nControl->meta);
+				nControl->meta = NULL;
+				nControl->metaTtl = 0;
+				rv = 1;
+			}
+			else if (val > 0) {
+				if (nControl->meta == NULL)
+					nControl->meta = calloc(FTP_CLIENT_METACACHE_ENTRIES, sizeof(MetaEntry_t));
+				if (nControl->meta != NULL) {
+					nControl->metaTtl = val;
+					rv = 1;
+				}
+				else
+					snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(ENOMEM));
+			}
+		}
+		break;
+	}
+	return rv;
+}
+
+
+
+/*
+ * poolAlive - check an idle session of the pool
+ *
+ * A server that timed out the session has sent 421 or closed it, which
+ * leaves the socket readable. Sessions idle for longer than
+ * FTP_CLIENT_POOL_NOOP_AFTER are also asked for a NOOP.
+ *
+ * return 1 if the session can be used, 0 otherwise
+ */
+static int poolAlive(NetBuf_t* nControl, int64_t idleMs)
+{
+	fd_set rfd;
+	struct timeval tv = { 0, 0 };
+	FD_ZERO(&rfd);
+	FD_SET(nControl->handle, &rfd);
+	if (select(nControl->handle + 1, &rfd, NULL, NULL, &tv) != 0)
+		return 0;
+	if (idleMs < FTP_CLIENT_POOL_NOOP_AFTER)
+		return 1;
+	return sendCommand("NOOP", '2', nControl);
+}
+
+
+
+/*
+ * poolDrop - close a session taken out of the pool
+ *
+ * A dead session is closed without QUIT.
+ */
+static void poolDrop(NetBuf_t* nControl, int alive)
+{
+	if (alive) {
+		quitFtpClient(nControl);
+		return;
+	}
+	statsFold(nControl);
+	closesocket(nControl->handle);
+	ftpClientPortMutexDelete(nControl->lock);
+	free(nControl->meta);
+	free(nControl->buf);
+	free(nControl);
+}
+
+
+
+/*
+ * poolAcquireFtpClient - get a logged in session from the pool
+ *
+ * An idle session with the same host, port and login is reused as is,
+ * including its transfer type, working directory and options. Otherwise
+ * a new session is connected and logged in.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int poolAcquireFtpClient(const char* host, uint16_t port, const char* user,
+	const char* pass, NetBuf_t** nControl)
+{
+	NetBuf_t* expired[FTP_CLIENT_POOL_SIZE];
+	int nexpired = 0;
+	NetBuf_t* ctrl = NULL;
+	int64_t idleMs = 0;
+	int64_t now = ftpClientPortTimeUs() / 1000;
+
+	ftpClientPortMutexLock(poolLock);
+	for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++) {
+		PoolEntry_t* e = &pool[i];
+		if ((e->nControl == NULL) || e->inUse)
+			continue;
+		if ((now - e->lastUsed) > FTP_CLIENT_POOL_IDLE_TTL) {
+			expired[nexpired++] = e->nControl;
+			e->nControl = NULL;
+			poolStats.expired++;
+			continue;
+		}
+		if ((ctrl == NULL) && (e->nControl->port == port) &&
+				(strcmp(e->nControl->host, host) == 0) &&
+				(strcmp(e->nControl->user, user) == 0) &&
+				(strcmp(e->nControl->pass, pass) == 0)) {
+			e->inUse = 1;
+			ctrl = e->nControl;
+			idleMs = now - e->lastUsed;
+		}
+	}
+	ftpClientPortMutexUnlock(poolLock);
+
+	for (int i = 0; i < nexpired; i++)
+		poolDrop(expired[i], 1);
+
+	if (ctrl != NULL) {
+		if (poolAlive(ctrl, idleMs)) {
+			ftpClientPortMutexLock(poolLock);
+			poolStats.hits++;
+			ftpClientPortMutexUnlock(poolLock);
+			*nControl = ctrl;
+			return 1;
+		}
+		ftpClientPortMutexLock(poolLock);
+		for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++)
+			if (pool[i].nControl == ctrl)
+				pool[i].nControl = NULL;
+		poolStats.reconnects++;
+		ftpClientPortMutexUnlock(poolLock);
+		poolDrop(ctrl, 0);
+		ctrl = NULL;
+	}
+
+	if (!connectFtpClient(host, port, &ctrl))
+		return 0;
+	if (!loginFtpClient(user, pass, ctrl)) {
+		ESP_LOGD(__FUNCTION__, "login failed: %s", ctrl->response);
+		quitFtpClient(ctrl);
+		return 0;
+	}
+	ftpClientPortMutexLock(poolLock);
+	poolStats.misses++;
+	for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++) {
+		if (pool[i].nControl == NULL) {
+			pool[i].nControl = ctrl;
+			pool[i].inUse = 1;
+			break;
+		}
+	}
+	ftpClientPortMutexUnlock(poolLock);
+	*nControl = ctrl;
+	return 1;
+}
+
+
+
+/*
+ * poolReleaseFtpClient - return a session to the pool
+ *
+ * The session stays logged in until it is acquired again or reaches
+ * FTP_CLIENT_POOL_IDLE_TTL. Sessions that did not fit into the pool are
+ * closed.
+ */
+static void poolReleaseFtpClient(NetBuf_t* nControl)
+{
+	if (nControl->dir != FTP_CLIENT_CONTROL)
+		return;
+	clearCallbackFtpClient(nControl);
+	statsFold(nControl);
+	int pooled = 0;
+	ftpClientPortMutexLock(poolLock);
+	for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++) {
+		if (pool[i].nControl == nControl) {
+			pool[i].inUse = 0;
+			pool[i].lastUsed = ftpClientPortTimeUs() / 1000;
+			pooled = 1;
+			break;
+		}
+	}
+	ftpClientPortMutexUnlock(poolLock);
+	if (!pooled)
+		quitFtpClient(nControl);
+}
+
+
+
+/*
+ * poolFlushFtpClient - close all idle sessions of the pool
+ */
+static void poolFlushFtpClient(void)
+{
+	NetBuf_t* idle[FTP_CLIENT_POOL_SIZE];
+	int nidle = 0;
+	ftpClientPortMutexLock(poolLock);
+	for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++) {
+		if ((pool[i].nControl != NULL) && !pool[i].inUse) {
+			idle[nidle++] = pool[i].nControl;
+			pool[i].nControl = NULL;
+		}
+	}
+	ftpClientPortMutexUnlock(poolLock);
+	for (int i = 0; i < nidle; i++)
+		poolDrop(idle[i], 1);
+}
+
+
+
+/*
+ * poolGetStatsFtpClient - counters of the connection pool
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int poolGetStatsFtpClient(FtpClientPoolStats_t* stats)
+{
+	if (stats == NULL)
+		return 0;
+	ftpClientPortMutexLock(poolLock);
+	*stats = poolStats;
+	stats->idle = stats->inUse = 0;
+	for (int i = 0; i < FTP_CLIENT_POOL_SIZE; i++) {
+		if (pool[i].nControl == NULL)
+			continue;
+		if (pool[i].inUse)
+			stats->inUse++;
+		else
+			stats->idle++;
+	}
+	ftpClientPortMutexUnlock(poolLock);
+	return 1;
+}
+
+
+
+/*
+ * memGetStatsFtpClient - sizes and high-water marks of the memory pools
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int memGetStatsFtpClient(FtpClientMemStats_t* stats)
+{
+	if (stats == NULL)
+		return 0;
+	ftpClientPortMutexLock(netBufLock);
+	*stats = netBufStats;
+	ftpClientPortMutexUnlock(netBufLock);
+	stats->netBufs = FTP_CLIENT_NETBUF_POOL_SIZE;
+	stats->netBufSize = sizeof(NetBufSlot_t);
+	stats->controlSize = sizeof(NetBuf_t);
+	ftpClientMemGetStats(stats->classes);
+	return 1;
+}
+
+
+
+/*
+ * memReserveFtpClient - allocate data buffers before the heap fragments
+ *
+ * The blocks stay with the pool, ftpClientMemFlush() keeps them.
+ *
+ * return number of blocks added
+ */
+static int memReserveFtpClient(int size, int count)
+{
+	return ftpClientMemReserve(size, count);
+}
+
+
+
+/*
+ * memFlushFtpClient - give the cached data buffers back to the heap
+ */
+static void memFlushFtpClient(void)
+{
+	ftpClientMemFlush();
+}
+
+
+
+/*
+ * changeDirFtpClient - change path at remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int changeDirFtpClient(const char* path, NetBuf_t* nControl)
+{
+	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(path) + 6) > sizeof(buf))
+		return 0;
+	if (nControl->cwdFrom && (path[0] == '/') && (strcmp(path, nControl->cwd) == 0)) {
+		nControl->rttSaved++;
+		return 1;
+	}
+	sprintf(buf, "CWD %s", path);
+	if (!sendCommand(buf, '2', nControl)) {
+		nControl->cwdFrom = 0;
+		return 0;
+	}
+	/* only an absolute path tells where we are without a PWD */
+	if ((path[0] == '/') && (strlen(path) < sizeof(nControl->cwd))) {
+		strcpy(nControl->cwd, path);
+		nControl->cwdFrom = 'C';
+	}
+	else
+		nControl->cwdFrom = 0;
+	return 1;
+}
+
+
+
+/*
+ * makeDirFtpClient - create a directory at server
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int makeDirFtpClient(const char* path, NetBuf_t* nControl)
+{
+	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(path) + 6) > sizeof(buf))
+		return 0;
+	metaForget(path, nControl);
+	sprintf(buf, "MKD %s", path);
+	if (!sendCommand(buf, '2', nControl))
+		return 0;
+	else
+		return 1;
+}
+
+
+
+/*
+ * removeDirFtpClient - remove directory at remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int removeDirFtpClient(const char* path, NetBuf_t* nControl)
+{
+	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(path) + 6) > sizeof(buf))
+		return 0;
+	metaForget(path, nControl);
+	sprintf(buf, "RMD %s", path);
+	if (!sendCommand(buf,'2',nControl))
+		return 0;
+	else
+		return 1;
+}
+
+
+
+/*
+ * dirFtpClient - issue a LIST command and write response to output
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int dirFtpClient(const char* outputfile, const char* path, NetBuf_t* nControl)
+{
+	return xfer(outputfile, path, nControl, FTP_CLIENT_DIR_VERBOSE, FTP_CLIENT_ASCII);
+}
+
+
+
+/*
+ * nlstFtpClient - issue an NLST command and write response to output
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int nlstFtpClient(const char* outputfile, const char* path,
+	NetBuf_t* nControl)
+{
+	return xfer(outputfile, path, nControl, FTP_CLIENT_DIR, FTP_CLIENT_ASCII);
+}
+
+
+
+/*
+ * nlstFtpClient - issue an MLSD command and write response to output
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int mlsdFtpClient(const char* outputfile, const char* path,
+	NetBuf_t* nControl)
+{
+	return xfer(outputfile, path, nControl, FTP_CLIENT_MLSD, FTP_CLIENT_ASCII);
+}
+
+
+
+/*
+ * listSinkWrite - parse listing data as it arrives
+ */
+static int listSinkWrite(const void* buf, int len, void* arg)
+{
+	return ftpClientListFeed(arg, buf, len) ? len : -1;
+}
+
+
+
+/*
+ * listMetaEntry - cache the size and the date of a listed file
+ */
+static int listMetaEntry(const FtpClientDirEntry_t* entry, void* arg)
+{
+	ListMeta_t* lm = arg;
+	if ((entry->type == FTP_CLIENT_ENTRY_FILE) &&
+			(entry->facts & (FTP_CLIENT_FACT_SIZE | FTP_CLIENT_FACT_MODIFY))) {
+		char modDate[FTP_CLIENT_METACACHE_DATE_SIZE] = "";
+		int facts = 0;
+		if (entry->facts & FTP_CLIENT_FACT_SIZE)
+			facts |= META_SIZE;
+		if (entry->facts & FTP_CLIENT_FACT_MODIFY) {
+			time_t t = entry->modify;
+			struct tm tm;
+			gmtime_r(&t, &tm);
+			strftime(modDate, sizeof(modDate), "%Y%m%d%H%M%S", &tm);
+			facts |= META_MODDATE;
+		}
+		metaStore(metaHash(lm->dir, entry->name, entry->nameLen), facts,
+			entry->size, modDate, lm->nControl);
+	}
+	return lm->cb(entry, lm->arg);
+}
+
+
+
+/*
+ * listFtpClient - issue MLSD, LIST or NLST and pass each entry to a callback
+ *
+ * The listing is parsed straight from the data connection. Stopping early
+ * from the callback is not an error.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int listFtpClient(const char* path, int format, FtpClientListCallback_t cb,
+	void* arg, NetBuf_t* nControl)
+{
+	/* MLSD facts are exact, the files of the listing go into the metadata cache */
+	ListMeta_t lm = { cb, arg, 0, nControl };
+	if (format == FTP_CLIENT_LIST_MLSD)
+		lm.dir = metaKey(path, nControl);
+	if (lm.dir) {
+		cb = listMetaEntry;
+		arg = &lm;
+	}
+	FtpClientListParser_t* lp = ftpClientListCreate(format, time(NULL), cb, arg);
+	if (lp == NULL) {
+		sprintf(nControl->response, "Invalid list format %d\n", format);
+		return 0;
+	}
+	int typ = FTP_CLIENT_DIR;
+	if (format == FTP_CLIENT_LIST_MLSD)
+		typ = FTP_CLIENT_MLSD;
+	else if (format == FTP_CLIENT_LIST_LIST)
+		typ = FTP_CLIENT_DIR_VERBOSE;
+	FtpClientSink_t sink = { NULL, listSinkWrite, lp };
+	int rv = xferSink(&sink, path, nControl, typ, FTP_CLIENT_ASCII);
+	int parsed = ftpClientListFinish(lp);
+	if (ftpClientListStopped(lp))
+		rv = 1;
+	else if (!parsed) {
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(ENOMEM));
+		rv = 0;
+	}
+	ftpClientListDelete(lp);
+	return rv;
+}
+
+
+
+/*
+ * changeDirUpFtpClient - move to parent directory at remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int changeDirUpFtpClient(NetBuf_t* nControl)
+{
+	nControl->cwdFrom = 0;
+	if (!sendCommand("CDUP", '2', nControl))
+		return 0;
+	else
+		return 1;
+}
+
+
+/*
+ * pwdFtpClient - get working directory at remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int pwdFtpClient(char* path, int max, NetBuf_t* nControl)
+{
+	if (nControl->cwdFrom == 'P') {
+		nControl->rttSaved++;
+		snprintf(path, max, "%s", nControl->cwd);
+		return 1;
+	}
+	if (!sendCommand("PWD",'2',nControl))
+		return 0;
+	char* s = strchr(nControl->response, '"');
+	if (s == NULL)
+		return 0;
+	s++;
+	int l = max;
+	char* b = path;
+	while ((--l) && (*s) && (*s != '"'))
+		*b++ = *s++;
+	*b++ = '\0';
+	/* a quote within the name is doubled, leave such paths uncached */
+	if ((*s == '"') && (s[1] != '"') && ((size_t)(b - path) <= sizeof(nControl->cwd))) {
+		strcpy(nControl->cwd, path);
+		nControl->cwdFrom = 'P';
+	}
 	return 1;
 }
 
 
 
 /*
- * write lines of text
+ * getDataFtpClient - issue a GET command and write received data to output
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getDataFtpClient(const char* outputfile, const char* path,
+		char mode, NetBuf_t* nControl)
+{
+	return xfer(outputfile, path, nControl, FTP_CLIENT_FILE_READ, mode);
+}
+
+
+
+/*
+ * segmentRun - download one byte range of a segmented GET
  *
- * return -1 on error or bytecount
+ * Segments without a control connection of their own open and log in
+ * a new one. A segment of length 0 runs to the end of the file.
  */
-static int writeLine(const char* buf, int len, NetBuf_t* nData)
+static void segmentRun(void* arg)
 {
-	if (nData->dir != FTP_CLIENT_WRITE)
-		return -1;
-	char* nbp = nData->buf;
-	int nb = 0;
-	int w = 0;
-	const char* ubp = buf;
-	char lc = 0;
-	int x = 0;
-
-	for (x = 0; x < len; x++) {
-		if ((*ubp == '\n') && (lc != '\r')) {
-			if (nb == FTP_CLIENT_BUFFER_SIZE) {
-				if (!socketWait(nData))
-					return x;
-				w = send(nData->handle, nbp, FTP_CLIENT_BUFFER_SIZE, 0);
-				if (w != FTP_CLIENT_BUFFER_SIZE) {
-					#if FTP_CLIENT_DEBUG
-					printf("Ftp client write line: net_write(1) returned %d, errno = %d\n",
-							w, errno);
-					#endif
-					return(-1);
-				}
-				nb = 0;
-			}
-			nbp[nb++] = '\r';
+	Segment_t* seg = arg;
+	NetBuf_t* main = seg->main;
+	NetBuf_t* nControl = seg->nControl;
+	seg->rv = 0;
+	if (nControl == NULL) {
+		if (!connectFtpClient(main->host, main->port, &nControl)) {
+			strcpy(seg->response, "Segment connect failed\n");
+			return;
 		}
-		if (nb == FTP_CLIENT_BUFFER_SIZE) {
-			if (!socketWait(nData))
-				return x;
-			w = send(nData->handle, nbp, FTP_CLIENT_BUFFER_SIZE, 0);
-			if (w != FTP_CLIENT_BUFFER_SIZE) {
-				#if FTP_CLIENT_DEBUG
-				printf("Ftp client write line: net_write(2) returned %d, errno = %d\n",
-						w, errno);
-				#endif
-				return(-1);
-			}
-			nb = 0;
+		nControl->cmode = main->cmode;
+		socketInherit(nControl, main);
+		nControl->rateFrom = main;
+		nControl->rateShare = main->rateShare;
+		if (!loginFtpClient(main->user, main->pass, nControl)) {
+			strcpy(seg->response, nControl->response);
+			quitFtpClient(nControl);
+			return;
 		}
-		nbp[nb++] = lc = *ubp++;
 	}
-	if (nb){
-		if (!socketWait(nData))
-			return x;
-		w = send(nData->handle, nbp, nb, 0);
-		if (w != nb) {
-			#if FTP_CLIENT_DEBUG
-			printf("Ftp client write line: net_write(3) returned %d, errno = %d\n",
-					w, errno);
-			#endif
-			return(-1);
+
+	NetBuf_t* nData;
+	char* buf = ftpClientMemAlloc(main->dbufsize, NULL);
+	nControl->restOffset = seg->offset;
+	if ((buf == NULL) ||
+			!accessFtpClient(seg->path, FTP_CLIENT_FILE_READ, FTP_CLIENT_IMAGE, nControl, &nData)) {
+		strcpy(seg->response, nControl->response);
+		ftpClientMemFree(buf);
+		if (nControl != seg->nControl)
+			quitFtpClient(nControl);
+		return;
+	}
+	uint64_t offset = seg->offset;
+	uint64_t left = seg->length;
+	int rv = 1;
+	while ((seg->length == 0) || (left > 0)) {
+		int max = main->dbufsize;
+		if ((seg->length != 0) && (left < (uint64_t)max))
+			max = (int)left;
+		int l = readFtpClient(buf, max, nData);
+		if (l <= 0)
+			break;
+		if (pwrite(seg->fd, buf, l, offset) != l) {
+			snprintf(seg->response, sizeof(seg->response), "%s", strerror(errno));
+			rv = 0;
+			break;
 		}
+		offset += l;
+		left -= l;
 	}
-	return len;
+	if ((((seg->length != 0) && (left != 0)) || nData->aborted) && rv) {
+		strcpy(seg->response, "Segment ended early\n");
+		rv = 0;
+	}
+	ftpClientMemFree(buf);
+	/* closing a range before its end makes the server abort the transfer */
+	closeFtpClient(nData);
+	if (nControl != seg->nControl)
+		quitFtpClient(nControl);
+	seg->rv = rv;
 }
 
 
 
 /*
- * acceptConnection - accept connection from server
+ * getSegmentedFtpClient - download a file over several connections
+ *
+ * The file is split into FTP_CLIENT_SEGMENTS byte ranges. Each range but
+ * the last is fetched with REST+RETR over a connection of its own and
+ * written at its offset of the local file; the last one uses nControl.
+ * A single stream is used for ASCII mode, compressed or hashed transfers,
+ * small files and servers that do not support SIZE or REST.
  *
  * return 1 if successful, 0 otherwise
  */
-static int acceptConnection(NetBuf_t* nData, NetBuf_t* nControl)
+static int getSegmentedFtpClient(const char* outputfile, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	int rv = 0;
-	fd_set mask;
-	FD_ZERO(&mask);
-	FD_SET(nControl->handle, &mask);
-	FD_SET(nData->handle, &mask);
-	struct timeval tv;
-	tv.tv_usec = 0;
-	tv.tv_sec = FTP_CLIENT_ACCEPT_TIMEOUT ;
-	int i = nControl->handle;
-	if (i < nData->handle)
-		i = nData->handle;
-	i = select(i+1, &mask, NULL, NULL, &tv);
-	if (i == -1) {
-		strncpy(nControl->response, strerror(errno),
-				sizeof(nControl->response));
-		closesocket(nData->handle);
-		nData->handle = 0;
-		rv = 0;
+	unsigned int size;
+	int segments = nControl->segments;
+	if ((segments <= 1) || (mode != FTP_CLIENT_IMAGE) || (outputfile == NULL) ||
+			nControl->compress || nControl->hashAlg || !sizeCommand(path, &size, FTP_CLIENT_IMAGE, nControl))
+		return getDataFtpClient(outputfile, path, mode, nControl);
+	if (size / segments < FTP_CLIENT_SEGMENT_MIN_SIZE)
+		segments = size / FTP_CLIENT_SEGMENT_MIN_SIZE;
+	if ((segments <= 1) || !sendCommand("REST 0", '3', nControl))
+		return getDataFtpClient(outputfile, path, mode, nControl);
+
+	int fd = open(outputfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+		return 0;
 	}
-	else if (i == 0) {
-		strcpy(nControl->response, "FTP Client accept connection "
-				"timed out waiting for connection");
-		closesocket(nData->handle);
-		nData->handle = 0;
-		rv = 0;
+	Segment_t* seg = calloc(segments, sizeof(Segment_t));
+	FtpClientPortThread_t* workers[FTP_CLIENT_SEGMENTS_MAX];
+	if (seg == NULL) {
+		close(fd);
+		unlink(outputfile);
+		return 0;
 	}
-	else {
-		if (FD_ISSET(nData->handle, &mask)) {
-			struct sockaddr addr;
-			//unsigned int l = sizeof(addr);
-			socklen_t l = sizeof(addr);
-			int sData = accept(nData->handle, &addr, &l);
-			i = errno;
-			closesocket(nData->handle);
-			if (sData > 0) {
-				rv = 1;
-				nData->handle = sData;
-			}
-			else {
-				strncpy(nControl->response, strerror(i),
-								sizeof(nControl->response));
-				nData->handle = 0;
-				rv = 0;
-			}
+	uint64_t step = size / segments;
+	for (int i = 0; i < segments; i++) {
+		seg[i].main = nControl;
+		seg[i].path = path;
+		seg[i].fd = fd;
+		seg[i].offset = step * i;
+		seg[i].length = (i == segments - 1) ? 0 : step;
+		workers[i] = NULL;
+	}
+	seg[segments - 1].nControl = nControl;
+	/* the connections split the rate limit of the session */
+	nControl->rateShare = segments;
+	for (int i = 0; i < segments - 1; i++) {
+		workers[i] = ftpClientPortThreadCreate(segmentRun, &seg[i],
+			"ftpSegment", FTP_CLIENT_SEGMENT_STACK_SIZE, 0);
+		if (workers[i] == NULL) {
+			/* no task for this range, fetch it here */
+			segmentRun(&seg[i]);
 		}
-		else if (FD_ISSET(nControl->handle, &mask)) {
-			closesocket(nData->handle);
-			nData->handle = 0;
-			readResponse('2', nControl);
+	}
+	segmentRun(&seg[segments - 1]);
+
+	int rv = 1;
+	for (int i = 0; i < segments; i++) {
+		if (workers[i])
+			ftpClientPortThreadJoin(workers[i]);
+		if (!seg[i].rv) {
+			if (rv)
+				strcpy(nControl->response, seg[i].response);
 			rv = 0;
 		}
 	}
+	nControl->rateShare = 1;
+	free(seg);
+	close(fd);
+	if (!rv)
+		unlink(outputfile);
 	return rv;
 }
 
 
 
 /*
- * siteFtpClient - send a SITE command
+ * putDataFtpClient - issue a PUT command and send data from input
  *
- * return 1 if command successful, 0 otherwise
+ * return 1 if successful, 0 otherwise
  */
-static int siteFtpClient(const char* cmd, NetBuf_t* nControl)
+static int putDataFtpClient(const char* inputfile, const char* path, char mode,
+	NetBuf_t* nControl)
 {
-	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(cmd) + 7) > sizeof(buf))
+	return xfer(inputfile, path, nControl, FTP_CLIENT_FILE_WRITE, mode);
+}
+
+
+
+/*
+ * resumeFtpClient - continue the interrupted transfer of a local file
+ *
+ * The remote path and direction are taken from the journal left next to
+ * the local file by a resumable GET or PUT.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int resumeFtpClient(const char* localfile, NetBuf_t* nControl)
+{
+	char journal[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	char path[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	char op, mode;
+	uint64_t offset;
+	int l = snprintf(journal, sizeof(journal), "%s%s", localfile, FTP_CLIENT_JOURNAL_SUFFIX);
+	if ((l < 0) || ((size_t)l >= sizeof(journal)) ||
+			!journalRead(journal, &op, &mode, &offset, path, sizeof(path))) {
+		sprintf(nControl->response, "No journal for %.900s\n", localfile);
 		return 0;
-	sprintf(buf, "SITE %s", cmd);
-	if (!sendCommand(buf, '2', nControl))
+	}
+	int typ = (op == 'G') ? FTP_CLIENT_FILE_READ : FTP_CLIENT_FILE_WRITE;
+	return xferResume(localfile, path, nControl, typ, mode);
+}
+
+
+
+/*
+ * deleteFtpClient - delete a file at remote
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int deleteDataFtpClient(const char* fnm, NetBuf_t* nControl)
+{
+	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if ((strlen(fnm) + 7) > sizeof(cmd))
+		return 0;
+	metaForget(fnm, nControl);
+	sprintf(cmd, "DELE %s", fnm);
+	if(!sendCommand(cmd, '2', nControl))
 		return 0;
 	else
 		return 1;
@@ -689,493 +4213,1002 @@ static int siteFtpClient(const char* cmd, NetBuf_t* nControl)
 
 
 /*
- * getLastResponseFtpClient - return a pointer to the last response received
+ * renameFtpClient - rename a file at remote
+ *
+ * return 1 if successful, 0 otherwise
  */
-static char* getLastResponseFtpClient(NetBuf_t* nControl)
+static int renameFtpClient(const char* src, const char* dst, NetBuf_t* nControl)
 {
-	if ((nControl) && (nControl->dir == FTP_CLIENT_CONTROL))
-		return nControl->response;
+	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
+	if (((strlen(src) + 7) > sizeof(cmd)) ||
+		((strlen(dst) + 7) > sizeof(cmd)))
+		return 0;
+	/* an uncached source may be a directory with cached files below it */
+	if (!metaForget(src, nControl))
+		metaFlush(nControl);
+	metaForget(dst, nControl);
+	sprintf(cmd, "RNFR %s", src);
+	if (!sendCommand(cmd, '3', nControl))
+		return 0;
+	sprintf(cmd,"RNTO %s",dst);
+	if (!sendCommand(cmd, '2', nControl))
+		return 0;
 	else
-		return NULL;
+		return 1;
 }
 
 
 
 /*
- * getSysTypeFtpClient - send a SYST command
- *
- * Fills in the user buffer with the remote system type.  If more
- * information from the response is required, the user can parse
- * it out of the response buffer returned by FtpLastResponse().
+ * batchLines - format the command lines of a batch command
  *
- * return 1 if command successful, 0 otherwise
+ * return number of replies to expect, 0 if the command does not fit
  */
-static int getSysTypeFtpClient(char* buf, int max, NetBuf_t* nControl)
+static int batchLines(const FtpClientBatchCmd_t* cmd, char* buf, int max)
 {
-	if (!sendCommand("SYST", '2', nControl))
+	const char* verb;
+	switch (cmd->op) {
+		case FTP_CLIENT_BATCH_DELE: verb = "DELE"; break;
+		case FTP_CLIENT_BATCH_MKD: verb = "MKD"; break;
+		case FTP_CLIENT_BATCH_RMD: verb = "RMD"; break;
+		case FTP_CLIENT_BATCH_SIZE: verb = "SIZE"; break;
+		case FTP_CLIENT_BATCH_MDTM: verb = "MDTM"; break;
+		case FTP_CLIENT_BATCH_RENAME: verb = "RNFR"; break;
+		case FTP_CLIENT_BATCH_SITE: verb = "SITE"; break;
+		default: return 0;
+	}
+	if ((cmd->arg == NULL) || ((cmd->op == FTP_CLIENT_BATCH_RENAME) && (cmd->arg2 == NULL)))
 		return 0;
-	char* s = &nControl->response[4];
-	int l = max;
-	char* b = buf;
-	while ((--l) && (*s != ' '))
-		*b++ = *s++;
-	*b++ = '\0';
+	int l = snprintf(buf, max, "%s %s\r\n", verb, cmd->arg);
+	if ((l >= max) || (l >= FTP_CLIENT_TEMP_BUFFER_SIZE))
+		return 0;
+	if (cmd->op != FTP_CLIENT_BATCH_RENAME)
+		return 1;
+	int l2 = snprintf(buf + l, max - l, "RNTO %s\r\n", cmd->arg2);
+	if ((l2 >= (max - l)) || (l2 >= FTP_CLIENT_TEMP_BUFFER_SIZE))
+		return 0;
+	return 2;
+}
+
+
+
+/*
+ * batchResult - store the reply to a batch command line
+ *
+ * second is set for the RNTO line of a rename.
+ */
+static void batchResult(FtpClientBatchCmd_t* cmd, int second, NetBuf_t* nControl)
+{
+	char expresp = ((cmd->op == FTP_CLIENT_BATCH_RENAME) && !second) ? '3' : '2';
+	int ok = (nControl->response[0] == expresp);
+	cmd->code = atoi(nControl->response);
+	cmd->result = second ? (cmd->result && ok) : ok;
+	if (!ok)
+		return;
+	if (cmd->op == FTP_CLIENT_BATCH_SIZE) {
+		int resp;
+		if (sscanf(nControl->response, "%d %u", &resp, &cmd->size) != 2)
+			cmd->result = 0;
+	}
+	else if (cmd->op == FTP_CLIENT_BATCH_MDTM) {
+		snprintf(cmd->modDate, sizeof(cmd->modDate), "%.14s", &nControl->response[4]);
+	}
+}
+
+
+
+/*
+ * replyWait - wait until a reply is available on the control connection
+ *
+ * return 1 if data is available, 0 on timeout or error
+ */
+static int replyWait(NetBuf_t* nControl, int ms)
+{
+	if (nControl->cavail > 0)
+		return 1;
+	fd_set rfd;
+	struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+	FD_ZERO(&rfd);
+	FD_SET(nControl->handle, &rfd);
+	return netSelect(nControl, nControl->handle + 1, &rfd, NULL, &tv) > 0;
+}
+
+
+
+/*
+ * batchResync - recover when pipelined replies stop coming
+ *
+ * Some servers drop the commands that arrive together with an earlier
+ * one. SYST is sent as a marker: the replies before its 215 belong to the
+ * pending commands, the commands left without a reply were not executed.
+ *
+ * return index of the first command without a reply, -1 if the
+ * connection is lost
+ */
+static int batchResync(FtpClientBatchCmd_t* cmds, int first, int last,
+	int second, NetBuf_t* nControl)
+{
+	if (netSend(nControl, "SYST\r\n", 6) != 6)
+		return -1;
+	int i = first;
+	while (1) {
+		nControl->response[0] = '\0';
+		if (!replyWait(nControl, FTP_CLIENT_CMD_TIMEOUT) ||
+				(!readResponse('2', nControl) && (nControl->response[0] == '\0')))
+			return -1;
+		if (strncmp(nControl->response, "215", 3) == 0)
+			break;
+		if (i == last)
+			continue;
+		/* a late reply, it belongs to the next pending command */
+		batchResult(&cmds[i], second, nControl);
+		if ((cmds[i].op == FTP_CLIENT_BATCH_RENAME) && !second)
+			second = 1;
+		else {
+			second = 0;
+			i++;
+		}
+	}
+	/* a rename with only the RNFR answered runs again */
+	return i;
+}
+
+
+
+/*
+ * batchSend - write command lines to the control connection
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int batchSend(const char* buf, int len, NetBuf_t* nControl)
+{
+	int done = 0;
+	while (done < len) {
+		int w = netSend(nControl, buf + done, len - done);
+		if (w <= 0) {
+			#if FTP_CLIENT_DEBUG
+			perror("FTP Client batch: write");
+			#endif
+			return 0;
+		}
+		done += w;
+	}
 	return 1;
 }
 
 
 
 /*
- * getFileSizeFtpClient - determine the size of a remote file
+ * batchFtpClient - run many commands with few round trips
+ *
+ * Up to FTP_CLIENT_CMDPIPELINE commands are written with one send() and
+ * their replies are read in order. When the server stops answering
+ * pipelined commands the session falls back to one command at a time.
+ * The outcome of each command is stored in its entry of cmds.
+ *
+ * return 1 if all commands were successful, 0 otherwise
+ */
+static int batchFtpClient(FtpClientBatchCmd_t* cmds, int count, NetBuf_t* nControl)
+{
+	if (nControl->dir != FTP_CLIENT_CONTROL)
+		return 0;
+	for (int i = 0; i < count; i++) {
+		cmds[i].result = 0;
+		cmds[i].code = 0;
+	}
+	for (int i = 0; i < count; i++) {
+		if ((cmds[i].op == FTP_CLIENT_BATCH_SIZE) && !setType(FTP_CLIENT_IMAGE, nControl))
+			return 0;
+	}
+	/* no PWD can be sent between pipelined commands, resolve the paths first */
+	for (int i = 0; i < count; i++) {
+		if ((cmds[i].op == FTP_CLIENT_BATCH_DELE) || (cmds[i].op == FTP_CLIENT_BATCH_MKD) ||
+				(cmds[i].op == FTP_CLIENT_BATCH_RMD))
+			metaForget(cmds[i].arg, nControl);
+		else if (cmds[i].op == FTP_CLIENT_BATCH_RENAME) {
+			if (!metaForget(cmds[i].arg, nControl))
+				metaFlush(nControl);
+			metaForget(cmds[i].arg2, nControl);
+		}
+	}
+	int max = FTP_CLIENT_TEMP_BUFFER_SIZE * 4;
+	char* buf = malloc(max);
+	if (buf == NULL) {
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(errno));
+		return 0;
+	}
+
+	int all = 1;
+	int i = 0;
+	while (i < count) {
+		/* fill one window */
+		int window = (nControl->cmdWindow > 1) ? nControl->cmdWindow : 1;
+		int len = 0;
+		int n = 0;
+		while ((n < window) && ((i + n) < count)) {
+			int l = batchLines(&cmds[i + n], buf + len, max - len);
+			if (l == 0) {
+				if (n > 0)
+					break;
+				/* invalid or too long, skip it */
+				sprintf(nControl->response, "Invalid batch command %d\n", i);
+				all = 0;
+				i++;
+				continue;
+			}
+			len += strlen(buf + len);
+			n++;
+		}
+		if (n == 0)
+			continue;
+
+		#if FTP_CLIENT_DEBUG == 2
+		printf("FTP Client batch: %d commands\n\r", n);
+		#endif
+		/* in lock-step even RNTO waits for the reply to RNFR */
+		char* line = buf;
+		if ((window > 1) && !batchSend(buf, len, nControl)) {
+			free(buf);
+			return 0;
+		}
+
+		int j = i;
+		int second = 0;
+		while (j < (i + n)) {
+			if (window == 1) {
+				char* eol = strchr(line, '\n') + 1;
+				if (!batchSend(line, eol - line, nControl)) {
+					free(buf);
+					return 0;
+				}
+				line = eol;
+			}
+			else if (!replyWait(nControl, FTP_CLIENT_CMD_TIMEOUT)) {
+				ESP_LOGD(__FUNCTION__, "no pipelined reply, fall back to lock-step");
+				nControl->cmdWindow = 0;
+				int next = batchResync(cmds, j, i + n, second, nControl);
+				if (next < 0) {
+					stateClear(nControl);
+					free(buf);
+					return 0;
+				}
+				for (; j < next; j++)
+					all = all && cmds[j].result;
+				/* the dropped commands are sent again */
+				nControl->stats.retries += (i + n) - next;
+				n = next - i;
+				break;
+			}
+			/* the server holds back replies until the previous one is acked */
+			if (window > 1)
+				ftpClientSockQuickAck(nControl->handle);
+			nControl->response[0] = '\0';
+			readResponse('2', nControl);
+			if (nControl->response[0] == '\0') {
+				free(buf);
+				return 0;
+			}
+			batchResult(&cmds[j], second, nControl);
+			if ((cmds[j].op == FTP_CLIENT_BATCH_RENAME) && !second) {
+				second = 1;
+				continue;
+			}
+			second = 0;
+			all = all && cmds[j].result;
+			j++;
+		}
+		i += n;
+	}
+	free(buf);
+	for (int i = 0; i < count; i++) {
+		if (!cmds[i].result)
+			continue;
+		if (cmds[i].op == FTP_CLIENT_BATCH_SIZE)
+			metaStore(metaKey(cmds[i].arg, nControl), META_SIZE, cmds[i].size, NULL, nControl);
+		else if (cmds[i].op == FTP_CLIENT_BATCH_MDTM)
+			metaStore(metaKey(cmds[i].arg, nControl), META_MODDATE, 0, cmds[i].modDate, nControl);
+	}
+	return all;
+}
+
+
+
+/*
+ * mirrorAdd - add an entry to a listing
+ *
+ * Names are kept in one growing buffer, so there is no malloc per entry.
  *
  * return 1 if successful, 0 otherwise
  */
-static int getFileSizeFtpClient(const char* path,
-		unsigned int* size, char mode, NetBuf_t* nControl)
+static int mirrorAdd(MirrorList_t* l, const char* name, size_t len, int type,
+	uint64_t size, uint32_t mtime)
 {
-	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(path) + 7) > sizeof(cmd))
-		return 0;
-	sprintf(cmd, "TYPE %c", mode);
-	if (!sendCommand(cmd, '2', nControl))
-		return 0;
-	int rv = 1;
-	sprintf(cmd,"SIZE %s", path);
-	if(!sendCommand(cmd, '2', nControl))
-		rv = 0;
-	else {
-		int resp;
-		unsigned int sz;
-		if (sscanf(nControl->response, "%d %u", &resp, &sz) == 2)
-			*size = sz;
-		else
-			rv = 0;
+	if (l->count == l->max) {
+		int max = l->max ? l->max * 2 : 32;
+		MirrorEntry_t* e = realloc(l->e, max * sizeof(MirrorEntry_t));
+		if (e == NULL) {
+			l->nomem = 1;
+			return 0;
+		}
+		l->e = e;
+		l->max = max;
 	}
-	return rv;
+	if (l->size - l->used < len + 1) {
+		size_t size = l->size ? l->size * 2 : 1024;
+		while (size - l->used < len + 1)
+			size *= 2;
+		char* names = realloc(l->names, size);
+		if (names == NULL) {
+			l->nomem = 1;
+			return 0;
+		}
+		l->names = names;
+		l->size = size;
+	}
+	MirrorEntry_t* e = &l->e[l->count++];
+	memset(e, 0, sizeof(*e));
+	e->off = l->used;
+	e->size = size;
+	e->mtime = mtime;
+	e->type = type;
+	e->match = -1;
+	memcpy(l->names + l->used, name, len);
+	l->names[l->used + len] = '\0';
+	l->used += len + 1;
+	return 1;
+}
+
+
+
+static int mirrorCompare(const void* a, const void* b)
+{
+	return strcmp(((const MirrorEntry_t*)a)->name, ((const MirrorEntry_t*)b)->name);
 }
 
 
 
 /*
- * getModDateFtpClient - determine the modification date of a remote file
- *
- * return 1 if successful, 0 otherwise
+ * mirrorResolve - point the entries at their names, the buffer no longer moves
  */
-static int getModDateFtpClient(const char* path, char* dt,
-		int max, NetBuf_t* nControl)
+static void mirrorResolve(MirrorList_t* l)
 {
-	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(path) + 7) > sizeof(buf))
-		return 0;
-	sprintf(buf, "MDTM %s", path);
-	int rv = 1;
-	if (!sendCommand(buf, '2', nControl))
-		rv = 0;
-	else
-		strncpy(dt, &nControl->response[4], max);
-	return rv;
+	for (int i = 0; i < l->count; i++)
+		l->e[i].name = l->names + l->e[i].off;
 }
 
 
 
-static int setCallbackFtpClient(const FtpClientCallbackOptions_t* opt, NetBuf_t* nControl)
+static void mirrorListFree(MirrorList_t* l)
 {
-   nControl->idlecb = opt->cbFunc;
-   nControl->idlearg = opt->cbArg;
-   nControl->idletime.tv_sec = opt->idleTime / 1000;
-   nControl->idletime.tv_usec = (opt->idleTime % 1000) * 1000;
-   nControl->cbbytes = opt->bytesXferred;
-   return 1;
+	free(l->e);
+	free(l->names);
+	memset(l, 0, sizeof(*l));
 }
 
 
 
-static int clearCallbackFtpClient(NetBuf_t* nControl)
+/*
+ * mirrorRemoteEntry - collect an entry of ftpClientList()
+ */
+static int mirrorRemoteEntry(const FtpClientDirEntry_t* entry, void* arg)
 {
-   nControl->idlecb = NULL;
-   nControl->idlearg = NULL;
-   nControl->idletime.tv_sec = 0;
-   nControl->idletime.tv_usec = 0;
-   nControl->cbbytes = 0;
-   return 1;
+	if (entry->type == FTP_CLIENT_ENTRY_UNKNOWN)
+		return 1;
+	return mirrorAdd(arg, entry->name, entry->nameLen, entry->type, entry->size,
+		(entry->facts & FTP_CLIENT_FACT_MODIFY) ? entry->modify : 0);
 }
 
 
 
 /*
- * connect - connect to remote server
+ * mirrorListRemote - list a remote directory, with MLSD if the server has it
  *
- * return 1 if connected, 0 if not
+ * return 1 if successful, -1 if the directory does not exist, 0 otherwise
  */
-static int connectFtpClient(const char* host, uint16_t port, NetBuf_t** nControl)
+static int mirrorListRemote(Mirror_t* m, const char* path, MirrorList_t* l)
 {
-	ESP_LOGD(__FUNCTION__, "host=%s", host);
-	struct sockaddr_in sin;
-	memset(&sin,0, sizeof(sin));
-	sin.sin_family = AF_INET;
-	sin.sin_port = htons(port);
-	sin.sin_addr.s_addr = inet_addr(host);
-	ESP_LOGD(__FUNCTION__, "sin.sin_addr.s_addr=%"PRIx32, sin.sin_addr.s_addr);
-	if (sin.sin_addr.s_addr == 0xffffffff) {
-		struct hostent *hp;
-		hp = gethostbyname(host);
-		if (hp == NULL) {
-			#if FTP_CLIENT_DEBUG
-			perror("FTP Client Error: Connect, gethostbyname");
-			#endif
-			return 0;
-		}
-		struct ip4_addr *ip4_addr;
-		ip4_addr = (struct ip4_addr *)hp->h_addr;
-		sin.sin_addr.s_addr = ip4_addr->addr;
-		ESP_LOGD(__FUNCTION__, "sin.sin_addr.s_addr=%"PRIx32, sin.sin_addr.s_addr);
-	}
-
-	int sControl = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-	ESP_LOGD(__FUNCTION__, "sControl=%d", sControl);
-	if (sControl == -1) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client Error: Connect, socket");
-		#endif
-		return 0;
-	}
-	if(connect(sControl, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client Error: Connect, connect");
-		#endif
-		closesocket(sControl);
-		return 0;
-	}
-	NetBuf_t* ctrl = calloc(1, sizeof(NetBuf_t));
-	if (ctrl == NULL) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client Error: Connect, calloc ctrl");
-		#endif
-		closesocket(sControl);
-		return 0;
+	NetBuf_t* nControl = m->nControl;
+	int rv = listFtpClient(path, m->listFormat, mirrorRemoteEntry, l, nControl);
+	if (!rv && (m->listFormat == FTP_CLIENT_LIST_MLSD) &&
+			(nControl->response[0] == '5') && (nControl->response[1] == '0')) {
+		/* 500, 501, 502 or 504, no MLSD */
+		m->listFormat = FTP_CLIENT_LIST_LIST;
+		l->count = 0;
+		l->used = 0;
+		rv = listFtpClient(path, m->listFormat, mirrorRemoteEntry, l, nControl);
 	}
-	ctrl->buf = malloc(FTP_CLIENT_BUFFER_SIZE);
-	if (ctrl->buf == NULL) {
-		#if FTP_CLIENT_DEBUG
-		perror("FTP Client Error: Connect, malloc ctrl->buf");
-		#endif
-		closesocket(sControl);
-		free(ctrl);
+	if (l->nomem) {
+		snprintf(nControl->response, sizeof(nControl->response), "%s", strerror(ENOMEM));
 		return 0;
 	}
-	ctrl->handle = sControl;
-	ctrl->dir = FTP_CLIENT_CONTROL;
-	ctrl->ctrl = NULL;
-	ctrl->data = NULL;
-	ctrl->cmode = FTP_CLIENT_DEFAULT_MODE;
-	ctrl->idlecb = NULL;
-	ctrl->idletime.tv_sec = ctrl->idletime.tv_usec = 0;
-	ctrl->idlearg = NULL;
-	ctrl->xfered = 0;
-	ctrl->xfered1 = 0;
-	ctrl->cbbytes = 0;
-	if (readResponse('2', ctrl) == 0) {
-		closesocket(sControl);
-		free(ctrl->buf);
-		free(ctrl);
-		return 0;
+	if (!rv && ((strncmp(nControl->response, "550", 3) == 0) ||
+			(strncmp(nControl->response, "450", 3) == 0)))
+		return -1;
+	if (m->listFormat == FTP_CLIENT_LIST_LIST) {
+		/* LIST shows minutes, or only the day for older files */
+		for (int i = 0; i < l->count; i++)
+			l->e[i].slack = (l->e[i].mtime % 86400) ? 60 : 86400;
 	}
-	*nControl = ctrl;
-	return 1;
+	return rv;
 }
 
+
+
 /*
- * login - log in to remote server
+ * mirrorListLocal - list a local directory
  *
- * return 1 if logged in, 0 otherwise
+ * return 1 if successful, -1 if the directory does not exist, 0 otherwise
  */
-static int loginFtpClient(const char* user, const char* pass, NetBuf_t* nControl)
+static int mirrorListLocal(const char* path, MirrorList_t* l)
 {
-	char tempbuf[64];
-	if (((strlen(user) + 7) > sizeof(tempbuf)) ||
-			((strlen(pass) + 7) > sizeof(tempbuf)))
-		return 0;
-	sprintf(tempbuf,"USER %s",user);
-	if (!sendCommand(tempbuf, '3', nControl)) {
-		if (nControl->response[0] == '2')
-			return 1;
-		return 0;
+	DIR* dir = opendir(path);
+	if (dir == NULL)
+		return (errno == ENOENT) ? -1 : 0;
+	char full[FTP_CLIENT_MIRROR_PATH_SIZE];
+	struct dirent* de;
+	int rv = 1;
+	while (rv && ((de = readdir(dir)) != NULL)) {
+		if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+			continue;
+		struct stat st;
+		int n = snprintf(full, sizeof(full), "%s/%s", path, de->d_name);
+		if ((n < 0) || ((size_t)n >= sizeof(full)) || (stat(full, &st) != 0))
+			continue;
+		if (S_ISDIR(st.st_mode))
+			rv = mirrorAdd(l, de->d_name, strlen(de->d_name), FTP_CLIENT_ENTRY_DIR, 0, 0);
+		else if (S_ISREG(st.st_mode))
+			rv = mirrorAdd(l, de->d_name, strlen(de->d_name), FTP_CLIENT_ENTRY_FILE,
+				st.st_size, (uint32_t)st.st_mtime);
 	}
-	sprintf(tempbuf, "PASS %s", pass);
-	return sendCommand(tempbuf, '2', nControl);
+	closedir(dir);
+	return rv;
 }
 
 
 
 /*
- * quitFtpClient - disconnect from remote
+ * mirrorReport - count a planned or finished action and tell the callback
  *
- * return 1 if successful, 0 otherwise
+ * result is 1 if done, 0 if failed and -1 if planned by a dry run.
  */
-static void quitFtpClient(NetBuf_t* nControl)
+static void mirrorReport(Mirror_t* m, int action, const char* local, const char* remote,
+	uint64_t size, int result)
 {
-	if (nControl->dir != FTP_CLIENT_CONTROL)
-		return;
-	sendCommand("QUIT", '2', nControl);
-	closesocket(nControl->handle);
-	free(nControl->buf);
-	free(nControl);
+	ftpClientPortMutexLock(m->lock);
+	if (result == 0)
+		m->stats->failed++;
+	else if (action == FTP_CLIENT_MIRROR_MKDIR)
+		m->stats->mkdirs++;
+	else {
+		m->stats->transfers++;
+		m->stats->bytes += size;
+	}
+	if (m->opt->cb) {
+		FtpClientMirrorItem_t item = { action, local, remote, size, result };
+		m->opt->cb(&item, m->opt->arg);
+	}
+	ftpClientPortMutexUnlock(m->lock);
 }
 
 
 
 /*
- * setOptionsFtpClient - change connection options
+ * mirrorTransfer - copy one file and give the copy the time of the source
  *
- * returns 1 if successful, 0 on error
+ * Remote times are set with MFMT where the server has it. Without it the
+ * remote copy is newer than the local file and still counts as unchanged.
  */
-static int setOptionsFtpClient(int opt, long val, NetBuf_t* nControl)
+static void mirrorTransfer(Mirror_t* m, MirrorJob_t* job, NetBuf_t* nControl)
 {
-	int v,rv = 0;
-	switch (opt)
-	{
-		case FTP_CLIENT_CONNMODE:
-		{
-			v = (int) val;
-			if ((v == FTP_CLIENT_PASSIVE)
-					|| (v == FTP_CLIENT_ACTIVE)) {
-				nControl->cmode = v;
-				rv = 1;
-			}
+	int rv = 0;
+	if ((nControl != NULL) && (m->opt->direction == FTP_CLIENT_MIRROR_UPLOAD)) {
+		rv = putDataFtpClient(job->local, job->remote, FTP_CLIENT_IMAGE, nControl);
+		if (rv && job->mtime && m->mfmt) {
+			char cmd[FTP_CLIENT_MIRROR_PATH_SIZE + 32];
+			time_t t = job->mtime;
+			struct tm tm;
+			gmtime_r(&t, &tm);
+			strftime(cmd, sizeof(cmd), "MFMT %Y%m%d%H%M%S ", &tm);
+			strncat(cmd, job->remote, sizeof(cmd) - strlen(cmd) - 1);
+			if (!sendCommand(cmd, '2', nControl) && (nControl->response[0] == '5') &&
+					(nControl->response[1] == '0'))
+				m->mfmt = 0;
 		}
-		break;
-
-		case FTP_CLIENT_CALLBACK:
-		{
-			nControl->idlecb = (FtpClientCallback_t) val;
-			rv = 1;
+	}
+	else if (nControl != NULL) {
+		rv = getDataFtpClient(job->local, job->remote, FTP_CLIENT_IMAGE, nControl);
+		if (rv && job->mtime) {
+			struct utimbuf ut = { job->mtime, job->mtime };
+			utime(job->local, &ut);
 		}
-		break;
+	}
+	mirrorReport(m, job->action, job->local, job->remote, job->size, rv);
+}
 
-		case FTP_CLIENT_IDLETIME:
-		{
-			v = (int) val;
-			rv = 1;
-			nControl->idletime.tv_sec = v / 1000;
-			nControl->idletime.tv_usec = (v % 1000) * 1000;
-		}
-		break;
 
-		case FTP_CLIENT_CALLBACKARG:
-		{
-			rv = 1;
-			nControl->idlearg = (void *) val;
-		}
-		break;
 
-		case FTP_CLIENT_CALLBACKBYTES:
-		{
-			rv = 1;
-			nControl->cbbytes = (int) val;
-		}
-		break;
+/*
+ * mirrorWorker - transfer queued files over a pooled connection
+ */
+static void mirrorWorker(void* arg)
+{
+	Mirror_t* m = arg;
+	NetBuf_t* main = m->nControl;
+	NetBuf_t* nControl = NULL;
+	if (poolAcquireFtpClient(main->host, main->port, main->user, main->pass, &nControl)) {
+		nControl->cmode = main->cmode;
+		socketInherit(nControl, main);
 	}
-	return rv;
+	else
+		nControl = NULL;
+	MirrorJob_t* job;
+	while ((job = ftpClientPortQueueReceive(m->jobs)) != NULL) {
+		mirrorTransfer(m, job, nControl);
+		free(job);
+	}
+	if (nControl != NULL)
+		poolReleaseFtpClient(nControl);
 }
 
 
 
 /*
- * changeDirFtpClient - change path at remote
- *
- * return 1 if successful, 0 otherwise
+ * mirrorFile - transfer a file that is new or changed
  */
-static int changeDirFtpClient(const char* path, NetBuf_t* nControl)
+static void mirrorFile(Mirror_t* m, int action, const MirrorEntry_t* src,
+	const char* local, const char* remote)
 {
-	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(path) + 6) > sizeof(buf))
-		return 0;
-	sprintf(buf, "CWD %s", path);
-	if (!sendCommand(buf, '2', nControl))
-		return 0;
-	else
-		return 1;
+	if (m->opt->dryRun) {
+		mirrorReport(m, action, local, remote, src->size, -1);
+		return;
+	}
+	MirrorJob_t* job = malloc(sizeof(MirrorJob_t));
+	if (job == NULL) {
+		mirrorReport(m, action, local, remote, src->size, 0);
+		return;
+	}
+	job->action = action;
+	job->size = src->size;
+	job->mtime = src->mtime;
+	strcpy(job->local, local);
+	strcpy(job->remote, remote);
+	if (m->workers > 0)
+		ftpClientPortQueueSend(m->jobs, job);
+	else {
+		mirrorTransfer(m, job, m->nControl);
+		free(job);
+	}
 }
 
 
 
 /*
- * makeDirFtpClient - create a directory at server
+ * mirrorPath - join a directory and a name
  *
- * return 1 if successful, 0 otherwise
+ * return 1 if successful, 0 if the path is too long
  */
-static int makeDirFtpClient(const char* path, NetBuf_t* nControl)
+static int mirrorPath(char* buf, const char* dir, const char* name)
 {
-	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(path) + 6) > sizeof(buf))
-		return 0;
-	sprintf(buf, "MKD %s", path);
-	if (!sendCommand(buf, '2', nControl))
-		return 0;
+	int l;
+	if (*dir == '\0')
+		l = snprintf(buf, FTP_CLIENT_MIRROR_PATH_SIZE, "%s", name);
+	else if (*name == '\0')
+		l = snprintf(buf, FTP_CLIENT_MIRROR_PATH_SIZE, "%s", dir);
 	else
-		return 1;
+		l = snprintf(buf, FTP_CLIENT_MIRROR_PATH_SIZE, "%s%s%s", dir,
+			(dir[strlen(dir) - 1] == '/') ? "" : "/", name);
+	return l < FTP_CLIENT_MIRROR_PATH_SIZE;
 }
 
 
 
 /*
- * removeDirFtpClient - remove directory at remote
+ * mirrorMakeDirs - create the missing destination subdirectories of a directory
  *
- * return 1 if successful, 0 otherwise
+ * Remote directories are created with one pipelined batch. An entry whose
+ * directory could not be created is set to MIRROR_SKIP.
  */
-static int removeDirFtpClient(const char* path, NetBuf_t* nControl)
+static void mirrorMakeDirs(Mirror_t* m, MirrorList_t* src, const char* local,
+	const char* remote)
 {
-	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(path) + 6) > sizeof(buf))
-		return 0;
-	sprintf(buf, "RMD %s", path);
-	if (!sendCommand(buf,'2',nControl))
-		return 0;
-	else
-		return 1;
+	MirrorList_t mk;
+	char lpath[FTP_CLIENT_MIRROR_PATH_SIZE];
+	char rpath[FTP_CLIENT_MIRROR_PATH_SIZE];
+	memset(&mk, 0, sizeof(mk));
+	for (int i = 0; i < src->count; i++) {
+		MirrorEntry_t* e = &src->e[i];
+		if (e->state != MIRROR_CREATE)
+			continue;
+		/* remote paths of the batch, size holds the index of the entry */
+		if (!mirrorPath(rpath, remote, e->name) ||
+				!mirrorAdd(&mk, rpath, strlen(rpath), FTP_CLIENT_ENTRY_DIR, i, 0)) {
+			e->state = MIRROR_SKIP;
+			mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, local, remote, 0, 0);
+		}
+	}
+	mirrorResolve(&mk);
+	FtpClientBatchCmd_t* cmds = NULL;
+	if ((mk.count > 0) && !m->opt->dryRun &&
+			(m->opt->direction == FTP_CLIENT_MIRROR_UPLOAD)) {
+		cmds = calloc(mk.count, sizeof(FtpClientBatchCmd_t));
+		if (cmds != NULL) {
+			for (int i = 0; i < mk.count; i++) {
+				cmds[i].op = FTP_CLIENT_BATCH_MKD;
+				cmds[i].arg = mk.e[i].name;
+			}
+			batchFtpClient(cmds, mk.count, m->nControl);
+		}
+	}
+	for (int i = 0; i < mk.count; i++) {
+		MirrorEntry_t* e = &src->e[mk.e[i].size];
+		int result;
+		mirrorPath(lpath, local, e->name);
+		if (m->opt->dryRun)
+			result = -1;
+		else if (m->opt->direction == FTP_CLIENT_MIRROR_UPLOAD)
+			result = (cmds != NULL) && cmds[i].result;
+		else
+			result = (mkdir(lpath, 0777) == 0) || (errno == EEXIST);
+		if (result == 0)
+			e->state = MIRROR_SKIP;
+		mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, lpath, mk.e[i].name, 0, result);
+	}
+	free(cmds);
+	mirrorListFree(&mk);
 }
 
 
 
 /*
- * dirFtpClient - issue a LIST command and write response to output
+ * mirrorDir - compare one directory and queue its subdirectories
  *
  * return 1 if successful, 0 otherwise
  */
-static int dirFtpClient(const char* outputfile, const char* path, NetBuf_t* nControl)
+static int mirrorDir(Mirror_t* m, MirrorDir_t* d, MirrorDir_t*** tail)
 {
-	return xfer(outputfile, path, nControl, FTP_CLIENT_DIR_VERBOSE, FTP_CLIENT_ASCII);
+	const FtpClientMirrorOptions_t* opt = m->opt;
+	int upload = (opt->direction == FTP_CLIENT_MIRROR_UPLOAD);
+	char local[FTP_CLIENT_MIRROR_PATH_SIZE];
+	char remote[FTP_CLIENT_MIRROR_PATH_SIZE];
+	if (!mirrorPath(local, m->local, d->rel) || !mirrorPath(remote, m->remote, d->rel)) {
+		mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, m->local, d->rel, 0, 0);
+		return 0;
+	}
+
+	MirrorList_t src;
+	MirrorList_t dst;
+	memset(&src, 0, sizeof(src));
+	memset(&dst, 0, sizeof(dst));
+	int rv = upload ? mirrorListLocal(local, &src) : mirrorListRemote(m, remote, &src);
+	if (rv != 1) {
+		mirrorListFree(&src);
+		mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, local, remote, 0, 0);
+		return 0;
+	}
+	if (!d->missing) {
+		rv = upload ? mirrorListRemote(m, remote, &dst) : mirrorListLocal(local, &dst);
+		if (rv == 0) {
+			mirrorListFree(&src);
+			mirrorListFree(&dst);
+			mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, local, remote, 0, 0);
+			return 0;
+		}
+		if ((rv == -1) && (d->rel[0] == '\0')) {
+			/* the top destination directory */
+			int result = -1;
+			if (!opt->dryRun)
+				result = upload ? makeDirFtpClient(remote, m->nControl) : (mkdir(local, 0777) == 0);
+			mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, local, remote, 0, result);
+			if (result == 0) {
+				mirrorListFree(&src);
+				return 0;
+			}
+		}
+	}
+	ftpClientPortMutexLock(m->lock);
+	m->stats->dirs++;
+	ftpClientPortMutexUnlock(m->lock);
+	mirrorResolve(&src);
+	mirrorResolve(&dst);
+	qsort(src.e, src.count, sizeof(MirrorEntry_t), mirrorCompare);
+	qsort(dst.e, dst.count, sizeof(MirrorEntry_t), mirrorCompare);
+
+	/* match the sorted listings */
+	int j = 0;
+	for (int i = 0; i < src.count; i++) {
+		MirrorEntry_t* e = &src.e[i];
+		while ((j < dst.count) && (strcmp(dst.e[j].name, e->name) < 0))
+			j++;
+		if ((j < dst.count) && (strcmp(dst.e[j].name, e->name) == 0))
+			e->match = j;
+		if (e->type == FTP_CLIENT_ENTRY_DIR) {
+			if (e->match < 0)
+				e->state = MIRROR_CREATE;
+			else if (dst.e[e->match].type == FTP_CLIENT_ENTRY_FILE)
+				e->state = MIRROR_SKIP;
+			else
+				e->state = MIRROR_EXISTS;
+		}
+	}
+	mirrorMakeDirs(m, &src, local, remote);
+
+	char lpath[FTP_CLIENT_MIRROR_PATH_SIZE];
+	char rpath[FTP_CLIENT_MIRROR_PATH_SIZE];
+	for (int i = 0; i < src.count; i++) {
+		MirrorEntry_t* e = &src.e[i];
+		if (!mirrorPath(lpath, local, e->name) || !mirrorPath(rpath, remote, e->name)) {
+			mirrorReport(m, (e->type == FTP_CLIENT_ENTRY_DIR) ? FTP_CLIENT_MIRROR_MKDIR :
+				FTP_CLIENT_MIRROR_NEW, local, remote, 0, 0);
+			continue;
+		}
+		if (e->type == FTP_CLIENT_ENTRY_DIR) {
+			if (e->state == MIRROR_SKIP) {
+				if (e->match >= 0)
+					mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, lpath, rpath, 0, 0);
+				continue;
+			}
+			size_t l = strlen(d->rel);
+			MirrorDir_t* sub = malloc(sizeof(MirrorDir_t) + l + strlen(e->name) + 2);
+			if (sub == NULL) {
+				mirrorReport(m, FTP_CLIENT_MIRROR_MKDIR, lpath, rpath, 0, 0);
+				continue;
+			}
+			sub->next = NULL;
+			sub->missing = (e->state == MIRROR_CREATE);
+			sprintf(sub->rel, "%s%s%s", d->rel, l ? "/" : "", e->name);
+			**tail = sub;
+			*tail = &sub->next;
+			continue;
+		}
+		if (e->type != FTP_CLIENT_ENTRY_FILE)
+			continue;
+		ftpClientPortMutexLock(m->lock);
+		m->stats->files++;
+		ftpClientPortMutexUnlock(m->lock);
+		const MirrorEntry_t* t = (e->match >= 0) ? &dst.e[e->match] : NULL;
+		int action = 0;
+		if (t == NULL)
+			action = FTP_CLIENT_MIRROR_NEW;
+		else if (t->type == FTP_CLIENT_ENTRY_DIR)
+			mirrorReport(m, FTP_CLIENT_MIRROR_CHANGED, lpath, rpath, e->size, 0);
+		else if (t->type == FTP_CLIENT_ENTRY_FILE) {
+			if (((m->compare & FTP_CLIENT_MIRROR_SIZE) && (e->size != t->size)) ||
+					((m->compare & FTP_CLIENT_MIRROR_MTIME) && e->mtime && t->mtime &&
+					(e->mtime > t->mtime + t->slack + FTP_CLIENT_MIRROR_MTIME_SLACK)))
+				action = FTP_CLIENT_MIRROR_CHANGED;
+		}
+		if (action)
+			mirrorFile(m, action, e, lpath, rpath);
+		else if ((t != NULL) && (t->type != FTP_CLIENT_ENTRY_DIR)) {
+			ftpClientPortMutexLock(m->lock);
+			m->stats->same++;
+			ftpClientPortMutexUnlock(m->lock);
+		}
+	}
+	mirrorListFree(&src);
+	mirrorListFree(&dst);
+	return 1;
 }
 
 
 
 /*
- * nlstFtpClient - issue an NLST command and write response to output
+ * mirrorFtpClient - make a directory tree the same on both sides
+ *
+ * The local tree and the remote tree (MLSD, or LIST where the server has
+ * no MLSD) are walked level by level. A file is copied when it is missing,
+ * its size differs or the source is newer. Missing directories of a level
+ * are created with one batch. With opt->connections > 1 the files are
+ * copied by that many tasks over pooled connections while nControl goes
+ * on walking the tree. A dry run only reports the planned actions.
  *
  * return 1 if successful, 0 otherwise
  */
-static int nlstFtpClient(const char* outputfile, const char* path,
-	NetBuf_t* nControl)
+static int mirrorFtpClient(const char* localDir, const char* remoteDir,
+	const FtpClientMirrorOptions_t* opt, FtpClientMirrorStats_t* stats, NetBuf_t* nControl)
 {
-	return xfer(outputfile, path, nControl, FTP_CLIENT_DIR, FTP_CLIENT_ASCII);
+	FtpClientMirrorStats_t st;
+	if (stats == NULL)
+		stats = &st;
+	memset(stats, 0, sizeof(*stats));
+	if ((opt == NULL) || ((opt->direction != FTP_CLIENT_MIRROR_UPLOAD) &&
+			(opt->direction != FTP_CLIENT_MIRROR_DOWNLOAD))) {
+		sprintf(nControl->response, "Invalid mirror direction\n");
+		return 0;
+	}
+	Mirror_t m;
+	memset(&m, 0, sizeof(m));
+	m.nControl = nControl;
+	m.opt = opt;
+	m.stats = stats;
+	m.local = localDir;
+	m.remote = remoteDir;
+	m.compare = opt->compare ? opt->compare : (FTP_CLIENT_MIRROR_SIZE | FTP_CLIENT_MIRROR_MTIME);
+	m.listFormat = FTP_CLIENT_LIST_MLSD;
+	m.mfmt = 1;
+	m.lock = ftpClientPortMutexCreate();
+	if (m.lock == NULL)
+		return 0;
+
+	FtpClientPortThread_t* workers[FTP_CLIENT_MIRROR_CONNECTIONS_MAX];
+	int count = opt->dryRun ? 0 : opt->connections;
+	if (count > FTP_CLIENT_MIRROR_CONNECTIONS_MAX)
+		count = FTP_CLIENT_MIRROR_CONNECTIONS_MAX;
+	if ((count > 1) && ((m.jobs = ftpClientPortQueueCreate(count * 2)) != NULL)) {
+		for (int i = 0; i < count; i++) {
+			workers[m.workers] = ftpClientPortThreadCreate(mirrorWorker, &m,
+				"ftpMirror", FTP_CLIENT_MIRROR_STACK_SIZE, 0);
+			if (workers[m.workers] != NULL)
+				m.workers++;
+		}
+	}
+
+	int rv = 1;
+	MirrorDir_t* head = calloc(1, sizeof(MirrorDir_t) + 1);
+	MirrorDir_t** tail = &head;
+	if (head != NULL)
+		tail = &head->next;
+	else
+		rv = 0;
+	while (head != NULL) {
+		MirrorDir_t* d = head;
+		if (!mirrorDir(&m, d, &tail))
+			rv = 0;
+		head = d->next;
+		if (head == NULL)
+			tail = &head;
+		free(d);
+	}
+
+	for (int i = 0; i < m.workers; i++)
+		ftpClientPortQueueSend(m.jobs, NULL);
+	for (int i = 0; i < m.workers; i++)
+		ftpClientPortThreadJoin(workers[i]);
+	if (m.jobs != NULL)
+		ftpClientPortQueueDelete(m.jobs);
+	ftpClientPortMutexDelete(m.lock);
+	if (stats->failed)
+		rv = 0;
+	return rv;
 }
 
 
 
 /*
- * nlstFtpClient - issue an MLSD command and write response to output
+ * getToSinkFtpClient - issue a GET command and pass received data to a sink
  *
  * return 1 if successful, 0 otherwise
  */
-static int mlsdFtpClient(const char* outputfile, const char* path,
-	NetBuf_t* nControl)
+static int getToSinkFtpClient(const FtpClientSink_t* sink, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	return xfer(outputfile, path, nControl, FTP_CLIENT_MLSD, FTP_CLIENT_ASCII);
+	return xferSink(sink, path, nControl, FTP_CLIENT_FILE_READ, mode);
 }
 
 
 
 /*
- * changeDirUpFtpClient - move to parent directory at remote
+ * putFromSourceFtpClient - issue a PUT command and send data from a source
  *
  * return 1 if successful, 0 otherwise
  */
-static int changeDirUpFtpClient(NetBuf_t* nControl)
+static int putFromSourceFtpClient(const FtpClientSource_t* source, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	if (!sendCommand("CDUP", '2', nControl))
-		return 0;
-	else
-		return 1;
+	return xferSource(source, path, nControl, FTP_CLIENT_FILE_WRITE, mode);
 }
 
 
+
 /*
- * pwdFtpClient - get working directory at remote
+ * getToBufferFtpClient - issue a GET command into a buffer of size bytes
+ *
+ * *len is set to the bytes received, also when the file does not fit.
  *
  * return 1 if successful, 0 otherwise
  */
-static int pwdFtpClient(char* path, int max, NetBuf_t* nControl)
+static int getToBufferFtpClient(void* buf, size_t size, size_t* len, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	if (!sendCommand("PWD",'2',nControl))
-		return 0;
-	char* s = strchr(nControl->response, '"');
-	if (s == NULL)
-		return 0;
-	s++;
-	int l = max;
-	char* b = path;
-	while ((--l) && (*s) && (*s != '"'))
-		*b++ = *s++;
-	*b++ = '\0';
-	return 1;
+	MemEndpoint_t me = { .buf = buf, .size = size };
+	FtpClientSink_t sink = { memSinkGetBuffer, memSinkWrite, &me };
+	int rv = xferSink(&sink, path, nControl, FTP_CLIENT_FILE_READ, mode);
+	if (me.overflow)
+		snprintf(nControl->response, sizeof(nControl->response), "%s\n", strerror(EFBIG));
+	if (len)
+		*len = me.len;
+	return rv;
 }
 
 
 
 /*
- * getDataFtpClient - issue a GET command and write received data to output
+ * getToMemoryFtpClient - issue a GET command into an allocated buffer
+ *
+ * The buffer grows as the data arrives, up to max bytes. On success *buf
+ * holds the data followed by a NUL and has to be freed by the caller, on
+ * failure it is NULL.
  *
  * return 1 if successful, 0 otherwise
  */
-static int getDataFtpClient(const char* outputfile, const char* path,
+static int getToMemoryFtpClient(char** buf, size_t* len, size_t max, const char* path,
 		char mode, NetBuf_t* nControl)
 {
-	return xfer(outputfile, path, nControl, FTP_CLIENT_FILE_READ, mode);
+	MemEndpoint_t me = { .max = max ? max : SIZE_MAX / 2, .grow = 1 };
+	FtpClientSink_t sink = { memSinkGetBuffer, memSinkWrite, &me };
+	int rv = xferSink(&sink, path, nControl, FTP_CLIENT_FILE_READ, mode);
+	if (me.overflow)
+		snprintf(nControl->response, sizeof(nControl->response), "%s\n", strerror(EFBIG));
+	if ((rv != 1) || (me.buf == NULL)) {
+		free(me.buf);
+		me.buf = NULL;
+		rv = 0;
+	}
+	else
+		me.buf[me.len] = '\0';
+	*buf = me.buf;
+	if (len)
+		*len = me.len;
+	return rv;
 }
 
 
 
 /*
- * putDataFtpClient - issue a PUT command and send data from input
+ * putFromBufferFtpClient - issue a PUT command and send len bytes of buf
  *
  * return 1 if successful, 0 otherwise
  */
-static int putDataFtpClient(const char* inputfile, const char* path, char mode,
-	NetBuf_t* nControl)
+static int putFromBufferFtpClient(const void* buf, size_t len, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	return xfer(inputfile, path, nControl, FTP_CLIENT_FILE_WRITE, mode);
+	MemEndpoint_t me = { .buf = (char*)buf, .size = len };
+	FtpClientSource_t source = { memSourceGetBuffer, memSourceRead, &me };
+	return xferSource(&source, path, nControl, FTP_CLIENT_FILE_WRITE, mode);
 }
 
 
 
 /*
- * deleteFtpClient - delete a file at remote
+ * getToStreamFtpClient - issue a GET command and send the data to a stream
+ *
+ * The stream is closed when the transfer ends, so its receiver sees the
+ * end of the data, or aborted when it fails, so the receiver gets -1.
+ * A receiver that closes it stops the transfer.
  *
  * return 1 if successful, 0 otherwise
  */
-static int deleteDataFtpClient(const char* fnm, NetBuf_t* nControl)
+static int getToStreamFtpClient(FtpClientPortStream_t* stream, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if ((strlen(fnm) + 7) > sizeof(cmd))
-		return 0;
-	sprintf(cmd, "DELE %s", fnm);
-	if(!sendCommand(cmd, '2', nControl))
-		return 0;
+	FtpClientSink_t sink = { NULL, streamSinkWrite, stream };
+	int rv = xferSink(&sink, path, nControl, FTP_CLIENT_FILE_READ, mode);
+	if (rv)
+		ftpClientPortStreamClose(stream);
 	else
-		return 1;
+		ftpClientPortStreamAbort(stream);
+	return rv;
 }
 
 
 
 /*
- * renameFtpClient - rename a file at remote
+ * putFromStreamFtpClient - issue a PUT command and send data from a stream
+ *
+ * The file ends when the sender closes the stream. A sender that fails
+ * aborts it instead, so the transfer fails rather than ending as if the
+ * file were complete. The stream is closed when the
+ * transfer ends, so a sender still waiting gets an error.
  *
  * return 1 if successful, 0 otherwise
  */
-static int renameFtpClient(const char* src, const char* dst, NetBuf_t* nControl)
+static int putFromStreamFtpClient(FtpClientPortStream_t* stream, const char* path,
+		char mode, NetBuf_t* nControl)
 {
-	char cmd[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	if (((strlen(src) + 7) > sizeof(cmd)) ||
-		((strlen(dst) + 7) > sizeof(cmd)))
-		return 0;
-	sprintf(cmd, "RNFR %s", src);
-	if (!sendCommand(cmd, '3', nControl))
-		return 0;
-	sprintf(cmd,"RNTO %s",dst);
-	if (!sendCommand(cmd, '2', nControl))
-		return 0;
-	else
-		return 1;
+	FtpClientSource_t source = { NULL, streamSourceRead, stream };
+	int rv = xferSource(&source, path, nControl, FTP_CLIENT_FILE_WRITE, mode);
+	ftpClientPortStreamClose(stream);
+	return rv;
 }
 
 
@@ -1188,16 +5221,31 @@ static int renameFtpClient(const char* src, const char* dst, NetBuf_t* nControl)
 static int accessFtpClient(const char* path, int typ, int mode, NetBuf_t* nControl,
 	NetBuf_t** nData)
 {
-	if ((path == NULL) &&
-		((typ == FTP_CLIENT_FILE_WRITE) || (typ == FTP_CLIENT_FILE_READ))) {
+	if (nControl->data != NULL) {
+		sprintf(nControl->response, "Data connection already open\n");
+		return 0;
+	}
+	/* a restart offset only applies to the transfer right after it was set */
+	uint64_t restOffset = nControl->restOffset;
+	nControl->restOffset = 0;
+	/* so does MODE Z, which codecBegin() has sent or reused already */
+	char xmodeSet = nControl->xmodeNext;
+	nControl->xmodeNext = 0;
+	nControl->stats.stageStart = ftpClientPortTimeUs();
+	for (int i = 0; i < FTP_CLIENT_STAGES; i++)
+		nControl->stats.stageUs[i] = -1;
+	if ((path == NULL) && ((typ == FTP_CLIENT_FILE_WRITE) ||
+		(typ == FTP_CLIENT_FILE_READ) || (typ == FTP_CLIENT_FILE_APPEND))) {
 		sprintf(nControl->response,
 					"Missing path argument for file transfer\n");
 		return 0;
 	}
 	char buf[FTP_CLIENT_TEMP_BUFFER_SIZE];
-	sprintf(buf, "TYPE %c", mode);
-	if (!sendCommand(buf, '2', nControl))
+	if ((typ == FTP_CLIENT_FILE_WRITE) || (typ == FTP_CLIENT_FILE_APPEND))
+		metaForget(path, nControl);
+	if (!setType(mode, nControl) || (!xmodeSet && !setMode('S', nControl)))
 		return 0;
+	statsStage(nControl, FTP_CLIENT_STAGE_TYPE);
 	int dir;
 	switch (typ) {
 		case FTP_CLIENT_DIR:
@@ -1235,6 +5283,13 @@ static int accessFtpClient(const char* path, int typ, int mode, NetBuf_t* nContr
 		}
 		break;
 
+		case FTP_CLIENT_FILE_APPEND:
+		{
+			strcpy(buf, "APPE");
+			dir = FTP_CLIENT_WRITE;
+		}
+		break;
+
 		default:
 		{
 			sprintf(nControl->response, "Invalid open type %d\n", typ);
@@ -1252,11 +5307,24 @@ static int accessFtpClient(const char* path, int typ, int mode, NetBuf_t* nContr
 
 	if (openPort(nControl, nData, mode, dir) == -1)
 		return 0;
+	statsStage(nControl, FTP_CLIENT_STAGE_PORT);
+	if (restOffset) {
+		char rest[32];
+		sprintf(rest, "REST %" PRIu64, restOffset);
+		if (!sendCommand(rest, '3', nControl)) {
+			closeFtpClient(*nData);
+			*nData = NULL;
+			return 0;
+		}
+		statsStage(nControl, FTP_CLIENT_STAGE_REST);
+	}
+	(*nData)->started = ftpClientPortTimeUs();
 	if (!sendCommand(buf, '1', nControl)) {
 		closeFtpClient(*nData);
 		*nData = NULL;
 		return 0;
 	}
+	statsStage(nControl, FTP_CLIENT_STAGE_COMMAND);
 	if (nControl->cmode == FTP_CLIENT_ACTIVE) {
 		if (!acceptConnection(*nData,nControl)) {
 			closeFtpClient(*nData);
@@ -1264,6 +5332,7 @@ static int accessFtpClient(const char* path, int typ, int mode, NetBuf_t* nContr
 			nControl->data = NULL;
 			return 0;
 		}
+		statsStage(nControl, FTP_CLIENT_STAGE_ACCEPT);
 	}
 	return 1;
 }
@@ -1285,20 +5354,38 @@ static int readFtpClient(void* buf, int max, NetBuf_t* nData)
 		i = socketWait(nData);
 		if (i != 1)
 			return 0;
-		i = recv(nData->handle, buf, max, 0);
+		i = netRecv(nData, buf, max);
 	}
-	if (i == -1)
+	if (i == -1) {
+		nData->aborted = 1;
 		return 0;
-	nData->xfered += i;
+	}
+	if (!readCount(nData, i))
+		return 0;
+	return i;
+}
+
+
+
+/*
+ * readCount - count received bytes and call the callback
+ *
+ * return 0 if the callback stops the transfer, 1 otherwise
+ */
+static int readCount(NetBuf_t* nData, int bytes)
+{
+	nData->xfered += bytes;
 	if (nData->idlecb && nData->cbbytes) {
-		nData->xfered1 += i;
+		nData->xfered1 += bytes;
 		if (nData->xfered1 > nData->cbbytes) {
-			if (nData->idlecb(nData, nData->xfered, nData->idlearg) == 0)
+			if (nData->idlecb(nData, nData->xfered, nData->idlearg) == 0) {
+				nData->aborted = 1;
 				return 0;
+			}
 			nData->xfered1 = 0;
 		}
 	}
-	return i;
+	return 1;
 }
 
 
@@ -1314,8 +5401,9 @@ static int writeFtpClient(const void* buf, int len, NetBuf_t* nData)
 	if (nData->buf)
 		i = writeLine(buf, len, nData);
 	else {
-		socketWait(nData);
-		i = send(nData->handle, buf, len, 0);
+		if (!socketWait(nData))
+			return 0;
+		i = netSend(nData, buf, len);
 	}
 	if (i == -1)
 		return 0;
@@ -1323,7 +5411,11 @@ static int writeFtpClient(const void* buf, int len, NetBuf_t* nData)
 	if (nData->idlecb && nData->cbbytes) {
 		nData->xfered1 += i;
 		if (nData->xfered1 > nData->cbbytes) {
-			nData->idlecb(nData, nData->xfered, nData->idlearg);
+			/* a callback returning 0 stops the transfer like a short write */
+			if (nData->idlecb(nData, nData->xfered, nData->idlearg) == 0) {
+				nData->aborted = 1;
+				return 0;
+			}
 			nData->xfered1 = 0;
 		}
 	}
@@ -1341,23 +5433,40 @@ static int closeFtpClient(NetBuf_t* nData)
 	{
 		case FTP_CLIENT_WRITE:
 		case FTP_CLIENT_READ:
-			if (nData->buf)
-				free(nData->buf);
+			ftpClientMemFree(nData->buf);
 			shutdown(nData->handle, 2);
 			closesocket(nData->handle);
 			NetBuf_t* ctrl = nData->ctrl;
-			free(nData);
+			uint64_t bytes = nData->xfered;
+			netBufRelease(nData);
+			if (ctrl == NULL)
+				return 1;
 			ctrl->data = NULL;
-			if (ctrl && ctrl->response[0] != '4' && ctrl->response[0] != '5')
-				return(readResponse('2', ctrl));
-			return 1;
+			/* the transfer ran if its command got the preliminary reply */
+			int ran = (ctrl->response[0] == '1');
+			int rv = 1;
+			if (ctrl->response[0] != '4' && ctrl->response[0] != '5')
+				rv = readResponse('2', ctrl);
+			if (ran) {
+				ctrl->stats.transfers++;
+				ctrl->stats.xferBytes += bytes;
+				ctrl->stats.xferUs += ftpClientPortTimeUs() - ctrl->stats.stageStart;
+				statsStage(ctrl, FTP_CLIENT_STAGE_CLOSE);
+			}
+			return rv;
 
 		case FTP_CLIENT_CONTROL:
 			if (nData->data) {
-				nData->ctrl = NULL;
+				nData->data->ctrl = NULL;
 				closeFtpClient(nData->data);
 			}
+			statsFold(nData);
 			closesocket(nData->handle);
+			if (nData->closing)
+				ftpClientPortMutexUnlock(nData->lock);
+			ftpClientPortMutexDelete(nData->lock);
+			free(nData->meta);
+			free(nData->buf);
 			free(nData);
 			return 0;
 	}
@@ -1366,37 +5475,326 @@ static int closeFtpClient(NetBuf_t* nData)
 
 
 
-FtpClient* getFtpClient(void)
+/*
+ * sessionLock - wait until no other task uses the session
+ *
+ * The functions of the table hold the lock of the session while they run,
+ * and ftpClientAccess() until ftpClientClose() of its data connection, so
+ * tasks that share a session take turns. The lock is recursive for the
+ * task that holds it. Internal calls use the functions without the lock.
+ * The statistics getters and the rate limit options do not wait, so they
+ * work while a transfer of the session runs.
+ *
+ * return 1 with the lock held, 0 if the session is being closed
+ */
+static int sessionLock(NetBuf_t* nControl)
+{
+	if ((nControl == NULL) || (nControl->dir != FTP_CLIENT_CONTROL))
+		return 1;
+	__atomic_add_fetch(&nControl->users, 1, __ATOMIC_ACQ_REL);
+	ftpClientPortMutexLock(nControl->lock);
+	if (nControl->closing) {
+		ftpClientPortMutexUnlock(nControl->lock);
+		/* the last access, sessionClose() frees the session after it */
+		__atomic_sub_fetch(&nControl->users, 1, __ATOMIC_ACQ_REL);
+		return 0;
+	}
+	return 1;
+}
+
+
+
+static void sessionUnlock(NetBuf_t* nControl)
+{
+	if ((nControl == NULL) || (nControl->dir != FTP_CLIENT_CONTROL))
+		return;
+	ftpClientPortMutexUnlock(nControl->lock);
+	__atomic_sub_fetch(&nControl->users, 1, __ATOMIC_ACQ_REL);
+}
+
+
+
+/*
+ * sessionClose - keep the lock for the teardown of the session
+ *
+ * Called with the lock held once. Tasks that wait for the lock get it in
+ * turn, see closing and fail; the session is torn down after the last of
+ * them has left. The lock stays held until quitFtpClient() or
+ * closeFtpClient() deletes it. Starting a call on a handle after quit or
+ * close has begun is an error as with any freed handle.
+ */
+static void sessionClose(NetBuf_t* nControl)
+{
+	nControl->closing = 1;
+	while (__atomic_load_n(&nControl->users, __ATOMIC_ACQUIRE) > 1) {
+		ftpClientPortMutexUnlock(nControl->lock);
+		ftpClientPortSleepUs(1000);
+		ftpClientPortMutexLock(nControl->lock);
+	}
+}
+
+
+
+#define SESSION_LOCKED(type, name, params, args) \
+static type name##Locked params \
+{ \
+	if (!sessionLock(nControl)) \
+		return (type)0; \
+	type rv = name args; \
+	sessionUnlock(nControl); \
+	return rv; \
+}
+
+#define SESSION_LOCKED_VOID(name, params, args) \
+static void name##Locked params \
+{ \
+	if (!sessionLock(nControl)) \
+		return; \
+	name args; \
+	sessionUnlock(nControl); \
+}
+
+SESSION_LOCKED(int, siteFtpClient, (const char* cmd, NetBuf_t* nControl), (cmd, nControl))
+SESSION_LOCKED(int, getSysTypeFtpClient, (char* buf, int max, NetBuf_t* nControl),
+	(buf, max, nControl))
+SESSION_LOCKED(int, getFileSizeFtpClient, (const char* path, unsigned int* size, char mode,
+	NetBuf_t* nControl), (path, size, mode, nControl))
+SESSION_LOCKED(int, getModDateFtpClient, (const char* path, char* dt, int max, NetBuf_t* nControl),
+	(path, dt, max, nControl))
+SESSION_LOCKED(int, setCallbackFtpClient, (const FtpClientCallbackOptions_t* opt,
+	NetBuf_t* nControl), (opt, nControl))
+SESSION_LOCKED(int, clearCallbackFtpClient, (NetBuf_t* nControl), (nControl))
+SESSION_LOCKED_VOID(resetStatsFtpClient, (NetBuf_t* nControl), (nControl))
+SESSION_LOCKED(int, loginFtpClient, (const char* user, const char* pass, NetBuf_t* nControl),
+	(user, pass, nControl))
+SESSION_LOCKED(int, changeDirFtpClient, (const char* path, NetBuf_t* nControl), (path, nControl))
+SESSION_LOCKED(int, makeDirFtpClient, (const char* path, NetBuf_t* nControl), (path, nControl))
+SESSION_LOCKED(int, removeDirFtpClient, (const char* path, NetBuf_t* nControl), (path, nControl))
+SESSION_LOCKED(int, dirFtpClient, (const char* outputfile, const char* path, NetBuf_t* nControl),
+	(outputfile, path, nControl))
+SESSION_LOCKED(int, nlstFtpClient, (const char* outputfile, const char* path, NetBuf_t* nControl),
+	(outputfile, path, nControl))
+SESSION_LOCKED(int, mlsdFtpClient, (const char* outputfile, const char* path, NetBuf_t* nControl),
+	(outputfile, path, nControl))
+SESSION_LOCKED(int, listFtpClient, (const char* path, int format, FtpClientListCallback_t cb,
+	void* arg, NetBuf_t* nControl), (path, format, cb, arg, nControl))
+SESSION_LOCKED(int, changeDirUpFtpClient, (NetBuf_t* nControl), (nControl))
+SESSION_LOCKED(int, pwdFtpClient, (char* path, int max, NetBuf_t* nControl), (path, max, nControl))
+SESSION_LOCKED(int, getDataFtpClient, (const char* outputfile, const char* path, char mode,
+	NetBuf_t* nControl), (outputfile, path, mode, nControl))
+SESSION_LOCKED(int, putDataFtpClient, (const char* inputfile, const char* path, char mode,
+	NetBuf_t* nControl), (inputfile, path, mode, nControl))
+SESSION_LOCKED(int, getSegmentedFtpClient, (const char* outputfile, const char* path, char mode,
+	NetBuf_t* nControl), (outputfile, path, mode, nControl))
+SESSION_LOCKED(int, resumeFtpClient, (const char* localfile, NetBuf_t* nControl),
+	(localfile, nControl))
+SESSION_LOCKED(int, deleteDataFtpClient, (const char* fnm, NetBuf_t* nControl), (fnm, nControl))
+SESSION_LOCKED(int, renameFtpClient, (const char* src, const char* dst, NetBuf_t* nControl),
+	(src, dst, nControl))
+SESSION_LOCKED(int, batchFtpClient, (FtpClientBatchCmd_t* cmds, int count, NetBuf_t* nControl),
+	(cmds, count, nControl))
+SESSION_LOCKED(int, mirrorFtpClient, (const char* localDir, const char* remoteDir,
+	const FtpClientMirrorOptions_t* opt, FtpClientMirrorStats_t* stats, NetBuf_t* nControl),
+	(localDir, remoteDir, opt, stats, nControl))
+SESSION_LOCKED(int, getToSinkFtpClient, (const FtpClientSink_t* sink, const char* path,
+	char mode, NetBuf_t* nControl), (sink, path, mode, nControl))
+SESSION_LOCKED(int, putFromSourceFtpClient, (const FtpClientSource_t* source, const char* path,
+	char mode, NetBuf_t* nControl), (source, path, mode, nControl))
+SESSION_LOCKED(int, getToBufferFtpClient, (void* buf, size_t size, size_t* len, const char* path,
+	char mode, NetBuf_t* nControl), (buf, size, len, path, mode, nControl))
+SESSION_LOCKED(int, getToMemoryFtpClient, (char** buf, size_t* len, size_t max, const char* path,
+	char mode, NetBuf_t* nControl), (buf, len, max, path, mode, nControl))
+SESSION_LOCKED(int, putFromBufferFtpClient, (const void* buf, size_t len, const char* path,
+	char mode, NetBuf_t* nControl), (buf, len, path, mode, nControl))
+SESSION_LOCKED(int, getToStreamFtpClient, (FtpClientPortStream_t* stream, const char* path,
+	char mode, NetBuf_t* nControl), (stream, path, mode, nControl))
+SESSION_LOCKED(int, putFromStreamFtpClient, (FtpClientPortStream_t* stream, const char* path,
+	char mode, NetBuf_t* nControl), (stream, path, mode, nControl))
+
+
+
+/*
+ * setOptionsFtpClientLocked - change an option
+ *
+ * The rate limits apply to a running transfer, which reads them whenever
+ * it sleeps, so they are set without waiting for the session. The global
+ * ones have rateLock.
+ */
+static int setOptionsFtpClientLocked(int opt, long val, NetBuf_t* nControl)
+{
+	switch (opt) {
+		case FTP_CLIENT_RATELIMIT:
+		case FTP_CLIENT_RATEBURST:
+		case FTP_CLIENT_GLOBALRATE:
+		case FTP_CLIENT_GLOBALBURST:
+			return setOptionsFtpClient(opt, val, nControl);
+	}
+	if (!sessionLock(nControl))
+		return 0;
+	int rv = setOptionsFtpClient(opt, val, nControl);
+	sessionUnlock(nControl);
+	return rv;
+}
+
+
+
+/*
+ * sessionCloseData - take the session and close the data connection the caller left open
+ *
+ * return 1 with the lock held once, 0 if another task closes the session
+ */
+static int sessionCloseData(NetBuf_t* nControl)
+{
+	if (!sessionLock(nControl))
+		return 0;
+	/*
+	 * The task that opened a data connection holds the lock until
+	 * ftpClientClose(), so one that is still open here is the caller's.
+	 * Its close ends the hold of ftpClientAccess() as well.
+	 */
+	if (nControl->data) {
+		closeFtpClient(nControl->data);
+		sessionUnlock(nControl);
+	}
+	return 1;
+}
+
+
+
+/*
+ * quitFtpClientLocked - disconnect once no other task uses the session
+ *
+ * A data connection the caller left open is closed first.
+ */
+static void quitFtpClientLocked(NetBuf_t* nControl)
+{
+	if ((nControl->dir != FTP_CLIENT_CONTROL) || !sessionCloseData(nControl))
+		return;
+	sessionClose(nControl);
+	quitFtpClient(nControl);
+}
+
+
+
+/*
+ * poolReleaseFtpClientLocked - return a session once no other task uses it
+ */
+static void poolReleaseFtpClientLocked(NetBuf_t* nControl)
 {
-	if(!isInitilized) {
-		ftpClient_.ftpClientSite = siteFtpClient;
-		ftpClient_.ftpClientGetLastResponse = getLastResponseFtpClient;
-		ftpClient_.ftpClientGetSysType = getSysTypeFtpClient;
-		ftpClient_.ftpClientGetFileSize = getFileSizeFtpClient;
-		ftpClient_.ftpClientGetModDate = getModDateFtpClient;
-		ftpClient_.ftpClientSetCallback = setCallbackFtpClient;
-		ftpClient_.ftpClientClearCallback = clearCallbackFtpClient;
-		ftpClient_.ftpClientConnect = connectFtpClient;
-		ftpClient_.ftpClientLogin = loginFtpClient;
-		ftpClient_.ftpClientQuit = quitFtpClient;
-		ftpClient_.ftpClientSetOptions = setOptionsFtpClient;
-		ftpClient_.ftpClientChangeDir = changeDirFtpClient;
-		ftpClient_.ftpClientMakeDir = makeDirFtpClient;
-		ftpClient_.ftpClientRemoveDir = removeDirFtpClient;
-		ftpClient_.ftpClientDir = dirFtpClient;
-		ftpClient_.ftpClientNlst = nlstFtpClient;
-		ftpClient_.ftpClientMlsd = mlsdFtpClient;
-		ftpClient_.ftpClientChangeDirUp = changeDirUpFtpClient;
-		ftpClient_.ftpClientPwd = pwdFtpClient;
-		ftpClient_.ftpClientGet = getDataFtpClient;
-		ftpClient_.ftpClientPut = putDataFtpClient;
-		ftpClient_.ftpClientDelete = deleteDataFtpClient;
-		ftpClient_.ftpClientRename = renameFtpClient;
-		ftpClient_.ftpClientAccess = accessFtpClient;
-		ftpClient_.ftpClientRead = readFtpClient;
-		ftpClient_.ftpClientWrite = writeFtpClient;
-		ftpClient_.ftpClientClose = closeFtpClient;
-		isInitilized = true;
+	if (!sessionLock(nControl))
+		return;
+	sessionUnlock(nControl);
+	poolReleaseFtpClient(nControl);
+}
+
+
+
+/*
+ * accessFtpClientLocked - open a data connection and keep the session
+ *
+ * The caller owns the session until ftpClientClose().
+ */
+static int accessFtpClientLocked(const char* path, int typ, int mode, NetBuf_t* nControl,
+	NetBuf_t** nData)
+{
+	if (!sessionLock(nControl))
+		return 0;
+	int rv = accessFtpClient(path, typ, mode, nControl, nData);
+	if (!rv)
+		sessionUnlock(nControl);
+	return rv;
+}
+
+
+
+static int closeFtpClientLocked(NetBuf_t* nData)
+{
+	if (nData->dir == FTP_CLIENT_CONTROL) {
+		if (!sessionCloseData(nData))
+			return 0;
+		sessionClose(nData);
+		return closeFtpClient(nData);
+	}
+	NetBuf_t* ctrl = nData->ctrl;
+	int rv = closeFtpClient(nData);
+	sessionUnlock(ctrl);
+	return rv;
+}
+
+
+
+static void initFtpClient(void)
+{
+	poolLock = ftpClientPortMutexCreate();
+	statsLock = ftpClientPortMutexCreate();
+	rateLock = ftpClientPortMutexCreate();
+	netBufLock = ftpClientPortMutexCreate();
+#if FTP_CLIENT_NETBUF_POOL_SIZE > 0
+	for (int i = FTP_CLIENT_NETBUF_POOL_SIZE - 1; i >= 0; i--) {
+		netBufSlots[i].next = netBufFreeList;
+		netBufFreeList = &netBufSlots[i];
 	}
+#endif
+	ftpClientMemInit();
+	ftpClient_.ftpClientSite = siteFtpClientLocked;
+	ftpClient_.ftpClientGetLastResponse = getLastResponseFtpClient;
+	ftpClient_.ftpClientGetSysType = getSysTypeFtpClientLocked;
+	ftpClient_.ftpClientGetFileSize = getFileSizeFtpClientLocked;
+	ftpClient_.ftpClientGetModDate = getModDateFtpClientLocked;
+	ftpClient_.ftpClientSetCallback = setCallbackFtpClientLocked;
+	ftpClient_.ftpClientClearCallback = clearCallbackFtpClientLocked;
+	ftpClient_.ftpClientGetXferStats = getXferStatsFtpClient;
+	ftpClient_.ftpClientGetRoundTripsSaved = getRoundTripsSavedFtpClient;
+	ftpClient_.ftpClientGetMetaCacheStats = getMetaCacheStatsFtpClient;
+	ftpClient_.ftpClientGetStats = getStatsFtpClient;
+	ftpClient_.ftpClientResetStats = resetStatsFtpClientLocked;
+	ftpClient_.ftpClientStatsJson = statsJsonFtpClient;
+	ftpClient_.ftpClientStatsVerb = statsVerbFtpClient;
+	ftpClient_.ftpClientConnect = connectFtpClient;
+	ftpClient_.ftpClientLogin = loginFtpClientLocked;
+	ftpClient_.ftpClientQuit = quitFtpClientLocked;
+	ftpClient_.ftpClientSetOptions = setOptionsFtpClientLocked;
+	ftpClient_.ftpClientPoolAcquire = poolAcquireFtpClient;
+	ftpClient_.ftpClientPoolRelease = poolReleaseFtpClientLocked;
+	ftpClient_.ftpClientPoolFlush = poolFlushFtpClient;
+	ftpClient_.ftpClientPoolGetStats = poolGetStatsFtpClient;
+	ftpClient_.ftpClientMemGetStats = memGetStatsFtpClient;
+	ftpClient_.ftpClientMemReserve = memReserveFtpClient;
+	ftpClient_.ftpClientMemFlush = memFlushFtpClient;
+	ftpClient_.ftpClientChangeDir = changeDirFtpClientLocked;
+	ftpClient_.ftpClientMakeDir = makeDirFtpClientLocked;
+	ftpClient_.ftpClientRemoveDir = removeDirFtpClientLocked;
+	ftpClient_.ftpClientDir = dirFtpClientLocked;
+	ftpClient_.ftpClientNlst = nlstFtpClientLocked;
+	ftpClient_.ftpClientMlsd = mlsdFtpClientLocked;
+	ftpClient_.ftpClientList = listFtpClientLocked;
+	ftpClient_.ftpClientChangeDirUp = changeDirUpFtpClientLocked;
+	ftpClient_.ftpClientPwd = pwdFtpClientLocked;
+	ftpClient_.ftpClientGet = getDataFtpClientLocked;
+	ftpClient_.ftpClientPut = putDataFtpClientLocked;
+	ftpClient_.ftpClientGetSegmented = getSegmentedFtpClientLocked;
+	ftpClient_.ftpClientResume = resumeFtpClientLocked;
+	ftpClient_.ftpClientDelete = deleteDataFtpClientLocked;
+	ftpClient_.ftpClientRename = renameFtpClientLocked;
+	ftpClient_.ftpClientBatch = batchFtpClientLocked;
+	ftpClient_.ftpClientMirror = mirrorFtpClientLocked;
+	ftpClient_.ftpClientGetToSink = getToSinkFtpClientLocked;
+	ftpClient_.ftpClientPutFromSource = putFromSourceFtpClientLocked;
+	ftpClient_.ftpClientGetToBuffer = getToBufferFtpClientLocked;
+	ftpClient_.ftpClientGetToMemory = getToMemoryFtpClientLocked;
+	ftpClient_.ftpClientPutFromBuffer = putFromBufferFtpClientLocked;
+	ftpClient_.ftpClientGetToStream = getToStreamFtpClientLocked;
+	ftpClient_.ftpClientPutFromStream = putFromStreamFtpClientLocked;
+	ftpClient_.ftpClientAccess = accessFtpClientLocked;
+	ftpClient_.ftpClientRead = readFtpClient;
+	ftpClient_.ftpClientWrite = writeFtpClient;
+	ftpClient_.ftpClientClose = closeFtpClientLocked;
+}
+
+
+
+FtpClient* getFtpClient(void)
+{
+	ftpClientPortOnce(&isInitilized, initFtpClient);
 	return &ftpClient_;
 }
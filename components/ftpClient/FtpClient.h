@@ -27,6 +27,10 @@
 #ifndef FTPCLIENT_H_
 #define FTPCLIENT_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include "FtpClientPort.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -38,12 +42,168 @@ extern "C" {
 #define FTP_CLIENT_TEMP_BUFFER_SIZE 		1024
 #define FTP_CLIENT_ACCEPT_TIMEOUT 			30
 
+/* data chunk size limits (FTP_CLIENT_DATABUFSIZE) */
+#define FTP_CLIENT_DATABUF_MIN_SIZE 		512
+#define FTP_CLIENT_DATABUF_MAX_SIZE 		65536
+
+/* pipelined transfers (FTP_CLIENT_PIPELINE) */
+#define FTP_CLIENT_PIPELINE_MAX_BUFFERS 	8
+#define FTP_CLIENT_PIPELINE_STACK_SIZE 		4096
+
+/* segmented downloads (FTP_CLIENT_SEGMENTS) */
+#define FTP_CLIENT_SEGMENTS_MAX 			8
+#define FTP_CLIENT_SEGMENT_MIN_SIZE 		(256 * 1024)
+#define FTP_CLIENT_SEGMENT_STACK_SIZE 		8192
+
+/* resumable transfers (FTP_CLIENT_RESUME) */
+#define FTP_CLIENT_JOURNAL_SUFFIX 			".ftpj"
+#define FTP_CLIENT_CHECKPOINT_DEFAULT 		(1024 * 1024)
+
+/* connection pool (ftpClientPoolAcquire) */
+#ifndef FTP_CLIENT_POOL_SIZE
+#define FTP_CLIENT_POOL_SIZE 				4
+#endif
+#ifndef FTP_CLIENT_POOL_IDLE_TTL
+#define FTP_CLIENT_POOL_IDLE_TTL 			60000	/* close idle sessions after ms */
+#endif
+#ifndef FTP_CLIENT_POOL_NOOP_AFTER
+#define FTP_CLIENT_POOL_NOOP_AFTER 			5000	/* NOOP sessions idle longer than ms */
+#endif
+
+/* memory pools (ftpClientMemGetStats) */
+#ifndef FTP_CLIENT_NETBUF_POOL_SIZE
+#define FTP_CLIENT_NETBUF_POOL_SIZE 		4		/* data connections without malloc() */
+#endif
+#define FTP_CLIENT_MEM_CLASSES 				4		/* buffer size classes */
+#define FTP_CLIENT_MEM_MIN_SIZE 			1024	/* class i holds 1024 << (2 * i) bytes */
+#ifndef FTP_CLIENT_MEM_KEEP
+#define FTP_CLIENT_MEM_KEEP 				4		/* free blocks kept per class */
+#endif
+
+/* command pipelining (ftpClientBatch) */
+#define FTP_CLIENT_CMD_WINDOW 				16		/* default commands per send() */
+#define FTP_CLIENT_CMD_WINDOW_MAX 			64
+#define FTP_CLIENT_CMD_TIMEOUT 				5000	/* ms to wait for a pipelined reply */
+
+/* ftpClientBatch() operations */
+#define FTP_CLIENT_BATCH_DELE 				1
+#define FTP_CLIENT_BATCH_MKD 				2
+#define FTP_CLIENT_BATCH_RMD 				3
+#define FTP_CLIENT_BATCH_SIZE 				4
+#define FTP_CLIENT_BATCH_MDTM 				5
+#define FTP_CLIENT_BATCH_RENAME 			6
+#define FTP_CLIENT_BATCH_SITE 				7
+
+/* streaming directory listing (ftpClientList) */
+#define FTP_CLIENT_LIST_LINE_SIZE 			512		/* longer listing lines are skipped */
+#define FTP_CLIENT_LIST_NAMES_BLOCK 		2048	/* name pool grows by this many bytes */
+
+/* ftpClientList() formats */
+#define FTP_CLIENT_LIST_MLSD 				1
+#define FTP_CLIENT_LIST_LIST 				2		/* UNIX or DOS style LIST */
+#define FTP_CLIENT_LIST_NLST 				3
+
+/* FtpClientDirEntry_t types */
+#define FTP_CLIENT_ENTRY_UNKNOWN 			0
+#define FTP_CLIENT_ENTRY_FILE 				1
+#define FTP_CLIENT_ENTRY_DIR 				2
+#define FTP_CLIENT_ENTRY_LINK 				3
+
+/* FtpClientDirEntry_t facts that were sent by the server */
+#define FTP_CLIENT_FACT_SIZE 				0x01
+#define FTP_CLIENT_FACT_MODIFY 				0x02
+#define FTP_CLIENT_FACT_PERM 				0x04
+#define FTP_CLIENT_FACT_MODE 				0x08
+#define FTP_CLIENT_FACT_UNIQUE 				0x10
+
+/* directory mirror (ftpClientMirror) */
+#define FTP_CLIENT_MIRROR_PATH_SIZE 		256
+#define FTP_CLIENT_MIRROR_CONNECTIONS_MAX 	8
+#define FTP_CLIENT_MIRROR_STACK_SIZE 		8192
+#define FTP_CLIENT_MIRROR_MTIME_SLACK 		2		/* seconds, FAT keeps even seconds */
+
+/* FtpClientMirrorOptions_t directions */
+#define FTP_CLIENT_MIRROR_UPLOAD 			1
+#define FTP_CLIENT_MIRROR_DOWNLOAD 			2
+
+/* FtpClientMirrorOptions_t compare flags */
+#define FTP_CLIENT_MIRROR_SIZE 				0x01
+#define FTP_CLIENT_MIRROR_MTIME 			0x02
+
+/* FtpClientMirrorItem_t actions */
+#define FTP_CLIENT_MIRROR_MKDIR 			1
+#define FTP_CLIENT_MIRROR_NEW 				2
+#define FTP_CLIENT_MIRROR_CHANGED 			3
+
+/* remote metadata cache (FTP_CLIENT_METACACHE) */
+#ifndef FTP_CLIENT_METACACHE_ENTRIES
+#define FTP_CLIENT_METACACHE_ENTRIES 		64		/* power of two */
+#endif
+#define FTP_CLIENT_METACACHE_DATE_SIZE 		20
+
+/* rate limiting (FTP_CLIENT_RATELIMIT, FTP_CLIENT_GLOBALRATE) */
+#define FTP_CLIENT_RATE_BURST_MS 			100		/* default burst, this many ms at the limit */
+#define FTP_CLIENT_RATE_SLEEP_MAX_MS 		100		/* a changed limit applies after at most this long */
+
+/* session statistics (ftpClientGetStats) */
+#ifndef FTP_CLIENT_STATS_STAGES
+#define FTP_CLIENT_STATS_STAGES 			1		/* 0 leaves stageUs at -1 */
+#endif
+#define FTP_CLIENT_STATS_HIST_SIZE 			8
+#define FTP_CLIENT_STATS_VERBS 				28
+#define FTP_CLIENT_STATS_JSON_SIZE 			4096	/* always enough for ftpClientStatsJson() */
+
+/* FtpClientStats_t stages of the last transfer */
+#define FTP_CLIENT_STAGE_TYPE 				0		/* TYPE set */
+#define FTP_CLIENT_STAGE_PORT 				1		/* PASV or PORT done */
+#define FTP_CLIENT_STAGE_REST 				2		/* restart offset accepted */
+#define FTP_CLIENT_STAGE_COMMAND 			3		/* preliminary reply to the transfer command */
+#define FTP_CLIENT_STAGE_ACCEPT 			4		/* data connection accepted in active mode */
+#define FTP_CLIENT_STAGE_FIRST_BYTE 		5		/* first data sent or received */
+#define FTP_CLIENT_STAGE_CLOSE 				6		/* final reply */
+#define FTP_CLIENT_STAGES 					7
+
+/* compressed transfers (FTP_CLIENT_COMPRESS) */
+#define FTP_CLIENT_GZIP_SUFFIX 				".gz"	/* appended to the remote path of gzip files */
+
+/* FTP_CLIENT_COMPRESS values */
+#define FTP_CLIENT_COMPRESS_OFF 			0
+#define FTP_CLIENT_COMPRESS_AUTO 			1		/* MODE Z, gzip files if the server refuses it */
+#define FTP_CLIENT_COMPRESS_MODEZ 			2		/* MODE Z, fail if the server refuses it */
+#define FTP_CLIENT_COMPRESS_GZIP 			3		/* gzip files */
+
+/* FTP_CLIENT_HASH values */
+#define FTP_CLIENT_HASH_NONE 				0
+#define FTP_CLIENT_HASH_CRC32 				1
+#define FTP_CLIENT_HASH_MD5 				2
+#define FTP_CLIENT_HASH_SHA256 				3
+#define FTP_CLIENT_HASH_SIZE_MAX 			32		/* bytes of the longest digest */
+
+/* FTP_CLIENT_SOCKCONTROL and FTP_CLIENT_SOCKDATA profiles, may be or'ed */
+#define FTP_CLIENT_SOCK_DEFAULT 			0		/* options of the TCP/IP stack */
+#define FTP_CLIENT_SOCK_LOWLATENCY 			1		/* TCP_NODELAY, no wait for the ACK of a short segment */
+#define FTP_CLIENT_SOCK_BULK 				2		/* SO_RCVBUF and SO_SNDBUF of FTP_CLIENT_SOCKBUFSIZE */
+#define FTP_CLIENT_SOCK_KEEPALIVE 			4		/* keepalive probes, send and receive timeout */
+
+/* socket option profiles */
+#ifndef FTP_CLIENT_SOCK_CONTROL_DEFAULT
+#define FTP_CLIENT_SOCK_CONTROL_DEFAULT 	FTP_CLIENT_SOCK_LOWLATENCY
+#endif
+#ifndef FTP_CLIENT_SOCK_BUFFER_SIZE
+#define FTP_CLIENT_SOCK_BUFFER_SIZE 		65536	/* default of FTP_CLIENT_SOCKBUFSIZE */
+#endif
+#define FTP_CLIENT_SOCK_TIMEOUT 			30000	/* default of FTP_CLIENT_SOCKTIMEOUT in ms */
+#define FTP_CLIENT_SOCK_KEEPIDLE 			30		/* s idle before the first keepalive probe */
+#define FTP_CLIENT_SOCK_KEEPINTVL 			5		/* s between probes */
+#define FTP_CLIENT_SOCK_KEEPCNT 			3		/* unanswered probes that drop the connection */
+
 /* FtpAccess() type codes */
 #define FTP_CLIENT_DIR 						1
 #define FTP_CLIENT_DIR_VERBOSE 				2
 #define FTP_CLIENT_FILE_READ 				3
 #define FTP_CLIENT_FILE_WRITE 				4
 #define FTP_CLIENT_MLSD 					5
+#define FTP_CLIENT_FILE_APPEND 				6
 
 /* FtpAccess() mode codes */
 #define FTP_CLIENT_ASCII 					'A'
@@ -61,6 +221,24 @@ extern "C" {
 #define FTP_CLIENT_IDLETIME 				3
 #define FTP_CLIENT_CALLBACKARG 				4
 #define FTP_CLIENT_CALLBACKBYTES 			5
+#define FTP_CLIENT_DATABUFSIZE 				6
+#define FTP_CLIENT_DATABUFADAPTIVE 			7
+#define FTP_CLIENT_PIPELINE 				8
+#define FTP_CLIENT_SEGMENTS 				9
+#define FTP_CLIENT_RESUME 					10
+#define FTP_CLIENT_CHECKPOINT 				11
+#define FTP_CLIENT_CMDPIPELINE 				12
+#define FTP_CLIENT_METACACHE 				13
+#define FTP_CLIENT_RATELIMIT 				14
+#define FTP_CLIENT_RATEBURST 				15
+#define FTP_CLIENT_GLOBALRATE 				16
+#define FTP_CLIENT_GLOBALBURST 				17
+#define FTP_CLIENT_COMPRESS 				18
+#define FTP_CLIENT_HASH 					19
+#define FTP_CLIENT_SOCKCONTROL 				20
+#define FTP_CLIENT_SOCKDATA 				21
+#define FTP_CLIENT_SOCKBUFSIZE 				22
+#define FTP_CLIENT_SOCKTIMEOUT 				23
 
 typedef struct NetBuf NetBuf_t;
 
@@ -74,6 +252,200 @@ typedef struct
     unsigned int 		idleTime;		/* callback if this many milliseconds have elapsed */
 } FtpClientCallbackOptions_t;
 
+typedef struct
+{
+	uint64_t bytes;				/* payload bytes of the last transfer */
+	uint32_t elapsedMs;			/* duration of the last transfer */
+	uint32_t chunkSize;			/* data chunk size at the end of the transfer */
+	uint32_t chunkSizeMax;		/* largest data chunk size used */
+	uint32_t bytesPerSec;		/* effective rate of the last transfer */
+	uint32_t throttledMs;		/* time the rate limiter held the last transfer */
+	uint64_t rawBytes;			/* file bytes before compression, bytes if not compressed */
+	uint32_t ratioPct;			/* bytes * 100 / rawBytes, 100 if not compressed */
+	uint32_t codecUs;			/* CPU time spent compressing or decompressing */
+	int compression;			/* FTP_CLIENT_COMPRESS_MODEZ, _GZIP or _OFF */
+	int hashAlg;				/* FTP_CLIENT_HASH_* of hash */
+	int hashLen;				/* bytes of hash, 0 if the transfer was not hashed */
+	int hashVerified;			/* 1 if the server's hash matched, -1 if not, 0 if not compared */
+	uint8_t hash[FTP_CLIENT_HASH_SIZE_MAX];	/* of the file data, CRC-32 most significant byte first */
+} FtpClientXferStats_t;
+
+typedef struct
+{
+	uint32_t hits;				/* sessions reused without login */
+	uint32_t misses;			/* sessions opened with connect and login */
+	uint32_t reconnects;		/* reused sessions found dead and replaced */
+	uint32_t expired;			/* idle sessions closed after the TTL */
+	uint32_t idle;				/* sessions currently waiting in the pool */
+	uint32_t inUse;				/* sessions currently handed out */
+} FtpClientPoolStats_t;
+
+typedef struct
+{
+	uint32_t size;				/* bytes of a block */
+	uint32_t inUse;				/* blocks currently handed out */
+	uint32_t highWater;			/* most blocks handed out at once */
+	uint32_t cached;			/* free blocks kept for reuse */
+	uint32_t hits;				/* blocks taken from the free list */
+	uint32_t misses;			/* blocks taken from the heap */
+	uint32_t failures;			/* blocks the heap could not provide */
+} FtpClientMemClassStats_t;
+
+typedef struct
+{
+	uint32_t netBufs;			/* FTP_CLIENT_NETBUF_POOL_SIZE */
+	uint32_t netBufsInUse;		/* data connections open */
+	uint32_t netBufsHighWater;	/* most data connections open at once */
+	uint32_t netBufsOverflow;	/* data connections allocated from the heap */
+	uint32_t netBufSize;		/* bytes of a data connection */
+	uint32_t controlSize;		/* bytes of a control connection */
+	FtpClientMemClassStats_t classes[FTP_CLIENT_MEM_CLASSES];
+} FtpClientMemStats_t;
+
+typedef struct
+{
+	uint32_t hits;				/* SIZE and MDTM answered from the cache */
+	uint32_t misses;			/* SIZE and MDTM sent to the server */
+	uint32_t stores;			/* results put into the cache */
+	uint32_t invalidations;		/* entries dropped because we changed the path */
+	uint32_t expired;			/* entries found older than the TTL */
+	uint32_t evictions;			/* entries replaced to make room */
+	uint32_t entries;			/* entries currently cached */
+} FtpClientMetaCacheStats_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t maxUs;
+	uint64_t totalUs;
+} FtpClientStatsTimer_t;
+
+/*
+ * Counters of a session, or of all sessions with ftpClientGetStats(NULL).
+ * recvHist[i] and sendHist[i] count the calls that moved up to 16 << (2 * i)
+ * bytes, the last entry the larger ones.
+ */
+typedef struct
+{
+	uint64_t bytesIn;			/* bytes received on control and data connections */
+	uint64_t bytesOut;			/* bytes sent on control and data connections */
+	uint32_t recvCalls;
+	uint32_t sendCalls;
+	uint32_t recvHist[FTP_CLIENT_STATS_HIST_SIZE];
+	uint32_t sendHist[FTP_CLIENT_STATS_HIST_SIZE];
+	uint64_t selectUs;			/* time blocked in select() */
+	FtpClientStatsTimer_t connect;	/* connect() until the greeting */
+	FtpClientStatsTimer_t login;	/* USER and PASS */
+	FtpClientStatsTimer_t pasv;		/* PASV or PORT and the data connection */
+	FtpClientStatsTimer_t ttfb;		/* transfer command until the first data byte */
+	FtpClientStatsTimer_t verb[FTP_CLIENT_STATS_VERBS];	/* round trip per command, see ftpClientStatsVerb() */
+	uint32_t transfers;
+	uint32_t retries;			/* resumed transfers and batch commands sent again */
+	uint64_t xferBytes;			/* data bytes of the transfers */
+	uint64_t xferUs;			/* start of the transfers until their final reply */
+	uint64_t throttleUs;		/* time the rate limiter held the transfers */
+	int64_t stageStart;			/* ftpClientPortTimeUs() when the last transfer started */
+	int64_t stageUs[FTP_CLIENT_STAGES];	/* us from stageStart, -1 if not reached */
+} FtpClientStats_t;
+
+/*
+ * One command of ftpClientBatch(). op, arg and arg2 are set by the caller,
+ * the other fields are filled in from the replies.
+ */
+typedef struct
+{
+	int op;						/* FTP_CLIENT_BATCH_* */
+	const char* arg;			/* remote path, or the command of SITE */
+	const char* arg2;			/* new name for FTP_CLIENT_BATCH_RENAME */
+	int result;					/* 1 if successful, 0 otherwise */
+	int code;					/* last reply code, 0 if there was no reply */
+	unsigned int size;			/* FTP_CLIENT_BATCH_SIZE */
+	char modDate[16];			/* FTP_CLIENT_BATCH_MDTM, YYYYMMDDHHMMSS */
+} FtpClientBatchCmd_t;
+
+/*
+ * One entry of ftpClientList(). name and unique point into a pool of
+ * interned strings that lives until ftpClientList() returns, so the
+ * callback may keep them without copying.
+ */
+typedef struct
+{
+	const char* name;
+	const char* unique;			/* MLSD unique fact */
+	uint64_t size;				/* bytes */
+	uint32_t modify;			/* seconds since 1970 UTC */
+	uint32_t perm;				/* MLSD perm letters, bit (letter - 'a') */
+	uint16_t mode;				/* UNIX permission bits of LIST or unix.mode */
+	uint16_t nameLen;
+	uint8_t type;				/* FTP_CLIENT_ENTRY_* */
+	uint8_t facts;				/* FTP_CLIENT_FACT_* */
+} FtpClientDirEntry_t;
+
+/* called for each entry of ftpClientList(), return 1 to go on, 0 to stop */
+typedef int (*FtpClientListCallback_t)(const FtpClientDirEntry_t* entry, void* arg);
+
+/* one action of ftpClientMirror() */
+typedef struct
+{
+	int action;					/* FTP_CLIENT_MIRROR_MKDIR, _NEW or _CHANGED */
+	const char* local;
+	const char* remote;
+	uint64_t size;				/* bytes of the source file */
+	int result;					/* 1 done, 0 failed, -1 planned by a dry run */
+} FtpClientMirrorItem_t;
+
+typedef void (*FtpClientMirrorCallback_t)(const FtpClientMirrorItem_t* item, void* arg);
+
+typedef struct
+{
+	int direction;				/* FTP_CLIENT_MIRROR_UPLOAD or _DOWNLOAD */
+	int compare;				/* FTP_CLIENT_MIRROR_SIZE | _MTIME, 0 for both */
+	int dryRun;					/* only report the delta */
+	int connections;			/* pooled connections for the files, 0 or 1 uses nControl */
+	FtpClientMirrorCallback_t cb;	/* optional, called for each action */
+	void* arg;
+} FtpClientMirrorOptions_t;
+
+/* counts of ftpClientMirror(), a dry run counts what it would do */
+typedef struct
+{
+	uint32_t dirs;				/* directories compared */
+	uint32_t files;				/* source files compared */
+	uint32_t same;				/* files left alone */
+	uint32_t mkdirs;			/* directories created */
+	uint32_t transfers;			/* files copied */
+	uint32_t failed;			/* failed actions */
+	uint64_t bytes;				/* bytes copied */
+} FtpClientMirrorStats_t;
+
+/*
+ * Streaming endpoints for ftpClientGetToSink() and ftpClientPutFromSource().
+ *
+ * getBuffer is optional. When set it returns the memory the data connection
+ * is read into (sink) or sent from (source) and stores its usable size in
+ * *size, so the payload can land directly in its final location. When it is
+ * NULL the client uses an internal buffer of FTP_CLIENT_BUFFER_SIZE bytes.
+ * getBuffer returns NULL on error.
+ *
+ * write returns the number of bytes consumed or -1 on error.
+ * read returns the number of bytes placed in buf, 0 at end of data or -1 on
+ * error. When buf is the memory handed out by getBuffer and already holds
+ * the data, read only has to return its length.
+ */
+typedef struct
+{
+	void* (*getBuffer)(int* size, void* arg);
+	int (*write)(const void* buf, int len, void* arg);
+	void* arg;
+} FtpClientSink_t;
+
+typedef struct
+{
+	void* (*getBuffer)(int* size, void* arg);
+	int (*read)(void* buf, int max, void* arg);
+	void* arg;
+} FtpClientSource_t;
+
 typedef struct
 {
 	/*Miscellaneous Functions*/
@@ -86,11 +458,28 @@ typedef struct
 			int max, NetBuf_t* nControl);
 	int (*ftpClientSetCallback)(const FtpClientCallbackOptions_t* opt, NetBuf_t* nControl);
 	int (*ftpClientClearCallback)(NetBuf_t* nControl);
+	int (*ftpClientGetXferStats)(FtpClientXferStats_t* stats, NetBuf_t* nControl);
+	unsigned long (*ftpClientGetRoundTripsSaved)(NetBuf_t* nControl);
+	int (*ftpClientGetMetaCacheStats)(FtpClientMetaCacheStats_t* stats, NetBuf_t* nControl);
+	int (*ftpClientGetStats)(FtpClientStats_t* stats, NetBuf_t* nControl);
+	void (*ftpClientResetStats)(NetBuf_t* nControl);
+	int (*ftpClientStatsJson)(char* buf, int max, NetBuf_t* nControl);
+	const char* (*ftpClientStatsVerb)(int index);
 	/*Server connection*/
 	int (*ftpClientConnect)(const char* host, uint16_t port, NetBuf_t** nControl);
 	int (*ftpClientLogin)(const char* user, const char* pass, NetBuf_t* nControl);
 	void (*ftpClientQuit)(NetBuf_t* nControl);
 	int (*ftpClientSetOptions)(int opt, long val, NetBuf_t* nControl);
+	/*Connection Pool*/
+	int (*ftpClientPoolAcquire)(const char* host, uint16_t port, const char* user,
+		const char* pass, NetBuf_t** nControl);
+	void (*ftpClientPoolRelease)(NetBuf_t* nControl);
+	void (*ftpClientPoolFlush)(void);
+	int (*ftpClientPoolGetStats)(FtpClientPoolStats_t* stats);
+	/*Memory Pools*/
+	int (*ftpClientMemGetStats)(FtpClientMemStats_t* stats);
+	int (*ftpClientMemReserve)(int size, int count);
+	void (*ftpClientMemFlush)(void);
 	/*Directory Functions*/
 	int (*ftpClientChangeDir)(const char* path, NetBuf_t* nControl);
 	int (*ftpClientMakeDir)(const char* path, NetBuf_t* nControl);
@@ -100,6 +489,8 @@ typedef struct
 		NetBuf_t* nControl);
 	int (*ftpClientMlsd)(const char* outputfile, const char* path,
 		NetBuf_t* nControl);
+	int (*ftpClientList)(const char* path, int format, FtpClientListCallback_t cb,
+		void* arg, NetBuf_t* nControl);
 	int (*ftpClientChangeDirUp)(NetBuf_t* nControl);
 	int (*ftpClientPwd)(char* path, int max, NetBuf_t* nControl);
 	/*File to File Transfer*/
@@ -107,8 +498,30 @@ typedef struct
 			char mode, NetBuf_t* nControl);
 	int (*ftpClientPut)(const char* inputfile, const char* path, char mode,
 		NetBuf_t* nControl);
+	int (*ftpClientGetSegmented)(const char* outputfile, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientResume)(const char* localfile, NetBuf_t* nControl);
 	int (*ftpClientDelete)(const char* fnm, NetBuf_t* nControl);
 	int (*ftpClientRename)(const char* src, const char* dst, NetBuf_t* nControl);
+	int (*ftpClientBatch)(FtpClientBatchCmd_t* cmds, int count, NetBuf_t* nControl);
+	int (*ftpClientMirror)(const char* localDir, const char* remoteDir,
+		const FtpClientMirrorOptions_t* opt, FtpClientMirrorStats_t* stats, NetBuf_t* nControl);
+	/*File to Stream Transfer*/
+	int (*ftpClientGetToSink)(const FtpClientSink_t* sink, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientPutFromSource)(const FtpClientSource_t* source, const char* path,
+			char mode, NetBuf_t* nControl);
+	/*File to Memory Transfer*/
+	int (*ftpClientGetToBuffer)(void* buf, size_t size, size_t* len, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientGetToMemory)(char** buf, size_t* len, size_t max, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientPutFromBuffer)(const void* buf, size_t len, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientGetToStream)(FtpClientPortStream_t* stream, const char* path,
+			char mode, NetBuf_t* nControl);
+	int (*ftpClientPutFromStream)(FtpClientPortStream_t* stream, const char* path,
+			char mode, NetBuf_t* nControl);
 	/*File to Program Transfer*/
 	int (*ftpClientAccess)(const char* path, int typ, int mode, NetBuf_t* nControl,
 	    NetBuf_t** nData);
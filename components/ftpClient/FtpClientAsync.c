@@ -0,0 +1,1088 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client asynchronous engine
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include "FtpClientAsync.h"
+#include "FtpClientPort.h"
+#include "FtpClientMem.h"
+#include "FtpClientSock.h"
+#include "FtpClientText.h"
+
+#include "netdb.h"
+
+#include "esp_log.h"
+
+#define FTP_ASYNC_LINE_SIZE					256
+#define FTP_ASYNC_LOGIN_SIZE				64
+
+/* operation kinds */
+#define OP_CONNECT							0
+#define OP_COMMAND							1
+#define OP_GET								2
+#define OP_PUT								3
+#define OP_QUIT								4
+
+/* operation stages */
+#define ST_START							0	/* queued */
+#define ST_CONNECT							1	/* control connection in progress */
+#define ST_GREETING							2
+#define ST_USER								3
+#define ST_PASS								4
+#define ST_REPLY							5	/* command sent, waiting for the final reply */
+#define ST_TYPE								6
+#define ST_PASV								7
+#define ST_PRELIM							8	/* RETR/STOR sent, waiting for 150 */
+#define ST_DATA								9	/* data connection open */
+
+struct FtpClientOp {
+	FtpClientOp_t* next;
+	FtpClientSession_t* session;
+	int kind;
+	int stage;
+	char mode;
+	char expresp;
+	char* text;
+	FtpClientSink_t sink;
+	FtpClientSource_t source;
+	FtpClientAsyncCallback_t cb;
+	void* arg;
+	int status;
+	int released;
+	int cancelled;
+	int failed;
+	uint64_t bytes;
+	char response[FTP_CLIENT_ASYNC_RESPONSE_SIZE];
+};
+
+struct FtpClientSession {
+	FtpClientSession_t* next;
+	FtpClientLoop_t* loop;
+	int ctl;
+	int data;
+	int dataConnecting;
+	int finalCode;
+	int closing;
+	int sendErr;
+	char type;
+	char cr;
+	struct sockaddr_in addr;
+	char user[FTP_ASYNC_LOGIN_SIZE];
+	char pass[FTP_ASYNC_LOGIN_SIZE];
+	FtpClientOp_t* head;
+	FtpClientOp_t* tail;
+	int64_t deadline;
+	/* data of the transfer in progress */
+	char* dbuf;
+	int dbufsize;
+	char* ibuf;
+	char* dptr;
+	int dlen;
+	int doff;
+	int eof;
+	/* control connection */
+	int multi;
+	int inlen;
+	char in[FTP_ASYNC_LINE_SIZE];
+	int outlen;
+	int outoff;
+	char out[FTP_CLIENT_TEMP_BUFFER_SIZE + 8];
+	char response[FTP_ASYNC_LINE_SIZE];
+};
+
+struct FtpClientLoop {
+	FtpClientSession_t* sessions;
+	int pending;
+};
+
+static FtpClientPortOnce_t isInitilized = FTP_CLIENT_PORT_ONCE_INIT;
+static FtpClientAsync ftpClientAsync_;
+
+static void sessionKick(FtpClientSession_t* s);
+static void sessionFail(FtpClientSession_t* s, const char* why);
+
+
+
+/*
+ * setNonBlocking - switch a socket to non-blocking mode
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int setNonBlocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return 0;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+
+
+static void opFree(FtpClientOp_t* op)
+{
+	free(op->text);
+	free(op);
+}
+
+
+
+/*
+ * opComplete - finish an operation and start the next one of its session
+ */
+static void opComplete(FtpClientOp_t* op, int result, const char* response)
+{
+	FtpClientSession_t* s = op->session;
+	FtpClientOp_t** pp = &s->head;
+	FtpClientOp_t* prev = NULL;
+	while (*pp && (*pp != op)) {
+		prev = *pp;
+		pp = &(*pp)->next;
+	}
+	if (*pp == op) {
+		*pp = op->next;
+		if (s->tail == op)
+			s->tail = prev;
+	}
+	s->loop->pending--;
+	if (op->cancelled) {
+		result = 0;
+		response = "Cancelled";
+	}
+	op->status = result ? FTP_CLIENT_ASYNC_DONE : FTP_CLIENT_ASYNC_FAILED;
+	if (response != op->response)
+		snprintf(op->response, sizeof(op->response), "%s", response ? response : s->response);
+	ESP_LOGD(__FUNCTION__, "op %d result %d %s", op->kind, result, op->response);
+	if (op->cb) {
+		op->cb(op, result, op->response, op->arg);
+		opFree(op);
+	}
+	else if (op->released)
+		opFree(op);
+	s->deadline = ftpClientPortTimeUs() + FTP_CLIENT_ASYNC_TIMEOUT * 1000LL;
+}
+
+
+
+static void dataClose(FtpClientSession_t* s)
+{
+	if (s->data >= 0)
+		closesocket(s->data);
+	s->data = -1;
+	s->dataConnecting = 0;
+}
+
+
+
+static void transferFree(FtpClientSession_t* s)
+{
+	dataClose(s);
+	ftpClientMemFree(s->dbuf);
+	ftpClientMemFree(s->ibuf);
+	s->dbuf = s->ibuf = s->dptr = NULL;
+	s->dlen = s->doff = 0;
+}
+
+
+
+/*
+ * sessionFail - close the connections of a session and fail its operations
+ */
+static void sessionFail(FtpClientSession_t* s, const char* why)
+{
+	if (s->ctl >= 0)
+		closesocket(s->ctl);
+	s->ctl = -1;
+	s->type = 0;
+	s->outlen = s->outoff = s->inlen = s->multi = s->sendErr = 0;
+	transferFree(s);
+	snprintf(s->response, sizeof(s->response), "%s", why);
+	while (s->head) {
+		FtpClientOp_t* op = s->head;
+		/* a quit of a dead session is successful */
+		opComplete(op, op->kind == OP_QUIT, why);
+	}
+}
+
+
+
+/*
+ * sessionFlush - send pending control data
+ *
+ * An error is only recorded, the session fails in sessionEvents() where
+ * no operation is in the middle of a state change.
+ */
+static void sessionFlush(FtpClientSession_t* s)
+{
+	while ((s->ctl >= 0) && !s->sendErr && (s->outoff < s->outlen)) {
+		int w = send(s->ctl, s->out + s->outoff, s->outlen - s->outoff, 0);
+		if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (w <= 0) {
+			s->sendErr = (w < 0) ? errno : EPIPE;
+			return;
+		}
+		s->outoff += w;
+	}
+}
+
+
+
+/*
+ * sessionSend - queue a command line on the control connection
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int sessionSend(FtpClientSession_t* s, const char* fmt, ...)
+{
+	if (s->outoff == s->outlen)
+		s->outoff = s->outlen = 0;
+	va_list ap;
+	va_start(ap, fmt);
+	int l = vsnprintf(s->out + s->outlen, sizeof(s->out) - s->outlen - 2, fmt, ap);
+	va_end(ap);
+	if ((l < 0) || ((size_t)l >= (sizeof(s->out) - s->outlen - 2)))
+		return 0;
+	#if FTP_CLIENT_DEBUG == 2
+	printf("FTP Client async: %s\n\r", s->out + s->outlen);
+	#endif
+	s->outlen += l;
+	s->out[s->outlen++] = '\r';
+	s->out[s->outlen++] = '\n';
+	sessionFlush(s);
+	return 1;
+}
+
+
+
+/*
+ * transferStart - open the data connection after a 227 reply
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int transferStart(FtpClientSession_t* s, FtpClientOp_t* op)
+{
+	char* cp = strchr(s->response, '(');
+	unsigned int v[6];
+	if ((cp == NULL) || (sscanf(cp + 1, "%u,%u,%u,%u,%u,%u",
+			&v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)) {
+		snprintf(s->response, sizeof(s->response), "Invalid PASV reply");
+		return 0;
+	}
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl((v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3]);
+	sin.sin_port = htons((v[4] << 8) | v[5]);
+
+	s->dbufsize = FTP_CLIENT_BUFFER_SIZE;
+	s->dbuf = ftpClientMemAlloc((op->mode == FTP_CLIENT_ASCII) ? (s->dbufsize * 2) : s->dbufsize, NULL);
+	if ((op->kind == OP_PUT) && (op->mode == FTP_CLIENT_ASCII))
+		s->ibuf = ftpClientMemAlloc(s->dbufsize, NULL);
+	if ((s->dbuf == NULL) || ((op->kind == OP_PUT) && (op->mode == FTP_CLIENT_ASCII) && (s->ibuf == NULL))) {
+		snprintf(s->response, sizeof(s->response), "%s", strerror(ENOMEM));
+		return 0;
+	}
+	s->data = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if ((s->data < 0) || !setNonBlocking(s->data)) {
+		snprintf(s->response, sizeof(s->response), "%s", strerror(errno));
+		return 0;
+	}
+	ftpClientSockProfile(s->data, FTP_CLIENT_SOCK_LOWLATENCY, FTP_CLIENT_SOCK_BUFFER_SIZE,
+		FTP_CLIENT_SOCK_TIMEOUT);
+	if (connect(s->data, (struct sockaddr*)&sin, sizeof(sin)) == 0)
+		s->dataConnecting = 0;
+	else if (errno == EINPROGRESS)
+		s->dataConnecting = 1;
+	else {
+		snprintf(s->response, sizeof(s->response), "%s", strerror(errno));
+		return 0;
+	}
+	s->finalCode = 0;
+	s->cr = 0;
+	s->eof = 0;
+	return sessionSend(s, "%s %s", (op->kind == OP_GET) ? "RETR" : "STOR", op->text);
+}
+
+
+
+/*
+ * transferCheck - complete a transfer once the data connection is closed
+ * and the final reply has arrived
+ */
+static void transferCheck(FtpClientSession_t* s, FtpClientOp_t* op)
+{
+	if ((s->data >= 0) || (s->finalCode == 0))
+		return;
+	int result = !op->failed && ((s->finalCode / 100) == 2);
+	transferFree(s);
+	opComplete(op, result, op->failed ? op->response : NULL);
+}
+
+
+
+/*
+ * transferFail - stop a transfer after a local error
+ *
+ * The data connection is closed and the operation completes with the
+ * final reply, so the control connection stays in step.
+ */
+static void transferFail(FtpClientSession_t* s, FtpClientOp_t* op, const char* why)
+{
+	if (!op->failed)
+		snprintf(op->response, sizeof(op->response), "%s", why);
+	op->failed = 1;
+	dataClose(s);
+	transferCheck(s, op);
+}
+
+
+
+/*
+ * dataRead - move received data of a GET to the sink
+ */
+static void dataRead(FtpClientSession_t* s, FtpClientOp_t* op)
+{
+	char* buf = s->dbuf;
+	int max = s->dbufsize;
+	if ((op->mode == FTP_CLIENT_IMAGE) && op->sink.getBuffer) {
+		buf = op->sink.getBuffer(&max, op->sink.arg);
+		if (buf == NULL) {
+			transferFail(s, op, "Sink has no buffer");
+			return;
+		}
+	}
+	/* ASCII keeps room for a CR held back from the previous chunk */
+	int skip = (op->mode == FTP_CLIENT_ASCII) ? 1 : 0;
+	int n = recv(s->data, buf + skip, max - skip, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n < 0) {
+		transferFail(s, op, strerror(errno));
+		return;
+	}
+	if (n == 0) {
+		if (s->cr && (op->sink.write("\r", 1, op->sink.arg) != 1))
+			op->failed = 1;
+		dataClose(s);
+		transferCheck(s, op);
+		return;
+	}
+	int len = n;
+	if (op->mode == FTP_CLIENT_ASCII) {
+		char* in = buf + 1;
+		if (s->cr) {
+			buf[0] = '\r';
+			in = buf;
+			len++;
+		}
+		len = ftpClientTextFromCrlf(in, len, buf, &s->cr);
+	}
+	op->bytes += n;
+	if ((len > 0) && (op->sink.write(buf, len, op->sink.arg) != len))
+		transferFail(s, op, "Sink write failed");
+}
+
+
+
+/*
+ * dataWrite - send data of a PUT from the source
+ */
+static void dataWrite(FtpClientSession_t* s, FtpClientOp_t* op)
+{
+	if (s->doff == s->dlen) {
+		if (s->eof) {
+			dataClose(s);
+			transferCheck(s, op);
+			return;
+		}
+		int n;
+		s->doff = 0;
+		if (op->mode == FTP_CLIENT_ASCII) {
+			n = op->source.read(s->ibuf, s->dbufsize, op->source.arg);
+			size_t in = (n > 0) ? n : 0;
+			s->dptr = s->dbuf;
+			s->dlen = ftpClientTextToCrlf(s->ibuf, &in, s->dbuf, s->dbufsize * 2, &s->cr);
+		}
+		else if (op->source.getBuffer) {
+			int max = 0;
+			s->dptr = op->source.getBuffer(&max, op->source.arg);
+			if (s->dptr == NULL) {
+				transferFail(s, op, "Source has no buffer");
+				return;
+			}
+			n = (max > 0) ? op->source.read(s->dptr, max, op->source.arg) : 0;
+			s->dlen = n;
+		}
+		else {
+			s->dptr = s->dbuf;
+			n = op->source.read(s->dbuf, s->dbufsize, op->source.arg);
+			s->dlen = n;
+		}
+		if (n < 0) {
+			transferFail(s, op, "Source read failed");
+			return;
+		}
+		op->bytes += n;
+		if (n == 0) {
+			s->eof = 1;
+			s->dlen = 0;
+			dataClose(s);
+			transferCheck(s, op);
+			return;
+		}
+	}
+	int w = send(s->data, s->dptr + s->doff, s->dlen - s->doff, 0);
+	if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (w <= 0) {
+		transferFail(s, op, strerror(errno));
+		return;
+	}
+	s->doff += w;
+}
+
+
+
+/*
+ * onReply - advance the active operation with a final or preliminary reply
+ */
+static void onReply(FtpClientSession_t* s, int code)
+{
+	FtpClientOp_t* op = s->head;
+	if ((op == NULL) || (op->stage == ST_START)) {
+		/* unsolicited, e.g. 421 on an idle timeout */
+		if (code == 421)
+			sessionFail(s, s->response);
+		return;
+	}
+	int c = code / 100;
+	if ((c == 1) && (op->stage != ST_PRELIM))
+		return;
+	switch (op->stage) {
+		case ST_GREETING:
+		{
+			if ((c != 2) || !sessionSend(s, "USER %s", s->user)) {
+				sessionFail(s, s->response);
+				return;
+			}
+			op->stage = ST_USER;
+		}
+		break;
+
+		case ST_USER:
+		{
+			if (c == 2)
+				opComplete(op, 1, NULL);
+			else if ((c == 3) && sessionSend(s, "PASS %s", s->pass))
+				op->stage = ST_PASS;
+			else
+				opComplete(op, 0, NULL);
+		}
+		break;
+
+		case ST_PASS:
+		case ST_REPLY:
+		{
+			if (op->kind == OP_QUIT) {
+				sessionFail(s, s->response);
+				return;
+			}
+			char expresp = (op->stage == ST_PASS) ? '2' : op->expresp;
+			opComplete(op, s->response[0] == expresp, NULL);
+		}
+		break;
+
+		case ST_TYPE:
+		{
+			if (c != 2) {
+				s->type = 0;
+				opComplete(op, 0, NULL);
+				return;
+			}
+			s->type = op->mode;
+			if (op->cancelled || !sessionSend(s, "PASV")) {
+				opComplete(op, 0, NULL);
+				return;
+			}
+			op->stage = ST_PASV;
+		}
+		break;
+
+		case ST_PASV:
+		{
+			if ((c != 2) || op->cancelled || !transferStart(s, op)) {
+				transferFree(s);
+				opComplete(op, 0, NULL);
+				return;
+			}
+			op->stage = ST_PRELIM;
+		}
+		break;
+
+		case ST_PRELIM:
+		{
+			if ((c == 4) || (c == 5)) {
+				transferFree(s);
+				opComplete(op, 0, NULL);
+				return;
+			}
+			op->stage = ST_DATA;
+			if (c == 1)
+				break;
+		}
+		/* fall through - the final reply came without a preliminary one */
+		case ST_DATA:
+		{
+			if (c == 1)
+				break;
+			s->finalCode = code;
+			/* a failed transfer does not wait for the data connection */
+			if ((c == 4) || (c == 5))
+				dataClose(s);
+			transferCheck(s, op);
+		}
+		break;
+	}
+}
+
+
+
+/*
+ * controlRead - read and parse replies on the control connection
+ */
+static void controlRead(FtpClientSession_t* s)
+{
+	int n = recv(s->ctl, s->in + s->inlen, sizeof(s->in) - s->inlen, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n <= 0) {
+		sessionFail(s, (n == 0) ? "Connection closed by server" : strerror(errno));
+		return;
+	}
+	s->inlen += n;
+	s->deadline = ftpClientPortTimeUs() + FTP_CLIENT_ASYNC_TIMEOUT * 1000LL;
+	/* the next reply must not wait for the ACK of this one */
+	ftpClientSockQuickAck(s->ctl);
+	while (s->ctl >= 0) {
+		char* eol = memchr(s->in, '\n', s->inlen);
+		if (eol == NULL) {
+			/* an overlong line is cut */
+			if (s->inlen == sizeof(s->in))
+				eol = &s->in[s->inlen - 1];
+			else
+				break;
+		}
+		int l = eol - s->in + 1;
+		char line[FTP_ASYNC_LINE_SIZE];
+		int ll = l;
+		while ((ll > 0) && ((s->in[ll - 1] == '\n') || (s->in[ll - 1] == '\r')))
+			ll--;
+		memcpy(line, s->in, ll);
+		line[ll] = '\0';
+		memmove(s->in, s->in + l, s->inlen - l);
+		s->inlen -= l;
+		#if FTP_CLIENT_DEBUG == 2
+		printf("FTP Client async response: %s\n\r", line);
+		#endif
+		int code = 0;
+		if ((ll >= 3) && (line[0] >= '1') && (line[0] <= '5'))
+			code = atoi(line);
+		if (s->multi) {
+			/* inside a multi-line reply only "xyz " ends it */
+			if ((code != s->multi) || (line[3] != ' '))
+				continue;
+			s->multi = 0;
+		}
+		else if (code == 0)
+			continue;
+		else if (line[3] == '-') {
+			s->multi = code;
+			continue;
+		}
+		snprintf(s->response, sizeof(s->response), "%s", line);
+		onReply(s, code);
+	}
+}
+
+
+
+/*
+ * opStart - start the operation at the head of a session
+ */
+static void opStart(FtpClientSession_t* s, FtpClientOp_t* op)
+{
+	s->deadline = ftpClientPortTimeUs() + FTP_CLIENT_ASYNC_TIMEOUT * 1000LL;
+	if (s->sendErr) {
+		sessionFail(s, strerror(s->sendErr));
+		return;
+	}
+	if (op->kind == OP_CONNECT) {
+		s->ctl = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if ((s->ctl < 0) || !setNonBlocking(s->ctl)) {
+			sessionFail(s, strerror(errno));
+			return;
+		}
+		ftpClientSockProfile(s->ctl, FTP_CLIENT_SOCK_LOWLATENCY, FTP_CLIENT_SOCK_BUFFER_SIZE,
+			FTP_CLIENT_SOCK_TIMEOUT);
+		if (connect(s->ctl, (struct sockaddr*)&s->addr, sizeof(s->addr)) == 0)
+			op->stage = ST_GREETING;
+		else if (errno == EINPROGRESS)
+			op->stage = ST_CONNECT;
+		else
+			sessionFail(s, strerror(errno));
+		return;
+	}
+	if (s->ctl < 0) {
+		opComplete(op, op->kind == OP_QUIT, "Not connected");
+		return;
+	}
+	switch (op->kind) {
+		case OP_COMMAND:
+			op->stage = ST_REPLY;
+			if (!sessionSend(s, "%s", op->text))
+				opComplete(op, 0, "Command too long");
+			break;
+
+		case OP_QUIT:
+			op->stage = ST_REPLY;
+			if (!sessionSend(s, "QUIT"))
+				sessionFail(s, "QUIT");
+			break;
+
+		case OP_GET:
+		case OP_PUT:
+			if (s->type == op->mode) {
+				op->stage = ST_PASV;
+				sessionSend(s, "PASV");
+			}
+			else {
+				op->stage = ST_TYPE;
+				sessionSend(s, "TYPE %c", op->mode);
+			}
+			break;
+	}
+}
+
+
+
+/*
+ * sessionKick - start queued operations of a session
+ */
+static void sessionKick(FtpClientSession_t* s)
+{
+	while (s->head && (s->head->stage == ST_START))
+		opStart(s, s->head);
+}
+
+
+
+/*
+ * sessionEvents - handle readiness of the sockets of a session
+ */
+static void sessionEvents(FtpClientSession_t* s, fd_set* rfd, fd_set* wfd, int64_t now)
+{
+	FtpClientOp_t* op = s->head;
+	if ((s->ctl >= 0) && op && (op->stage == ST_CONNECT) && FD_ISSET(s->ctl, wfd)) {
+		int err = 0;
+		socklen_t l = sizeof(err);
+		getsockopt(s->ctl, SOL_SOCKET, SO_ERROR, &err, &l);
+		if (err != 0) {
+			sessionFail(s, strerror(err));
+			return;
+		}
+		op->stage = ST_GREETING;
+	}
+	if ((s->ctl >= 0) && FD_ISSET(s->ctl, wfd))
+		sessionFlush(s);
+	if ((s->ctl >= 0) && FD_ISSET(s->ctl, rfd))
+		controlRead(s);
+
+	op = s->head;
+	if ((s->data >= 0) && op && ((op->kind == OP_GET) || (op->kind == OP_PUT))) {
+		if (s->dataConnecting && FD_ISSET(s->data, wfd)) {
+			int err = 0;
+			socklen_t l = sizeof(err);
+			getsockopt(s->data, SOL_SOCKET, SO_ERROR, &err, &l);
+			if (err != 0)
+				transferFail(s, op, strerror(err));
+			else
+				s->dataConnecting = 0;
+		}
+		else if (!s->dataConnecting) {
+			s->deadline = now + FTP_CLIENT_ASYNC_TIMEOUT * 1000LL;
+			if ((op->kind == OP_GET) && FD_ISSET(s->data, rfd))
+				dataRead(s, op);
+			else if ((op->kind == OP_PUT) && FD_ISSET(s->data, wfd))
+				dataWrite(s, op);
+		}
+	}
+
+	if (s->sendErr)
+		sessionFail(s, strerror(s->sendErr));
+	else if (s->head && (s->head->stage != ST_START) && (now > s->deadline))
+		sessionFail(s, "Timeout");
+	sessionKick(s);
+}
+
+
+
+/*
+ * loopReap - free the sessions whose quit has completed
+ */
+static void loopReap(FtpClientLoop_t* loop)
+{
+	FtpClientSession_t** pp = &loop->sessions;
+	while (*pp) {
+		FtpClientSession_t* s = *pp;
+		if (s->closing && (s->head == NULL)) {
+			*pp = s->next;
+			transferFree(s);
+			free(s);
+			continue;
+		}
+		pp = &s->next;
+	}
+}
+
+
+
+/*
+ * ftpClientAsyncRun - wait for socket events and advance all sessions
+ *
+ * return number of operations still pending, -1 on error
+ */
+static int runFtpClientAsync(FtpClientLoop_t* loop, int timeoutMs)
+{
+	fd_set rfd, wfd;
+	FD_ZERO(&rfd);
+	FD_ZERO(&wfd);
+	int maxfd = -1;
+	int64_t now = ftpClientPortTimeUs();
+	int64_t wake = now + (int64_t)timeoutMs * 1000;
+	for (FtpClientSession_t* s = loop->sessions; s; s = s->next) {
+		sessionKick(s);
+		FtpClientOp_t* op = s->head;
+		if ((op == NULL) && (s->ctl < 0))
+			continue;
+		if (s->ctl >= 0) {
+			FD_SET(s->ctl, &rfd);
+			if ((s->outoff < s->outlen) || (op && (op->stage == ST_CONNECT)))
+				FD_SET(s->ctl, &wfd);
+			if (s->ctl > maxfd)
+				maxfd = s->ctl;
+		}
+		if (s->data >= 0) {
+			if (s->dataConnecting || (op && (op->kind == OP_PUT)))
+				FD_SET(s->data, &wfd);
+			else
+				FD_SET(s->data, &rfd);
+			if (s->data > maxfd)
+				maxfd = s->data;
+		}
+		if (op && (op->stage != ST_START) && (s->deadline < wake))
+			wake = s->deadline;
+	}
+	if (loop->pending == 0) {
+		loopReap(loop);
+		return 0;
+	}
+
+	int64_t us = wake - now;
+	if (us < 0)
+		us = 0;
+	struct timeval tv = { us / 1000000, us % 1000000 };
+	int rv = select(maxfd + 1, &rfd, &wfd, NULL, &tv);
+	if (rv < 0) {
+		if (errno == EINTR)
+			return loop->pending;
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client async: select");
+		#endif
+		return -1;
+	}
+	now = ftpClientPortTimeUs();
+	if (rv == 0) {
+		FD_ZERO(&rfd);
+		FD_ZERO(&wfd);
+	}
+	for (FtpClientSession_t* s = loop->sessions; s; s = s->next)
+		sessionEvents(s, &rfd, &wfd, now);
+	loopReap(loop);
+	return loop->pending;
+}
+
+
+
+/*
+ * opCreate - queue a new operation on a session
+ */
+static FtpClientOp_t* opCreate(FtpClientSession_t* s, int kind, const char* text,
+	FtpClientAsyncCallback_t cb, void* arg)
+{
+	if ((s == NULL) || s->closing)
+		return NULL;
+	FtpClientOp_t* op = calloc(1, sizeof(FtpClientOp_t));
+	if (op == NULL)
+		return NULL;
+	if (text) {
+		/* not strdup(), so the copy comes from the same allocator as free() */
+		size_t l = strlen(text) + 1;
+		if ((op->text = malloc(l)) == NULL) {
+			free(op);
+			return NULL;
+		}
+		memcpy(op->text, text, l);
+	}
+	op->session = s;
+	op->kind = kind;
+	op->stage = ST_START;
+	op->cb = cb;
+	op->arg = arg;
+	op->status = FTP_CLIENT_ASYNC_PENDING;
+	if (s->tail)
+		s->tail->next = op;
+	else
+		s->head = op;
+	s->tail = op;
+	s->loop->pending++;
+	return op;
+}
+
+
+
+static FtpClientLoop_t* createFtpClientAsync(void)
+{
+	return calloc(1, sizeof(FtpClientLoop_t));
+}
+
+
+
+/*
+ * destroyFtpClientAsync - close all sessions and free the loop
+ *
+ * Pending operations fail, their callbacks are called.
+ */
+static void destroyFtpClientAsync(FtpClientLoop_t* loop)
+{
+	while (loop->sessions) {
+		FtpClientSession_t* s = loop->sessions;
+		loop->sessions = s->next;
+		sessionFail(s, "Destroyed");
+		free(s);
+	}
+	free(loop);
+}
+
+
+
+/*
+ * connectFtpClientAsync - open a session and log in
+ *
+ * The session handle is valid at once, so operations can be queued
+ * before the login completes. A name is resolved before returning.
+ */
+static FtpClientOp_t* connectFtpClientAsync(FtpClientLoop_t* loop, const char* host,
+	uint16_t port, const char* user, const char* pass,
+	FtpClientSession_t** session, FtpClientAsyncCallback_t cb, void* arg)
+{
+	if ((strlen(user) >= FTP_ASYNC_LOGIN_SIZE) || (strlen(pass) >= FTP_ASYNC_LOGIN_SIZE))
+		return NULL;
+	FtpClientSession_t* s = calloc(1, sizeof(FtpClientSession_t));
+	if (s == NULL)
+		return NULL;
+	s->addr.sin_family = AF_INET;
+	s->addr.sin_port = htons(port);
+	s->addr.sin_addr.s_addr = inet_addr(host);
+	if (s->addr.sin_addr.s_addr == 0xffffffff) {
+		struct addrinfo hints, *res;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		if ((getaddrinfo(host, NULL, &hints, &res) != 0) || (res == NULL)) {
+			free(s);
+			return NULL;
+		}
+		s->addr.sin_addr = ((struct sockaddr_in*)res->ai_addr)->sin_addr;
+		freeaddrinfo(res);
+	}
+	s->loop = loop;
+	s->ctl = -1;
+	s->data = -1;
+	strcpy(s->user, user);
+	strcpy(s->pass, pass);
+	s->next = loop->sessions;
+	loop->sessions = s;
+	FtpClientOp_t* op = opCreate(s, OP_CONNECT, NULL, cb, arg);
+	if (op == NULL) {
+		loop->sessions = s->next;
+		free(s);
+		return NULL;
+	}
+	*session = s;
+	return op;
+}
+
+
+
+/*
+ * commandFtpClientAsync - send a command, expresp is the expected first
+ * digit of the reply
+ */
+static FtpClientOp_t* commandFtpClientAsync(FtpClientSession_t* session,
+	const char* cmd, char expresp, FtpClientAsyncCallback_t cb, void* arg)
+{
+	FtpClientOp_t* op = opCreate(session, OP_COMMAND, cmd, cb, arg);
+	if (op)
+		op->expresp = expresp;
+	return op;
+}
+
+
+
+static FtpClientOp_t* getFtpClientAsync_(FtpClientSession_t* session, const char* path,
+	char mode, const FtpClientSink_t* sink, FtpClientAsyncCallback_t cb, void* arg)
+{
+	if ((mode != FTP_CLIENT_ASCII) && (mode != FTP_CLIENT_IMAGE))
+		return NULL;
+	FtpClientOp_t* op = opCreate(session, OP_GET, path, cb, arg);
+	if (op) {
+		op->mode = mode;
+		op->sink = *sink;
+	}
+	return op;
+}
+
+
+
+static FtpClientOp_t* putFtpClientAsync(FtpClientSession_t* session, const char* path,
+	char mode, const FtpClientSource_t* source, FtpClientAsyncCallback_t cb, void* arg)
+{
+	if ((mode != FTP_CLIENT_ASCII) && (mode != FTP_CLIENT_IMAGE))
+		return NULL;
+	FtpClientOp_t* op = opCreate(session, OP_PUT, path, cb, arg);
+	if (op) {
+		op->mode = mode;
+		op->source = *source;
+	}
+	return op;
+}
+
+
+
+/*
+ * quitFtpClientAsync - close a session after its queued operations
+ *
+ * The session handle is freed once the quit completes.
+ */
+static FtpClientOp_t* quitFtpClientAsync(FtpClientSession_t* session,
+	FtpClientAsyncCallback_t cb, void* arg)
+{
+	FtpClientOp_t* op = opCreate(session, OP_QUIT, NULL, cb, arg);
+	if (op)
+		session->closing = 1;
+	return op;
+}
+
+
+
+static int statusFtpClientAsync(FtpClientOp_t* op)
+{
+	return op->status;
+}
+
+
+
+static const char* responseFtpClientAsync(FtpClientOp_t* op)
+{
+	return (op->status == FTP_CLIENT_ASYNC_PENDING) ? op->session->response : op->response;
+}
+
+
+
+static uint64_t bytesFtpClientAsync(FtpClientOp_t* op)
+{
+	return op->bytes;
+}
+
+
+
+/*
+ * cancelFtpClientAsync - stop an operation
+ *
+ * A queued operation fails at once. An active transfer closes its data
+ * connection and fails with the final reply of the server.
+ */
+static void cancelFtpClientAsync(FtpClientOp_t* op)
+{
+	if (op->status != FTP_CLIENT_ASYNC_PENDING)
+		return;
+	FtpClientSession_t* s = op->session;
+	op->cancelled = 1;
+	if (op->stage == ST_START) {
+		opComplete(op, 0, "Cancelled");
+		return;
+	}
+	if (op->kind == OP_CONNECT) {
+		sessionFail(s, "Cancelled");
+		return;
+	}
+	if (((op->kind == OP_GET) || (op->kind == OP_PUT)) && (s->data >= 0))
+		transferFail(s, op, "Cancelled");
+}
+
+
+
+/*
+ * releaseFtpClientAsync - free the handle of an operation without callback
+ */
+static void releaseFtpClientAsync(FtpClientOp_t* op)
+{
+	if (op->status == FTP_CLIENT_ASYNC_PENDING)
+		op->released = 1;
+	else
+		opFree(op);
+}
+
+
+
+static void initFtpClientAsync(void)
+{
+	ftpClientMemInit();
+	ftpClientAsync_.ftpClientAsyncCreate = createFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncDestroy = destroyFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncRun = runFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncConnect = connectFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncCommand = commandFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncGet = getFtpClientAsync_;
+	ftpClientAsync_.ftpClientAsyncPut = putFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncQuit = quitFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncStatus = statusFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncResponse = responseFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncBytes = bytesFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncCancel = cancelFtpClientAsync;
+	ftpClientAsync_.ftpClientAsyncRelease = releaseFtpClientAsync;
+}
+
+
+
+FtpClientAsync* getFtpClientAsync(void)
+{
+	ftpClientPortOnce(&isInitilized, initFtpClientAsync);
+	return &ftpClientAsync_;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client asynchronous engine
+ *
+ * One task drives many sessions. All sockets are non-blocking and
+ * ftpClientAsyncRun() waits on every control and data connection with a
+ * single select(), advancing each session as a state machine. Operations
+ * queued on a session run in order and report through a completion
+ * callback, or through a handle that is polled with ftpClientAsyncStatus()
+ * when no callback is given. Data connections are passive.
+ *
+ * The engine is not thread safe: create sessions, queue operations and
+ * call ftpClientAsyncRun() from the same task.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTASYNC_H_
+#define FTPCLIENTASYNC_H_
+
+#include "FtpClient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FTP_CLIENT_ASYNC_TIMEOUT 			30000	/* ms without progress before an operation fails */
+#define FTP_CLIENT_ASYNC_RESPONSE_SIZE 		256
+
+/* ftpClientAsyncStatus() */
+#define FTP_CLIENT_ASYNC_PENDING 			0
+#define FTP_CLIENT_ASYNC_DONE 				1
+#define FTP_CLIENT_ASYNC_FAILED 			2
+
+typedef struct FtpClientLoop FtpClientLoop_t;
+typedef struct FtpClientSession FtpClientSession_t;
+typedef struct FtpClientOp FtpClientOp_t;
+
+/*
+ * Completion callback. result is 1 if successful, 0 otherwise, response is
+ * the last reply of the server or the reason of the failure. The operation
+ * handle is freed when the callback returns.
+ */
+typedef void (*FtpClientAsyncCallback_t)(FtpClientOp_t* op, int result,
+	const char* response, void* arg);
+
+typedef struct
+{
+	/*Event Loop*/
+	FtpClientLoop_t* (*ftpClientAsyncCreate)(void);
+	void (*ftpClientAsyncDestroy)(FtpClientLoop_t* loop);
+	int (*ftpClientAsyncRun)(FtpClientLoop_t* loop, int timeoutMs);
+	/*Session Operations*/
+	FtpClientOp_t* (*ftpClientAsyncConnect)(FtpClientLoop_t* loop, const char* host,
+		uint16_t port, const char* user, const char* pass,
+		FtpClientSession_t** session, FtpClientAsyncCallback_t cb, void* arg);
+	FtpClientOp_t* (*ftpClientAsyncCommand)(FtpClientSession_t* session,
+		const char* cmd, char expresp, FtpClientAsyncCallback_t cb, void* arg);
+	FtpClientOp_t* (*ftpClientAsyncGet)(FtpClientSession_t* session, const char* path,
+		char mode, const FtpClientSink_t* sink, FtpClientAsyncCallback_t cb, void* arg);
+	FtpClientOp_t* (*ftpClientAsyncPut)(FtpClientSession_t* session, const char* path,
+		char mode, const FtpClientSource_t* source, FtpClientAsyncCallback_t cb, void* arg);
+	FtpClientOp_t* (*ftpClientAsyncQuit)(FtpClientSession_t* session,
+		FtpClientAsyncCallback_t cb, void* arg);
+	/*Operation Handles*/
+	int (*ftpClientAsyncStatus)(FtpClientOp_t* op);
+	const char* (*ftpClientAsyncResponse)(FtpClientOp_t* op);
+	uint64_t (*ftpClientAsyncBytes)(FtpClientOp_t* op);
+	void (*ftpClientAsyncCancel)(FtpClientOp_t* op);
+	void (*ftpClientAsyncRelease)(FtpClientOp_t* op);
+} FtpClientAsync;
+
+FtpClientAsync* getFtpClientAsync(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTASYNC_H_ */
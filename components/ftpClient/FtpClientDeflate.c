@@ -0,0 +1,1065 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client streaming deflate and inflate
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "FtpClientDeflate.h"
+
+#define MIN_MATCH 							3
+#define MAX_MATCH 							258
+
+#define WSIZE 								(1 << FTP_CLIENT_DEFLATE_WINDOW_BITS)
+#define WMASK 								(WSIZE - 1)
+#define HASH_BITS 							FTP_CLIENT_DEFLATE_WINDOW_BITS
+#define HSIZE 								(1 << HASH_BITS)
+#define MIN_LOOKAHEAD 						(MAX_MATCH + MIN_MATCH + 1)
+#define MAX_DIST 							(WSIZE - MIN_LOOKAHEAD)
+
+#define INFLATE_WINDOW_MAX 					32768
+#define FAST_BITS 							9		/* codes up to this long decode with one lookup */
+
+/* deflate states */
+#define Z_HEADER 							0
+#define Z_DATA 								1
+#define Z_DONE 								2
+#define Z_ERROR 							3
+
+/* inflate states */
+#define I_HEADER 							0
+#define I_BLOCK 							1		/* next block header */
+#define I_STORED 							2
+#define I_CODES 							3
+#define I_TRAILER 							4
+#define I_DONE 								5
+#define I_ERROR 							6
+
+struct FtpClientDeflate {
+	int format;
+	FtpClientZRead_t read;
+	void* arg;
+	int state;
+	int eof;
+	int strstart;				/* window position of the next byte to compress */
+	int lookahead;				/* bytes read but not compressed yet */
+	uint32_t bitBuf;
+	int bitCnt;
+	uint32_t check;				/* Adler-32 or CRC-32 of the input */
+	uint32_t total;				/* input bytes modulo 2^32 */
+	int outPos;
+	int outLen;
+	int blockStart;				/* window position of the first byte of the block */
+	int blockOut;				/* output state where the block began, see deflateBlockEnd() */
+	uint32_t blockBitBuf;
+	int blockBitCnt;
+	uint16_t litCode[288];		/* fixed Huffman codes, bit reversed */
+	uint8_t litLen[288];
+	uint8_t distCode[30];
+	uint16_t head[HSIZE];		/* most recent position of a hash, 0 for none */
+	uint16_t prev[WSIZE];		/* previous position with the same hash */
+	uint8_t window[2 * WSIZE];
+	uint8_t out[FTP_CLIENT_DEFLATE_BUFFER_SIZE];
+};
+
+typedef struct {
+	uint16_t count[16];			/* codes of each length */
+	uint16_t symbol[288];		/* symbols ordered by code */
+	uint16_t fast[1 << FAST_BITS];	/* symbol << 4 | length, 0 for longer codes */
+} Huff_t;
+
+struct FtpClientInflate {
+	int format;
+	FtpClientZRead_t read;
+	void* arg;
+	int state;
+	int last;					/* the current block is the last one */
+	int left;					/* bytes of the stored block */
+	int copyLen;				/* match bytes still to copy */
+	int copyDist;
+	int eof;
+	int failed;					/* read error */
+	uint32_t bitBuf;
+	int bitCnt;
+	int inPos;
+	int inLen;
+	uint32_t check;				/* Adler-32 or CRC-32 of the output */
+	uint32_t total;				/* output bytes of the gzip member modulo 2^32 */
+	uint8_t* window;
+	uint32_t wsize;
+	uint32_t wpos;
+	uint32_t have;				/* valid bytes of the window */
+	Huff_t lencode;
+	Huff_t distcode;
+	uint8_t in[FTP_CLIENT_INFLATE_BUFFER_SIZE];
+};
+
+static const uint16_t lenBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lenExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static const uint32_t crcTable[256] = {
+	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+	0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+	0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+	0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+	0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+	0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+	0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+	0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+	0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+	0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+	0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+	0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+	0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+	0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+	0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+	0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+	0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+	0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+	0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+	0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+	0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+
+
+
+/*
+ * ftpClientCrc32 - update a CRC-32 (polynomial 0xEDB88320)
+ */
+uint32_t ftpClientCrc32(uint32_t crc, const void* buf, size_t len)
+{
+	const uint8_t* p = buf;
+	crc = ~crc;
+	while (len--)
+		crc = crcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+
+
+static uint32_t adler32(uint32_t adler, const uint8_t* p, size_t len)
+{
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	while (len > 0) {
+		/* the largest run that cannot overflow b */
+		size_t n = (len < 5552) ? len : 5552;
+		len -= n;
+		while (n--) {
+			a += *p++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+
+
+static uint32_t checkUpdate(int format, uint32_t check, const uint8_t* p, size_t len)
+{
+	if (format == FTP_CLIENT_GZIP)
+		return ftpClientCrc32(check, p, len);
+	return adler32(check, p, len);
+}
+
+
+
+static int reverseBits(int code, int len)
+{
+	int r = 0;
+	while (len--) {
+		r = (r << 1) | (code & 1);
+		code >>= 1;
+	}
+	return r;
+}
+
+
+
+/*
+ * deflatePut - append bits to the output, least significant first
+ */
+static void deflatePut(FtpClientDeflate_t* z, uint32_t value, int n)
+{
+	z->bitBuf |= value << z->bitCnt;
+	z->bitCnt += n;
+	while (z->bitCnt >= 8) {
+		z->out[z->outLen++] = (uint8_t)z->bitBuf;
+		z->bitBuf >>= 8;
+		z->bitCnt -= 8;
+	}
+}
+
+
+
+static void deflateSymbol(FtpClientDeflate_t* z, int sym)
+{
+	deflatePut(z, z->litCode[sym], z->litLen[sym]);
+}
+
+
+
+/*
+ * deflateMatchOut - emit a length and distance pair
+ *
+ * The code of a length or distance follows from the position of its
+ * highest bit, the next bits select the code within the group.
+ */
+static void deflateMatchOut(FtpClientDeflate_t* z, int len, int dist)
+{
+	int l = len - MIN_MATCH;
+	if (len == MAX_MATCH)
+		deflateSymbol(z, 285);
+	else if (l < 8)
+		deflateSymbol(z, 257 + l);
+	else {
+		int n = 31 - __builtin_clz(l);
+		int e = n - 2;
+		deflateSymbol(z, 257 + 4 * (n - 1) + ((l >> e) & 3));
+		deflatePut(z, l & ((1 << e) - 1), e);
+	}
+	int d = dist - 1;
+	if (d < 4)
+		deflatePut(z, z->distCode[d], 5);
+	else {
+		int n = 31 - __builtin_clz(d);
+		int e = n - 1;
+		deflatePut(z, z->distCode[2 * n + ((d >> e) & 1)], 5);
+		deflatePut(z, d & ((1 << e) - 1), e);
+	}
+}
+
+
+
+static uint32_t hash3(const uint8_t* p)
+{
+	return ((p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16)) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+
+static void deflateInsert(FtpClientDeflate_t* z, int pos)
+{
+	uint32_t h = hash3(z->window + pos);
+	z->prev[pos & WMASK] = z->head[h];
+	z->head[h] = pos;
+}
+
+
+
+/*
+ * deflateFill - read input until a full match can be looked ahead
+ *
+ * The upper half of the window moves down when the position gets close to
+ * its end, the hash chains move with it.
+ *
+ * return 1 if successful, 0 on a read error
+ */
+static int deflateFill(FtpClientDeflate_t* z)
+{
+	if (z->strstart >= WSIZE + MAX_DIST) {
+		memcpy(z->window, z->window + WSIZE, WSIZE);
+		z->strstart -= WSIZE;
+		for (int i = 0; i < HSIZE; i++)
+			z->head[i] = (z->head[i] >= WSIZE) ? z->head[i] - WSIZE : 0;
+		for (int i = 0; i < WSIZE; i++)
+			z->prev[i] = (z->prev[i] >= WSIZE) ? z->prev[i] - WSIZE : 0;
+	}
+	while (!z->eof && (z->lookahead < MIN_LOOKAHEAD)) {
+		int pos = z->strstart + z->lookahead;
+		int l = z->read(z->window + pos, 2 * WSIZE - pos, z->arg);
+		if (l < 0)
+			return 0;
+		if (l == 0) {
+			z->eof = 1;
+			break;
+		}
+		z->check = checkUpdate(z->format, z->check, z->window + pos, l);
+		z->total += l;
+		z->lookahead += l;
+	}
+	return 1;
+}
+
+
+
+/*
+ * deflateLongest - longest earlier match of the bytes at strstart
+ *
+ * return the match length, 0 if there is none of at least MIN_MATCH bytes
+ */
+static int deflateLongest(FtpClientDeflate_t* z, int cur, int* dist)
+{
+	const uint8_t* w = z->window;
+	int s = z->strstart;
+	int max = (z->lookahead < MAX_MATCH) ? z->lookahead : MAX_MATCH;
+	int limit = (s > MAX_DIST) ? s - MAX_DIST : 0;
+	int best = MIN_MATCH - 1;
+	int chain = FTP_CLIENT_DEFLATE_CHAIN;
+	while ((cur > limit) && (cur < s) && (chain-- > 0)) {
+		if ((w[cur + best] == w[s + best]) && (w[cur] == w[s]) && (w[cur + 1] == w[s + 1])) {
+			int l = 2;
+			while ((l < max) && (w[cur + l] == w[s + l]))
+				l++;
+			if (l > best) {
+				best = l;
+				*dist = s - cur;
+				if (l >= max)
+					break;
+			}
+		}
+		cur = z->prev[cur & WMASK];
+	}
+	return (best >= MIN_MATCH) ? best : 0;
+}
+
+
+
+static void deflateHeader(FtpClientDeflate_t* z)
+{
+	if (z->format == FTP_CLIENT_GZIP) {
+		static const uint8_t gz[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+		for (int i = 0; i < 10; i++)
+			deflatePut(z, gz[i], 8);
+		z->check = 0;
+	}
+	else {
+		int cmf = ((FTP_CLIENT_DEFLATE_WINDOW_BITS - 8) << 4) | 8;
+		deflatePut(z, cmf, 8);
+		deflatePut(z, (31 - (cmf << 8) % 31) % 31, 8);
+		z->check = 1;
+	}
+}
+
+
+
+/*
+ * deflateBlockBegin - start a block with the fixed codes
+ */
+static void deflateBlockBegin(FtpClientDeflate_t* z)
+{
+	z->blockStart = z->strstart;
+	z->blockOut = z->outLen;
+	z->blockBitBuf = z->bitBuf;
+	z->blockBitCnt = z->bitCnt;
+	deflatePut(z, 0, 1);
+	deflatePut(z, 1, 2);
+}
+
+
+
+/*
+ * deflateBlockEnd - end the block, stored instead if the codes did not shrink it
+ *
+ * The block is still in the output buffer and its input in the window, so
+ * the output goes back to where the block began and the input is copied.
+ */
+static void deflateBlockEnd(FtpClientDeflate_t* z)
+{
+	deflateSymbol(z, 256);
+	int len = z->strstart - z->blockStart;
+	int bits = (z->outLen - z->blockOut) * 8 + z->bitCnt - z->blockBitCnt;
+	int pad = (8 - (z->blockBitCnt + 3) % 8) % 8;
+	if (3 + pad + 32 + 8 * len >= bits)
+		return;
+	z->outLen = z->blockOut;
+	z->bitBuf = z->blockBitBuf;
+	z->bitCnt = z->blockBitCnt;
+	deflatePut(z, 0, 3);
+	if (z->bitCnt)
+		deflatePut(z, 0, 8 - z->bitCnt);
+	deflatePut(z, len, 16);
+	deflatePut(z, len ^ 0xffff, 16);
+	memcpy(z->out + z->outLen, z->window + z->blockStart, len);
+	z->outLen += len;
+}
+
+
+
+static void deflateTrailer(FtpClientDeflate_t* z)
+{
+	/* an empty last block */
+	deflatePut(z, 1, 1);
+	deflatePut(z, 1, 2);
+	deflateSymbol(z, 256);
+	if (z->bitCnt)
+		deflatePut(z, 0, 8 - z->bitCnt);
+	if (z->format == FTP_CLIENT_GZIP) {
+		for (int i = 0; i < 32; i += 8)
+			deflatePut(z, (z->check >> i) & 0xff, 8);
+		for (int i = 0; i < 32; i += 8)
+			deflatePut(z, (z->total >> i) & 0xff, 8);
+	}
+	else {
+		for (int i = 24; i >= 0; i -= 8)
+			deflatePut(z, (z->check >> i) & 0xff, 8);
+	}
+}
+
+
+
+/*
+ * deflateStep - compress until the output buffer is nearly full
+ *
+ * return 1 if successful, 0 on a read error
+ */
+static int deflateStep(FtpClientDeflate_t* z)
+{
+	z->outPos = z->outLen = 0;
+	if (z->state == Z_HEADER) {
+		deflateHeader(z);
+		z->state = Z_DATA;
+	}
+	/* moves the window before the block begins */
+	if (!deflateFill(z))
+		return 0;
+	deflateBlockBegin(z);
+	/* a match takes at most 31 bits, the end of the block and the trailer 14 bytes */
+	while (z->outLen < FTP_CLIENT_DEFLATE_BUFFER_SIZE - 16) {
+		/* the input of the block stays in the window until the block ends */
+		if (z->strstart >= WSIZE + MAX_DIST)
+			break;
+		if ((z->lookahead < MIN_LOOKAHEAD) && !deflateFill(z))
+			return 0;
+		if (z->lookahead == 0)
+			break;
+		int s = z->strstart;
+		int len = 0;
+		int dist = 0;
+		if (z->lookahead >= MIN_MATCH) {
+			int cur = z->head[hash3(z->window + s)];
+			deflateInsert(z, s);
+			len = deflateLongest(z, cur, &dist);
+		}
+		if (len) {
+			deflateMatchOut(z, len, dist);
+			for (int p = s + 1; (p < s + len) && (p + MIN_MATCH <= s + z->lookahead); p++)
+				deflateInsert(z, p);
+			z->strstart += len;
+			z->lookahead -= len;
+		}
+		else {
+			deflateSymbol(z, z->window[s]);
+			z->strstart++;
+			z->lookahead--;
+		}
+	}
+	deflateBlockEnd(z);
+	if (z->lookahead == 0) {
+		deflateTrailer(z);
+		z->state = Z_DONE;
+	}
+	return 1;
+}
+
+
+
+/*
+ * ftpClientDeflateCreate - start a compressed stream of the data of read
+ *
+ * return the compressor, NULL if out of memory
+ */
+FtpClientDeflate_t* ftpClientDeflateCreate(int format, FtpClientZRead_t read, void* arg)
+{
+	FtpClientDeflate_t* z = calloc(1, sizeof(FtpClientDeflate_t));
+	if (z == NULL)
+		return NULL;
+	z->format = format;
+	z->read = read;
+	z->arg = arg;
+	for (int i = 0; i < 288; i++) {
+		int code, len;
+		if (i < 144) {
+			code = 0x30 + i;
+			len = 8;
+		}
+		else if (i < 256) {
+			code = 0x190 + i - 144;
+			len = 9;
+		}
+		else if (i < 280) {
+			code = i - 256;
+			len = 7;
+		}
+		else {
+			code = 0xc0 + i - 280;
+			len = 8;
+		}
+		z->litCode[i] = reverseBits(code, len);
+		z->litLen[i] = len;
+	}
+	for (int i = 0; i < 30; i++)
+		z->distCode[i] = reverseBits(i, 5);
+	return z;
+}
+
+
+
+void ftpClientDeflateDelete(FtpClientDeflate_t* z)
+{
+	free(z);
+}
+
+
+
+int ftpClientDeflateRead(FtpClientDeflate_t* z, void* buf, int max)
+{
+	while (z->outPos == z->outLen) {
+		if (z->state == Z_DONE)
+			return 0;
+		if ((z->state == Z_ERROR) || !deflateStep(z)) {
+			z->state = Z_ERROR;
+			return -1;
+		}
+	}
+	int n = z->outLen - z->outPos;
+	if (n > max)
+		n = max;
+	memcpy(buf, z->out + z->outPos, n);
+	z->outPos += n;
+	return n;
+}
+
+
+
+/*
+ * inflateByte - next input byte
+ *
+ * return the byte, -1 at the end of the input or on a read error
+ */
+static int inflateByte(FtpClientInflate_t* z)
+{
+	if (z->inPos == z->inLen) {
+		if (z->eof)
+			return -1;
+		int l = z->read(z->in, sizeof(z->in), z->arg);
+		if (l <= 0) {
+			z->eof = 1;
+			z->failed = (l < 0);
+			return -1;
+		}
+		z->inPos = 0;
+		z->inLen = l;
+	}
+	return z->in[z->inPos++];
+}
+
+
+
+static int inflateNeed(FtpClientInflate_t* z, int n)
+{
+	while (z->bitCnt < n) {
+		int b = inflateByte(z);
+		if (b < 0)
+			return 0;
+		z->bitBuf |= (uint32_t)b << z->bitCnt;
+		z->bitCnt += 8;
+	}
+	return 1;
+}
+
+
+
+/*
+ * inflateBits - take n bits (0-16) of the input
+ *
+ * return the bits, -1 at the end of the input
+ */
+static int inflateBits(FtpClientInflate_t* z, int n)
+{
+	if (!inflateNeed(z, n))
+		return -1;
+	int v = z->bitBuf & ((1u << n) - 1);
+	z->bitBuf >>= n;
+	z->bitCnt -= n;
+	return v;
+}
+
+
+
+/*
+ * huffBuild - canonical Huffman code of the code lengths of n symbols
+ *
+ * return 0 for a complete code, > 0 for an incomplete one, -1 if the
+ * lengths are over-subscribed
+ */
+static int huffBuild(Huff_t* h, const uint8_t* lengths, int n)
+{
+	uint16_t offs[16];
+	memset(h->count, 0, sizeof(h->count));
+	memset(h->fast, 0, sizeof(h->fast));
+	for (int i = 0; i < n; i++)
+		h->count[lengths[i]]++;
+	if (h->count[0] == n)
+		return 0;
+	int left = 1;
+	for (int len = 1; len < 16; len++) {
+		left <<= 1;
+		left -= h->count[len];
+		if (left < 0)
+			return -1;
+	}
+	offs[1] = 0;
+	for (int len = 1; len < 15; len++)
+		offs[len + 1] = offs[len] + h->count[len];
+	for (int i = 0; i < n; i++)
+		if (lengths[i])
+			h->symbol[offs[lengths[i]]++] = i;
+	/* the codes of each length are consecutive, in symbol order */
+	int code = 0;
+	int index = 0;
+	for (int len = 1; len <= FAST_BITS; len++) {
+		for (int k = 0; k < h->count[len]; k++) {
+			int sym = h->symbol[index++];
+			for (int j = reverseBits(code, len); j < (1 << FAST_BITS); j += 1 << len)
+				h->fast[j] = (sym << 4) | len;
+			code++;
+		}
+		code <<= 1;
+	}
+	return left;
+}
+
+
+
+/*
+ * huffDecode - decode a symbol
+ *
+ * One table lookup for the short codes, bit by bit for the long ones and
+ * near the end of the input.
+ *
+ * return the symbol, -1 on error
+ */
+static int huffDecode(FtpClientInflate_t* z, const Huff_t* h)
+{
+	if (inflateNeed(z, FAST_BITS)) {
+		uint16_t e = h->fast[z->bitBuf & ((1 << FAST_BITS) - 1)];
+		if (e) {
+			z->bitBuf >>= e & 15;
+			z->bitCnt -= e & 15;
+			return e >> 4;
+		}
+	}
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len < 16; len++) {
+		int b = inflateBits(z, 1);
+		if (b < 0)
+			return -1;
+		code |= b;
+		int count = h->count[len];
+		if (code - count < first)
+			return h->symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+
+
+static int inflateFixed(FtpClientInflate_t* z)
+{
+	uint8_t lengths[288];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 112);
+	memset(lengths + 256, 7, 24);
+	memset(lengths + 280, 8, 8);
+	huffBuild(&z->lencode, lengths, 288);
+	memset(lengths, 5, 30);
+	huffBuild(&z->distcode, lengths, 30);
+	return 1;
+}
+
+
+
+/*
+ * inflateDynamic - read the code tables of a dynamic block
+ *
+ * return 1 if successful, 0 on corrupt data
+ */
+static int inflateDynamic(FtpClientInflate_t* z)
+{
+	static const uint8_t order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	uint8_t lengths[286 + 30];
+	int nlen = inflateBits(z, 5);
+	int ndist = inflateBits(z, 5);
+	int ncode = inflateBits(z, 4);
+	if ((nlen < 0) || (ndist < 0) || (ncode < 0))
+		return 0;
+	nlen += 257;
+	ndist += 1;
+	ncode += 4;
+	if ((nlen > 286) || (ndist > 30))
+		return 0;
+	memset(lengths, 0, 19);
+	for (int i = 0; i < ncode; i++) {
+		int l = inflateBits(z, 3);
+		if (l < 0)
+			return 0;
+		lengths[order[i]] = l;
+	}
+	/* the code length code is built in lencode, which is rebuilt below */
+	if (huffBuild(&z->lencode, lengths, 19) != 0)
+		return 0;
+	int index = 0;
+	while (index < nlen + ndist) {
+		int sym = huffDecode(z, &z->lencode);
+		if (sym < 0)
+			return 0;
+		if (sym < 16) {
+			lengths[index++] = sym;
+			continue;
+		}
+		int len = 0;
+		int rep;
+		if (sym == 16) {
+			if (index == 0)
+				return 0;
+			len = lengths[index - 1];
+			rep = inflateBits(z, 2) + 3;
+		}
+		else if (sym == 17)
+			rep = inflateBits(z, 3) + 3;
+		else
+			rep = inflateBits(z, 7) + 11;
+		if ((rep < 3) || (index + rep > nlen + ndist))
+			return 0;
+		while (rep--)
+			lengths[index++] = len;
+	}
+	if (lengths[256] == 0)
+		return 0;
+	/* an incomplete code is only allowed for a single length */
+	int err = huffBuild(&z->lencode, lengths, nlen);
+	if ((err < 0) || ((err > 0) && (nlen - z->lencode.count[0] != 1)))
+		return 0;
+	err = huffBuild(&z->distcode, lengths + nlen, ndist);
+	if ((err < 0) || ((err > 0) && (ndist - z->distcode.count[0] != 1)))
+		return 0;
+	return 1;
+}
+
+
+
+static void inflatePut(FtpClientInflate_t* z, uint8_t* out, int* pos, uint8_t b)
+{
+	out[(*pos)++] = b;
+	z->window[z->wpos++ & (z->wsize - 1)] = b;
+	if (z->have < z->wsize)
+		z->have++;
+}
+
+
+
+/*
+ * inflateCodes - decode the symbols of a block until out is full
+ *
+ * A match that does not fit is finished by the next call.
+ *
+ * return 1 if successful, 0 on corrupt data
+ */
+static int inflateCodes(FtpClientInflate_t* z, uint8_t* out, int max, int* pos)
+{
+	while (*pos < max) {
+		if (z->copyLen) {
+			uint32_t from = z->wpos - z->copyDist;
+			while (z->copyLen && (*pos < max)) {
+				inflatePut(z, out, pos, z->window[from++ & (z->wsize - 1)]);
+				z->copyLen--;
+			}
+			continue;
+		}
+		int sym = huffDecode(z, &z->lencode);
+		if (sym < 0)
+			return 0;
+		if (sym < 256) {
+			inflatePut(z, out, pos, sym);
+			continue;
+		}
+		if (sym == 256) {
+			z->state = z->last ? I_TRAILER : I_BLOCK;
+			return 1;
+		}
+		sym -= 257;
+		if (sym >= 29)
+			return 0;
+		int e = inflateBits(z, lenExtra[sym]);
+		int dsym = huffDecode(z, &z->distcode);
+		if ((e < 0) || (dsym < 0) || (dsym >= 30))
+			return 0;
+		int d = inflateBits(z, distExtra[dsym]);
+		if (d < 0)
+			return 0;
+		z->copyLen = lenBase[sym] + e;
+		z->copyDist = distBase[dsym] + d;
+		if ((uint32_t)z->copyDist > z->have)
+			return 0;
+	}
+	return 1;
+}
+
+
+
+/*
+ * inflateStored - copy the bytes of a stored block until out is full
+ *
+ * return 1 if successful, 0 on truncated data
+ */
+static int inflateStored(FtpClientInflate_t* z, uint8_t* out, int max, int* pos)
+{
+	while (z->left && (*pos < max)) {
+		int b;
+		if (z->bitCnt >= 8)
+			b = inflateBits(z, 8);
+		else
+			b = inflateByte(z);
+		if (b < 0)
+			return 0;
+		inflatePut(z, out, pos, b);
+		z->left--;
+	}
+	if (z->left == 0)
+		z->state = z->last ? I_TRAILER : I_BLOCK;
+	return 1;
+}
+
+
+
+static int inflateSkipString(FtpClientInflate_t* z)
+{
+	int b;
+	while ((b = inflateBits(z, 8)) > 0)
+		;
+	return b == 0;
+}
+
+
+
+/*
+ * inflateHeader - read the zlib or gzip header and set up the window
+ *
+ * return 1 if successful, 0 on a bad header
+ */
+static int inflateHeader(FtpClientInflate_t* z)
+{
+	uint32_t wsize = INFLATE_WINDOW_MAX;
+	if (z->format == FTP_CLIENT_GZIP) {
+		int id1 = inflateBits(z, 8);
+		int id2 = inflateBits(z, 8);
+		int cm = inflateBits(z, 8);
+		int flg = inflateBits(z, 8);
+		if ((id1 != 0x1f) || (id2 != 0x8b) || (cm != 8) || (flg < 0))
+			return 0;
+		/* MTIME, XFL, OS */
+		for (int i = 0; i < 6; i++)
+			if (inflateBits(z, 8) < 0)
+				return 0;
+		if (flg & 0x04) {
+			int xlen = inflateBits(z, 16);
+			if (xlen < 0)
+				return 0;
+			while (xlen--)
+				if (inflateBits(z, 8) < 0)
+					return 0;
+		}
+		if ((flg & 0x08) && !inflateSkipString(z))
+			return 0;
+		if ((flg & 0x10) && !inflateSkipString(z))
+			return 0;
+		if ((flg & 0x02) && (inflateBits(z, 16) < 0))
+			return 0;
+		z->check = 0;
+		z->total = 0;
+	}
+	else {
+		int cmf = inflateBits(z, 8);
+		int flg = inflateBits(z, 8);
+		if ((cmf < 0) || (flg < 0) || ((cmf & 0x0f) != 8) || ((cmf >> 4) > 7) ||
+				(((cmf << 8) | flg) % 31) || (flg & 0x20))
+			return 0;
+		wsize = 1 << ((cmf >> 4) + 8);
+		z->check = 1;
+	}
+	if (z->window == NULL) {
+		z->window = malloc(wsize);
+		if (z->window == NULL)
+			return 0;
+		z->wsize = wsize;
+	}
+	z->have = 0;
+	z->last = 0;
+	return 1;
+}
+
+
+
+/*
+ * inflateTrailer - compare the check value and length after the last block
+ *
+ * A gzip file may hold more members, they are decompressed in turn.
+ *
+ * return 1 if successful, 0 on a mismatch
+ */
+static int inflateTrailer(FtpClientInflate_t* z)
+{
+	uint32_t v[2] = { 0, 0 };
+	int n = (z->format == FTP_CLIENT_GZIP) ? 2 : 1;
+	inflateBits(z, z->bitCnt & 7);
+	for (int k = 0; k < n; k++) {
+		for (int i = 0; i < 4; i++) {
+			int b = inflateBits(z, 8);
+			if (b < 0)
+				return 0;
+			if (z->format == FTP_CLIENT_GZIP)
+				v[k] |= (uint32_t)b << (8 * i);
+			else
+				v[k] = (v[k] << 8) | b;
+		}
+	}
+	if ((v[0] != z->check) || ((n == 2) && (v[1] != z->total)))
+		return 0;
+	z->state = I_DONE;
+	if ((z->format == FTP_CLIENT_GZIP) && (z->bitCnt == 0)) {
+		int b = inflateByte(z);
+		if (b >= 0) {
+			z->inPos--;
+			z->state = I_HEADER;
+		}
+	}
+	return !z->failed;
+}
+
+
+
+/*
+ * ftpClientInflateCreate - start reading a compressed stream through read
+ *
+ * return the decompressor, NULL if out of memory
+ */
+FtpClientInflate_t* ftpClientInflateCreate(int format, FtpClientZRead_t read, void* arg)
+{
+	FtpClientInflate_t* z = calloc(1, sizeof(FtpClientInflate_t));
+	if (z == NULL)
+		return NULL;
+	z->format = format;
+	z->read = read;
+	z->arg = arg;
+	return z;
+}
+
+
+
+void ftpClientInflateDelete(FtpClientInflate_t* z)
+{
+	free(z->window);
+	free(z);
+}
+
+
+
+int ftpClientInflateRead(FtpClientInflate_t* z, void* buf, int max)
+{
+	uint8_t* out = buf;
+	int pos = 0;
+	int checked = 0;
+	int ok = 1;
+	while (ok && (pos < max) && (z->state != I_DONE) && (z->state != I_ERROR)) {
+		switch (z->state) {
+			case I_HEADER:
+				ok = inflateHeader(z);
+				z->state = I_BLOCK;
+				break;
+
+			case I_BLOCK:
+			{
+				z->last = inflateBits(z, 1);
+				int type = inflateBits(z, 2);
+				if ((z->last < 0) || (type < 0) || (type == 3)) {
+					ok = 0;
+					break;
+				}
+				if (type == 0) {
+					inflateBits(z, z->bitCnt & 7);
+					int len = inflateBits(z, 16);
+					int nlen = inflateBits(z, 16);
+					ok = (len >= 0) && (nlen >= 0) && (len == (~nlen & 0xffff));
+					z->left = len;
+					z->state = z->left ? I_STORED : (z->last ? I_TRAILER : I_BLOCK);
+				}
+				else {
+					ok = (type == 1) ? inflateFixed(z) : inflateDynamic(z);
+					z->state = I_CODES;
+				}
+			}
+			break;
+
+			case I_STORED:
+				ok = inflateStored(z, out, max, &pos);
+				break;
+
+			case I_CODES:
+				ok = inflateCodes(z, out, max, &pos);
+				break;
+
+			case I_TRAILER:
+				z->check = checkUpdate(z->format, z->check, out + checked, pos - checked);
+				z->total += pos - checked;
+				checked = pos;
+				ok = inflateTrailer(z);
+				break;
+		}
+	}
+	z->check = checkUpdate(z->format, z->check, out + checked, pos - checked);
+	z->total += pos - checked;
+	if (!ok || z->failed)
+		z->state = I_ERROR;
+	if (z->state == I_ERROR)
+		return -1;
+	return pos;
+}
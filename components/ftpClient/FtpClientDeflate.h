@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client streaming deflate and inflate
+ *
+ * Compression for MODE Z (zlib format) and for gzip files. The compressor
+ * uses a small sliding window, greedy hash chain matching and the fixed
+ * Huffman codes, so it needs about 6 * 2^FTP_CLIENT_DEFLATE_WINDOW_BITS
+ * bytes. A block ends when FTP_CLIENT_DEFLATE_BUFFER_SIZE is full or the
+ * window moves and is sent stored if the codes did not make it smaller,
+ * so data that is already compressed grows by less than 1%. The
+ * decompressor reads any deflate
+ * stream; its window is the one announced in the zlib header, 32 KB for
+ * gzip.
+ *
+ * Both directions pull their input through a read function with the
+ * signature of FtpClientSource_t.read and are themselves read like a
+ * source, so they can be put between a data connection and a sink or
+ * source without extra copies.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTDEFLATE_H_
+#define FTPCLIENTDEFLATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FTP_CLIENT_DEFLATE_WINDOW_BITS
+#define FTP_CLIENT_DEFLATE_WINDOW_BITS 		12		/* 9-15, window of the compressor */
+#endif
+#ifndef FTP_CLIENT_DEFLATE_CHAIN
+#define FTP_CLIENT_DEFLATE_CHAIN 			16		/* match candidates tried per position */
+#endif
+#define FTP_CLIENT_DEFLATE_BUFFER_SIZE 		1024	/* compressed bytes produced at once */
+#define FTP_CLIENT_INFLATE_BUFFER_SIZE 		1024	/* compressed bytes read at once */
+
+/* stream formats */
+#define FTP_CLIENT_ZLIB 					1		/* RFC 1950, MODE Z */
+#define FTP_CLIENT_GZIP 					2		/* RFC 1952 */
+
+/* return the bytes placed in buf, 0 at end of data or -1 on error */
+typedef int (*FtpClientZRead_t)(void* buf, int max, void* arg);
+
+typedef struct FtpClientDeflate FtpClientDeflate_t;
+typedef struct FtpClientInflate FtpClientInflate_t;
+
+FtpClientDeflate_t* ftpClientDeflateCreate(int format, FtpClientZRead_t read, void* arg);
+void ftpClientDeflateDelete(FtpClientDeflate_t* z);
+/* return compressed bytes placed in buf, 0 at end of the stream or -1 on error */
+int ftpClientDeflateRead(FtpClientDeflate_t* z, void* buf, int max);
+
+FtpClientInflate_t* ftpClientInflateCreate(int format, FtpClientZRead_t read, void* arg);
+void ftpClientInflateDelete(FtpClientInflate_t* z);
+/*
+ * return decompressed bytes placed in buf, 0 at end of the stream or -1 on
+ * error. Data that is corrupt, truncated or fails the check value is an error.
+ */
+int ftpClientInflateRead(FtpClientInflate_t* z, void* buf, int max);
+
+/* CRC-32 of gzip, start with crc 0 */
+uint32_t ftpClientCrc32(uint32_t crc, const void* buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTDEFLATE_H_ */
@@ -0,0 +1,303 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client incremental hashes of transferred data
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <string.h>
+#include "FtpClientHash.h"
+#include "FtpClientDeflate.h"
+
+#ifndef ESP_PLATFORM
+
+#define ROL(x, n) 							(((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR(x, n) 							(((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t md5K[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391 };
+static const uint8_t md5R[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+static const uint32_t sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+
+
+static void md5Block(uint32_t* s, const uint8_t* p)
+{
+	uint32_t m[16];
+	for (int i = 0; i < 16; i++)
+		m[i] = p[4 * i] | (p[4 * i + 1] << 8) | (p[4 * i + 2] << 16) | ((uint32_t)p[4 * i + 3] << 24);
+	uint32_t a = s[0], b = s[1], c = s[2], d = s[3];
+	for (int i = 0; i < 64; i++) {
+		uint32_t f;
+		int g;
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		}
+		else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) & 15;
+		}
+		else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) & 15;
+		}
+		else {
+			f = c ^ (b | ~d);
+			g = (7 * i) & 15;
+		}
+		f += a + md5K[i] + m[g];
+		a = d;
+		d = c;
+		c = b;
+		b += ROL(f, md5R[(i >> 4) * 4 + (i & 3)]);
+	}
+	s[0] += a;
+	s[1] += b;
+	s[2] += c;
+	s[3] += d;
+}
+
+
+
+static void sha256Block(uint32_t* s, const uint8_t* p)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t)p[4 * i] << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+			sha256K[i] + w[i];
+		uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	s[0] += a;
+	s[1] += b;
+	s[2] += c;
+	s[3] += d;
+	s[4] += e;
+	s[5] += f;
+	s[6] += g;
+	s[7] += h;
+}
+
+
+
+/*
+ * mdUpdate - feed whole 64 byte blocks to the compression function
+ */
+static void mdUpdate(FtpClientHash_t* h, const uint8_t* p, size_t len)
+{
+	void (*block)(uint32_t*, const uint8_t*) =
+		(h->alg == FTP_CLIENT_HASH_MD5) ? md5Block : sha256Block;
+	size_t used = h->u.md.count & 63;
+	h->u.md.count += len;
+	if (used) {
+		size_t n = 64 - used;
+		if (len < n) {
+			memcpy(h->u.md.block + used, p, len);
+			return;
+		}
+		memcpy(h->u.md.block + used, p, n);
+		block(h->u.md.state, h->u.md.block);
+		p += n;
+		len -= n;
+	}
+	for (; len >= 64; p += 64, len -= 64)
+		block(h->u.md.state, p);
+	memcpy(h->u.md.block, p, len);
+}
+
+
+
+/*
+ * mdFinal - pad with the bit count, little endian for MD5, big endian for SHA-256
+ */
+static void mdFinal(FtpClientHash_t* h, uint8_t* out)
+{
+	int md5 = (h->alg == FTP_CLIENT_HASH_MD5);
+	uint64_t bits = h->u.md.count * 8;
+	uint8_t pad[72] = { 0x80 };
+	size_t n = 64 - ((h->u.md.count + 8) & 63);
+	for (int i = 0; i < 8; i++)
+		pad[n + i] = md5 ? (bits >> (8 * i)) : (bits >> (56 - 8 * i));
+	mdUpdate(h, pad, n + 8);
+	int words = md5 ? 4 : 8;
+	for (int i = 0; i < words; i++) {
+		uint32_t v = h->u.md.state[i];
+		for (int j = 0; j < 4; j++)
+			out[4 * i + j] = md5 ? (v >> (8 * j)) : (v >> (24 - 8 * j));
+	}
+}
+
+#endif /* ESP_PLATFORM */
+
+
+
+/*
+ * ftpClientHashInit - start a hash of the given algorithm
+ */
+void ftpClientHashInit(FtpClientHash_t* h, int alg)
+{
+	h->alg = alg;
+	switch (alg) {
+		case FTP_CLIENT_HASH_CRC32:
+			h->u.crc = 0;
+			break;
+
+#ifdef ESP_PLATFORM
+		case FTP_CLIENT_HASH_MD5:
+			mbedtls_md5_init(&h->u.md5);
+			mbedtls_md5_starts(&h->u.md5);
+			break;
+
+		case FTP_CLIENT_HASH_SHA256:
+			mbedtls_sha256_init(&h->u.sha256);
+			mbedtls_sha256_starts(&h->u.sha256, 0);
+			break;
+#else
+		case FTP_CLIENT_HASH_MD5:
+		{
+			static const uint32_t iv[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+			memcpy(h->u.md.state, iv, sizeof(iv));
+			h->u.md.count = 0;
+		}
+		break;
+
+		case FTP_CLIENT_HASH_SHA256:
+		{
+			static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+				0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+			memcpy(h->u.md.state, iv, sizeof(iv));
+			h->u.md.count = 0;
+		}
+		break;
+#endif
+
+		default:
+			h->alg = FTP_CLIENT_HASH_NONE;
+			break;
+	}
+}
+
+
+
+void ftpClientHashUpdate(FtpClientHash_t* h, const void* buf, size_t len)
+{
+	switch (h->alg) {
+		case FTP_CLIENT_HASH_CRC32:
+			h->u.crc = ftpClientCrc32(h->u.crc, buf, len);
+			break;
+
+#ifdef ESP_PLATFORM
+		case FTP_CLIENT_HASH_MD5:
+			mbedtls_md5_update(&h->u.md5, buf, len);
+			break;
+
+		case FTP_CLIENT_HASH_SHA256:
+			mbedtls_sha256_update(&h->u.sha256, buf, len);
+			break;
+#else
+		case FTP_CLIENT_HASH_MD5:
+		case FTP_CLIENT_HASH_SHA256:
+			mdUpdate(h, buf, len);
+			break;
+#endif
+	}
+}
+
+
+
+int ftpClientHashFinal(FtpClientHash_t* h, uint8_t* out)
+{
+	switch (h->alg) {
+		case FTP_CLIENT_HASH_CRC32:
+			for (int i = 0; i < 4; i++)
+				out[i] = h->u.crc >> (24 - 8 * i);
+			break;
+
+#ifdef ESP_PLATFORM
+		case FTP_CLIENT_HASH_MD5:
+			mbedtls_md5_finish(&h->u.md5, out);
+			mbedtls_md5_free(&h->u.md5);
+			break;
+
+		case FTP_CLIENT_HASH_SHA256:
+			mbedtls_sha256_finish(&h->u.sha256, out);
+			mbedtls_sha256_free(&h->u.sha256);
+			break;
+#else
+		case FTP_CLIENT_HASH_MD5:
+		case FTP_CLIENT_HASH_SHA256:
+			mdFinal(h, out);
+			break;
+#endif
+	}
+	int size = ftpClientHashSize(h->alg);
+	h->alg = FTP_CLIENT_HASH_NONE;
+	return size;
+}
+
+
+
+int ftpClientHashSize(int alg)
+{
+	switch (alg) {
+		case FTP_CLIENT_HASH_CRC32:
+			return 4;
+		case FTP_CLIENT_HASH_MD5:
+			return 16;
+		case FTP_CLIENT_HASH_SHA256:
+			return 32;
+	}
+	return 0;
+}
+
+
+
+const char* ftpClientHashName(int alg)
+{
+	switch (alg) {
+		case FTP_CLIENT_HASH_CRC32:
+			return "CRC32";
+		case FTP_CLIENT_HASH_MD5:
+			return "MD5";
+		case FTP_CLIENT_HASH_SHA256:
+			return "SHA-256";
+	}
+	return "";
+}
@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client incremental hashes of transferred data
+ *
+ * CRC-32, MD5 and SHA-256 updated chunk by chunk while a transfer runs, so
+ * the data does not have to be read again to check it. On the ESP32 MD5
+ * and SHA-256 come from mbedTLS, which uses the SHA accelerator of the chip
+ * when CONFIG_MBEDTLS_HARDWARE_SHA is set; the host build has its own.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTHASH_H_
+#define FTPCLIENTHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FtpClient.h"
+#ifdef ESP_PLATFORM
+#include "mbedtls/md5.h"
+#include "mbedtls/sha256.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the algorithms are FTP_CLIENT_HASH_* of FtpClient.h */
+typedef struct
+{
+	int alg;
+	union {
+		uint32_t crc;
+#ifdef ESP_PLATFORM
+		mbedtls_md5_context md5;
+		mbedtls_sha256_context sha256;
+#else
+		struct {
+			uint32_t state[8];
+			uint64_t count;
+			uint8_t block[64];
+		} md;
+#endif
+	} u;
+} FtpClientHash_t;
+
+void ftpClientHashInit(FtpClientHash_t* h, int alg);
+/* nothing happens for FTP_CLIENT_HASH_NONE */
+void ftpClientHashUpdate(FtpClientHash_t* h, const void* buf, size_t len);
+/*
+ * Put the digest into out, CRC-32 most significant byte first, and release
+ * the context. return the digest length, 0 for FTP_CLIENT_HASH_NONE
+ */
+int ftpClientHashFinal(FtpClientHash_t* h, uint8_t* out);
+/* digest length of an algorithm, 0 for none */
+int ftpClientHashSize(int alg);
+/* name of an algorithm as used by the HASH command, "" for none */
+const char* ftpClientHashName(int alg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTHASH_H_ */
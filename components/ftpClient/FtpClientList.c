@@ -0,0 +1,631 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client directory listing parser
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "FtpClientList.h"
+#include "FtpClientText.h"
+
+#define FTP_CLIENT_LIST_SLOTS				64		/* first size of the intern table */
+#define FTP_CLIENT_LIST_FIELDS				10
+
+typedef struct NameBlock NameBlock_t;
+
+struct NameBlock {
+	NameBlock_t* next;
+	size_t used;
+	size_t size;
+	char data[];
+};
+
+struct FtpClientListParser {
+	int format;
+	FtpClientListCallback_t cb;
+	void* arg;
+	int64_t now;
+	int stopped;
+	int failed;
+	uint32_t count;
+	NameBlock_t* blocks;
+	const char** slots;
+	uint32_t nslots;
+	uint32_t nnames;
+	int lineLen;
+	int overflow;
+	char line[FTP_CLIENT_LIST_LINE_SIZE];
+};
+
+/* one whitespace separated field of a LIST line */
+typedef struct {
+	const char* s;
+	size_t len;
+} Field_t;
+
+static const char* const months[12] = {
+	"jan", "feb", "mar", "apr", "may", "jun",
+	"jul", "aug", "sep", "oct", "nov", "dec"
+};
+
+
+
+/*
+ * nameHash - FNV-1a
+ */
+static uint32_t nameHash(const char* s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	while (len--)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+
+
+/*
+ * namesGrow - double the intern table
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int namesGrow(FtpClientListParser_t* lp)
+{
+	uint32_t nslots = lp->nslots ? lp->nslots * 2 : FTP_CLIENT_LIST_SLOTS;
+	const char** slots = calloc(nslots, sizeof(const char*));
+	if (slots == NULL)
+		return 0;
+	for (uint32_t i = 0; i < lp->nslots; i++) {
+		const char* n = lp->slots[i];
+		if (n == NULL)
+			continue;
+		uint32_t h = nameHash(n, strlen(n)) & (nslots - 1);
+		while (slots[h] != NULL)
+			h = (h + 1) & (nslots - 1);
+		slots[h] = n;
+	}
+	free(lp->slots);
+	lp->slots = slots;
+	lp->nslots = nslots;
+	return 1;
+}
+
+
+
+/*
+ * namesIntern - find or store a string in the name pool
+ *
+ * return the pooled string, NULL if out of memory
+ */
+static const char* namesIntern(FtpClientListParser_t* lp, const char* s, size_t len)
+{
+	if ((lp->nnames + 1) * 4 > lp->nslots * 3) {
+		if (!namesGrow(lp))
+			return NULL;
+	}
+	uint32_t h = nameHash(s, len) & (lp->nslots - 1);
+	while (lp->slots[h] != NULL) {
+		const char* n = lp->slots[h];
+		if ((memcmp(n, s, len) == 0) && (n[len] == '\0'))
+			return n;
+		h = (h + 1) & (lp->nslots - 1);
+	}
+	NameBlock_t* b = lp->blocks;
+	if ((b == NULL) || (b->size - b->used < len + 1)) {
+		size_t size = (len + 1 > FTP_CLIENT_LIST_NAMES_BLOCK) ? (len + 1) : FTP_CLIENT_LIST_NAMES_BLOCK;
+		b = malloc(sizeof(NameBlock_t) + size);
+		if (b == NULL)
+			return NULL;
+		b->next = lp->blocks;
+		b->used = 0;
+		b->size = size;
+		lp->blocks = b;
+	}
+	char* n = b->data + b->used;
+	memcpy(n, s, len);
+	n[len] = '\0';
+	b->used += len + 1;
+	lp->slots[h] = n;
+	lp->nnames++;
+	return n;
+}
+
+
+
+/*
+ * epochTime - seconds since 1970 of a UTC date
+ *
+ * return 0 if the date is out of range
+ */
+static uint32_t epochTime(int year, int mon, int day, int hour, int min, int sec)
+{
+	if ((year < 1970) || (year > 2105) || (mon < 1) || (mon > 12) || (day < 1) || (day > 31) ||
+			(hour > 23) || (min > 59) || (sec > 60))
+		return 0;
+	/* days from civil, the year starts in March */
+	int y = year - (mon <= 2);
+	int era = y / 400;
+	int yoe = y - era * 400;
+	int doy = (153 * (mon + ((mon > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	int64_t days = (int64_t)era * 146097 + doe - 719468;
+	return (uint32_t)(days * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+
+
+/*
+ * parseNumber - read decimal digits
+ *
+ * return the number of digits
+ */
+static size_t parseNumber(const char* s, size_t len, uint64_t* v)
+{
+	size_t i = 0;
+	*v = 0;
+	while ((i < len) && isdigit((unsigned char)s[i]))
+		*v = *v * 10 + (s[i++] - '0');
+	return i;
+}
+
+
+
+/*
+ * parseDigits - read exactly n decimal digits
+ *
+ * return the value, -1 if there are not n digits
+ */
+static int parseDigits(const char* s, int n)
+{
+	int v = 0;
+	for (int i = 0; i < n; i++) {
+		if (!isdigit((unsigned char)s[i]))
+			return -1;
+		v = v * 10 + (s[i] - '0');
+	}
+	return v;
+}
+
+
+
+/*
+ * factIs - compare a fact name without case
+ */
+static int factIs(const char* s, size_t len, const char* name)
+{
+	return (strlen(name) == len) && (strncasecmp(s, name, len) == 0);
+}
+
+
+
+/*
+ * parseMlsd - parse "fact=value;fact=value; name"
+ *
+ * return 1 for an entry, 0 for a line to skip
+ */
+static int parseMlsd(FtpClientListParser_t* lp, const char* s, size_t len,
+	FtpClientDirEntry_t* e, Field_t* name)
+{
+	/* fact values contain no space, the first space starts the name */
+	const char* sp = memchr(s, ' ', len);
+	if (sp == NULL)
+		return 0;
+	name->s = sp + 1;
+	name->len = (s + len) - name->s;
+	const char* p = s;
+	while (p < sp) {
+		const char* semi = memchr(p, ';', sp - p);
+		const char* fend = semi ? semi : sp;
+		const char* eq = memchr(p, '=', fend - p);
+		if (eq != NULL) {
+			const char* v = eq + 1;
+			size_t vlen = fend - v;
+			size_t flen = eq - p;
+			uint64_t n;
+			if (factIs(p, flen, "type")) {
+				if ((vlen == 4) && (strncasecmp(v, "file", 4) == 0))
+					e->type = FTP_CLIENT_ENTRY_FILE;
+				else if ((vlen == 3) && (strncasecmp(v, "dir", 3) == 0))
+					e->type = FTP_CLIENT_ENTRY_DIR;
+				else if ((vlen == 4) && ((strncasecmp(v, "cdir", 4) == 0) || (strncasecmp(v, "pdir", 4) == 0)))
+					return 0;
+				else if ((vlen > 3) && (strncasecmp(v, "OS.", 3) == 0)) {
+					/* OS.unix=slink:target, OS.unix=symlink */
+					for (size_t i = 3; i + 4 <= vlen; i++) {
+						if (strncasecmp(v + i, "link", 4) == 0) {
+							e->type = FTP_CLIENT_ENTRY_LINK;
+							break;
+						}
+					}
+				}
+			}
+			else if (factIs(p, flen, "size") || factIs(p, flen, "sizd")) {
+				if (parseNumber(v, vlen, &n) == vlen) {
+					e->size = n;
+					e->facts |= FTP_CLIENT_FACT_SIZE;
+				}
+			}
+			else if (factIs(p, flen, "modify")) {
+				if (vlen >= 14) {
+					e->modify = epochTime(parseDigits(v, 4), parseDigits(v + 4, 2), parseDigits(v + 6, 2),
+						parseDigits(v + 8, 2), parseDigits(v + 10, 2), parseDigits(v + 12, 2));
+					if (e->modify)
+						e->facts |= FTP_CLIENT_FACT_MODIFY;
+				}
+			}
+			else if (factIs(p, flen, "perm")) {
+				for (size_t i = 0; i < vlen; i++) {
+					int c = tolower((unsigned char)v[i]);
+					if ((c >= 'a') && (c <= 'z'))
+						e->perm |= 1UL << (c - 'a');
+				}
+				e->facts |= FTP_CLIENT_FACT_PERM;
+			}
+			else if (factIs(p, flen, "unix.mode")) {
+				uint16_t mode = 0;
+				size_t i;
+				for (i = 0; (i < vlen) && (v[i] >= '0') && (v[i] <= '7'); i++)
+					mode = (mode << 3) | (v[i] - '0');
+				if ((i == vlen) && vlen) {
+					e->mode = mode & 07777;
+					e->facts |= FTP_CLIENT_FACT_MODE;
+				}
+			}
+			else if (factIs(p, flen, "unique") && vlen) {
+				e->unique = namesIntern(lp, v, vlen);
+				if (e->unique == NULL) {
+					lp->failed = 1;
+					return 0;
+				}
+				e->facts |= FTP_CLIENT_FACT_UNIQUE;
+			}
+		}
+		p = fend + 1;
+	}
+	return 1;
+}
+
+
+
+/*
+ * splitFields - split up to max whitespace separated fields
+ *
+ * return the number of fields
+ */
+static int splitFields(const char* s, size_t len, Field_t* f, int max)
+{
+	const char* end = s + len;
+	int n = 0;
+	while (n < max) {
+		while ((s < end) && ((*s == ' ') || (*s == '\t')))
+			s++;
+		if (s == end)
+			break;
+		f[n].s = s;
+		while ((s < end) && (*s != ' ') && (*s != '\t'))
+			s++;
+		f[n].len = s - f[n].s;
+		n++;
+	}
+	return n;
+}
+
+
+
+/*
+ * monthOf - month of a three letter name
+ *
+ * return 1 to 12, 0 if it is no month
+ */
+static int monthOf(const Field_t* f)
+{
+	if (f->len != 3)
+		return 0;
+	for (int i = 0; i < 12; i++) {
+		if (strncasecmp(f->s, months[i], 3) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+
+
+/*
+ * unixDate - check for "Jan 15 10:30" or "Jan 15 2023" from field f
+ *
+ * return the month 1 to 12 and the day in *day, 0 if it is no date
+ */
+static int unixDate(const Field_t* f, uint64_t* day)
+{
+	int mon = monthOf(&f[0]);
+	const Field_t* t = &f[2];
+	if ((mon == 0) || (f[1].len > 2) || (parseNumber(f[1].s, f[1].len, day) != f[1].len))
+		return 0;
+	if (((t->len == 5) && (t->s[2] == ':')) || ((t->len == 4) && (parseDigits(t->s, 4) >= 0)))
+		return mon;
+	return 0;
+}
+
+
+
+/*
+ * parseUnix - parse "drwxr-xr-x 2 user group 4096 Jan 15 10:30 name"
+ *
+ * The owner and group columns vary between servers, so the date is found
+ * by its month name and the size is the column in front of it. An owner
+ * or group named like a month is skipped, it is not followed by a day and
+ * a time or year, or not preceded by a size.
+ *
+ * return 1 for an entry, 0 for a line to skip
+ */
+static int parseUnix(FtpClientListParser_t* lp, const char* s, size_t len,
+	FtpClientDirEntry_t* e, Field_t* name)
+{
+	Field_t f[FTP_CLIENT_LIST_FIELDS];
+	int n = splitFields(s, len, f, FTP_CLIENT_LIST_FIELDS);
+	int m;
+	int mon = 0;
+	uint64_t v, day;
+	for (m = 2; m + 3 < n; m++) {
+		if (((mon = unixDate(&f[m], &day)) != 0) &&
+				(parseNumber(f[m - 1].s, f[m - 1].len, &v) == f[m - 1].len))
+			break;
+		mon = 0;
+	}
+	if ((mon == 0) || (f[0].len < 10))
+		return 0;
+	e->size = v;
+	e->facts |= FTP_CLIENT_FACT_SIZE;
+
+	switch (f[0].s[0]) {
+		case '-': e->type = FTP_CLIENT_ENTRY_FILE; break;
+		case 'd': e->type = FTP_CLIENT_ENTRY_DIR; break;
+		case 'l': e->type = FTP_CLIENT_ENTRY_LINK; break;
+		default: e->type = FTP_CLIENT_ENTRY_UNKNOWN; break;
+	}
+	static const char rwx[] = "rwxrwxrwx";
+	uint16_t mode = 0;
+	for (int i = 0; i < 9; i++) {
+		char c = f[0].s[i + 1];
+		if ((c == rwx[i]) || (((i % 3) == 2) && ((c == 's') || (c == 't'))))
+			mode |= 0400 >> i;
+		if ((c == 's') || (c == 'S'))
+			mode |= (i == 2) ? 04000 : 02000;
+		if ((c == 't') || (c == 'T'))
+			mode |= 01000;
+	}
+	e->mode = mode;
+	e->facts |= FTP_CLIENT_FACT_MODE;
+
+	const Field_t* t = &f[m + 2];
+	if ((t->len == 5) && (t->s[2] == ':')) {
+		/* recent files show the time instead of the year */
+		int hour = parseDigits(t->s, 2);
+		int min = parseDigits(t->s + 3, 2);
+		int year = 1971 + (int)(lp->now / 31556952);
+		while ((year > 1970) && (epochTime(year, 1, 1, 0, 0, 0) > lp->now))
+			year--;
+		e->modify = epochTime(year, mon, (int)day, hour, min, 0);
+		if (e->modify > lp->now + 86400)
+			e->modify = epochTime(year - 1, mon, (int)day, hour, min, 0);
+	}
+	else if (t->len == 4)
+		e->modify = epochTime(parseDigits(t->s, 4), mon, (int)day, 0, 0, 0);
+	if (e->modify)
+		e->facts |= FTP_CLIENT_FACT_MODIFY;
+
+	name->s = t->s + t->len;
+	while ((name->s < s + len) && (*name->s == ' '))
+		name->s++;
+	name->len = (s + len) - name->s;
+	if (e->type == FTP_CLIENT_ENTRY_LINK) {
+		for (size_t i = 0; i + 4 <= name->len; i++) {
+			if (memcmp(name->s + i, " -> ", 4) == 0) {
+				name->len = i;
+				break;
+			}
+		}
+	}
+	return 1;
+}
+
+
+
+/*
+ * parseDos - parse "01-15-24  10:30AM  <DIR>  name" or "... 1234 name"
+ *
+ * return 1 for an entry, 0 for a line to skip
+ */
+static int parseDos(const char* s, size_t len, FtpClientDirEntry_t* e, Field_t* name)
+{
+	Field_t f[3];
+	if (splitFields(s, len, f, 3) != 3)
+		return 0;
+	const Field_t* d = &f[0];
+	if (((d->len != 8) && (d->len != 10)) || (d->s[2] != '-') || (d->s[5] != '-'))
+		return 0;
+	int mon = parseDigits(d->s, 2);
+	int day = parseDigits(d->s + 3, 2);
+	int year = parseDigits(d->s + 6, d->len - 6);
+	if ((year >= 0) && (d->len == 8))
+		year += (year < 70) ? 2000 : 1900;
+	const Field_t* t = &f[1];
+	if ((t->len < 5) || (t->s[2] != ':'))
+		return 0;
+	int hour = parseDigits(t->s, 2);
+	int min = parseDigits(t->s + 3, 2);
+	if ((t->len == 7) && ((t->s[5] == 'P') || (t->s[5] == 'p')) && (hour < 12))
+		hour += 12;
+	else if ((t->len == 7) && ((t->s[5] == 'A') || (t->s[5] == 'a')) && (hour == 12))
+		hour = 0;
+	e->modify = epochTime(year, mon, day, hour, min, 0);
+	if (e->modify)
+		e->facts |= FTP_CLIENT_FACT_MODIFY;
+
+	uint64_t v;
+	if ((f[2].len == 5) && (memcmp(f[2].s, "<DIR>", 5) == 0))
+		e->type = FTP_CLIENT_ENTRY_DIR;
+	else if (parseNumber(f[2].s, f[2].len, &v) == f[2].len) {
+		e->type = FTP_CLIENT_ENTRY_FILE;
+		e->size = v;
+		e->facts |= FTP_CLIENT_FACT_SIZE;
+	}
+	else
+		return 0;
+	name->s = f[2].s + f[2].len;
+	while ((name->s < s + len) && (*name->s == ' '))
+		name->s++;
+	name->len = (s + len) - name->s;
+	return 1;
+}
+
+
+
+/*
+ * parseLine - parse one listing line and pass its entry to the callback
+ *
+ * return 1 to go on, 0 to stop
+ */
+static int parseLine(FtpClientListParser_t* lp, const char* s, size_t len)
+{
+	while ((len > 0) && (s[len - 1] == '\r'))
+		len--;
+	if (len == 0)
+		return 1;
+
+	FtpClientDirEntry_t e;
+	Field_t name;
+	int ok = 0;
+	memset(&e, 0, sizeof(e));
+	if (lp->format == FTP_CLIENT_LIST_MLSD)
+		ok = parseMlsd(lp, s, len, &e, &name);
+	else if (lp->format == FTP_CLIENT_LIST_NLST) {
+		name.s = s;
+		name.len = len;
+		ok = 1;
+	}
+	else if (isdigit((unsigned char)s[0]))
+		ok = parseDos(s, len, &e, &name);
+	else if ((len < 6) || (strncmp(s, "total ", 6) != 0))
+		ok = parseUnix(lp, s, len, &e, &name);
+	if (lp->failed)
+		return 0;
+	if (!ok || (name.len == 0) || (name.len > UINT16_MAX))
+		return 1;
+	if ((name.s[0] == '.') && ((name.len == 1) || ((name.len == 2) && (name.s[1] == '.'))))
+		return 1;
+	e.name = namesIntern(lp, name.s, name.len);
+	if (e.name == NULL) {
+		lp->failed = 1;
+		return 0;
+	}
+	e.nameLen = (uint16_t)name.len;
+	lp->count++;
+	if (!lp->cb(&e, lp->arg)) {
+		lp->stopped = 1;
+		return 0;
+	}
+	return 1;
+}
+
+
+
+FtpClientListParser_t* ftpClientListCreate(int format, int64_t now,
+	FtpClientListCallback_t cb, void* arg)
+{
+	if ((format != FTP_CLIENT_LIST_MLSD) && (format != FTP_CLIENT_LIST_LIST) &&
+			(format != FTP_CLIENT_LIST_NLST))
+		return NULL;
+	FtpClientListParser_t* lp = calloc(1, sizeof(FtpClientListParser_t));
+	if (lp == NULL)
+		return NULL;
+	lp->format = format;
+	lp->now = now;
+	lp->cb = cb;
+	lp->arg = arg;
+	if (!namesGrow(lp)) {
+		free(lp);
+		return NULL;
+	}
+	return lp;
+}
+
+
+
+void ftpClientListDelete(FtpClientListParser_t* lp)
+{
+	while (lp->blocks) {
+		NameBlock_t* b = lp->blocks;
+		lp->blocks = b->next;
+		free(b);
+	}
+	free(lp->slots);
+	free(lp);
+}
+
+
+
+int ftpClientListFeed(FtpClientListParser_t* lp, const char* buf, size_t len)
+{
+	const char* end = buf + len;
+	while (buf < end) {
+		if (lp->stopped || lp->failed)
+			return 0;
+		const char* nl = ftpClientTextFind(buf, end - buf, '\n');
+		size_t n = (nl ? nl : end) - buf;
+		if ((nl != NULL) && (lp->lineLen == 0) && !lp->overflow && (n <= sizeof(lp->line))) {
+			/* whole line in the chunk, parse it in place */
+			if (!parseLine(lp, buf, n))
+				return 0;
+		}
+		else {
+			if (lp->lineLen + n > sizeof(lp->line))
+				lp->overflow = 1;
+			else {
+				memcpy(lp->line + lp->lineLen, buf, n);
+				lp->lineLen += n;
+			}
+			if (nl != NULL) {
+				if (!lp->overflow && !parseLine(lp, lp->line, lp->lineLen))
+					return 0;
+				lp->lineLen = 0;
+				lp->overflow = 0;
+			}
+		}
+		buf += n + (nl != NULL);
+	}
+	return !(lp->stopped || lp->failed);
+}
+
+
+
+int ftpClientListFinish(FtpClientListParser_t* lp)
+{
+	if ((lp->lineLen > 0) && !lp->overflow && !lp->stopped && !lp->failed)
+		parseLine(lp, lp->line, lp->lineLen);
+	lp->lineLen = 0;
+	lp->overflow = 0;
+	return !(lp->stopped || lp->failed);
+}
+
+
+
+int ftpClientListStopped(const FtpClientListParser_t* lp)
+{
+	return lp->stopped;
+}
+
+
+
+uint32_t ftpClientListCount(const FtpClientListParser_t* lp)
+{
+	return lp->count;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client directory listing parser
+ *
+ * Turns the data of MLSD, LIST (UNIX and DOS style) and NLST into
+ * FtpClientDirEntry_t while it arrives, so a listing never goes through a
+ * local file. Names are interned in a pool that grows in blocks of
+ * FTP_CLIENT_LIST_NAMES_BLOCK bytes, entries themselves are not allocated.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTLIST_H_
+#define FTPCLIENTLIST_H_
+
+#include <stddef.h>
+#include "FtpClient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FtpClientListParser FtpClientListParser_t;
+
+/* now is the current time in seconds since 1970, it dates LIST entries without a year */
+FtpClientListParser_t* ftpClientListCreate(int format, int64_t now,
+	FtpClientListCallback_t cb, void* arg);
+void ftpClientListDelete(FtpClientListParser_t* lp);
+
+/*
+ * Parse the next chunk of listing data, lines may span chunks.
+ *
+ * return 1 to go on, 0 when the callback stopped or the pool is out of memory
+ */
+int ftpClientListFeed(FtpClientListParser_t* lp, const char* buf, size_t len);
+
+/* parse a last line without line end, return like ftpClientListFeed() */
+int ftpClientListFinish(FtpClientListParser_t* lp);
+
+/* 1 if the callback returned 0 */
+int ftpClientListStopped(const FtpClientListParser_t* lp);
+
+/* number of entries passed to the callback */
+uint32_t ftpClientListCount(const FtpClientListParser_t* lp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTLIST_H_ */
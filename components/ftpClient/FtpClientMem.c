@@ -0,0 +1,219 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client data buffer pool
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "FtpClientMem.h"
+#include "FtpClientPort.h"
+
+/* in front of every block, keeps the data aligned like malloc() does */
+typedef union MemBlock {
+	struct {
+		union MemBlock* next;	/* free list of the class */
+		int cls;				/* -1 for a block larger than the classes */
+	} h;
+	max_align_t align;
+} MemBlock_t;
+
+typedef struct {
+	MemBlock_t* free;
+	int reserved;				/* blocks kept even by ftpClientMemFlush() */
+	FtpClientMemClassStats_t stats;
+} MemClass_t;
+
+static FtpClientPortOnce_t memOnce = FTP_CLIENT_PORT_ONCE_INIT;
+static FtpClientPortMutex_t* memLock;
+static MemClass_t memClasses[FTP_CLIENT_MEM_CLASSES];
+
+
+
+static int memClassSize(int cls)
+{
+	return FTP_CLIENT_MEM_MIN_SIZE << (2 * cls);
+}
+
+
+
+/*
+ * memClassOf - the smallest class that holds size bytes, -1 if none does
+ */
+static int memClassOf(int size)
+{
+	for (int cls = 0; cls < FTP_CLIENT_MEM_CLASSES; cls++)
+		if (size <= memClassSize(cls))
+			return cls;
+	return -1;
+}
+
+
+
+static MemBlock_t* memHeapAlloc(size_t size)
+{
+#ifdef ESP_PLATFORM
+	return heap_caps_malloc(sizeof(MemBlock_t) + size, FTP_CLIENT_MEM_CAPS);
+#else
+	return malloc(sizeof(MemBlock_t) + size);
+#endif
+}
+
+
+
+static void memHeapFree(MemBlock_t* b)
+{
+#ifdef ESP_PLATFORM
+	heap_caps_free(b);
+#else
+	free(b);
+#endif
+}
+
+
+
+static void memInit(void)
+{
+	memLock = ftpClientPortMutexCreate();
+	for (int cls = 0; cls < FTP_CLIENT_MEM_CLASSES; cls++)
+		memClasses[cls].stats.size = memClassSize(cls);
+}
+
+
+
+void ftpClientMemInit(void)
+{
+	ftpClientPortOnce(&memOnce, memInit);
+}
+
+
+
+void* ftpClientMemAlloc(int size, int* capacity)
+{
+	int cls = memClassOf(size);
+	if (cls < 0) {
+		MemBlock_t* b = memHeapAlloc(size);
+		if (b == NULL)
+			return NULL;
+		b->h.cls = -1;
+		if (capacity)
+			*capacity = size;
+		return b + 1;
+	}
+	MemClass_t* c = &memClasses[cls];
+	ftpClientPortMutexLock(memLock);
+	MemBlock_t* b = c->free;
+	if (b) {
+		c->free = b->h.next;
+		c->stats.cached--;
+		c->stats.hits++;
+	}
+	else
+		c->stats.misses++;
+	ftpClientPortMutexUnlock(memLock);
+	if ((b == NULL) && ((b = memHeapAlloc(memClassSize(cls))) == NULL)) {
+		ftpClientPortMutexLock(memLock);
+		c->stats.failures++;
+		ftpClientPortMutexUnlock(memLock);
+		return NULL;
+	}
+	b->h.cls = cls;
+	ftpClientPortMutexLock(memLock);
+	if (++c->stats.inUse > c->stats.highWater)
+		c->stats.highWater = c->stats.inUse;
+	ftpClientPortMutexUnlock(memLock);
+	if (capacity)
+		*capacity = memClassSize(cls);
+	return b + 1;
+}
+
+
+
+void ftpClientMemFree(void* buf)
+{
+	if (buf == NULL)
+		return;
+	MemBlock_t* b = (MemBlock_t*)buf - 1;
+	if (b->h.cls < 0) {
+		memHeapFree(b);
+		return;
+	}
+	MemClass_t* c = &memClasses[b->h.cls];
+	int keep = (c->reserved > FTP_CLIENT_MEM_KEEP) ? c->reserved : FTP_CLIENT_MEM_KEEP;
+	ftpClientPortMutexLock(memLock);
+	c->stats.inUse--;
+	if ((int)c->stats.cached < keep) {
+		b->h.next = c->free;
+		c->free = b;
+		c->stats.cached++;
+		b = NULL;
+	}
+	ftpClientPortMutexUnlock(memLock);
+	if (b)
+		memHeapFree(b);
+}
+
+
+
+int ftpClientMemReserve(int size, int count)
+{
+	int cls = memClassOf(size);
+	if (cls < 0)
+		return 0;
+	MemClass_t* c = &memClasses[cls];
+	int added;
+	for (added = 0; added < count; added++) {
+		MemBlock_t* b = memHeapAlloc(memClassSize(cls));
+		if (b == NULL)
+			break;
+		b->h.cls = cls;
+		ftpClientPortMutexLock(memLock);
+		b->h.next = c->free;
+		c->free = b;
+		c->stats.cached++;
+		c->reserved++;
+		ftpClientPortMutexUnlock(memLock);
+	}
+	return added;
+}
+
+
+
+void ftpClientMemFlush(void)
+{
+	for (int cls = 0; cls < FTP_CLIENT_MEM_CLASSES; cls++) {
+		MemClass_t* c = &memClasses[cls];
+		MemBlock_t* release = NULL;
+		ftpClientPortMutexLock(memLock);
+		while (c->free && ((int)c->stats.cached > c->reserved)) {
+			MemBlock_t* b = c->free;
+			c->free = b->h.next;
+			c->stats.cached--;
+			b->h.next = release;
+			release = b;
+		}
+		ftpClientPortMutexUnlock(memLock);
+		while (release) {
+			MemBlock_t* b = release;
+			release = b->h.next;
+			memHeapFree(b);
+		}
+	}
+}
+
+
+
+void ftpClientMemGetStats(FtpClientMemClassStats_t* stats)
+{
+	ftpClientPortMutexLock(memLock);
+	for (int cls = 0; cls < FTP_CLIENT_MEM_CLASSES; cls++)
+		stats[cls] = memClasses[cls].stats;
+	ftpClientPortMutexUnlock(memLock);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client data buffer pool
+ *
+ * Data buffers come in FTP_CLIENT_MEM_CLASSES size classes and are kept for
+ * the next transfer when one ends, so transfers do not cut the heap into
+ * pieces of odd sizes over days of uptime. Blocks can be reserved early,
+ * while the heap is still in one piece. On the ESP32 the blocks come from
+ * heap_caps_malloc() with FTP_CLIENT_MEM_CAPS, which can place them in
+ * PSRAM or in DMA capable internal RAM.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTMEM_H_
+#define FTPCLIENTMEM_H_
+
+#include "FtpClient.h"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * MALLOC_CAP_SPIRAM puts the buffers into PSRAM,
+ * MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL into DMA capable internal RAM
+ */
+#if defined(ESP_PLATFORM) && !defined(FTP_CLIENT_MEM_CAPS)
+#define FTP_CLIENT_MEM_CAPS 				MALLOC_CAP_8BIT
+#endif
+
+/* create the lock, called by getFtpClient() and getFtpClientAsync() */
+void ftpClientMemInit(void);
+/*
+ * a block of at least size bytes, its usable size is stored in *capacity
+ * if capacity is not NULL. return NULL when out of memory
+ */
+void* ftpClientMemAlloc(int size, int* capacity);
+/* give a block back to its class, NULL is ignored */
+void ftpClientMemFree(void* buf);
+/* allocate count blocks of the class of size now, return the blocks added */
+int ftpClientMemReserve(int size, int count);
+/* release the kept blocks to the heap, except the reserved ones */
+void ftpClientMemFlush(void);
+/* fill FTP_CLIENT_MEM_CLASSES entries */
+void ftpClientMemGetStats(FtpClientMemClassStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTMEM_H_ */
@@ -0,0 +1,313 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client download into a flash partition
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FtpClientOta.h"
+#include "FtpClientHash.h"
+#include "FtpClientPort.h"
+#include "esp_ota_ops.h"
+
+#include "esp_log.h"
+
+struct FtpClientOtaWriter {
+	const esp_partition_t* part;
+	int raw;
+	esp_ota_handle_t ota;
+	uint32_t size;				/* image size, 0 if unknown */
+	uint32_t offset;			/* bytes written */
+	uint32_t erased;			/* bytes erased from the start, data partitions */
+	uint32_t eraseAhead;
+	FtpClientOtaOptions_t opt;
+	FtpClientOtaStats_t stats;
+	uint8_t buf[FTP_CLIENT_OTA_BUFFER_SIZE];
+};
+
+static FtpClientPortOnce_t isInitilized = FTP_CLIENT_PORT_ONCE_INIT;
+static FtpClientOta ftpClientOta_;
+
+
+
+/*
+ * otaPartition - the partition named by the options
+ */
+static const esp_partition_t* otaPartition(const FtpClientOtaOptions_t* opt)
+{
+	if (opt->label)
+		return esp_partition_find_first(opt->raw ? ESP_PARTITION_TYPE_DATA : ESP_PARTITION_TYPE_APP,
+			ESP_PARTITION_SUBTYPE_ANY, opt->label);
+	if (opt->raw)
+		return NULL;
+	return esp_ota_get_next_update_partition(NULL);
+}
+
+
+
+static void* otaGetBuffer(int* size, void* arg)
+{
+	FtpClientOtaWriter_t* w = arg;
+	*size = sizeof(w->buf);
+	return w->buf;
+}
+
+
+
+/*
+ * otaErase - erase the data partition in front of the next write
+ *
+ * return ESP_OK if successful
+ */
+static esp_err_t otaErase(FtpClientOtaWriter_t* w, uint32_t end)
+{
+	uint32_t limit = w->part->size;
+	if (w->size && (w->size < limit))
+		limit = (w->size + w->part->erase_size - 1) / w->part->erase_size * w->part->erase_size;
+	while (w->erased < end) {
+		uint32_t n = w->eraseAhead;
+		if (n > limit - w->erased)
+			n = limit - w->erased;
+		if (n == 0)
+			return ESP_ERR_INVALID_SIZE;
+		int64_t t = ftpClientPortTimeUs();
+		esp_err_t err = esp_partition_erase_range(w->part, w->erased, n);
+		w->stats.eraseUs += ftpClientPortTimeUs() - t;
+		if (err != ESP_OK)
+			return err;
+		w->erased += n;
+		w->stats.erasedBytes += n;
+	}
+	return ESP_OK;
+}
+
+
+
+static int otaWrite(const void* buf, int len, void* arg)
+{
+	FtpClientOtaWriter_t* w = arg;
+	esp_err_t err;
+	if ((uint32_t)len > w->part->size - w->offset)
+		err = ESP_ERR_INVALID_SIZE;
+	else if (w->raw && ((err = otaErase(w, w->offset + len)) != ESP_OK))
+		;
+	else {
+		int64_t t = ftpClientPortTimeUs();
+		err = w->raw ? esp_partition_write(w->part, w->offset, buf, len) :
+			esp_ota_write(w->ota, buf, len);
+		w->stats.writeUs += ftpClientPortTimeUs() - t;
+	}
+	if (err != ESP_OK) {
+		ESP_LOGE(__FUNCTION__, "%s at %u: %s", w->part->label, (unsigned)w->offset,
+			esp_err_to_name(err));
+		w->stats.err = err;
+		return -1;
+	}
+	w->offset += len;
+	w->stats.bytes += len;
+	return len;
+}
+
+
+
+/*
+ * otaReadBack - hash what the partition holds now
+ *
+ * return 1 if it matches the digest of the transfer, 0 otherwise
+ */
+static int otaReadBack(FtpClientOtaWriter_t* w, const FtpClientXferStats_t* xstats)
+{
+	FtpClientHash_t h;
+	uint8_t digest[FTP_CLIENT_HASH_SIZE_MAX];
+	ftpClientHashInit(&h, xstats->hashAlg);
+	for (uint32_t off = 0; off < w->offset; ) {
+		uint32_t n = w->offset - off;
+		if (n > sizeof(w->buf))
+			n = sizeof(w->buf);
+		esp_err_t err = esp_partition_read(w->part, off, w->buf, n);
+		if (err != ESP_OK) {
+			ftpClientHashFinal(&h, digest);
+			w->stats.err = err;
+			return 0;
+		}
+		ftpClientHashUpdate(&h, w->buf, n);
+		off += n;
+	}
+	return (ftpClientHashFinal(&h, digest) == xstats->hashLen) &&
+		!memcmp(digest, xstats->hash, xstats->hashLen);
+}
+
+
+
+/*
+ * otaVerify - compare the digests the options ask for
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int otaVerify(FtpClientOtaWriter_t* w, const FtpClientXferStats_t* xstats)
+{
+	const FtpClientOtaOptions_t* opt = &w->opt;
+	int hashed = xstats && xstats->hashLen && (xstats->hashAlg == opt->hashAlg);
+	if (xstats && (xstats->hashVerified < 0)) {
+		w->stats.hashVerified = -1;
+		return 0;
+	}
+	if (hashed && opt->digest) {
+		if (memcmp(opt->digest, xstats->hash, xstats->hashLen)) {
+			ESP_LOGE(__FUNCTION__, "%s digest mismatch", w->part->label);
+			w->stats.hashVerified = -1;
+			return 0;
+		}
+		w->stats.hashVerified = 1;
+	}
+	else if (xstats && (xstats->hashVerified > 0))
+		w->stats.hashVerified = 1;
+	if (opt->readBack && hashed && !otaReadBack(w, xstats)) {
+		ESP_LOGE(__FUNCTION__, "%s read back mismatch", w->part->label);
+		w->stats.hashVerified = -1;
+		return 0;
+	}
+	if (opt->requireVerified && (w->stats.hashVerified != 1)) {
+		ESP_LOGE(__FUNCTION__, "%s not verified", w->part->label);
+		return 0;
+	}
+	return 1;
+}
+
+
+
+/*
+ * beginFtpClientOta - prepare the partition and a sink that writes it
+ *
+ * return the writer, NULL on error
+ */
+static FtpClientOtaWriter_t* beginFtpClientOta(const FtpClientOtaOptions_t* opt,
+	uint32_t size, FtpClientSink_t* sink)
+{
+	const esp_partition_t* part = otaPartition(opt);
+	if (part == NULL) {
+		ESP_LOGE(__FUNCTION__, "no partition %s", opt->label ? opt->label : "to update");
+		return NULL;
+	}
+	if (size > part->size) {
+		ESP_LOGE(__FUNCTION__, "%u bytes do not fit into %s", (unsigned)size, part->label);
+		return NULL;
+	}
+	FtpClientOtaWriter_t* w = calloc(1, sizeof(FtpClientOtaWriter_t));
+	if (w == NULL)
+		return NULL;
+	w->part = part;
+	w->raw = opt->raw;
+	w->size = size;
+	w->opt = *opt;
+	w->stats.partition = part;
+	w->eraseAhead = opt->eraseAhead ? opt->eraseAhead : FTP_CLIENT_OTA_ERASE_AHEAD;
+	w->eraseAhead = (w->eraseAhead + part->erase_size - 1) / part->erase_size * part->erase_size;
+	if (!w->raw) {
+		esp_err_t err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &w->ota);
+		if (err != ESP_OK) {
+			ESP_LOGE(__FUNCTION__, "esp_ota_begin %s: %s", part->label, esp_err_to_name(err));
+			free(w);
+			return NULL;
+		}
+	}
+	sink->getBuffer = otaGetBuffer;
+	sink->write = otaWrite;
+	sink->arg = w;
+	return w;
+}
+
+
+
+/*
+ * endFtpClientOta - finish the image, make it bootable if asked to
+ *
+ * A failed app image is aborted. A failed data partition gets its first
+ * sector erased so the partial image is not taken for a valid one.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int endFtpClientOta(FtpClientOtaWriter_t* w, int ok,
+	const FtpClientXferStats_t* xstats, FtpClientOtaStats_t* stats)
+{
+	if (ok)
+		ok = otaVerify(w, xstats);
+	else if (xstats && (xstats->hashVerified < 0))
+		w->stats.hashVerified = -1;
+	if (w->raw) {
+		if (!ok && w->erased)
+			esp_partition_erase_range(w->part, 0, w->part->erase_size);
+	}
+	else if (!ok)
+		esp_ota_abort(w->ota);
+	else {
+		esp_err_t err = esp_ota_end(w->ota);
+		if ((err == ESP_OK) && w->opt.setBoot)
+			err = esp_ota_set_boot_partition(w->part);
+		if (err != ESP_OK) {
+			ESP_LOGE(__FUNCTION__, "%s: %s", w->part->label, esp_err_to_name(err));
+			w->stats.err = err;
+			ok = 0;
+		}
+	}
+	if (stats)
+		*stats = w->stats;
+	free(w);
+	return ok;
+}
+
+
+
+/*
+ * downloadFtpClientOta - download a remote file into a partition
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int downloadFtpClientOta(const char* path, const FtpClientOtaOptions_t* opt,
+	FtpClientOtaStats_t* stats, NetBuf_t* nControl)
+{
+	FtpClient* ftp = getFtpClient();
+	unsigned int size = 0;
+	if (!ftp->ftpClientGetFileSize(path, &size, FTP_CLIENT_BINARY, nControl))
+		size = 0;
+	FtpClientSink_t sink;
+	FtpClientOtaWriter_t* w = beginFtpClientOta(opt, size, &sink);
+	if (w == NULL) {
+		if (stats) {
+			memset(stats, 0, sizeof(*stats));
+			stats->err = ESP_FAIL;
+		}
+		return 0;
+	}
+	ftp->ftpClientSetOptions(FTP_CLIENT_HASH, opt->hashAlg, nControl);
+	int ok = ftp->ftpClientGetToSink(&sink, path, FTP_CLIENT_BINARY, nControl);
+	ftp->ftpClientSetOptions(FTP_CLIENT_HASH, FTP_CLIENT_HASH_NONE, nControl);
+	FtpClientXferStats_t xstats;
+	ftp->ftpClientGetXferStats(&xstats, nControl);
+	return endFtpClientOta(w, ok, &xstats, stats);
+}
+
+
+
+static void initFtpClientOta(void)
+{
+	ftpClientOta_.ftpClientOtaGet = downloadFtpClientOta;
+	ftpClientOta_.ftpClientOtaBegin = beginFtpClientOta;
+	ftpClientOta_.ftpClientOtaEnd = endFtpClientOta;
+}
+
+
+
+FtpClientOta* getFtpClientOta(void)
+{
+	ftpClientPortOnce(&isInitilized, initFtpClientOta);
+	return &ftpClientOta_;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client download into a flash partition
+ *
+ * A sink for ftpClientGetToSink() whose buffer the data connection is read
+ * into, so the image goes from the socket to esp_ota_write(), or to
+ * esp_partition_write() for a data partition, without passing through a
+ * file. An app partition is erased by esp_ota_write() one sector at a time
+ * as the writes reach it. A data partition is erased here, eraseAhead bytes
+ * at a time in front of the write position, so large aligned ranges can use
+ * the block erase of the chip and the rest of the partition is left alone.
+ *
+ * The image is hashed while it is written with the FTP_CLIENT_HASH option
+ * of the session. It is only made bootable when the digest matches the one
+ * of the caller or of the server, as the options ask for.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTOTA_H_
+#define FTPCLIENTOTA_H_
+
+#include "FtpClient.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FTP_CLIENT_OTA_BUFFER_SIZE
+#define FTP_CLIENT_OTA_BUFFER_SIZE 			4096	/* bytes read from the data connection at once */
+#endif
+#define FTP_CLIENT_OTA_ERASE_AHEAD 			65536	/* default erase step of a data partition */
+
+typedef struct FtpClientOtaWriter FtpClientOtaWriter_t;
+
+typedef struct
+{
+	const char* label;			/* partition, NULL for the next OTA app partition */
+	int raw;					/* write a data partition with esp_partition_write() */
+	int setBoot;				/* app partition: boot from it once it is verified */
+	int hashAlg;				/* FTP_CLIENT_HASH_* to hash the image with, 0 for none */
+	const uint8_t* digest;		/* optional, expected digest of hashAlg */
+	int requireVerified;		/* fail unless digest or the server's hash matched */
+	int readBack;				/* hash the written partition again and compare */
+	uint32_t eraseAhead;		/* data partition: erase step, rounded up to sectors, 0 for the default */
+} FtpClientOtaOptions_t;
+
+typedef struct
+{
+	const esp_partition_t* partition;
+	uint64_t bytes;				/* bytes written to the partition */
+	uint32_t erasedBytes;		/* erased in front of the writes, data partitions only */
+	uint32_t eraseUs;			/* time spent erasing, esp_ota_write() counts as writeUs */
+	uint32_t writeUs;			/* time spent writing */
+	int hashVerified;			/* 1 if a digest matched, -1 if one differed, 0 if none was compared */
+	esp_err_t err;				/* flash error that failed the download, ESP_OK otherwise */
+} FtpClientOtaStats_t;
+
+typedef struct
+{
+	/*
+	 * Download path into the partition of opt. The FTP_CLIENT_HASH option of
+	 * the session is set to opt->hashAlg for the transfer and to
+	 * FTP_CLIENT_HASH_NONE afterwards.
+	 */
+	int (*ftpClientOtaGet)(const char* path, const FtpClientOtaOptions_t* opt,
+		FtpClientOtaStats_t* stats, NetBuf_t* nControl);
+	/*
+	 * Lower level, for ftpClientAsyncGet() and other streams: fill in sink to
+	 * write the partition of opt. size is the image size if known, else 0.
+	 */
+	FtpClientOtaWriter_t* (*ftpClientOtaBegin)(const FtpClientOtaOptions_t* opt,
+		uint32_t size, FtpClientSink_t* sink);
+	/*
+	 * Finish the writer. ok is the result of the transfer, xstats its
+	 * statistics for the digest or NULL. return 1 if the image was written
+	 * and verified, 0 otherwise. The writer is freed.
+	 */
+	int (*ftpClientOtaEnd)(FtpClientOtaWriter_t* writer, int ok,
+		const FtpClientXferStats_t* xstats, FtpClientOtaStats_t* stats);
+} FtpClientOta;
+
+FtpClientOta* getFtpClientOta(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTOTA_H_ */
@@ -0,0 +1,659 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client platform layer
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdlib.h>
+#include "FtpClientPort.h"
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+struct FtpClientPortThread {
+	void (*func)(void* arg);
+	void* arg;
+	SemaphoreHandle_t done;
+	TaskHandle_t task;
+};
+
+struct FtpClientPortQueue {
+	QueueHandle_t handle;
+};
+
+struct FtpClientPortMutex {
+	SemaphoreHandle_t handle;
+	int recursive;
+};
+
+/* a blocked side looks at closed this often */
+#define STREAM_POLL_MS						20
+
+struct FtpClientPortStream {
+	StreamBufferHandle_t handle;
+	volatile int closed;
+	volatile int aborted;
+};
+
+int64_t ftpClientPortTimeUs(void)
+{
+	return esp_timer_get_time();
+}
+
+void ftpClientPortSleepUs(int64_t us)
+{
+	TickType_t ticks = (us * configTICK_RATE_HZ + 999999) / 1000000;
+	vTaskDelay(ticks ? ticks : 1);
+}
+
+size_t ftpClientPortFreeHeap(void)
+{
+	return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+static void threadEntry(void* arg)
+{
+	FtpClientPortThread_t* thread = arg;
+	thread->func(thread->arg);
+	xSemaphoreGive(thread->done);
+	vTaskDelete(NULL);
+}
+
+FtpClientPortThread_t* ftpClientPortThreadCreate(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority)
+{
+	return ftpClientPortThreadCreatePinned(func, arg, name, stackSize, priority,
+		FTP_CLIENT_PORT_CORE_ANY);
+}
+
+FtpClientPortThread_t* ftpClientPortThreadCreatePinned(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority, int core)
+{
+	if (core >= portNUM_PROCESSORS)
+		return NULL;
+	FtpClientPortThread_t* thread = calloc(1, sizeof(FtpClientPortThread_t));
+	if (thread == NULL)
+		return NULL;
+	thread->func = func;
+	thread->arg = arg;
+	thread->done = xSemaphoreCreateBinary();
+	if (thread->done == NULL) {
+		free(thread);
+		return NULL;
+	}
+	if (priority <= 0)
+		priority = uxTaskPriorityGet(NULL);
+	if (xTaskCreatePinnedToCore(threadEntry, name, stackSize, thread, priority, &thread->task,
+			(core < 0) ? tskNO_AFFINITY : core) != pdPASS) {
+		vSemaphoreDelete(thread->done);
+		free(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+int64_t ftpClientPortThreadCpuUs(FtpClientPortThread_t* thread)
+{
+/* a 32-bit counter of microseconds wraps after 71 minutes */
+#if (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1) && \
+	defined(CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER) && \
+	defined(CONFIG_FREERTOS_RUN_TIME_COUNTER_TYPE_U64)
+	TaskStatus_t status;
+	vTaskGetInfo(thread->task, &status, pdFALSE, eRunning);
+	return status.ulRunTimeCounter;
+#else
+	(void)thread;
+	return -1;
+#endif
+}
+
+int ftpClientPortCores(void)
+{
+	return portNUM_PROCESSORS;
+}
+
+int ftpClientPortCoreId(void)
+{
+	return xPortGetCoreID();
+}
+
+void ftpClientPortThreadJoin(FtpClientPortThread_t* thread)
+{
+	xSemaphoreTake(thread->done, portMAX_DELAY);
+	vSemaphoreDelete(thread->done);
+	free(thread);
+}
+
+FtpClientPortQueue_t* ftpClientPortQueueCreate(int length)
+{
+	FtpClientPortQueue_t* queue = calloc(1, sizeof(FtpClientPortQueue_t));
+	if (queue == NULL)
+		return NULL;
+	queue->handle = xQueueCreate(length, sizeof(void*));
+	if (queue->handle == NULL) {
+		free(queue);
+		return NULL;
+	}
+	return queue;
+}
+
+void ftpClientPortQueueDelete(FtpClientPortQueue_t* queue)
+{
+	vQueueDelete(queue->handle);
+	free(queue);
+}
+
+void ftpClientPortQueueSend(FtpClientPortQueue_t* queue, void* item)
+{
+	xQueueSend(queue->handle, &item, portMAX_DELAY);
+}
+
+void* ftpClientPortQueueReceive(FtpClientPortQueue_t* queue)
+{
+	void* item = NULL;
+	xQueueReceive(queue->handle, &item, portMAX_DELAY);
+	return item;
+}
+
+void* ftpClientPortQueueReceiveTimeout(FtpClientPortQueue_t* queue, int timeoutMs)
+{
+	void* item = NULL;
+	TickType_t ticks = portMAX_DELAY;
+	if (timeoutMs >= 0)
+		ticks = ((TickType_t)timeoutMs * configTICK_RATE_HZ + 999) / 1000;
+	xQueueReceive(queue->handle, &item, ticks);
+	return item;
+}
+
+int ftpClientPortQueueTrySend(FtpClientPortQueue_t* queue, void* item)
+{
+	return xQueueSend(queue->handle, &item, 0) == pdTRUE;
+}
+
+FtpClientPortMutex_t* ftpClientPortMutexCreate(void)
+{
+	FtpClientPortMutex_t* mutex = calloc(1, sizeof(FtpClientPortMutex_t));
+	if (mutex == NULL)
+		return NULL;
+	mutex->handle = xSemaphoreCreateMutex();
+	if (mutex->handle == NULL) {
+		free(mutex);
+		return NULL;
+	}
+	return mutex;
+}
+
+FtpClientPortMutex_t* ftpClientPortMutexCreateRecursive(void)
+{
+	FtpClientPortMutex_t* mutex = calloc(1, sizeof(FtpClientPortMutex_t));
+	if (mutex == NULL)
+		return NULL;
+	mutex->handle = xSemaphoreCreateRecursiveMutex();
+	if (mutex->handle == NULL) {
+		free(mutex);
+		return NULL;
+	}
+	mutex->recursive = 1;
+	return mutex;
+}
+
+void ftpClientPortMutexDelete(FtpClientPortMutex_t* mutex)
+{
+	vSemaphoreDelete(mutex->handle);
+	free(mutex);
+}
+
+void ftpClientPortMutexLock(FtpClientPortMutex_t* mutex)
+{
+	if (mutex->recursive)
+		xSemaphoreTakeRecursive(mutex->handle, portMAX_DELAY);
+	else
+		xSemaphoreTake(mutex->handle, portMAX_DELAY);
+}
+
+void ftpClientPortMutexUnlock(FtpClientPortMutex_t* mutex)
+{
+	if (mutex->recursive)
+		xSemaphoreGiveRecursive(mutex->handle);
+	else
+		xSemaphoreGive(mutex->handle);
+}
+
+FtpClientPortStream_t* ftpClientPortStreamCreate(size_t size)
+{
+	FtpClientPortStream_t* stream = calloc(1, sizeof(FtpClientPortStream_t));
+	if (stream == NULL)
+		return NULL;
+	stream->handle = xStreamBufferCreate(size, 1);
+	if (stream->handle == NULL) {
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+void ftpClientPortStreamDelete(FtpClientPortStream_t* stream)
+{
+	vStreamBufferDelete(stream->handle);
+	free(stream);
+}
+
+int ftpClientPortStreamSend(FtpClientPortStream_t* stream, const void* buf, int len)
+{
+	const char* p = buf;
+	int sent = 0;
+	while (sent < len) {
+		if (stream->closed)
+			return -1;
+		sent += xStreamBufferSend(stream->handle, p + sent, len - sent,
+			pdMS_TO_TICKS(STREAM_POLL_MS));
+	}
+	return len;
+}
+
+int ftpClientPortStreamReceive(FtpClientPortStream_t* stream, void* buf, int max)
+{
+	while (1) {
+		/* closed is read first, so bytes sent before the close are not lost */
+		int closed = stream->closed;
+		if (stream->aborted)
+			return -1;
+		int n = xStreamBufferReceive(stream->handle, buf, max,
+			closed ? 0 : pdMS_TO_TICKS(STREAM_POLL_MS));
+		if (n || closed)
+			return n;
+	}
+}
+
+void ftpClientPortStreamClose(FtpClientPortStream_t* stream)
+{
+	stream->closed = 1;
+}
+
+void ftpClientPortStreamAbort(FtpClientPortStream_t* stream)
+{
+	stream->aborted = 1;
+	stream->closed = 1;
+}
+
+#else /* ESP_PLATFORM */
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+struct FtpClientPortThread {
+	pthread_t handle;
+	void (*func)(void* arg);
+	void* arg;
+};
+
+struct FtpClientPortQueue {
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	int length;
+	int head;
+	int count;
+	void* items[];
+};
+
+struct FtpClientPortMutex {
+	pthread_mutex_t handle;
+};
+
+struct FtpClientPortStream {
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	size_t size;
+	size_t head;
+	size_t count;
+	int closed;
+	int aborted;
+	char data[];
+};
+
+int64_t ftpClientPortTimeUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void ftpClientPortSleepUs(int64_t us)
+{
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+	while (nanosleep(&ts, &ts) == -1)
+		;
+}
+
+size_t ftpClientPortFreeHeap(void)
+{
+	long pages = sysconf(_SC_AVPHYS_PAGES);
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pages < 0 || pagesize < 0)
+		return SIZE_MAX;
+	return (size_t)pages * (size_t)pagesize;
+}
+
+static void* threadEntry(void* arg)
+{
+	FtpClientPortThread_t* thread = arg;
+	thread->func(thread->arg);
+	return NULL;
+}
+
+FtpClientPortThread_t* ftpClientPortThreadCreate(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority)
+{
+	return ftpClientPortThreadCreatePinned(func, arg, name, stackSize, priority,
+		FTP_CLIENT_PORT_CORE_ANY);
+}
+
+FtpClientPortThread_t* ftpClientPortThreadCreatePinned(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority, int core)
+{
+	(void)name;
+	(void)priority;
+	if ((core >= ftpClientPortCores()) || (core >= CPU_SETSIZE))
+		return NULL;
+	FtpClientPortThread_t* thread = calloc(1, sizeof(FtpClientPortThread_t));
+	if (thread == NULL)
+		return NULL;
+	thread->func = func;
+	thread->arg = arg;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	if (stackSize >= PTHREAD_STACK_MIN)
+		pthread_attr_setstacksize(&attr, stackSize);
+	if (core >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+	int err = pthread_create(&thread->handle, &attr, threadEntry, thread);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		free(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+void ftpClientPortThreadJoin(FtpClientPortThread_t* thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+int64_t ftpClientPortThreadCpuUs(FtpClientPortThread_t* thread)
+{
+	clockid_t clock;
+	struct timespec ts;
+	if ((pthread_getcpuclockid(thread->handle, &clock) != 0) ||
+			(clock_gettime(clock, &ts) != 0))
+		return -1;
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int ftpClientPortCores(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+}
+
+int ftpClientPortCoreId(void)
+{
+	int core = sched_getcpu();
+	return (core >= 0) ? core : 0;
+}
+
+FtpClientPortQueue_t* ftpClientPortQueueCreate(int length)
+{
+	FtpClientPortQueue_t* queue = calloc(1, sizeof(FtpClientPortQueue_t) + length * sizeof(void*));
+	if (queue == NULL)
+		return NULL;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->notEmpty, NULL);
+	pthread_cond_init(&queue->notFull, NULL);
+	queue->length = length;
+	return queue;
+}
+
+void ftpClientPortQueueDelete(FtpClientPortQueue_t* queue)
+{
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->notEmpty);
+	pthread_cond_destroy(&queue->notFull);
+	free(queue);
+}
+
+void ftpClientPortQueueSend(FtpClientPortQueue_t* queue, void* item)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == queue->length)
+		pthread_cond_wait(&queue->notFull, &queue->lock);
+	queue->items[(queue->head + queue->count) % queue->length] = item;
+	queue->count++;
+	pthread_cond_signal(&queue->notEmpty);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+void* ftpClientPortQueueReceive(FtpClientPortQueue_t* queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0)
+		pthread_cond_wait(&queue->notEmpty, &queue->lock);
+	void* item = queue->items[queue->head];
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_signal(&queue->notFull);
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
+
+void* ftpClientPortQueueReceiveTimeout(FtpClientPortQueue_t* queue, int timeoutMs)
+{
+	if (timeoutMs < 0)
+		return ftpClientPortQueueReceive(queue);
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeoutMs / 1000;
+	ts.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	void* item = NULL;
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0) {
+		if (pthread_cond_timedwait(&queue->notEmpty, &queue->lock, &ts) != 0)
+			break;
+	}
+	if (queue->count > 0) {
+		item = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->length;
+		queue->count--;
+		pthread_cond_signal(&queue->notFull);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
+
+int ftpClientPortQueueTrySend(FtpClientPortQueue_t* queue, void* item)
+{
+	int rv = 0;
+	pthread_mutex_lock(&queue->lock);
+	if (queue->count < queue->length) {
+		queue->items[(queue->head + queue->count) % queue->length] = item;
+		queue->count++;
+		pthread_cond_signal(&queue->notEmpty);
+		rv = 1;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return rv;
+}
+
+FtpClientPortMutex_t* ftpClientPortMutexCreate(void)
+{
+	FtpClientPortMutex_t* mutex = calloc(1, sizeof(FtpClientPortMutex_t));
+	if (mutex == NULL)
+		return NULL;
+	pthread_mutex_init(&mutex->handle, NULL);
+	return mutex;
+}
+
+FtpClientPortMutex_t* ftpClientPortMutexCreateRecursive(void)
+{
+	FtpClientPortMutex_t* mutex = calloc(1, sizeof(FtpClientPortMutex_t));
+	if (mutex == NULL)
+		return NULL;
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex->handle, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return mutex;
+}
+
+void ftpClientPortMutexDelete(FtpClientPortMutex_t* mutex)
+{
+	pthread_mutex_destroy(&mutex->handle);
+	free(mutex);
+}
+
+void ftpClientPortMutexLock(FtpClientPortMutex_t* mutex)
+{
+	pthread_mutex_lock(&mutex->handle);
+}
+
+void ftpClientPortMutexUnlock(FtpClientPortMutex_t* mutex)
+{
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+FtpClientPortStream_t* ftpClientPortStreamCreate(size_t size)
+{
+	FtpClientPortStream_t* stream = calloc(1, sizeof(FtpClientPortStream_t) + size);
+	if (stream == NULL)
+		return NULL;
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->notEmpty, NULL);
+	pthread_cond_init(&stream->notFull, NULL);
+	stream->size = size;
+	return stream;
+}
+
+void ftpClientPortStreamDelete(FtpClientPortStream_t* stream)
+{
+	pthread_mutex_destroy(&stream->lock);
+	pthread_cond_destroy(&stream->notEmpty);
+	pthread_cond_destroy(&stream->notFull);
+	free(stream);
+}
+
+int ftpClientPortStreamSend(FtpClientPortStream_t* stream, const void* buf, int len)
+{
+	const char* p = buf;
+	size_t left = len;
+	pthread_mutex_lock(&stream->lock);
+	while (left) {
+		while ((stream->count == stream->size) && !stream->closed)
+			pthread_cond_wait(&stream->notFull, &stream->lock);
+		if (stream->closed) {
+			pthread_mutex_unlock(&stream->lock);
+			return -1;
+		}
+		size_t tail = (stream->head + stream->count) % stream->size;
+		size_t n = stream->size - stream->count;
+		if (n > stream->size - tail)
+			n = stream->size - tail;
+		if (n > left)
+			n = left;
+		memcpy(stream->data + tail, p, n);
+		stream->count += n;
+		p += n;
+		left -= n;
+		pthread_cond_signal(&stream->notEmpty);
+	}
+	pthread_mutex_unlock(&stream->lock);
+	return len;
+}
+
+int ftpClientPortStreamReceive(FtpClientPortStream_t* stream, void* buf, int max)
+{
+	pthread_mutex_lock(&stream->lock);
+	while ((stream->count == 0) && !stream->closed)
+		pthread_cond_wait(&stream->notEmpty, &stream->lock);
+	if (stream->aborted) {
+		pthread_mutex_unlock(&stream->lock);
+		return -1;
+	}
+	size_t n = stream->count;
+	if (n > (size_t)max)
+		n = max;
+	size_t first = stream->size - stream->head;
+	if (first > n)
+		first = n;
+	memcpy(buf, stream->data + stream->head, first);
+	memcpy((char*)buf + first, stream->data, n - first);
+	stream->head = (stream->head + n) % stream->size;
+	stream->count -= n;
+	pthread_cond_signal(&stream->notFull);
+	pthread_mutex_unlock(&stream->lock);
+	return n;
+}
+
+void ftpClientPortStreamClose(FtpClientPortStream_t* stream)
+{
+	pthread_mutex_lock(&stream->lock);
+	stream->closed = 1;
+	pthread_cond_broadcast(&stream->notEmpty);
+	pthread_cond_broadcast(&stream->notFull);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+void ftpClientPortStreamAbort(FtpClientPortStream_t* stream)
+{
+	pthread_mutex_lock(&stream->lock);
+	stream->aborted = 1;
+	stream->closed = 1;
+	pthread_cond_broadcast(&stream->notEmpty);
+	pthread_cond_broadcast(&stream->notFull);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+#endif /* ESP_PLATFORM */
+
+/* state 0: not run, 1: running, 2: done */
+void ftpClientPortOnce(FtpClientPortOnce_t* once, void (*init)(void))
+{
+	if (__atomic_load_n(once, __ATOMIC_ACQUIRE) == 2)
+		return;
+	int expected = 0;
+	if (__atomic_compare_exchange_n(once, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		init();
+		__atomic_store_n(once, 2, __ATOMIC_RELEASE);
+		return;
+	}
+	while (__atomic_load_n(once, __ATOMIC_ACQUIRE) != 2)
+		ftpClientPortSleepUs(1000);
+}
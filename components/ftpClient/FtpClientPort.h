@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client platform layer
+ *
+ * The few operating system services the client needs beyond sockets.
+ * They map to ESP-IDF when ESP_PLATFORM is defined and to POSIX otherwise,
+ * so the component also builds on the host (see host/).
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTPORT_H_
+#define FTPCLIENTPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* monotonic time in microseconds */
+int64_t ftpClientPortTimeUs(void);
+
+/* sleep at least us microseconds, on ESP-IDF rounded up to whole ticks */
+void ftpClientPortSleepUs(int64_t us);
+
+/* free heap in bytes usable for data buffers */
+size_t ftpClientPortFreeHeap(void);
+
+/*
+ * Worker threads - a FreeRTOS task on ESP-IDF, a pthread on the host.
+ * stackSize is in bytes, priority 0 means the priority of the caller.
+ */
+typedef struct FtpClientPortThread FtpClientPortThread_t;
+
+FtpClientPortThread_t* ftpClientPortThreadCreate(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority);
+void ftpClientPortThreadJoin(FtpClientPortThread_t* thread);
+
+#define FTP_CLIENT_PORT_CORE_ANY 			-1		/* the scheduler picks the core */
+
+/*
+ * As ftpClientPortThreadCreate(), the thread runs only on core - a task
+ * of xTaskCreatePinnedToCore() on ESP-IDF. NULL if the core does not exist.
+ */
+FtpClientPortThread_t* ftpClientPortThreadCreatePinned(void (*func)(void* arg), void* arg,
+	const char* name, int stackSize, int priority, int core);
+/*
+ * CPU time the thread has used in microseconds, -1 if it is not counted.
+ * ESP-IDF counts it with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS,
+ * CONFIG_FREERTOS_USE_TRACE_FACILITY, the esp_timer as run time clock and
+ * CONFIG_FREERTOS_RUN_TIME_COUNTER_TYPE_U64; the 32-bit counter would wrap
+ * after 71 minutes.
+ */
+int64_t ftpClientPortThreadCpuUs(FtpClientPortThread_t* thread);
+/* number of cores and the core the caller runs on */
+int ftpClientPortCores(void);
+int ftpClientPortCoreId(void);
+
+/*
+ * Blocking queue of pointers - a FreeRTOS queue on ESP-IDF.
+ */
+typedef struct FtpClientPortQueue FtpClientPortQueue_t;
+
+FtpClientPortQueue_t* ftpClientPortQueueCreate(int length);
+void ftpClientPortQueueDelete(FtpClientPortQueue_t* queue);
+void ftpClientPortQueueSend(FtpClientPortQueue_t* queue, void* item);
+void* ftpClientPortQueueReceive(FtpClientPortQueue_t* queue);
+/* NULL when nothing arrived within timeoutMs, -1 waits forever */
+void* ftpClientPortQueueReceiveTimeout(FtpClientPortQueue_t* queue, int timeoutMs);
+/* return 1 if queued, 0 if the queue is full */
+int ftpClientPortQueueTrySend(FtpClientPortQueue_t* queue, void* item);
+
+/*
+ * Mutex - a FreeRTOS mutex on ESP-IDF. A recursive mutex may be locked
+ * again by the thread that holds it and must be unlocked as often.
+ */
+typedef struct FtpClientPortMutex FtpClientPortMutex_t;
+
+FtpClientPortMutex_t* ftpClientPortMutexCreate(void);
+FtpClientPortMutex_t* ftpClientPortMutexCreateRecursive(void);
+void ftpClientPortMutexDelete(FtpClientPortMutex_t* mutex);
+void ftpClientPortMutexLock(FtpClientPortMutex_t* mutex);
+void ftpClientPortMutexUnlock(FtpClientPortMutex_t* mutex);
+
+/*
+ * One-time initialization. The first caller runs init, the others wait
+ * until it has returned. Define the control with FTP_CLIENT_PORT_ONCE_INIT.
+ */
+typedef int FtpClientPortOnce_t;
+#define FTP_CLIENT_PORT_ONCE_INIT 			0
+
+void ftpClientPortOnce(FtpClientPortOnce_t* once, void (*init)(void));
+
+/*
+ * Byte stream between two threads - a FreeRTOS stream buffer on ESP-IDF.
+ * Either side may close it: the receiver then gets the bytes still
+ * buffered and 0 after them, the sender gets -1. A side that fails aborts
+ * it instead: both sides then get -1 and buffered bytes are dropped, so a
+ * truncated stream is not taken for a complete one.
+ */
+typedef struct FtpClientPortStream FtpClientPortStream_t;
+
+FtpClientPortStream_t* ftpClientPortStreamCreate(size_t size);
+void ftpClientPortStreamDelete(FtpClientPortStream_t* stream);
+/* block until all len bytes are buffered, return len or -1 if closed */
+int ftpClientPortStreamSend(FtpClientPortStream_t* stream, const void* buf, int len);
+/* block until bytes are buffered, return up to max of them, 0 if closed and empty, -1 if aborted */
+int ftpClientPortStreamReceive(FtpClientPortStream_t* stream, void* buf, int max);
+void ftpClientPortStreamClose(FtpClientPortStream_t* stream);
+void ftpClientPortStreamAbort(FtpClientPortStream_t* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTPORT_H_ */
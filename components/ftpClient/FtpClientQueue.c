@@ -0,0 +1,702 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client transfer queue
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/unistd.h>
+#include <fcntl.h>
+#include "FtpClientQueue.h"
+
+#include "esp_log.h"
+
+struct FtpClientJob {
+	FtpClientJob_t* next;
+	FtpClientJobQueue_t* queue;
+	int op;
+	int prio;
+	char mode;
+	char* local;
+	char* remote;
+	int retries;				/* attempts left after a failure */
+	int attempts;				/* attempts started */
+	int failures;
+	int64_t notBefore;			/* ftpClientPortTimeUs() of the next attempt */
+	FtpClientQueueCallback_t cb;
+	void* arg;
+	volatile int status;
+	volatile int cancelled;
+	volatile int preempted;
+	int released;
+	uint64_t bytesDone;			/* bytes of the finished attempts */
+	volatile uint32_t xfered;	/* bytes of the running attempt */
+	char response[FTP_CLIENT_QUEUE_RESPONSE_SIZE];
+};
+
+typedef struct {
+	FtpClientJobQueue_t* queue;
+	FtpClientPortThread_t* thread;
+	FtpClientJob_t* job;		/* running job */
+	FtpClientQueueWorkerOptions_t opt;
+	int64_t started;			/* ftpClientPortTimeUs() */
+	int lastCore;
+	uint32_t jobs;
+	uint64_t bytes;
+	uint64_t busyUs;
+} QueueWorker_t;
+
+struct FtpClientJobQueue {
+	FtpClientQueueOptions_t opt;
+	char* host;
+	char* user;
+	char* pass;
+	FtpClientPortMutex_t* lock;
+	FtpClientPortQueue_t* wake;	/* a token per submitted job, idle workers wait on it */
+	FtpClientJob_t* head[FTP_CLIENT_QUEUE_CLASSES];
+	FtpClientJob_t* tail[FTP_CLIENT_QUEUE_CLASSES];
+	QueueWorker_t worker[FTP_CLIENT_QUEUE_WORKERS_MAX];
+	int workers;
+	int stop;
+	FtpClientQueueStats_t stats;
+};
+
+static FtpClientPortOnce_t isInitilized = FTP_CLIENT_PORT_ONCE_INIT;
+static FtpClientQueue ftpClientQueue_;
+
+
+
+static char* copyString(const char* s)
+{
+	size_t l = strlen(s) + 1;
+	char* c = malloc(l);
+	if (c != NULL)
+		memcpy(c, s, l);
+	return c;
+}
+
+
+
+static void jobFree(FtpClientJob_t* job)
+{
+	free(job->local);
+	free(job->remote);
+	free(job);
+}
+
+
+
+/*
+ * jobLink - queue a job at the end, or the front, of its class
+ */
+static void jobLink(FtpClientJobQueue_t* q, FtpClientJob_t* job, int front)
+{
+	int c = job->prio;
+	if (front) {
+		job->next = q->head[c];
+		q->head[c] = job;
+		if (q->tail[c] == NULL)
+			q->tail[c] = job;
+	}
+	else {
+		job->next = NULL;
+		if (q->tail[c])
+			q->tail[c]->next = job;
+		else
+			q->head[c] = job;
+		q->tail[c] = job;
+	}
+	q->stats.queued++;
+}
+
+
+
+/*
+ * jobUnlink - take a job out of its class
+ *
+ * return 1 if it was queued, 0 otherwise
+ */
+static int jobUnlink(FtpClientJobQueue_t* q, FtpClientJob_t* job)
+{
+	int c = job->prio;
+	FtpClientJob_t* prev = NULL;
+	FtpClientJob_t** pp = &q->head[c];
+	while (*pp && (*pp != job)) {
+		prev = *pp;
+		pp = &(*pp)->next;
+	}
+	if (*pp == NULL)
+		return 0;
+	*pp = job->next;
+	if (q->tail[c] == job)
+		q->tail[c] = prev;
+	job->next = NULL;
+	q->stats.queued--;
+	return 1;
+}
+
+
+
+/*
+ * jobNext - take the first job of the highest class that may start now
+ *
+ * Jobs waiting for a retry are skipped. When nothing may start, *waitMs
+ * is the time until the next retry, -1 if there is none.
+ */
+static FtpClientJob_t* jobNext(FtpClientJobQueue_t* q, int* waitMs)
+{
+	int64_t now = ftpClientPortTimeUs();
+	int64_t wait = -1;
+	for (int c = 0; c < FTP_CLIENT_QUEUE_CLASSES; c++) {
+		for (FtpClientJob_t* job = q->head[c]; job; job = job->next) {
+			if (job->notBefore <= now) {
+				jobUnlink(q, job);
+				return job;
+			}
+			if ((wait < 0) || (job->notBefore - now < wait))
+				wait = job->notBefore - now;
+		}
+	}
+	*waitMs = (wait < 0) ? -1 : (int)((wait + 999) / 1000);
+	return NULL;
+}
+
+
+
+/*
+ * jobPreempt - make room for the urgent jobs that may start now
+ *
+ * When there are more of them than workers about to be free, the running
+ * job of the lowest class is told to stop. Called with the lock held.
+ */
+static void jobPreempt(FtpClientJobQueue_t* q)
+{
+	int64_t now = ftpClientPortTimeUs();
+	int urgent = 0;
+	for (FtpClientJob_t* job = q->head[FTP_CLIENT_QUEUE_URGENT]; job; job = job->next)
+		if (job->notBefore <= now)
+			urgent++;
+	int idle = 0;
+	FtpClientJob_t* victim = NULL;
+	for (int i = 0; i < q->workers; i++) {
+		FtpClientJob_t* job = q->worker[i].job;
+		if ((job == NULL) || job->cancelled || job->preempted)
+			idle++;
+		else if ((job->prio > FTP_CLIENT_QUEUE_URGENT) &&
+				((victim == NULL) || (job->prio > victim->prio)))
+			victim = job;
+	}
+	if ((urgent > idle) && (victim != NULL)) {
+		ESP_LOGD(__FUNCTION__, "pre-empt %s", victim->remote);
+		victim->preempted = 1;
+	}
+}
+
+
+
+/*
+ * jobFinish - report the end of a job
+ *
+ * Called with the lock held, which is released around the callback.
+ */
+static void jobFinish(FtpClientJobQueue_t* q, FtpClientJob_t* job, int status)
+{
+	if (status == FTP_CLIENT_QUEUE_DONE)
+		q->stats.done++;
+	else if (status == FTP_CLIENT_QUEUE_FAILED)
+		q->stats.failed++;
+	else {
+		q->stats.cancelled++;
+		snprintf(job->response, sizeof(job->response), "Cancelled");
+	}
+	/* a GET that did not complete leaves no partial file behind */
+	if ((status != FTP_CLIENT_QUEUE_DONE) && (job->op == FTP_CLIENT_QUEUE_GET) &&
+			(job->attempts > 0)) {
+		char journal[FTP_CLIENT_TEMP_BUFFER_SIZE];
+		unlink(job->local);
+		int l = snprintf(journal, sizeof(journal), "%s%s", job->local,
+			FTP_CLIENT_JOURNAL_SUFFIX);
+		if ((l >= 0) && ((size_t)l < sizeof(journal)))
+			unlink(journal);
+	}
+	ESP_LOGD(__FUNCTION__, "%s status %d %s", job->remote, status, job->response);
+	int release = job->released || ((job->cb != NULL) && (q->opt.doneQueue == NULL));
+	int post = !job->released && (q->opt.doneQueue != NULL);
+	job->status = status;
+	ftpClientPortMutexUnlock(q->lock);
+	if (job->cb)
+		job->cb(job, status, job->response, job->arg);
+	if (post)
+		ftpClientPortQueueSend(q->opt.doneQueue, job);
+	else if (release)
+		jobFree(job);
+	ftpClientPortMutexLock(q->lock);
+}
+
+
+
+/*
+ * jobProgress - transfer callback of a running job
+ *
+ * return 0 to stop the transfer of a cancelled or pre-empted job
+ */
+static int jobProgress(NetBuf_t* nData, uint32_t xfered, void* arg)
+{
+	FtpClientJob_t* job = arg;
+	(void) nData;
+	job->xfered = xfered;
+	return !job->cancelled && !job->preempted;
+}
+
+
+
+/*
+ * jobAttempt - run one attempt of a job over a pooled session
+ *
+ * Image mode GETs always resume, the first attempt from an emptied local
+ * file. Image mode PUTs resume from their second attempt, the first one
+ * replaces the remote file.
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int jobAttempt(FtpClientJobQueue_t* q, FtpClientJob_t* job)
+{
+	FtpClient* ftp = getFtpClient();
+	int resume = (job->mode == FTP_CLIENT_IMAGE) &&
+		((job->op == FTP_CLIENT_QUEUE_GET) || (job->attempts > 1));
+	if ((job->op == FTP_CLIENT_QUEUE_GET) && resume && (job->attempts == 1)) {
+		int fd = open(job->local, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			snprintf(job->response, sizeof(job->response), "%s", strerror(errno));
+			return 0;
+		}
+		close(fd);
+	}
+
+	NetBuf_t* nControl = NULL;
+	if (!ftp->ftpClientPoolAcquire(q->host, q->opt.port, q->user, q->pass, &nControl)) {
+		snprintf(job->response, sizeof(job->response), "Connect or login to %s failed",
+			q->host);
+		return 0;
+	}
+	FtpClientStats_t stats;
+	ftp->ftpClientGetStats(&stats, nControl);
+	uint64_t before = stats.xferBytes;
+	FtpClientCallbackOptions_t cb = { jobProgress, job, FTP_CLIENT_QUEUE_POLL_BYTES,
+		FTP_CLIENT_QUEUE_POLL_MS };
+	ftp->ftpClientSetCallback(&cb, nControl);
+	ftp->ftpClientSetOptions(FTP_CLIENT_RESUME, resume, nControl);
+	int rv;
+	if (job->op == FTP_CLIENT_QUEUE_GET)
+		rv = ftp->ftpClientGet(job->local, job->remote, job->mode, nControl);
+	else
+		rv = ftp->ftpClientPut(job->local, job->remote, job->mode, nControl);
+	const char* response = ftp->ftpClientGetLastResponse(nControl);
+	snprintf(job->response, sizeof(job->response), "%.*s",
+		(int)strcspn(response, "\r\n"), response);
+	ftp->ftpClientGetStats(&stats, nControl);
+	job->xfered = stats.xferBytes - before;
+	ftp->ftpClientSetOptions(FTP_CLIENT_RESUME, 0, nControl);
+	ftp->ftpClientPoolRelease(nControl);
+	return rv;
+}
+
+
+
+/*
+ * jobBackoff - delay before the next attempt of a job that failed
+ */
+static int64_t jobBackoff(FtpClientJobQueue_t* q, FtpClientJob_t* job)
+{
+	int64_t ms = q->opt.backoffMs;
+	for (int i = 1; (i < job->failures) && (ms < q->opt.backoffMaxMs); i++)
+		ms *= 2;
+	if (ms > q->opt.backoffMaxMs)
+		ms = q->opt.backoffMaxMs;
+	return ms * 1000;
+}
+
+
+
+/*
+ * queueWorker - run jobs until the queue is destroyed
+ */
+static void queueWorker(void* arg)
+{
+	QueueWorker_t* w = arg;
+	FtpClientJobQueue_t* q = w->queue;
+	ftpClientPortMutexLock(q->lock);
+	while (!q->stop) {
+		int waitMs;
+		FtpClientJob_t* job = jobNext(q, &waitMs);
+		if (job == NULL) {
+			ftpClientPortMutexUnlock(q->lock);
+			ftpClientPortQueueReceiveTimeout(q->wake, waitMs);
+			ftpClientPortMutexLock(q->lock);
+			continue;
+		}
+		w->job = job;
+		job->attempts++;
+		q->stats.running++;
+		ftpClientPortMutexUnlock(q->lock);
+
+		int64_t t0 = ftpClientPortTimeUs();
+		int rv = jobAttempt(q, job);
+		int64_t busy = ftpClientPortTimeUs() - t0;
+
+		ftpClientPortMutexLock(q->lock);
+		w->job = NULL;
+		w->jobs++;
+		w->bytes += job->xfered;
+		w->busyUs += busy;
+		w->lastCore = ftpClientPortCoreId();
+		q->stats.running--;
+		job->bytesDone += job->xfered;
+		job->xfered = 0;
+		if (rv)
+			jobFinish(q, job, FTP_CLIENT_QUEUE_DONE);
+		else if (job->cancelled)
+			jobFinish(q, job, FTP_CLIENT_QUEUE_CANCELLED);
+		else if (job->preempted) {
+			/* not a failure, it continues before the rest of its class */
+			job->preempted = 0;
+			q->stats.preemptions++;
+			jobLink(q, job, 1);
+		}
+		else if (job->retries > 0) {
+			job->retries--;
+			job->failures++;
+			q->stats.retries++;
+			job->notBefore = ftpClientPortTimeUs() + jobBackoff(q, job);
+			ESP_LOGD(__FUNCTION__, "%s retry %d: %s", job->remote, job->failures,
+				job->response);
+			jobLink(q, job, 0);
+			/* idle workers recompute how long to sleep */
+			ftpClientPortQueueTrySend(q->wake, q);
+		}
+		else
+			jobFinish(q, job, FTP_CLIENT_QUEUE_FAILED);
+	}
+	ftpClientPortMutexUnlock(q->lock);
+}
+
+
+
+/*
+ * destroyFtpClientQueue - cancel all jobs and stop the workers
+ */
+static void destroyFtpClientQueue(FtpClientJobQueue_t* q)
+{
+	if (q == NULL)
+		return;
+	ftpClientPortMutexLock(q->lock);
+	q->stop = 1;
+	for (int c = 0; c < FTP_CLIENT_QUEUE_CLASSES; c++) {
+		while (q->head[c] != NULL) {
+			FtpClientJob_t* job = q->head[c];
+			jobUnlink(q, job);
+			job->cancelled = 1;
+			jobFinish(q, job, FTP_CLIENT_QUEUE_CANCELLED);
+		}
+	}
+	for (int i = 0; i < q->workers; i++)
+		if (q->worker[i].job)
+			q->worker[i].job->cancelled = 1;
+	ftpClientPortMutexUnlock(q->lock);
+	/* tokens left by submits may fill the queue, an idle worker then takes one of them */
+	for (int i = 0; i < q->workers; i++)
+		ftpClientPortQueueTrySend(q->wake, q);
+	for (int i = 0; i < q->workers; i++)
+		ftpClientPortThreadJoin(q->worker[i].thread);
+	ftpClientPortQueueDelete(q->wake);
+	ftpClientPortMutexDelete(q->lock);
+	free(q->host);
+	free(q->user);
+	free(q->pass);
+	free(q);
+}
+
+
+
+/*
+ * createFtpClientQueue - start the workers of a transfer queue
+ *
+ * return the queue, NULL on error
+ */
+static FtpClientJobQueue_t* createFtpClientQueue(const FtpClientQueueOptions_t* opt)
+{
+	if ((opt == NULL) || (opt->host == NULL) || (opt->user == NULL) || (opt->pass == NULL))
+		return NULL;
+	FtpClientJobQueue_t* q = calloc(1, sizeof(FtpClientJobQueue_t));
+	if (q == NULL)
+		return NULL;
+	q->opt = *opt;
+	if (q->opt.backoffMs <= 0)
+		q->opt.backoffMs = FTP_CLIENT_QUEUE_BACKOFF_MS;
+	if (q->opt.backoffMaxMs <= 0)
+		q->opt.backoffMaxMs = FTP_CLIENT_QUEUE_BACKOFF_MAX_MS;
+	if (q->opt.backoffMaxMs < q->opt.backoffMs)
+		q->opt.backoffMaxMs = q->opt.backoffMs;
+	if (q->opt.stackSize <= 0)
+		q->opt.stackSize = FTP_CLIENT_QUEUE_STACK_SIZE;
+	if (q->opt.retries < 0)
+		q->opt.retries = 0;
+	int workers = opt->workers;
+	if (workers < 1)
+		workers = 1;
+	if (workers > FTP_CLIENT_QUEUE_WORKERS_MAX)
+		workers = FTP_CLIENT_QUEUE_WORKERS_MAX;
+	for (int i = 0; i < workers; i++) {
+		QueueWorker_t* w = &q->worker[i];
+		w->opt.core = FTP_CLIENT_PORT_CORE_ANY;
+		if (opt->worker != NULL)
+			w->opt = opt->worker[i];
+		if (w->opt.core >= ftpClientPortCores()) {
+			ESP_LOGE(__FUNCTION__, "no core %d for worker %d", w->opt.core, i);
+			free(q);
+			return NULL;
+		}
+		if (w->opt.core < 0)
+			w->opt.core = FTP_CLIENT_PORT_CORE_ANY;
+		if (w->opt.stackSize <= 0)
+			w->opt.stackSize = q->opt.stackSize;
+		if (w->opt.priority <= 0)
+			w->opt.priority = q->opt.priority;
+	}
+	/* the array of the caller is not kept */
+	q->opt.worker = NULL;
+	q->host = copyString(opt->host);
+	q->user = copyString(opt->user);
+	q->pass = copyString(opt->pass);
+	q->lock = ftpClientPortMutexCreate();
+	q->wake = ftpClientPortQueueCreate(workers);
+	if (!q->host || !q->user || !q->pass || !q->lock || !q->wake) {
+		#if FTP_CLIENT_DEBUG
+		perror("FTP Client queue create");
+		#endif
+		if (q->lock)
+			ftpClientPortMutexDelete(q->lock);
+		if (q->wake)
+			ftpClientPortQueueDelete(q->wake);
+		free(q->host);
+		free(q->user);
+		free(q->pass);
+		free(q);
+		return NULL;
+	}
+	getFtpClient();
+	for (int i = 0; i < workers; i++) {
+		QueueWorker_t* w = &q->worker[i];
+		w->queue = q;
+		w->started = ftpClientPortTimeUs();
+		w->lastCore = w->opt.core;
+		w->thread = ftpClientPortThreadCreatePinned(queueWorker, w, "ftpQueue",
+			w->opt.stackSize, w->opt.priority, w->opt.core);
+		if (w->thread == NULL)
+			break;
+		q->workers++;
+	}
+	if (q->workers == 0) {
+		destroyFtpClientQueue(q);
+		return NULL;
+	}
+	return q;
+}
+
+
+
+/*
+ * getStatsFtpClientQueue - counters of a transfer queue
+ *
+ * return 1 if successful, 0 otherwise
+ */
+static int getStatsFtpClientQueue(FtpClientJobQueue_t* q, FtpClientQueueStats_t* stats)
+{
+	if ((q == NULL) || (stats == NULL))
+		return 0;
+	ftpClientPortMutexLock(q->lock);
+	*stats = q->stats;
+	ftpClientPortMutexUnlock(q->lock);
+	return 1;
+}
+
+
+
+/*
+ * getWorkerStatsFtpClientQueue - throughput and CPU time of each worker
+ *
+ * return the number of entries filled, at most max
+ */
+static int getWorkerStatsFtpClientQueue(FtpClientJobQueue_t* q,
+	FtpClientQueueWorkerStats_t* stats, int max)
+{
+	if ((q == NULL) || (stats == NULL))
+		return 0;
+	int64_t now = ftpClientPortTimeUs();
+	int n = 0;
+	ftpClientPortMutexLock(q->lock);
+	for (; (n < q->workers) && (n < max); n++) {
+		QueueWorker_t* w = &q->worker[n];
+		FtpClientQueueWorkerStats_t* st = &stats[n];
+		st->core = w->opt.core;
+		st->lastCore = w->lastCore;
+		st->jobs = w->jobs;
+		st->bytes = w->bytes;
+		st->busyUs = w->busyUs;
+		st->upUs = now - w->started;
+		st->cpuUs = ftpClientPortThreadCpuUs(w->thread);
+		st->bytesPerSec = w->busyUs ? (uint32_t)(w->bytes * 1000000 / w->busyUs) : 0;
+		st->cpuPct = ((st->cpuUs > 0) && st->upUs) ? (uint32_t)(st->cpuUs * 100 / st->upUs) : 0;
+	}
+	ftpClientPortMutexUnlock(q->lock);
+	return n;
+}
+
+
+
+/*
+ * submitFtpClientQueue - queue a transfer of a local file
+ *
+ * retries below 0 takes the retries of the queue options.
+ *
+ * return the job handle, NULL on error
+ */
+static FtpClientJob_t* submitFtpClientQueue(FtpClientJobQueue_t* q, int op, int prio,
+	const char* localfile, const char* path, char mode, int retries,
+	FtpClientQueueCallback_t cb, void* arg)
+{
+	if ((q == NULL) || (localfile == NULL) || (path == NULL) ||
+			((op != FTP_CLIENT_QUEUE_GET) && (op != FTP_CLIENT_QUEUE_PUT)) ||
+			(prio < 0) || (prio >= FTP_CLIENT_QUEUE_CLASSES))
+		return NULL;
+	FtpClientJob_t* job = calloc(1, sizeof(FtpClientJob_t));
+	if (job == NULL)
+		return NULL;
+	job->local = copyString(localfile);
+	job->remote = copyString(path);
+	if ((job->local == NULL) || (job->remote == NULL)) {
+		jobFree(job);
+		return NULL;
+	}
+	job->queue = q;
+	job->op = op;
+	job->prio = prio;
+	job->mode = mode;
+	job->retries = (retries < 0) ? q->opt.retries : retries;
+	job->cb = cb;
+	job->arg = arg;
+	job->status = FTP_CLIENT_QUEUE_PENDING;
+	ftpClientPortMutexLock(q->lock);
+	jobLink(q, job, 0);
+	if (prio == FTP_CLIENT_QUEUE_URGENT)
+		jobPreempt(q);
+	ftpClientPortMutexUnlock(q->lock);
+	ftpClientPortQueueTrySend(q->wake, q);
+	return job;
+}
+
+
+
+static int statusFtpClientQueue(FtpClientJob_t* job)
+{
+	return job->status;
+}
+
+
+
+/*
+ * responseFtpClientQueue - last reply of the server for a job
+ *
+ * While the job is pending this is the reply of its last attempt.
+ */
+static const char* responseFtpClientQueue(FtpClientJob_t* job)
+{
+	return job->response;
+}
+
+
+
+static uint64_t bytesFtpClientQueue(FtpClientJob_t* job)
+{
+	return job->bytesDone + job->xfered;
+}
+
+
+
+static int attemptsFtpClientQueue(FtpClientJob_t* job)
+{
+	return job->attempts;
+}
+
+
+
+/*
+ * cancelFtpClientQueue - stop a job
+ *
+ * A queued job is cancelled at once. A running transfer stops within
+ * FTP_CLIENT_QUEUE_POLL_MS.
+ */
+static void cancelFtpClientQueue(FtpClientJob_t* job)
+{
+	FtpClientJobQueue_t* q = job->queue;
+	ftpClientPortMutexLock(q->lock);
+	if (job->status == FTP_CLIENT_QUEUE_PENDING) {
+		job->cancelled = 1;
+		if (jobUnlink(q, job))
+			jobFinish(q, job, FTP_CLIENT_QUEUE_CANCELLED);
+	}
+	ftpClientPortMutexUnlock(q->lock);
+}
+
+
+
+/*
+ * releaseFtpClientQueue - free the handle of a job without callback
+ *
+ * A pending job keeps running and is freed when it ends.
+ */
+static void releaseFtpClientQueue(FtpClientJob_t* job)
+{
+	FtpClientJobQueue_t* q = job->queue;
+	ftpClientPortMutexLock(q->lock);
+	int pending = (job->status == FTP_CLIENT_QUEUE_PENDING);
+	if (pending)
+		job->released = 1;
+	ftpClientPortMutexUnlock(q->lock);
+	if (!pending)
+		jobFree(job);
+}
+
+
+
+static void initFtpClientQueue(void)
+{
+	ftpClientQueue_.ftpClientQueueCreate = createFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueDestroy = destroyFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueGetStats = getStatsFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueGetWorkerStats = getWorkerStatsFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueSubmit = submitFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueStatus = statusFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueResponse = responseFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueBytes = bytesFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueAttempts = attemptsFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueCancel = cancelFtpClientQueue;
+	ftpClientQueue_.ftpClientQueueRelease = releaseFtpClientQueue;
+}
+
+
+
+FtpClientQueue* getFtpClientQueue(void)
+{
+	ftpClientPortOnce(&isInitilized, initFtpClientQueue);
+	return &ftpClientQueue_;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client transfer queue
+ *
+ * Jobs that get or put a local file are queued by priority class and run
+ * by a fixed number of worker tasks, each with a session of the connection
+ * pool. Within a class jobs run in the order they were submitted. A failed
+ * job is tried again after a delay that doubles with every attempt, image
+ * mode transfers continue where the last attempt stopped. An urgent job
+ * that finds every worker busy pre-empts the running job of the lowest
+ * class, which goes back to the front of its class and resumes later.
+ *
+ * Completion is reported through a callback, a queue that receives the job
+ * handles, or a handle polled with ftpClientQueueStatus().
+ *
+ * Each worker can be pinned to a core with a stack size and priority of its
+ * own, e.g. to keep file system work off the core of the Wi-Fi and lwIP
+ * tasks. ftpClientQueueGetWorkerStats() reports the throughput and CPU
+ * time of every worker.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTQUEUE_H_
+#define FTPCLIENTQUEUE_H_
+
+#include "FtpClient.h"
+#include "FtpClientPort.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FTP_CLIENT_QUEUE_WORKERS_MAX 		8
+#define FTP_CLIENT_QUEUE_STACK_SIZE 		8192
+#define FTP_CLIENT_QUEUE_RESPONSE_SIZE 		256
+#define FTP_CLIENT_QUEUE_POLL_MS 			100		/* a running job sees cancel and pre-emption within ms */
+#define FTP_CLIENT_QUEUE_POLL_BYTES 		65536	/* or after this many bytes */
+#define FTP_CLIENT_QUEUE_BACKOFF_MS 		1000	/* default delay of the first retry */
+#define FTP_CLIENT_QUEUE_BACKOFF_MAX_MS 	60000	/* default limit of the retry delay */
+
+/* priority classes, a lower class runs first */
+#define FTP_CLIENT_QUEUE_URGENT 			0		/* pre-empts BULK and NORMAL jobs */
+#define FTP_CLIENT_QUEUE_NORMAL 			1
+#define FTP_CLIENT_QUEUE_BULK 				2
+#define FTP_CLIENT_QUEUE_CLASSES 			3
+
+/* job operations */
+#define FTP_CLIENT_QUEUE_GET 				1
+#define FTP_CLIENT_QUEUE_PUT 				2
+
+/* ftpClientQueueStatus() */
+#define FTP_CLIENT_QUEUE_PENDING 			0		/* queued, waiting for a retry or running */
+#define FTP_CLIENT_QUEUE_DONE 				1
+#define FTP_CLIENT_QUEUE_FAILED 			2
+#define FTP_CLIENT_QUEUE_CANCELLED 			3
+
+typedef struct FtpClientJobQueue FtpClientJobQueue_t;
+typedef struct FtpClientJob FtpClientJob_t;
+
+/*
+ * Completion callback, called from a worker task. status is one of
+ * FTP_CLIENT_QUEUE_DONE, _FAILED or _CANCELLED, response is the last reply
+ * of the server or the reason of the failure. Without a doneQueue the job
+ * handle is freed when the callback returns.
+ */
+typedef void (*FtpClientQueueCallback_t)(FtpClientJob_t* job, int status,
+	const char* response, void* arg);
+
+/* per worker settings, see FtpClientQueueOptions_t.worker */
+typedef struct
+{
+	int core;					/* FTP_CLIENT_PORT_CORE_ANY or the core to pin the task to */
+	int stackSize;				/* 0 for the stackSize of the queue */
+	int priority;				/* 0 for the priority of the queue */
+} FtpClientQueueWorkerOptions_t;
+
+typedef struct
+{
+	const char* host;
+	uint16_t port;
+	const char* user;
+	const char* pass;
+	int workers;				/* concurrent connections (1-8), 0 for 1 */
+	int retries;				/* attempts after the first failure of a job */
+	int backoffMs;				/* delay of the first retry, 0 for FTP_CLIENT_QUEUE_BACKOFF_MS */
+	int backoffMaxMs;			/* limit of the doubled delay, 0 for FTP_CLIENT_QUEUE_BACKOFF_MAX_MS */
+	int stackSize;				/* of the worker tasks, 0 for FTP_CLIENT_QUEUE_STACK_SIZE */
+	int priority;				/* of the worker tasks, 0 for the priority of the caller */
+	FtpClientPortQueue_t* doneQueue;	/* optional, receives each finished job handle */
+	const FtpClientQueueWorkerOptions_t* worker;	/* optional, an entry for each worker */
+} FtpClientQueueOptions_t;
+
+typedef struct
+{
+	uint32_t queued;			/* jobs waiting, including those waiting for a retry */
+	uint32_t running;			/* jobs a worker is transferring */
+	uint32_t done;
+	uint32_t failed;
+	uint32_t cancelled;
+	uint32_t retries;			/* attempts after a failure */
+	uint32_t preemptions;		/* running jobs put back for an urgent one */
+} FtpClientQueueStats_t;
+
+typedef struct
+{
+	int core;					/* pinned to, FTP_CLIENT_PORT_CORE_ANY if not */
+	int lastCore;				/* the last attempt finished on */
+	uint32_t jobs;				/* attempts run */
+	uint64_t bytes;				/* transferred by the attempts */
+	uint64_t busyUs;			/* time spent in attempts */
+	uint64_t upUs;				/* time since the worker started */
+	int64_t cpuUs;				/* CPU time of the task, -1 if not counted */
+	uint32_t bytesPerSec;		/* bytes over busyUs */
+	uint32_t cpuPct;			/* cpuUs over upUs, 0 if not counted */
+} FtpClientQueueWorkerStats_t;
+
+typedef struct
+{
+	/*Queue*/
+	FtpClientJobQueue_t* (*ftpClientQueueCreate)(const FtpClientQueueOptions_t* opt);
+	void (*ftpClientQueueDestroy)(FtpClientJobQueue_t* queue);
+	int (*ftpClientQueueGetStats)(FtpClientJobQueue_t* queue, FtpClientQueueStats_t* stats);
+	int (*ftpClientQueueGetWorkerStats)(FtpClientJobQueue_t* queue,
+		FtpClientQueueWorkerStats_t* stats, int max);
+	/*Jobs*/
+	FtpClientJob_t* (*ftpClientQueueSubmit)(FtpClientJobQueue_t* queue, int op, int prio,
+		const char* localfile, const char* path, char mode, int retries,
+		FtpClientQueueCallback_t cb, void* arg);
+	int (*ftpClientQueueStatus)(FtpClientJob_t* job);
+	const char* (*ftpClientQueueResponse)(FtpClientJob_t* job);
+	uint64_t (*ftpClientQueueBytes)(FtpClientJob_t* job);
+	int (*ftpClientQueueAttempts)(FtpClientJob_t* job);
+	void (*ftpClientQueueCancel)(FtpClientJob_t* job);
+	void (*ftpClientQueueRelease)(FtpClientJob_t* job);
+} FtpClientQueue;
+
+FtpClientQueue* getFtpClientQueue(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTQUEUE_H_ */
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client socket options
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "FtpClientSock.h"
+
+#include "netdb.h"
+
+#include "esp_log.h"
+
+void ftpClientSockProfile(int s, int profile, int bufSize, int timeoutMs)
+{
+	int on = ((profile & FTP_CLIENT_SOCK_LOWLATENCY) != 0);
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if (profile & FTP_CLIENT_SOCK_BULK) {
+		if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize)) < 0)
+			ESP_LOGD(__FUNCTION__, "SO_RCVBUF not set");
+		if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize)) < 0)
+			ESP_LOGD(__FUNCTION__, "SO_SNDBUF not set");
+	}
+	on = ((profile & FTP_CLIENT_SOCK_KEEPALIVE) != 0);
+	setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+	#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+	if (on) {
+		int v = FTP_CLIENT_SOCK_KEEPIDLE;
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, &v, sizeof(v));
+		v = FTP_CLIENT_SOCK_KEEPINTVL;
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, &v, sizeof(v));
+		v = FTP_CLIENT_SOCK_KEEPCNT;
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &v, sizeof(v));
+	}
+	#endif
+	struct timeval tv = { 0, 0 };
+	if (on) {
+		tv.tv_sec = timeoutMs / 1000;
+		tv.tv_usec = (timeoutMs % 1000) * 1000;
+	}
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+void ftpClientSockQuickAck(int s)
+{
+	#ifdef TCP_QUICKACK
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+	#else
+	(void) s;
+	#endif
+}
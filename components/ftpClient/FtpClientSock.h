@@ -0,0 +1,38 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client socket options
+ *
+ * The FTP_CLIENT_SOCK_* profiles of the blocking client and the async engine.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTSOCK_H_
+#define FTPCLIENTSOCK_H_
+
+#include "FtpClient.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Set the options of FTP_CLIENT_SOCK_* profiles. Options of profiles not
+ * given are turned off again, except the buffer sizes. An option the stack
+ * does not support is skipped; lwIP has no SO_SNDBUF and SO_RCVBUF needs
+ * CONFIG_LWIP_SO_RCVBUF.
+ */
+void ftpClientSockProfile(int s, int profile, int bufSize, int timeoutMs);
+/* ACK the next segment at once, Linux leaves quick ACK mode again; no-op elsewhere */
+void ftpClientSockQuickAck(int s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTSOCK_H_ */
@@ -0,0 +1,153 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client line end translation of ASCII transfers
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "FtpClientText.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+
+/*
+ * ftpClientTextFind - find the next line end byte
+ *
+ * 16 bytes per compare with SSE2 or NEON, otherwise one machine word per
+ * compare: a word holds c in one of its bytes when
+ * (v - 0x01..01) & ~v & 0x80..80 is not zero for v = word ^ (c * 0x01..01).
+ */
+const char* ftpClientTextFind(const char* p, size_t len, char c)
+{
+	const char* end = p + len;
+#if defined(__SSE2__)
+	const __m128i n = _mm_set1_epi8(c);
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		int m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, n));
+		if (m)
+			return p + __builtin_ctz(m);
+		p += 16;
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t n = vdupq_n_u8((uint8_t)c);
+	while (end - p >= 16) {
+		uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)p), n);
+		/* 4 bits per byte */
+		uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+			vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (m)
+			return p + (__builtin_ctzll(m) >> 2);
+		p += 16;
+	}
+#else
+	const uintptr_t ones = (uintptr_t)-1 / 0xff;
+	const uintptr_t highs = ones * 0x80;
+	const uintptr_t n = ones * (unsigned char)c;
+	while ((p < end) && ((uintptr_t)p & (sizeof(uintptr_t) - 1))) {
+		if (*p == c)
+			return p;
+		p++;
+	}
+	while (end - p >= (ptrdiff_t)sizeof(uintptr_t)) {
+		uintptr_t v;
+		memcpy(&v, __builtin_assume_aligned(p, sizeof(uintptr_t)), sizeof(v));
+		v ^= n;
+		if ((v - ones) & ~v & highs)
+			break;
+		p += sizeof(uintptr_t);
+	}
+#endif
+	while (p < end) {
+		if (*p == c)
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+
+
+/*
+ * ftpClientTextToCrlf - LF to CRLF
+ */
+size_t ftpClientTextToCrlf(const char* in, size_t* inlen, char* out, size_t outmax,
+	char* last)
+{
+	const char* p = in;
+	const char* end = in + *inlen;
+	char* o = out;
+	char* oend = out + outmax;
+	char lc = *last;
+	while ((p < end) && (o < oend)) {
+		size_t room = oend - o;
+		size_t left = end - p;
+		const char* nl = ftpClientTextFind(p, (left < room) ? left : room, '\n');
+		size_t n = (nl != NULL) ? (size_t)(nl - p) : ((left < room) ? left : room);
+		if (n) {
+			memcpy(o, p, n);
+			o += n;
+			p += n;
+			lc = p[-1];
+		}
+		if (nl == NULL)
+			continue;
+		if (lc == '\r') {
+			*o++ = '\n';
+		}
+		else {
+			if (oend - o < 2)
+				break;
+			*o++ = '\r';
+			*o++ = '\n';
+		}
+		lc = *p++;
+	}
+	*last = lc;
+	*inlen = p - in;
+	return o - out;
+}
+
+
+
+/*
+ * ftpClientTextFromCrlf - CRLF to LF
+ */
+size_t ftpClientTextFromCrlf(const char* in, size_t len, char* out, char* cr)
+{
+	const char* p = in;
+	const char* end = in + len;
+	char* o = out;
+	*cr = 0;
+	while (p < end) {
+		const char* r = ftpClientTextFind(p, end - p, '\r');
+		size_t n = (r != NULL) ? (size_t)(r - p) : (size_t)(end - p);
+		if (o != p)
+			memmove(o, p, n);
+		o += n;
+		p += n;
+		if (r == NULL)
+			break;
+		if (p + 1 == end) {
+			*cr = 1;
+			break;
+		}
+		/* drop the CR of a CRLF, keep a lone CR */
+		if (p[1] != '\n')
+			*o++ = '\r';
+		p++;
+	}
+	return o - out;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file
+ * @brief ESP32-FTP-Client line end translation of ASCII transfers
+ *
+ * ASCII (TYPE A) data is sent with CRLF line ends and stored locally with LF.
+ * Both directions scan whole chunks for the next line end and move the text
+ * between line ends with block copies. The scan uses SSE2 or NEON on the
+ * host and compares a machine word at a time (SWAR) on Xtensa and RISC-V.
+ *
+ * @note
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+#ifndef FTPCLIENTTEXT_H_
+#define FTPCLIENTTEXT_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * LF to CRLF. A LF that already follows a CR is copied as is.
+ * *inlen is the input length and returns the bytes consumed, which is less
+ * when out fills up. *last is the previous input byte, 0 at the start of
+ * the transfer, and is updated for the next call.
+ *
+ * return the bytes written to out
+ */
+size_t ftpClientTextToCrlf(const char* in, size_t* inlen, char* out, size_t outmax,
+	char* last);
+
+/*
+ * CRLF to LF. out may be in, it never holds more than len bytes.
+ * A CR at the end of the input is held back and *cr is set, the caller puts
+ * it in front of the next chunk, or writes it when the data ends.
+ *
+ * return the bytes written to out
+ */
+size_t ftpClientTextFromCrlf(const char* in, size_t len, char* out, char* cr);
+
+/* first c in p[0..len), NULL if there is none */
+const char* ftpClientTextFind(const char* p, size_t len, char c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPCLIENTTEXT_H_ */
@@ -0,0 +1,735 @@
+/*
+	FTP Client throughput benchmark (host build).
+
+	Runs PUT/GET/LIST in ASCII and IMAGE mode against an FTP server
+	(python-ftp-server/main.py by default) and reports throughput,
+	per-command latency percentiles and the heap peak of the client.
+	The memory endpoints are compared with the file based transfers.
+	Downloads through the transfer queue report throughput and CPU time
+	of each worker, pinned to the cores given with -w. The socket option
+	profiles of -k and -K show their effect on small and large files.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ftp_host_port.h"
+#include "FtpClient.h"
+#include "FtpClientAsync.h"
+#include "FtpClientPort.h"
+#include "FtpClientQueue.h"
+
+#define BENCH_MAX_ITERATIONS		100
+#define BENCH_MAX_SIZES				16
+#define BENCH_LARGE_FILE			(64UL * 1024 * 1024)
+#define BENCH_MEMORY_MAX			(256UL * 1024 * 1024)
+#define BENCH_STREAM_SIZE			(64 * 1024)
+
+typedef struct {
+	const char* host;
+	uint16_t port;
+	const char* user;
+	const char* pass;
+	const char* workdir;
+	const char* modes;
+	const char* ops;
+	int iterations;
+	int chunkSize;
+	int adaptive;
+	int pipeline;
+	int segments;
+	int sessions;
+	int asyncSessions;
+	int sockControl;
+	int sockData;
+	int sockBufSize;
+	int queueWorkers;
+	FtpClientQueueWorkerOptions_t worker[FTP_CLIENT_QUEUE_WORKERS_MAX];
+	FtpClientJobQueue_t* queue;
+	FtpClientPortQueue_t* queueDone;
+	int nsizes;
+	uint64_t sizes[BENCH_MAX_SIZES];
+} BenchConfig_t;
+
+typedef struct {
+	double samples[BENCH_MAX_ITERATIONS];
+	int count;
+	uint64_t bytes;
+	size_t heapPeak;
+	uint32_t chunkSize;
+} BenchResult_t;
+
+static double nowSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of an already sorted array */
+static double percentile(const double* sorted, int count, int pct)
+{
+	int rank = (pct * count + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	return sorted[rank - 1];
+}
+
+static uint64_t parseSize(const char* s)
+{
+	char* end;
+	uint64_t v = strtoull(s, &end, 10);
+	switch (*end) {
+		case 'k': case 'K': v <<= 10; break;
+		case 'm': case 'M': v <<= 20; break;
+		case 'g': case 'G': v <<= 30; break;
+	}
+	return v;
+}
+
+static void formatSize(uint64_t v, char* buf, size_t max)
+{
+	if (v >= (1ULL << 30) && (v % (1ULL << 30)) == 0)
+		snprintf(buf, max, "%" PRIu64 "G", v >> 30);
+	else if (v >= (1ULL << 20) && (v % (1ULL << 20)) == 0)
+		snprintf(buf, max, "%" PRIu64 "M", v >> 20);
+	else if (v >= (1ULL << 10) && (v % (1ULL << 10)) == 0)
+		snprintf(buf, max, "%" PRIu64 "K", v >> 10);
+	else
+		snprintf(buf, max, "%" PRIu64, v);
+}
+
+static int parseSizes(const char* list, BenchConfig_t* cfg)
+{
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), "%s", list);
+	cfg->nsizes = 0;
+	for (char* tok = strtok(tmp, ","); tok; tok = strtok(NULL, ",")) {
+		if (cfg->nsizes == BENCH_MAX_SIZES)
+			return 0;
+		cfg->sizes[cfg->nsizes++] = parseSize(tok);
+	}
+	return cfg->nsizes > 0;
+}
+
+/* comma separated cores of the queue workers, "any" for no pinning */
+static int parseCores(const char* list, BenchConfig_t* cfg)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", list);
+	int n = 0;
+	for (char* tok = strtok(buf, ","); tok; tok = strtok(NULL, ",")) {
+		if (n >= FTP_CLIENT_QUEUE_WORKERS_MAX)
+			return 0;
+		cfg->worker[n++].core = strcmp(tok, "any") ? atoi(tok) : FTP_CLIENT_PORT_CORE_ANY;
+	}
+	return n > 0;
+}
+
+/*
+ * makeSourceFile - create a text file of exactly size bytes
+ *
+ * The content is made of newline terminated lines so the ASCII mode
+ * runs exercise the CR/LF translation of the client.
+ */
+static int makeSourceFile(const char* path, uint64_t size)
+{
+	struct stat st;
+	if (stat(path, &st) == 0 && (uint64_t)st.st_size == size)
+		return 1;
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return 0;
+	char line[64 * 1024];
+	for (size_t i = 0; i < sizeof(line); i++)
+		line[i] = ((i % 64) == 63) ? '\n' : (char)('a' + (i % 26));
+	uint64_t left = size;
+	while (left) {
+		size_t n = left > sizeof(line) ? sizeof(line) : (size_t)left;
+		if (fwrite(line, 1, n, f) != n) {
+			fclose(f);
+			return 0;
+		}
+		left -= n;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void printHeader(void)
+{
+	printf("%-4s %-6s %-5s %5s %10s %10s %10s %10s %10s %10s %6s\n",
+		"mode", "size", "op", "iters", "MB/s", "min(ms)", "p50(ms)",
+		"p90(ms)", "p99(ms)", "heap-peak", "chunk");
+}
+
+static void printResult(char mode, uint64_t size, const char* op, BenchResult_t* r)
+{
+	char sz[24];
+	formatSize(size, sz, sizeof(sz));
+	if (r->count == 0) {
+		printf("%-4c %-6s %-5s %5s\n", mode, sz, op, "FAIL");
+		return;
+	}
+	double total = 0;
+	for (int i = 0; i < r->count; i++)
+		total += r->samples[i];
+	qsort(r->samples, r->count, sizeof(double), compareDouble);
+	double mbps = (total > 0) ? (r->bytes / total) / (1024.0 * 1024.0) : 0;
+	printf("%-4c %-6s %-5s %5d %10.2f %10.3f %10.3f %10.3f %10.3f %10zu %6" PRIu32 "\n",
+		mode, sz, op, r->count, mbps,
+		r->samples[0] * 1e3,
+		percentile(r->samples, r->count, 50) * 1e3,
+		percentile(r->samples, r->count, 90) * 1e3,
+		percentile(r->samples, r->count, 99) * 1e3,
+		r->heapPeak, r->chunkSize);
+	fflush(stdout);
+}
+
+static void record(FtpClient* ftpClient, NetBuf_t* nControl,
+	BenchResult_t* r, double elapsed, uint64_t bytes)
+{
+	FtpClientXferStats_t stats;
+	if (ftpClient->ftpClientGetXferStats(&stats, nControl))
+		r->chunkSize = stats.chunkSize;
+	if (r->count < BENCH_MAX_ITERATIONS)
+		r->samples[r->count++] = elapsed;
+	r->bytes += bytes;
+	size_t peak = ftpHostHeapPeak() - ftpHostHeapInUse();
+	if (peak > r->heapPeak)
+		r->heapPeak = peak;
+}
+
+static int asyncFailed;
+
+static int countingWrite(const void* buf, int len, void* arg)
+{
+	*(uint64_t*)arg += len;
+	return len;
+}
+
+static void asyncDone(FtpClientOp_t* op, int result, const char* response, void* arg)
+{
+	if (!result) {
+		fprintf(stderr, "async %s failed: %s\n", (const char*)arg, response);
+		asyncFailed = 1;
+	}
+}
+
+/*
+ * runAsync - GET a file over several sessions driven by one task
+ *
+ * return total bytes received, 0 on error
+ */
+static uint64_t runAsync(const BenchConfig_t* cfg, char mode, const char* remote)
+{
+	FtpClientAsync* ftpAsync = getFtpClientAsync();
+	FtpClientLoop_t* loop = ftpAsync->ftpClientAsyncCreate();
+	uint64_t received[cfg->asyncSessions];
+	FtpClientSink_t sinks[cfg->asyncSessions];
+	asyncFailed = 0;
+	for (int i = 0; i < cfg->asyncSessions; i++) {
+		FtpClientSession_t* session;
+		received[i] = 0;
+		sinks[i] = (FtpClientSink_t){ NULL, countingWrite, &received[i] };
+		if (!ftpAsync->ftpClientAsyncConnect(loop, cfg->host, cfg->port,
+				cfg->user, cfg->pass, &session, asyncDone, "login")) {
+			asyncFailed = 1;
+			break;
+		}
+		ftpAsync->ftpClientAsyncGet(session, remote, mode, &sinks[i], asyncDone, "GET");
+		ftpAsync->ftpClientAsyncQuit(session, asyncDone, "QUIT");
+	}
+	while (ftpAsync->ftpClientAsyncRun(loop, 1000) > 0)
+		;
+	ftpAsync->ftpClientAsyncDestroy(loop);
+	uint64_t total = 0;
+	for (int i = 0; i < cfg->asyncSessions; i++)
+		total += received[i];
+	return asyncFailed ? 0 : total;
+}
+
+/*
+ * runQueue - GET a file once for each queue worker, all jobs at a time
+ *
+ * return total bytes received, 0 on error
+ */
+static uint64_t runQueue(const BenchConfig_t* cfg, char mode, const char* remote)
+{
+	FtpClientQueue* ftpQueue = getFtpClientQueue();
+	char dst[FTP_CLIENT_QUEUE_WORKERS_MAX][256];
+	for (int i = 0; i < cfg->queueWorkers; i++) {
+		snprintf(dst[i], sizeof(dst[i]), "%s/dst_q%d.dat", cfg->workdir, i);
+		if (!ftpQueue->ftpClientQueueSubmit(cfg->queue, FTP_CLIENT_QUEUE_GET,
+				FTP_CLIENT_QUEUE_NORMAL, dst[i], remote, mode, 0, NULL, NULL))
+			return 0;
+	}
+	uint64_t total = 0;
+	int failed = 0;
+	for (int i = 0; i < cfg->queueWorkers; i++) {
+		FtpClientJob_t* job = ftpClientPortQueueReceive(cfg->queueDone);
+		if (ftpQueue->ftpClientQueueStatus(job) != FTP_CLIENT_QUEUE_DONE) {
+			fprintf(stderr, "queue GET failed: %s", ftpQueue->ftpClientQueueResponse(job));
+			failed = 1;
+		}
+		total += ftpQueue->ftpClientQueueBytes(job);
+		ftpQueue->ftpClientQueueRelease(job);
+	}
+	for (int i = 0; i < cfg->queueWorkers; i++)
+		unlink(dst[i]);
+	return failed ? 0 : total;
+}
+
+/*
+ * printWorkers - per worker report of the transfer queue
+ */
+static void printWorkers(const BenchConfig_t* cfg)
+{
+	FtpClientQueueWorkerStats_t st[FTP_CLIENT_QUEUE_WORKERS_MAX];
+	int n = getFtpClientQueue()->ftpClientQueueGetWorkerStats(cfg->queue, st,
+		FTP_CLIENT_QUEUE_WORKERS_MAX);
+	for (int i = 0; i < n; i++) {
+		char core[8];
+		if (st[i].core == FTP_CLIENT_PORT_CORE_ANY)
+			snprintf(core, sizeof(core), "any");
+		else
+			snprintf(core, sizeof(core), "%d", st[i].core);
+		printf("worker %d core %-3s (last %d) jobs %" PRIu32 " %10.2f MB/s busy %.3f s cpu %.3f s %3"
+			PRIu32 "%%\n", i, core, st[i].lastCore, st[i].jobs, st[i].bytesPerSec / (1024.0 * 1024),
+			st[i].busyUs / 1e6, st[i].cpuUs / 1e6, st[i].cpuPct);
+	}
+}
+
+static void streamDrain(void* arg)
+{
+	FtpClientPortStream_t* stream = arg;
+	static char buf[16 * 1024];
+	while (ftpClientPortStreamReceive(stream, buf, sizeof(buf)) > 0)
+		;
+}
+
+/*
+ * runMemory - transfers between memory and the server, no file system
+ *
+ * MPUT sends a buffer, MGET receives into a buffer of the file size,
+ * MGROW into a buffer the client grows, SGET into a stream buffer that
+ * another thread drains.
+ */
+static void runMemory(FtpClient* ftpClient, NetBuf_t* nControl,
+	const BenchConfig_t* cfg, char mode, uint64_t size, const char* src,
+	const char* remote, int iterations)
+{
+	if (size > BENCH_MEMORY_MAX)
+		return;
+	char* data = malloc(size + 1);
+	FILE* f = fopen(src, "rb");
+	if ((data == NULL) || (f == NULL) || (fread(data, 1, size, f) != size)) {
+		fprintf(stderr, "cannot read %s\n", src);
+		if (f)
+			fclose(f);
+		free(data);
+		return;
+	}
+	fclose(f);
+
+	const char* ops[] = { "MPUT", "MGET", "MGROW", "SGET" };
+	for (int op = 0; op < 4; op++) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			FtpClientPortStream_t* stream = NULL;
+			FtpClientPortThread_t* drain = NULL;
+			if (op == 3) {
+				stream = ftpClientPortStreamCreate(BENCH_STREAM_SIZE);
+				drain = ftpClientPortThreadCreate(streamDrain, stream, "drain", 0, 0);
+			}
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			size_t len = size;
+			char* grown = NULL;
+			int ok;
+			if (op == 0)
+				ok = ftpClient->ftpClientPutFromBuffer(data, size, remote, mode, nControl);
+			else if (op == 1)
+				ok = ftpClient->ftpClientGetToBuffer(data, size + 1, &len, remote, mode, nControl);
+			else if (op == 2)
+				ok = ftpClient->ftpClientGetToMemory(&grown, &len, size + 1, remote, mode, nControl);
+			else
+				ok = ftpClient->ftpClientGetToStream(stream, remote, mode, nControl);
+			double t1 = nowSeconds();
+			/* the heap peak includes the buffer of MGROW */
+			ftpHostFree(grown);
+			record(ftpClient, nControl, &r, t1 - t0, len);
+			if (stream) {
+				ftpClientPortThreadJoin(drain);
+				ftpClientPortStreamDelete(stream);
+			}
+			if (!ok) {
+				fprintf(stderr, "%s failed: %s", ops[op], ftpClient->ftpClientGetLastResponse(nControl));
+				r.count = 0;
+				break;
+			}
+		}
+		printResult(mode, size, ops[op], &r);
+	}
+	free(data);
+}
+
+static int runSize(FtpClient* ftpClient, NetBuf_t* nControl,
+	const BenchConfig_t* cfg, char mode, uint64_t size)
+{
+	char src[256], dst[256], lst[256], remote[64], sz[24];
+	formatSize(size, sz, sizeof(sz));
+	snprintf(src, sizeof(src), "%s/src_%s.dat", cfg->workdir, sz);
+	snprintf(dst, sizeof(dst), "%s/dst_%s.dat", cfg->workdir, sz);
+	snprintf(lst, sizeof(lst), "%s/list.txt", cfg->workdir);
+	snprintf(remote, sizeof(remote), "ftpbench_%s.dat", sz);
+	if (!makeSourceFile(src, size)) {
+		fprintf(stderr, "cannot create %s\n", src);
+		return 0;
+	}
+	int iterations = (size >= BENCH_LARGE_FILE) ? 1 : cfg->iterations;
+
+	if (strchr(cfg->ops, 'P')) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			int ok = ftpClient->ftpClientPut(src, remote, mode, nControl);
+			double t1 = nowSeconds();
+			if (!ok) {
+				fprintf(stderr, "PUT failed: %s", ftpClient->ftpClientGetLastResponse(nControl));
+				break;
+			}
+			record(ftpClient, nControl, &r, t1 - t0, size);
+		}
+		printResult(mode, size, "PUT", &r);
+	}
+
+	if (strchr(cfg->ops, 'G')) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			int ok = (cfg->segments > 1) ?
+				ftpClient->ftpClientGetSegmented(dst, remote, mode, nControl) :
+				ftpClient->ftpClientGet(dst, remote, mode, nControl);
+			double t1 = nowSeconds();
+			struct stat st;
+			if (!ok || stat(dst, &st) != 0) {
+				fprintf(stderr, "GET failed: %s", ftpClient->ftpClientGetLastResponse(nControl));
+				break;
+			}
+			record(ftpClient, nControl, &r, t1 - t0, st.st_size);
+		}
+		unlink(dst);
+		printResult(mode, size, "GET", &r);
+	}
+
+	if (strchr(cfg->ops, 'G') && (cfg->asyncSessions > 0)) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			uint64_t bytes = runAsync(cfg, mode, remote);
+			double t1 = nowSeconds();
+			if (bytes == 0)
+				break;
+			record(ftpClient, nControl, &r, t1 - t0, bytes);
+		}
+		printResult(mode, size, "AGET", &r);
+	}
+
+	if (strchr(cfg->ops, 'G') && (cfg->queue != NULL)) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			uint64_t bytes = runQueue(cfg, mode, remote);
+			double t1 = nowSeconds();
+			if (bytes == 0)
+				break;
+			record(ftpClient, nControl, &r, t1 - t0, bytes);
+		}
+		printResult(mode, size, "QGET", &r);
+	}
+
+	if (strchr(cfg->ops, 'M'))
+		runMemory(ftpClient, nControl, cfg, mode, size, src, remote, iterations);
+
+	if (strchr(cfg->ops, 'L')) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < iterations; i++) {
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			int ok = ftpClient->ftpClientDir(lst, ".", nControl);
+			double t1 = nowSeconds();
+			struct stat st;
+			if (!ok || stat(lst, &st) != 0) {
+				fprintf(stderr, "LIST failed: %s", ftpClient->ftpClientGetLastResponse(nControl));
+				break;
+			}
+			record(ftpClient, nControl, &r, t1 - t0, st.st_size);
+		}
+		unlink(lst);
+		printResult(mode, size, "LIST", &r);
+	}
+
+	if (strchr(cfg->ops, 'P') || strchr(cfg->ops, 'M'))
+		ftpClient->ftpClientDelete(remote, nControl);
+	return 1;
+}
+
+/*
+ * runSessions - periodic jobs, each uploading one small file
+ *
+ * NEW connects and logs in for every job, POOL takes the session from
+ * the connection pool.
+ */
+static void runSessions(FtpClient* ftpClient, const BenchConfig_t* cfg)
+{
+	char src[256];
+	const uint64_t size = 1024;
+	snprintf(src, sizeof(src), "%s/src_1K.dat", cfg->workdir);
+	if (!makeSourceFile(src, size)) {
+		fprintf(stderr, "cannot create %s\n", src);
+		return;
+	}
+	for (int pooled = 0; pooled <= 1; pooled++) {
+		BenchResult_t r = {0};
+		for (int i = 0; i < cfg->sessions; i++) {
+			NetBuf_t* nControl = NULL;
+			ftpHostHeapReset();
+			double t0 = nowSeconds();
+			int ok;
+			if (pooled)
+				ok = ftpClient->ftpClientPoolAcquire(cfg->host, cfg->port,
+					cfg->user, cfg->pass, &nControl);
+			else
+				ok = ftpClient->ftpClientConnect(cfg->host, cfg->port, &nControl) &&
+					ftpClient->ftpClientLogin(cfg->user, cfg->pass, nControl);
+			if (ok)
+				ok = ftpClient->ftpClientPut(src, "ftpbench_job.dat", FTP_CLIENT_IMAGE, nControl);
+			double t1 = nowSeconds();
+			if (ok)
+				record(ftpClient, nControl, &r, t1 - t0, size);
+			else
+				fprintf(stderr, "job failed: %s", nControl ?
+					ftpClient->ftpClientGetLastResponse(nControl) : "connect\n");
+			if (nControl == NULL)
+				break;
+			if (pooled)
+				ftpClient->ftpClientPoolRelease(nControl);
+			else
+				ftpClient->ftpClientQuit(nControl);
+			if (!ok)
+				break;
+		}
+		printResult(FTP_CLIENT_IMAGE, size, pooled ? "POOL" : "NEW", &r);
+	}
+	FtpClientPoolStats_t stats;
+	ftpClient->ftpClientPoolGetStats(&stats);
+	printf("pool hits %" PRIu32 " misses %" PRIu32 " reconnects %" PRIu32 " expired %" PRIu32 "\n",
+		stats.hits, stats.misses, stats.reconnects, stats.expired);
+	ftpClient->ftpClientPoolFlush();
+}
+
+static void usage(const char* prog)
+{
+	printf("usage: %s [options]\n"
+		"  -H host        FTP server address (127.0.0.1)\n"
+		"  -P port        FTP server port (2121)\n"
+		"  -u user        user name (ftpuser)\n"
+		"  -p password    password (ftppass)\n"
+		"  -d dir         local scratch directory (/tmp/ftpbench)\n"
+		"  -s sizes       comma separated file sizes (1K,16K,256K,1M,16M,256M,1G)\n"
+		"  -n iterations  iterations per size, files of 64M and more run once (5)\n"
+		"  -m modes       transfer modes, A=ASCII I=IMAGE (AI)\n"
+		"  -o ops         operations, P=PUT G=GET L=LIST M=memory (PGL)\n"
+		"  -b bytes       data chunk size (4096)\n"
+		"  -a             adaptive data chunk size\n"
+		"  -l buffers     pipelined transfer with this many buffers (off)\n"
+		"  -g segments    segmented GET over this many connections (1)\n"
+		"  -c sessions    also GET each file over this many concurrent sessions of the async engine (0)\n"
+		"  -q workers     also GET each file once per worker of a transfer queue (0)\n"
+		"  -w cores       comma separated cores of the queue workers, any=not pinned (any)\n"
+		"  -k profiles    socket options of the control connection, 1=low latency 2=bulk 4=keepalive (1)\n"
+		"  -K profiles    socket options of the data connections (0)\n"
+		"  -B bytes       socket buffer size of the bulk profile (65536)\n"
+		"  -r jobs        also run this many 1K upload jobs with a new and a pooled session (0)\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+	BenchConfig_t cfg = {
+		.host = "127.0.0.1",
+		.port = 2121,
+		.user = "ftpuser",
+		.pass = "ftppass",
+		.workdir = "/tmp/ftpbench",
+		.modes = "AI",
+		.ops = "PGL",
+		.iterations = 5,
+		.chunkSize = FTP_CLIENT_BUFFER_SIZE,
+		.segments = 1,
+		.sockControl = FTP_CLIENT_SOCK_CONTROL_DEFAULT,
+		.sockData = FTP_CLIENT_SOCK_DEFAULT,
+		.sockBufSize = FTP_CLIENT_SOCK_BUFFER_SIZE,
+	};
+	for (int i = 0; i < FTP_CLIENT_QUEUE_WORKERS_MAX; i++)
+		cfg.worker[i].core = FTP_CLIENT_PORT_CORE_ANY;
+	parseSizes("1K,16K,256K,1M,16M,256M,1G", &cfg);
+
+	int c;
+	while ((c = getopt(argc, argv, "H:P:u:p:d:s:n:m:o:b:al:g:r:c:q:w:k:K:B:h")) != -1) {
+		switch (c) {
+			case 'H': cfg.host = optarg; break;
+			case 'P': cfg.port = atoi(optarg); break;
+			case 'u': cfg.user = optarg; break;
+			case 'p': cfg.pass = optarg; break;
+			case 'd': cfg.workdir = optarg; break;
+			case 'n': cfg.iterations = atoi(optarg); break;
+			case 'm': cfg.modes = optarg; break;
+			case 'o': cfg.ops = optarg; break;
+			case 'b': cfg.chunkSize = atoi(optarg); break;
+			case 'a': cfg.adaptive = 1; break;
+			case 'l': cfg.pipeline = atoi(optarg); break;
+			case 'g': cfg.segments = atoi(optarg); break;
+			case 'r': cfg.sessions = atoi(optarg); break;
+			case 'c': cfg.asyncSessions = atoi(optarg); break;
+			case 'q': cfg.queueWorkers = atoi(optarg); break;
+			case 'k': cfg.sockControl = atoi(optarg); break;
+			case 'K': cfg.sockData = atoi(optarg); break;
+			case 'B': cfg.sockBufSize = atoi(optarg); break;
+			case 'w':
+				if (!parseCores(optarg, &cfg)) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				if (!parseSizes(optarg, &cfg)) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if (cfg.iterations < 1 || cfg.iterations > BENCH_MAX_ITERATIONS) {
+		fprintf(stderr, "iterations must be 1..%d\n", BENCH_MAX_ITERATIONS);
+		return 1;
+	}
+	if (cfg.queueWorkers < 0 || cfg.queueWorkers > FTP_CLIENT_QUEUE_WORKERS_MAX) {
+		fprintf(stderr, "queue workers must be 0..%d\n", FTP_CLIENT_QUEUE_WORKERS_MAX);
+		return 1;
+	}
+	mkdir(cfg.workdir, 0755);
+	/* a dead pooled session must fail the send, not kill the process */
+	signal(SIGPIPE, SIG_IGN);
+
+	FtpClient* ftpClient = getFtpClient();
+	NetBuf_t* nControl = NULL;
+	double t0 = nowSeconds();
+	if (!ftpClient->ftpClientConnect(cfg.host, cfg.port, &nControl)) {
+		fprintf(stderr, "connect to %s:%u failed\n", cfg.host, cfg.port);
+		return 1;
+	}
+	double t1 = nowSeconds();
+	if (!ftpClient->ftpClientLogin(cfg.user, cfg.pass, nControl)) {
+		fprintf(stderr, "login failed: %s", ftpClient->ftpClientGetLastResponse(nControl));
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+	double t2 = nowSeconds();
+	if (!ftpClient->ftpClientSetOptions(FTP_CLIENT_DATABUFSIZE, cfg.chunkSize, nControl)) {
+		fprintf(stderr, "invalid chunk size %d\n", cfg.chunkSize);
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+	ftpClient->ftpClientSetOptions(FTP_CLIENT_DATABUFADAPTIVE, cfg.adaptive, nControl);
+	if (!ftpClient->ftpClientSetOptions(FTP_CLIENT_PIPELINE, cfg.pipeline, nControl)) {
+		fprintf(stderr, "invalid pipeline buffers %d\n", cfg.pipeline);
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+	if (!ftpClient->ftpClientSetOptions(FTP_CLIENT_SEGMENTS, cfg.segments, nControl)) {
+		fprintf(stderr, "invalid segments %d\n", cfg.segments);
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+	if (!ftpClient->ftpClientSetOptions(FTP_CLIENT_SOCKBUFSIZE, cfg.sockBufSize, nControl) ||
+			!ftpClient->ftpClientSetOptions(FTP_CLIENT_SOCKCONTROL, cfg.sockControl, nControl) ||
+			!ftpClient->ftpClientSetOptions(FTP_CLIENT_SOCKDATA, cfg.sockData, nControl)) {
+		fprintf(stderr, "invalid socket profiles %d/%d or buffer size %d\n",
+			cfg.sockControl, cfg.sockData, cfg.sockBufSize);
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+	if (cfg.queueWorkers > 0) {
+		FtpClientQueueOptions_t qopt = {
+			.host = cfg.host,
+			.port = cfg.port,
+			.user = cfg.user,
+			.pass = cfg.pass,
+			.workers = cfg.queueWorkers,
+			.worker = cfg.worker,
+		};
+		cfg.queueDone = ftpClientPortQueueCreate(cfg.queueWorkers);
+		qopt.doneQueue = cfg.queueDone;
+		cfg.queue = getFtpClientQueue()->ftpClientQueueCreate(&qopt);
+		if (cfg.queue == NULL) {
+			fprintf(stderr, "cannot start %d queue workers on these cores\n", cfg.queueWorkers);
+			ftpClient->ftpClientQuit(nControl);
+			return 1;
+		}
+	}
+	printf("server %s:%u connect %.3f ms login %.3f ms socket profiles control %d data %d\n\n",
+		cfg.host, cfg.port, (t1 - t0) * 1e3, (t2 - t1) * 1e3, cfg.sockControl, cfg.sockData);
+
+	printHeader();
+	for (const char* m = cfg.modes; *m; m++) {
+		char mode = (*m == 'A' || *m == 'a') ? FTP_CLIENT_ASCII : FTP_CLIENT_IMAGE;
+		for (int i = 0; i < cfg.nsizes; i++)
+			runSize(ftpClient, nControl, &cfg, mode, cfg.sizes[i]);
+	}
+	if (cfg.sessions > 0)
+		runSessions(ftpClient, &cfg);
+	if (cfg.queue != NULL) {
+		printWorkers(&cfg);
+		getFtpClientQueue()->ftpClientQueueDestroy(cfg.queue);
+		ftpClientPortQueueDelete(cfg.queueDone);
+	}
+	printf("round trips saved by the TYPE/CWD cache %lu\n",
+		ftpClient->ftpClientGetRoundTripsSaved(nControl));
+	FtpClientMemStats_t mem;
+	ftpClient->ftpClientMemGetStats(&mem);
+	printf("data connections %" PRIu32 " bytes (control %" PRIu32 "), high-water %" PRIu32
+		" of %" PRIu32 " pooled, %" PRIu32 " from the heap\n", mem.netBufSize, mem.controlSize,
+		mem.netBufsHighWater, mem.netBufs, mem.netBufsOverflow);
+	for (int i = 0; i < FTP_CLIENT_MEM_CLASSES; i++)
+		printf("buffers %6" PRIu32 " high-water %" PRIu32 " cached %" PRIu32 " hits %" PRIu32
+			" misses %" PRIu32 "\n", mem.classes[i].size, mem.classes[i].highWater,
+			mem.classes[i].cached, mem.classes[i].hits, mem.classes[i].misses);
+
+	ftpClient->ftpClientQuit(nControl);
+	return 0;
+}
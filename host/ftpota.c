@@ -0,0 +1,255 @@
+/*
+	FTP Client download into simulated flash partitions (host build).
+
+	Uploads an app image and a data image to the FTP server, then reads
+	them back with ftpClientOtaGet() into the partitions of
+	ftp_host_flash.c. The partition is filled with zeros first, so a
+	write that was not erased in front of it shows as a dirty write.
+	Each download checks the digest, the erased range and the partition
+	read back against the image; a wrong digest must fail and leave the
+	boot partition alone. Any failed check makes the exit status 1.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+
+#include "ftp_host_port.h"
+#include "FtpClient.h"
+#include "FtpClientHash.h"
+#include "FtpClientOta.h"
+#include "esp_ota_ops.h"
+
+#define OTA_APP_PATH				"ftpota_app.bin"
+#define OTA_RAW_PATH				"ftpota_raw.bin"
+#define OTA_SECTOR_SIZE				4096
+#define OTA_IMAGE_MAGIC				0xE9
+
+typedef struct {
+	const char* host;
+	uint16_t port;
+	const char* user;
+	const char* pass;
+	int size;
+} OtaConfig_t;
+
+typedef struct {
+	const char* name;
+	int raw;
+	int hashAlg;
+	int badDigest;				/* expect the download to fail on the digest */
+	uint32_t eraseAhead;
+} OtaCase_t;
+
+static const OtaCase_t otaCases[] = {
+	{ "app",           0, FTP_CLIENT_HASH_SHA256, 0, 0 },
+	{ "app-baddigest", 0, FTP_CLIENT_HASH_SHA256, 1, 0 },
+	{ "raw",           1, FTP_CLIENT_HASH_MD5,    0, 0 },
+	{ "raw-4k",        1, FTP_CLIENT_HASH_CRC32,  0, 4096 },
+	{ "raw-5000",      1, FTP_CLIENT_HASH_MD5,    0, 5000 },
+	{ "raw-nohash",    1, FTP_CLIENT_HASH_NONE,   0, 0 },
+};
+
+static uint32_t roundUp(uint32_t n, uint32_t step)
+{
+	return (n + step - 1) / step * step;
+}
+
+static void fillImage(uint8_t* buf, int size, uint32_t seed)
+{
+	uint32_t x = seed;
+	for (int i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = (uint8_t)x;
+	}
+}
+
+/* clear every bit, an erase is needed before anything can be written */
+static void dirtyPartition(const esp_partition_t* part)
+{
+	static const uint8_t zero[OTA_SECTOR_SIZE];
+	for (uint32_t off = 0; off < part->size; off += sizeof(zero))
+		esp_partition_write(part, off, zero, sizeof(zero));
+}
+
+/*
+ * otaCase - download one image and check the partition
+ *
+ * return the number of failed checks
+ */
+static int otaCase(const OtaCase_t* c, const OtaConfig_t* cfg, const uint8_t* image,
+	uint8_t* back, NetBuf_t* nControl)
+{
+	uint8_t digest[32];
+	FtpClientHash_t h;
+	ftpClientHashInit(&h, c->hashAlg);
+	ftpClientHashUpdate(&h, image, cfg->size);
+	ftpClientHashFinal(&h, digest);
+	if (c->badDigest)
+		digest[0] ^= 1;
+
+	FtpClientOtaOptions_t opt = {
+		.label = c->raw ? "storage" : NULL,
+		.raw = c->raw,
+		.setBoot = !c->raw,
+		.hashAlg = c->hashAlg,
+		.digest = (c->hashAlg != FTP_CLIENT_HASH_NONE) ? digest : NULL,
+		.requireVerified = (c->hashAlg != FTP_CLIENT_HASH_NONE),
+		.readBack = (c->hashAlg != FTP_CLIENT_HASH_NONE),
+		.eraseAhead = c->eraseAhead,
+	};
+	dirtyPartition(c->raw ? esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+		ESP_PARTITION_SUBTYPE_ANY, "storage") : esp_ota_get_next_update_partition(NULL));
+	const esp_partition_t* boot = esp_ota_get_boot_partition();
+	ftpHostFlashResetStats();
+	FtpClientOtaStats_t st;
+	memset(&st, 0, sizeof(st));
+	int rv = getFtpClientOta()->ftpClientOtaGet(c->raw ? OTA_RAW_PATH : OTA_APP_PATH, &opt,
+		&st, nControl);
+	FtpHostFlashStats_t fs;
+	ftpHostFlashGetStats(&fs);
+
+	int failures = 0;
+	const char* why = "";
+	if (c->badDigest) {
+		if (rv || (st.hashVerified != -1))
+			failures++, why = "wrong digest accepted";
+		else if (esp_ota_get_boot_partition() != boot)
+			failures++, why = "boot partition changed";
+	}
+	else if (!rv)
+		failures++, why = getFtpClient()->ftpClientGetLastResponse(nControl);
+	else if (st.bytes != (uint64_t)cfg->size)
+		failures++, why = "short image";
+	else if ((c->hashAlg != FTP_CLIENT_HASH_NONE) && (st.hashVerified != 1))
+		failures++, why = "digest not compared";
+	else if (fs.dirtyWrites)
+		failures++, why = "write without erase";
+	else if ((esp_partition_read(st.partition, 0, back, cfg->size) != ESP_OK) ||
+			memcmp(image, back, cfg->size))
+		failures++, why = "read back differs";
+	else if (!c->raw && (esp_ota_get_boot_partition() != st.partition))
+		failures++, why = "boot partition not set";
+	else if (c->raw) {
+		/* erased up to the image in eraseAhead steps, the rest left alone */
+		uint32_t step = roundUp(c->eraseAhead ? c->eraseAhead : FTP_CLIENT_OTA_ERASE_AHEAD,
+			OTA_SECTOR_SIZE);
+		uint32_t erased = roundUp(cfg->size, OTA_SECTOR_SIZE);
+		uint8_t after = 0;
+		if (erased < st.partition->size)
+			esp_partition_read(st.partition, erased, &after, 1);
+		if ((st.erasedBytes != erased) || (fs.erasedSectors * OTA_SECTOR_SIZE != erased))
+			failures++, why = "erased range";
+		else if (fs.eraseCalls != (erased + step - 1) / step)
+			failures++, why = "erase steps";
+		else if (after != 0)
+			failures++, why = "erased past the image";
+	}
+	printf("%-14s %-7s %8" PRIu64 " %8" PRIu32 " %6" PRIu32 " %7" PRIu32 " %6" PRIu32
+		" %5d %9.1f %9.1f  %s%.*s\n", c->name,
+		c->hashAlg ? ftpClientHashName(c->hashAlg) : "none",
+		st.bytes, st.erasedBytes, fs.eraseCalls, fs.writeCalls, fs.dirtyWrites,
+		st.hashVerified, st.eraseUs / 1e3, st.writeUs / 1e3,
+		failures ? "FAIL " : "ok", (int)strcspn(why, "\r\n"), why);
+	return failures;
+}
+
+static void usage(const char* prog)
+{
+	printf("usage: %s [options]\n"
+		"  -H host        FTP server address (127.0.0.1)\n"
+		"  -P port        FTP server port (2121)\n"
+		"  -u user        user name (ftpuser)\n"
+		"  -p password    password (ftppass)\n"
+		"  -s bytes       image size (1048576)\n",
+		prog);
+}
+
+int main(int argc, char* argv[])
+{
+	OtaConfig_t cfg = {
+		.host = "127.0.0.1",
+		.port = 2121,
+		.user = "ftpuser",
+		.pass = "ftppass",
+		.size = 1024 * 1024,
+	};
+	int c;
+	while ((c = getopt(argc, argv, "H:P:u:p:s:h")) != -1) {
+		switch (c) {
+			case 'H': cfg.host = optarg; break;
+			case 'P': cfg.port = atoi(optarg); break;
+			case 'u': cfg.user = optarg; break;
+			case 'p': cfg.pass = optarg; break;
+			case 's': cfg.size = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if (cfg.size < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	/* the data partition has room past the image, which must stay untouched */
+	uint32_t appSize = roundUp(cfg.size, 65536);
+	if (!ftpHostFlashAdd("factory", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY,
+			appSize) ||
+			!ftpHostFlashAdd("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0,
+			appSize) ||
+			!ftpHostFlashAdd("ota_1", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1,
+			appSize) ||
+			!ftpHostFlashAdd("storage", ESP_PARTITION_TYPE_DATA,
+			ESP_PARTITION_SUBTYPE_DATA_SPIFFS, appSize + 65536)) {
+		fprintf(stderr, "no memory for the partitions\n");
+		return 1;
+	}
+	uint8_t* app = malloc(cfg.size);
+	uint8_t* raw = malloc(cfg.size);
+	uint8_t* back = malloc(cfg.size);
+	if (!app || !raw || !back) {
+		fprintf(stderr, "no memory for the images\n");
+		return 1;
+	}
+	fillImage(app, cfg.size, 0x9e3779b9u);
+	app[0] = OTA_IMAGE_MAGIC;
+	fillImage(raw, cfg.size, 0x85ebca6bu);
+
+	FtpClient* ftpClient = getFtpClient();
+	NetBuf_t* nControl = NULL;
+	if (!ftpClient->ftpClientConnect(cfg.host, cfg.port, &nControl) ||
+			!ftpClient->ftpClientLogin(cfg.user, cfg.pass, nControl)) {
+		fprintf(stderr, "connect or login failed\n");
+		return 1;
+	}
+	if (!ftpClient->ftpClientPutFromBuffer(app, cfg.size, OTA_APP_PATH, FTP_CLIENT_IMAGE, nControl) ||
+			!ftpClient->ftpClientPutFromBuffer(raw, cfg.size, OTA_RAW_PATH, FTP_CLIENT_IMAGE,
+			nControl)) {
+		fprintf(stderr, "upload failed: %s", ftpClient->ftpClientGetLastResponse(nControl));
+		ftpClient->ftpClientQuit(nControl);
+		return 1;
+	}
+
+	printf("case           hash       bytes   erased erases  writes  dirty   ver erase(ms) write(ms)\n");
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(otaCases) / sizeof(otaCases[0]); i++)
+		failures += otaCase(&otaCases[i], &cfg, otaCases[i].raw ? raw : app, back, nControl);
+
+	ftpClient->ftpClientDelete(OTA_APP_PATH, nControl);
+	ftpClient->ftpClientDelete(OTA_RAW_PATH, nControl);
+	ftpClient->ftpClientQuit(nControl);
+	free(app);
+	free(raw);
+	free(back);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,367 @@
+/*
+	FTP Client multi-threaded stress test (host build).
+
+	Starts many threads at once against an FTP server. Each thread first
+	calls getFtpClient() so the tables are initialized concurrently, then
+	uploads, downloads and compares files of its own. Most threads use a
+	session of their own; with -S groups of threads share one session
+	and take turns through its lock, including ftpClientAccess() ...
+	ftpClientClose() sequences. At the end one thread uploads under a low
+	rate limit while another reads the statistics of the session and
+	lifts the limit, neither may wait for the transfer. Any failed
+	transfer, corrupted byte or blocked call makes the exit status 1.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ftp_host_port.h"
+#include "FtpClient.h"
+#include "FtpClientPort.h"
+
+#define STRESS_MAX_THREADS			64
+#define STRESS_RATE_SIZE			(1024 * 1024)
+#define STRESS_RATE_LIMIT			(128 * 1024)	/* 8 s for STRESS_RATE_SIZE */
+#define STRESS_RATE_LIFT_MS			300				/* the limit is lifted after */
+#define STRESS_CALL_MAX_MS			200				/* longest call beside a transfer */
+
+typedef struct {
+	const char* host;
+	uint16_t port;
+	const char* user;
+	const char* pass;
+	int threads;
+	int iterations;
+	int size;
+	int shared;					/* threads per shared session, 0 for none */
+} StressConfig_t;
+
+typedef struct {
+	const StressConfig_t* cfg;
+	pthread_barrier_t* start;
+	NetBuf_t* shared;			/* session of the group, NULL for an own one */
+	int id;
+	int transfers;
+	int failures;
+	int corrupt;
+	uint64_t bytes;
+} StressThread_t;
+
+static double nowSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* content depends on the thread and the iteration, so mixed up files show */
+static void fillPattern(char* buf, int size, int id, int iteration)
+{
+	uint32_t x = 0x9e3779b9u * (id + 1) + iteration;
+	for (int i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = (char)x;
+	}
+}
+
+static void fail(StressThread_t* t, FtpClient* ftpClient, NetBuf_t* nControl, const char* op)
+{
+	t->failures++;
+	fprintf(stderr, "thread %d %s failed: %s", t->id, op,
+		nControl ? ftpClient->ftpClientGetLastResponse(nControl) : "no session\n");
+}
+
+/*
+ * putByAccess - upload through ftpClientAccess(), the session stays with
+ * this thread until ftpClientClose()
+ */
+static int putByAccess(FtpClient* ftpClient, const char* buf, int size, const char* path,
+	NetBuf_t* nControl)
+{
+	NetBuf_t* nData;
+	if (!ftpClient->ftpClientAccess(path, FTP_CLIENT_FILE_WRITE, FTP_CLIENT_IMAGE, nControl, &nData))
+		return 0;
+	int ok = 1;
+	for (int off = 0; off < size; off += 1000) {
+		int n = (size - off < 1000) ? size - off : 1000;
+		if (ftpClient->ftpClientWrite(buf + off, n, nData) != n) {
+			ok = 0;
+			break;
+		}
+	}
+	return ftpClient->ftpClientClose(nData) && ok;
+}
+
+/*
+ * stressRounds - PUT, GET back and compare, the PUT alternating between
+ * ftpClientPutFromBuffer() and ftpClientAccess()
+ */
+static void stressRounds(StressThread_t* t, FtpClient* ftpClient, NetBuf_t* nControl,
+	char* data, char* back)
+{
+	const StressConfig_t* cfg = t->cfg;
+	char path[64];
+	snprintf(path, sizeof(path), "ftpstress_%d.dat", t->id);
+	for (int i = 0; i < cfg->iterations; i++) {
+		fillPattern(data, cfg->size, t->id, i);
+		int ok = (i % 2) ?
+			putByAccess(ftpClient, data, cfg->size, path, nControl) :
+			ftpClient->ftpClientPutFromBuffer(data, cfg->size, path, FTP_CLIENT_IMAGE, nControl);
+		if (!ok) {
+			fail(t, ftpClient, nControl, "PUT");
+			continue;
+		}
+		t->transfers++;
+		t->bytes += cfg->size;
+		size_t len = 0;
+		if (!ftpClient->ftpClientGetToBuffer(back, cfg->size + 1, &len, path,
+				FTP_CLIENT_IMAGE, nControl)) {
+			fail(t, ftpClient, nControl, "GET");
+			continue;
+		}
+		t->transfers++;
+		t->bytes += len;
+		if ((len != (size_t)cfg->size) || memcmp(data, back, cfg->size)) {
+			fprintf(stderr, "thread %d iteration %d: %s differs\n", t->id, i, path);
+			t->corrupt++;
+		}
+		/* a command between the transfers of the other threads of the group */
+		char pwd[256];
+		if (!ftpClient->ftpClientPwd(pwd, sizeof(pwd), nControl))
+			fail(t, ftpClient, nControl, "PWD");
+	}
+	if (!ftpClient->ftpClientDelete(path, nControl))
+		fail(t, ftpClient, nControl, "DELE");
+}
+
+static void* stressThread(void* arg)
+{
+	StressThread_t* t = arg;
+	const StressConfig_t* cfg = t->cfg;
+	pthread_barrier_wait(t->start);
+	FtpClient* ftpClient = getFtpClient();
+
+	NetBuf_t* nControl = t->shared;
+	if (nControl == NULL) {
+		if (!ftpClient->ftpClientConnect(cfg->host, cfg->port, &nControl)) {
+			fail(t, ftpClient, NULL, "connect");
+			return NULL;
+		}
+		if (!ftpClient->ftpClientLogin(cfg->user, cfg->pass, nControl)) {
+			fail(t, ftpClient, nControl, "login");
+			ftpClient->ftpClientQuit(nControl);
+			return NULL;
+		}
+	}
+	char* data = malloc(cfg->size);
+	char* back = malloc(cfg->size + 1);
+	if ((data == NULL) || (back == NULL)) {
+		fprintf(stderr, "thread %d out of memory\n", t->id);
+		t->failures++;
+	}
+	else
+		stressRounds(t, ftpClient, nControl, data, back);
+	free(data);
+	free(back);
+	if (t->shared == NULL)
+		ftpClient->ftpClientQuit(nControl);
+	return NULL;
+}
+
+typedef struct {
+	const StressConfig_t* cfg;
+	NetBuf_t* nControl;
+	char* data;
+	int ok;
+} RateTransfer_t;
+
+static void* rateTransfer(void* arg)
+{
+	RateTransfer_t* r = arg;
+	r->ok = getFtpClient()->ftpClientPutFromBuffer(r->data, STRESS_RATE_SIZE,
+		"ftpstress_rate.dat", FTP_CLIENT_IMAGE, r->nControl);
+	return NULL;
+}
+
+/*
+ * rateChange - lift the rate limit of a running upload from another thread
+ *
+ * return the number of failures
+ */
+static int rateChange(const StressConfig_t* cfg)
+{
+	FtpClient* ftpClient = getFtpClient();
+	RateTransfer_t r = { .cfg = cfg };
+	if (!ftpClient->ftpClientConnect(cfg->host, cfg->port, &r.nControl) ||
+			!ftpClient->ftpClientLogin(cfg->user, cfg->pass, r.nControl)) {
+		fprintf(stderr, "rate session failed\n");
+		return 1;
+	}
+	int failures = 0;
+	r.data = malloc(STRESS_RATE_SIZE);
+	if (r.data == NULL) {
+		ftpClient->ftpClientQuit(r.nControl);
+		return 1;
+	}
+	fillPattern(r.data, STRESS_RATE_SIZE, 0, 0);
+	ftpClient->ftpClientSetOptions(FTP_CLIENT_RATELIMIT, STRESS_RATE_LIMIT, r.nControl);
+	pthread_t thread;
+	double t0 = nowSeconds();
+	pthread_create(&thread, NULL, rateTransfer, &r);
+	usleep(STRESS_RATE_LIFT_MS * 1000);
+
+	double t1 = nowSeconds();
+	FtpClientStats_t stats;
+	ftpClient->ftpClientGetStats(&stats, r.nControl);
+	double statsMs = (nowSeconds() - t1) * 1e3;
+	t1 = nowSeconds();
+	ftpClient->ftpClientSetOptions(FTP_CLIENT_RATELIMIT, 0, r.nControl);
+	double setMs = (nowSeconds() - t1) * 1e3;
+	pthread_join(thread, NULL);
+	double elapsed = nowSeconds() - t0;
+
+	double limited = (double)STRESS_RATE_SIZE / STRESS_RATE_LIMIT;
+	printf("rate change: stats %.1f ms (%" PRIu64 " bytes out) set %.1f ms, upload %.2f s of %.0f s"
+		" at the limit\n", statsMs, stats.bytesOut, setMs, elapsed, limited);
+	if (!r.ok) {
+		fprintf(stderr, "rate upload failed: %s", ftpClient->ftpClientGetLastResponse(r.nControl));
+		failures++;
+	}
+	else
+		ftpClient->ftpClientDelete("ftpstress_rate.dat", r.nControl);
+	if ((statsMs > STRESS_CALL_MAX_MS) || (setMs > STRESS_CALL_MAX_MS)) {
+		fprintf(stderr, "a call waited for the transfer\n");
+		failures++;
+	}
+	if (elapsed > limited / 2) {
+		fprintf(stderr, "the lifted limit did not apply to the running upload\n");
+		failures++;
+	}
+	free(r.data);
+	ftpClient->ftpClientQuit(r.nControl);
+	return failures;
+}
+
+static void usage(const char* prog)
+{
+	printf("usage: %s [options]\n"
+		"  -H host        FTP server address (127.0.0.1)\n"
+		"  -P port        FTP server port (2121)\n"
+		"  -u user        user name (ftpuser)\n"
+		"  -p password    password (ftppass)\n"
+		"  -t threads     threads started at once (8, at most %d)\n"
+		"  -n iterations  PUT/GET/compare rounds per thread (20)\n"
+		"  -s bytes       file size (65536)\n"
+		"  -S threads     threads sharing one session, 0 for a session each (0)\n",
+		prog, STRESS_MAX_THREADS);
+}
+
+int main(int argc, char* argv[])
+{
+	StressConfig_t cfg = {
+		.host = "127.0.0.1",
+		.port = 2121,
+		.user = "ftpuser",
+		.pass = "ftppass",
+		.threads = 8,
+		.iterations = 20,
+		.size = 65536,
+	};
+	int c;
+	while ((c = getopt(argc, argv, "H:P:u:p:t:n:s:S:h")) != -1) {
+		switch (c) {
+			case 'H': cfg.host = optarg; break;
+			case 'P': cfg.port = atoi(optarg); break;
+			case 'u': cfg.user = optarg; break;
+			case 'p': cfg.pass = optarg; break;
+			case 't': cfg.threads = atoi(optarg); break;
+			case 'n': cfg.iterations = atoi(optarg); break;
+			case 's': cfg.size = atoi(optarg); break;
+			case 'S': cfg.shared = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? 0 : 1;
+		}
+	}
+	if ((cfg.threads < 1) || (cfg.threads > STRESS_MAX_THREADS) || (cfg.iterations < 1) ||
+			(cfg.size < 1) || (cfg.shared < 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	/*
+	 * Without shared sessions the threads are the first to call
+	 * getFtpClient(), so its initialization runs concurrently.
+	 */
+	FtpClient* ftpClient = (cfg.shared > 0) ? getFtpClient() : NULL;
+	StressThread_t t[STRESS_MAX_THREADS];
+	NetBuf_t* sessions[STRESS_MAX_THREADS];
+	int nsessions = 0;
+	memset(t, 0, sizeof(t));
+	for (int i = 0; i < cfg.threads; i++) {
+		t[i].cfg = &cfg;
+		t[i].id = i;
+		if ((cfg.shared > 0) && ((i % cfg.shared) == 0)) {
+			NetBuf_t* nControl = NULL;
+			if (!ftpClient->ftpClientConnect(cfg.host, cfg.port, &nControl) ||
+					!ftpClient->ftpClientLogin(cfg.user, cfg.pass, nControl)) {
+				fprintf(stderr, "shared session failed\n");
+				return 1;
+			}
+			sessions[nsessions++] = nControl;
+		}
+		if (cfg.shared > 0)
+			t[i].shared = sessions[nsessions - 1];
+	}
+
+	pthread_barrier_t start;
+	pthread_barrier_init(&start, NULL, cfg.threads + 1);
+	pthread_t threads[STRESS_MAX_THREADS];
+	for (int i = 0; i < cfg.threads; i++) {
+		t[i].start = &start;
+		if (pthread_create(&threads[i], NULL, stressThread, &t[i]) != 0) {
+			fprintf(stderr, "cannot start thread %d\n", i);
+			return 1;
+		}
+	}
+	double t0 = nowSeconds();
+	pthread_barrier_wait(&start);
+	int transfers = 0, failures = 0, corrupt = 0;
+	uint64_t bytes = 0;
+	for (int i = 0; i < cfg.threads; i++) {
+		pthread_join(threads[i], NULL);
+		transfers += t[i].transfers;
+		failures += t[i].failures;
+		corrupt += t[i].corrupt;
+		bytes += t[i].bytes;
+	}
+	double elapsed = nowSeconds() - t0;
+	pthread_barrier_destroy(&start);
+	ftpClient = getFtpClient();
+	for (int i = 0; i < nsessions; i++)
+		ftpClient->ftpClientQuit(sessions[i]);
+
+	failures += rateChange(&cfg);
+
+	FtpClientMemStats_t mem;
+	ftpClient->ftpClientMemGetStats(&mem);
+	printf("threads %d sessions %d transfers %d failures %d corrupt %d  %.2f MB/s\n",
+		cfg.threads, cfg.shared ? nsessions : cfg.threads, transfers, failures, corrupt,
+		elapsed > 0 ? bytes / elapsed / (1024 * 1024) : 0.0);
+	printf("data connections high-water %" PRIu32 ", %" PRIu32 " from the heap, %" PRIu32
+		" still open\n", mem.netBufsHighWater, mem.netBufsOverflow, mem.netBufsInUse);
+	return (failures || corrupt || mem.netBufsInUse) ? 1 : 0;
+}
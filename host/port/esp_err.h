@@ -0,0 +1,26 @@
+/*
+	Host (Linux) port of the ftpClient component - esp_err.h replacement.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#ifndef FTP_HOST_ESP_ERR_H_
+#define FTP_HOST_ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK								0
+#define ESP_FAIL							-1
+#define ESP_ERR_NO_MEM						0x101
+#define ESP_ERR_INVALID_ARG					0x102
+#define ESP_ERR_INVALID_STATE				0x103
+#define ESP_ERR_INVALID_SIZE				0x104
+#define ESP_ERR_NOT_FOUND					0x105
+#define ESP_ERR_OTA_BASE					0x1500
+#define ESP_ERR_OTA_PARTITION_CONFLICT		(ESP_ERR_OTA_BASE + 0x01)
+#define ESP_ERR_OTA_SELECT_INFO_INVALID		(ESP_ERR_OTA_BASE + 0x02)
+#define ESP_ERR_OTA_VALIDATE_FAILED			(ESP_ERR_OTA_BASE + 0x03)
+
+const char* esp_err_to_name(esp_err_t code);
+
+#endif /* FTP_HOST_ESP_ERR_H_ */
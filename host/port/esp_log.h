@@ -0,0 +1,36 @@
+/*
+	Host (Linux) port of the ftpClient component - esp_log.h replacement.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#ifndef FTP_HOST_ESP_LOG_H_
+#define FTP_HOST_ESP_LOG_H_
+
+#include <stdio.h>
+
+typedef enum {
+	ESP_LOG_NONE,
+	ESP_LOG_ERROR,
+	ESP_LOG_WARN,
+	ESP_LOG_INFO,
+	ESP_LOG_DEBUG,
+	ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL						ESP_LOG_INFO
+#endif
+
+#define ESP_LOG_LEVEL_LOCAL(level, letter, tag, format, ...) do { \
+		if (LOG_LOCAL_LEVEL >= level) \
+			fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+	} while (0)
+
+#define ESP_LOGE(tag, format, ...)	ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)	ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)	ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)	ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)	ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#endif /* FTP_HOST_ESP_LOG_H_ */
@@ -0,0 +1,40 @@
+/*
+	Host (Linux) port of the ftpClient component - esp_ota_ops.h replacement.
+
+	Works on the app partitions of the simulated flash. esp_ota_write()
+	checks the magic byte of the image like ESP-IDF does, esp_ota_end()
+	only checks that an image was written.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#ifndef FTP_HOST_ESP_OTA_OPS_H_
+#define FTP_HOST_ESP_OTA_OPS_H_
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_SIZE_UNKNOWN					0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES			0xfffffffe
+
+typedef uint32_t esp_ota_handle_t;
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size,
+	esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTP_HOST_ESP_OTA_OPS_H_ */
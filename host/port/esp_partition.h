@@ -0,0 +1,87 @@
+/*
+	Host (Linux) port of the ftpClient component - esp_partition.h replacement.
+
+	The partitions live in memory and behave like NOR flash: erasing sets
+	the bytes to 0xFF and writing can only clear bits. Define them with
+	ftpHostFlashAdd() before use.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#ifndef FTP_HOST_ESP_PARTITION_H_
+#define FTP_HOST_ESP_PARTITION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	ESP_PARTITION_TYPE_APP = 0x00,
+	ESP_PARTITION_TYPE_DATA = 0x01,
+	ESP_PARTITION_TYPE_ANY = 0xff
+} esp_partition_type_t;
+
+typedef enum {
+	ESP_PARTITION_SUBTYPE_APP_FACTORY = 0x00,
+	ESP_PARTITION_SUBTYPE_APP_OTA_MIN = 0x10,
+	ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+	ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+	ESP_PARTITION_SUBTYPE_APP_OTA_MAX = 0x20,
+	ESP_PARTITION_SUBTYPE_DATA_OTA = 0x00,
+	ESP_PARTITION_SUBTYPE_DATA_PHY = 0x01,
+	ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+	ESP_PARTITION_SUBTYPE_DATA_FAT = 0x81,
+	ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+	ESP_PARTITION_SUBTYPE_DATA_LITTLEFS = 0x83,
+	ESP_PARTITION_SUBTYPE_ANY = 0xff
+} esp_partition_subtype_t;
+
+typedef struct {
+	void* flash_chip;
+	esp_partition_type_t type;
+	esp_partition_subtype_t subtype;
+	uint32_t address;
+	uint32_t size;
+	uint32_t erase_size;
+	char label[17];
+	bool encrypted;
+	bool readonly;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+	esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+	size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+	size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+	size_t offset, size_t size);
+
+/* host only: define a partition of the simulated flash, NULL if out of room */
+const esp_partition_t* ftpHostFlashAdd(const char* label, esp_partition_type_t type,
+	esp_partition_subtype_t subtype, uint32_t size);
+
+/* host only: counters of the simulated flash since ftpHostFlashResetStats() */
+typedef struct {
+	uint32_t eraseCalls;
+	uint32_t erasedSectors;
+	uint32_t writeCalls;
+	uint64_t writeBytes;
+	uint32_t dirtyWrites;		/* writes that needed a 0 bit to become 1, lost on NOR flash */
+} FtpHostFlashStats_t;
+
+void ftpHostFlashGetStats(FtpHostFlashStats_t* stats);
+void ftpHostFlashResetStats(void);
+/* host only: time an erase takes, per 4 KB sector and per aligned 64 KB block */
+void ftpHostFlashSetTiming(uint32_t sectorUs, uint32_t blockUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTP_HOST_ESP_PARTITION_H_ */
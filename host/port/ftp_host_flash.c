@@ -0,0 +1,386 @@
+/*
+	Host (Linux) port of the ftpClient component - simulated flash
+	partitions for esp_partition.h and esp_ota_ops.h.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+
+#define FLASH_PARTITIONS_MAX				8
+#define FLASH_SECTOR_SIZE					4096
+#define FLASH_BLOCK_SIZE					65536
+#define FLASH_BASE							0x10000
+#define OTA_HANDLES_MAX						2
+#define IMAGE_MAGIC							0xE9
+
+typedef struct {
+	esp_partition_t part;
+	uint8_t* data;
+} FlashPartition_t;
+
+typedef struct {
+	const esp_partition_t* part;
+	uint32_t wrote;
+	uint32_t erased;			/* bytes from the start erased for sequential writes */
+	int sequential;
+} OtaHandle_t;
+
+static pthread_mutex_t flashLock = PTHREAD_MUTEX_INITIALIZER;
+static FlashPartition_t flash[FLASH_PARTITIONS_MAX];
+static int flashCount;
+static uint32_t flashEnd = FLASH_BASE;
+static FtpHostFlashStats_t flashStats;
+static uint32_t sectorUs;
+static uint32_t blockUs;
+static OtaHandle_t otaHandles[OTA_HANDLES_MAX];
+static const esp_partition_t* bootPartition;
+
+
+
+const char* esp_err_to_name(esp_err_t code)
+{
+	switch (code) {
+		case ESP_OK:
+			return "ESP_OK";
+		case ESP_FAIL:
+			return "ESP_FAIL";
+		case ESP_ERR_NO_MEM:
+			return "ESP_ERR_NO_MEM";
+		case ESP_ERR_INVALID_ARG:
+			return "ESP_ERR_INVALID_ARG";
+		case ESP_ERR_INVALID_STATE:
+			return "ESP_ERR_INVALID_STATE";
+		case ESP_ERR_INVALID_SIZE:
+			return "ESP_ERR_INVALID_SIZE";
+		case ESP_ERR_NOT_FOUND:
+			return "ESP_ERR_NOT_FOUND";
+		case ESP_ERR_OTA_PARTITION_CONFLICT:
+			return "ESP_ERR_OTA_PARTITION_CONFLICT";
+		case ESP_ERR_OTA_SELECT_INFO_INVALID:
+			return "ESP_ERR_OTA_SELECT_INFO_INVALID";
+		case ESP_ERR_OTA_VALIDATE_FAILED:
+			return "ESP_ERR_OTA_VALIDATE_FAILED";
+	}
+	return "UNKNOWN ERROR";
+}
+
+
+
+const esp_partition_t* ftpHostFlashAdd(const char* label, esp_partition_type_t type,
+	esp_partition_subtype_t subtype, uint32_t size)
+{
+	size = (size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+	pthread_mutex_lock(&flashLock);
+	FlashPartition_t* f = NULL;
+	if ((flashCount < FLASH_PARTITIONS_MAX) && ((f = &flash[flashCount])->data = malloc(size))) {
+		memset(f->data, 0xFF, size);
+		memset(&f->part, 0, sizeof(f->part));
+		f->part.type = type;
+		f->part.subtype = subtype;
+		f->part.address = flashEnd;
+		f->part.size = size;
+		f->part.erase_size = FLASH_SECTOR_SIZE;
+		strncpy(f->part.label, label, sizeof(f->part.label) - 1);
+		flashEnd += size;
+		flashCount++;
+	}
+	else
+		f = NULL;
+	pthread_mutex_unlock(&flashLock);
+	return f ? &f->part : NULL;
+}
+
+
+
+void ftpHostFlashGetStats(FtpHostFlashStats_t* stats)
+{
+	pthread_mutex_lock(&flashLock);
+	*stats = flashStats;
+	pthread_mutex_unlock(&flashLock);
+}
+
+
+
+void ftpHostFlashResetStats(void)
+{
+	pthread_mutex_lock(&flashLock);
+	memset(&flashStats, 0, sizeof(flashStats));
+	pthread_mutex_unlock(&flashLock);
+}
+
+
+
+void ftpHostFlashSetTiming(uint32_t sector, uint32_t block)
+{
+	sectorUs = sector;
+	blockUs = block;
+}
+
+
+
+static FlashPartition_t* flashFind(const esp_partition_t* partition)
+{
+	for (int i = 0; i < flashCount; i++)
+		if (&flash[i].part == partition)
+			return &flash[i];
+	return NULL;
+}
+
+
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+	esp_partition_subtype_t subtype, const char* label)
+{
+	for (int i = 0; i < flashCount; i++) {
+		const esp_partition_t* p = &flash[i].part;
+		if ((type != ESP_PARTITION_TYPE_ANY) && (p->type != type))
+			continue;
+		if ((subtype != ESP_PARTITION_SUBTYPE_ANY) && (p->subtype != subtype))
+			continue;
+		if (label && strcmp(p->label, label))
+			continue;
+		return p;
+	}
+	return NULL;
+}
+
+
+
+esp_err_t esp_partition_read(const esp_partition_t* partition,
+	size_t src_offset, void* dst, size_t size)
+{
+	FlashPartition_t* f = flashFind(partition);
+	if ((f == NULL) || (dst == NULL))
+		return ESP_ERR_INVALID_ARG;
+	if ((src_offset > partition->size) || (size > partition->size - src_offset))
+		return ESP_ERR_INVALID_SIZE;
+	memcpy(dst, f->data + src_offset, size);
+	return ESP_OK;
+}
+
+
+
+esp_err_t esp_partition_write(const esp_partition_t* partition,
+	size_t dst_offset, const void* src, size_t size)
+{
+	FlashPartition_t* f = flashFind(partition);
+	if ((f == NULL) || (src == NULL))
+		return ESP_ERR_INVALID_ARG;
+	if ((dst_offset > partition->size) || (size > partition->size - dst_offset))
+		return ESP_ERR_INVALID_SIZE;
+	const uint8_t* s = src;
+	uint8_t* d = f->data + dst_offset;
+	int dirty = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (s[i] & ~d[i])
+			dirty = 1;
+		d[i] &= s[i];
+	}
+	pthread_mutex_lock(&flashLock);
+	flashStats.writeCalls++;
+	flashStats.writeBytes += size;
+	flashStats.dirtyWrites += dirty;
+	pthread_mutex_unlock(&flashLock);
+	return ESP_OK;
+}
+
+
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+	size_t offset, size_t size)
+{
+	FlashPartition_t* f = flashFind(partition);
+	if (f == NULL)
+		return ESP_ERR_INVALID_ARG;
+	if ((offset > partition->size) || (size > partition->size - offset))
+		return ESP_ERR_INVALID_SIZE;
+	if ((offset % FLASH_SECTOR_SIZE) || (size % FLASH_SECTOR_SIZE))
+		return ESP_ERR_INVALID_SIZE;
+	memset(f->data + offset, 0xFF, size);
+	/* like the flash driver, whole aligned blocks are erased at once */
+	uint32_t us = 0;
+	size_t addr = partition->address + offset;
+	size_t end = addr + size;
+	while (addr < end) {
+		if (((addr % FLASH_BLOCK_SIZE) == 0) && (end - addr >= FLASH_BLOCK_SIZE)) {
+			us += blockUs;
+			addr += FLASH_BLOCK_SIZE;
+		}
+		else {
+			us += sectorUs;
+			addr += FLASH_SECTOR_SIZE;
+		}
+	}
+	if (us)
+		usleep(us);
+	pthread_mutex_lock(&flashLock);
+	flashStats.eraseCalls++;
+	flashStats.erasedSectors += size / FLASH_SECTOR_SIZE;
+	pthread_mutex_unlock(&flashLock);
+	return ESP_OK;
+}
+
+
+
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+	const esp_partition_t* p = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+		ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+	if (p == NULL)
+		p = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
+	return p;
+}
+
+
+
+const esp_partition_t* esp_ota_get_boot_partition(void)
+{
+	return bootPartition ? bootPartition : esp_ota_get_running_partition();
+}
+
+
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+{
+	if ((flashFind(partition) == NULL) || (partition->type != ESP_PARTITION_TYPE_APP))
+		return ESP_ERR_INVALID_ARG;
+	uint8_t magic;
+	esp_partition_read(partition, 0, &magic, 1);
+	if (magic != IMAGE_MAGIC)
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	bootPartition = partition;
+	return ESP_OK;
+}
+
+
+
+/*
+ * the OTA app partition after the running one, the first one when the
+ * factory app runs
+ */
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from)
+{
+	if (start_from == NULL)
+		start_from = esp_ota_get_running_partition();
+	const esp_partition_t* first = NULL;
+	int found = 0;
+	for (int i = 0; i < flashCount; i++) {
+		const esp_partition_t* p = &flash[i].part;
+		if (p == start_from) {
+			found = 1;
+			continue;
+		}
+		if ((p->type != ESP_PARTITION_TYPE_APP) || (p->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MIN) ||
+			(p->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_MAX))
+			continue;
+		if (found)
+			return p;
+		if (first == NULL)
+			first = p;
+	}
+	return first;
+}
+
+
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size,
+	esp_ota_handle_t* out_handle)
+{
+	if ((flashFind(partition) == NULL) || (partition->type != ESP_PARTITION_TYPE_APP) ||
+		(partition->subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY))
+		return ESP_ERR_INVALID_ARG;
+	if (partition == esp_ota_get_running_partition())
+		return ESP_ERR_OTA_PARTITION_CONFLICT;
+	if ((image_size != OTA_SIZE_UNKNOWN) && (image_size != OTA_WITH_SEQUENTIAL_WRITES) &&
+		(image_size > partition->size))
+		return ESP_ERR_INVALID_SIZE;
+	int h;
+	pthread_mutex_lock(&flashLock);
+	for (h = 0; h < OTA_HANDLES_MAX; h++)
+		if (otaHandles[h].part == NULL)
+			break;
+	if (h < OTA_HANDLES_MAX)
+		otaHandles[h].part = partition;
+	pthread_mutex_unlock(&flashLock);
+	if (h == OTA_HANDLES_MAX)
+		return ESP_ERR_NO_MEM;
+	OtaHandle_t* o = &otaHandles[h];
+	o->wrote = 0;
+	o->erased = 0;
+	o->sequential = (image_size == OTA_WITH_SEQUENTIAL_WRITES);
+	if (!o->sequential) {
+		size_t n = (image_size == OTA_SIZE_UNKNOWN) ? partition->size :
+			(image_size + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+		esp_err_t err = esp_partition_erase_range(partition, 0, n);
+		if (err != ESP_OK) {
+			o->part = NULL;
+			return err;
+		}
+	}
+	*out_handle = h + 1;
+	return ESP_OK;
+}
+
+
+
+static OtaHandle_t* otaFind(esp_ota_handle_t handle)
+{
+	if ((handle == 0) || (handle > OTA_HANDLES_MAX) || (otaHandles[handle - 1].part == NULL))
+		return NULL;
+	return &otaHandles[handle - 1];
+}
+
+
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+	OtaHandle_t* o = otaFind(handle);
+	if ((o == NULL) || (data == NULL))
+		return ESP_ERR_INVALID_ARG;
+	if ((o->wrote == 0) && size && (((const uint8_t*)data)[0] != IMAGE_MAGIC))
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	if (size > o->part->size - o->wrote)
+		return ESP_ERR_INVALID_SIZE;
+	/* sequential writes erase each sector when they reach it */
+	while (o->sequential && (o->erased < o->wrote + size)) {
+		esp_err_t err = esp_partition_erase_range(o->part, o->erased, FLASH_SECTOR_SIZE);
+		if (err != ESP_OK)
+			return err;
+		o->erased += FLASH_SECTOR_SIZE;
+	}
+	esp_err_t err = esp_partition_write(o->part, o->wrote, data, size);
+	if (err == ESP_OK)
+		o->wrote += size;
+	return err;
+}
+
+
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+	OtaHandle_t* o = otaFind(handle);
+	if (o == NULL)
+		return ESP_ERR_NOT_FOUND;
+	esp_err_t err = (o->wrote == 0) ? ESP_ERR_OTA_VALIDATE_FAILED : ESP_OK;
+	o->part = NULL;
+	return err;
+}
+
+
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+	OtaHandle_t* o = otaFind(handle);
+	if (o == NULL)
+		return ESP_ERR_NOT_FOUND;
+	o->part = NULL;
+	return ESP_OK;
+}
@@ -0,0 +1,93 @@
+/*
+	Host (Linux) port of the ftpClient component - heap tracker.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "ftp_host_port.h"
+
+/*
+ * Every block carries a header with its size so that free() can account
+ * for it. The header is padded to max_align_t to keep the user pointer
+ * suitably aligned.
+ */
+typedef union {
+	size_t size;
+	max_align_t align;
+} HeapHeader_t;
+
+static atomic_size_t heapInUse;
+static atomic_size_t heapPeak;
+
+static void heapAdd(size_t size)
+{
+	size_t now = atomic_fetch_add(&heapInUse, size) + size;
+	size_t peak = atomic_load(&heapPeak);
+	while (now > peak && !atomic_compare_exchange_weak(&heapPeak, &peak, now))
+		;
+}
+
+void* ftpHostMalloc(size_t size)
+{
+	HeapHeader_t* h = malloc(sizeof(HeapHeader_t) + size);
+	if (h == NULL)
+		return NULL;
+	h->size = size;
+	heapAdd(size);
+	return h + 1;
+}
+
+void* ftpHostCalloc(size_t nmemb, size_t size)
+{
+	if (size && nmemb > (SIZE_MAX - sizeof(HeapHeader_t)) / size)
+		return NULL;
+	HeapHeader_t* h = calloc(1, sizeof(HeapHeader_t) + nmemb * size);
+	if (h == NULL)
+		return NULL;
+	h->size = nmemb * size;
+	heapAdd(h->size);
+	return h + 1;
+}
+
+void* ftpHostRealloc(void* ptr, size_t size)
+{
+	if (ptr == NULL)
+		return ftpHostMalloc(size);
+	HeapHeader_t* h = (HeapHeader_t*)ptr - 1;
+	size_t old = h->size;
+	HeapHeader_t* n = realloc(h, sizeof(HeapHeader_t) + size);
+	if (n == NULL)
+		return NULL;
+	n->size = size;
+	atomic_fetch_sub(&heapInUse, old);
+	heapAdd(size);
+	return n + 1;
+}
+
+void ftpHostFree(void* ptr)
+{
+	if (ptr == NULL)
+		return;
+	HeapHeader_t* h = (HeapHeader_t*)ptr - 1;
+	atomic_fetch_sub(&heapInUse, h->size);
+	free(h);
+}
+
+void ftpHostHeapReset(void)
+{
+	atomic_store(&heapPeak, atomic_load(&heapInUse));
+}
+
+size_t ftpHostHeapInUse(void)
+{
+	return atomic_load(&heapInUse);
+}
+
+size_t ftpHostHeapPeak(void)
+{
+	return atomic_load(&heapPeak);
+}
@@ -0,0 +1,60 @@
+/*
+	Host (Linux) port of the ftpClient component.
+
+	This header is force-included (-include) in front of every ftpClient
+	source when building on the host, so the component compiles unchanged
+	outside of ESP-IDF. It supplies what lwIP and newlib normally pull in
+	implicitly, and routes the component's heap calls through a small
+	tracker so the benchmark can report the peak heap usage.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#ifndef FTP_HOST_PORT_H_
+#define FTP_HOST_PORT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* lwIP compatibility */
+#define closesocket(s)						close(s)
+
+/* heap tracker */
+void* ftpHostMalloc(size_t size);
+void* ftpHostCalloc(size_t nmemb, size_t size);
+void* ftpHostRealloc(void* ptr, size_t size);
+void ftpHostFree(void* ptr);
+
+void ftpHostHeapReset(void);
+size_t ftpHostHeapInUse(void);
+size_t ftpHostHeapPeak(void);
+
+#ifdef FTP_HOST_TRACK_HEAP
+#define malloc(n)							ftpHostMalloc(n)
+#define calloc(n, s)						ftpHostCalloc(n, s)
+#define realloc(p, n)						ftpHostRealloc(p, n)
+#define free(p)								ftpHostFree(p)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTP_HOST_PORT_H_ */
@@ -0,0 +1,221 @@
+/*
+	ASCII line end translation microbenchmark (host build).
+
+	Compares the per-byte LF to CRLF loop of the former writeLine() and the
+	line by line CRLF to LF of readLine() with the chunk translators of
+	FtpClientText.c, on text with different line lengths.
+
+	This code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "FtpClientText.h"
+
+#define TEXT_CHUNK					4096
+
+static double nowSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* printable lines of about lineLen bytes, each ended by LF */
+static void makeText(char* buf, size_t size, int lineLen)
+{
+	unsigned int seed = 12345;
+	size_t i = 0;
+	while (i < size) {
+		seed = seed * 1103515245 + 12345;
+		int l = lineLen / 2 + (int)((seed >> 16) % (unsigned int)(lineLen + 1));
+		for (int j = 0; (j < l) && (i < size); j++, i++)
+			buf[i] = (j % 9 == 8) ? ',' : (char)('0' + i % 10);
+		if (i < size)
+			buf[i++] = '\n';
+	}
+}
+
+/* LF to CRLF of the former writeLine(), one chunk of output at a time */
+static size_t perByteToCrlf(const char* in, size_t len, char* out)
+{
+	char nbp[TEXT_CHUNK];
+	size_t total = 0;
+	int nb = 0;
+	char lc = 0;
+	for (size_t x = 0; x < len; x++) {
+		if ((in[x] == '\n') && (lc != '\r')) {
+			if (nb == TEXT_CHUNK) {
+				memcpy(out + total, nbp, nb);
+				total += nb;
+				nb = 0;
+			}
+			nbp[nb++] = '\r';
+		}
+		if (nb == TEXT_CHUNK) {
+			memcpy(out + total, nbp, nb);
+			total += nb;
+			nb = 0;
+		}
+		nbp[nb++] = lc = in[x];
+	}
+	memcpy(out + total, nbp, nb);
+	return total + nb;
+}
+
+static size_t chunkToCrlf(const char* in, size_t len, char* out)
+{
+	char nbp[TEXT_CHUNK];
+	size_t total = 0;
+	size_t x = 0;
+	char last = 0;
+	while (x < len) {
+		size_t n = len - x;
+		size_t nb = ftpClientTextToCrlf(in + x, &n, nbp, TEXT_CHUNK, &last);
+		memcpy(out + total, nbp, nb);
+		total += nb;
+		x += n;
+	}
+	return total;
+}
+
+/*
+ * CRLF to LF of the former readChunk(): each received chunk is staged like
+ * the ASCII buffer of the data connection and copied out line by line with
+ * readLine()
+ */
+static size_t perLineFromCrlf(const char* in, size_t len, char* out)
+{
+	char stage[TEXT_CHUNK];
+	size_t total = 0;
+	size_t x = 0;
+	while (x < len) {
+		int cavail = (len - x > TEXT_CHUNK) ? TEXT_CHUNK : (int)(len - x);
+		memcpy(stage, in + x, cavail);
+		x += cavail;
+		char* cget = stage;
+		while (cavail > 0) {
+			/* readChunk() checks for a complete line first */
+			char* nl = memchr(cget, '\n', cavail);
+			int l = (nl != NULL) ? (int)(nl - cget + 1) : cavail;
+			char* bp = out + total;
+			char* end = memccpy(bp, cget, '\n', l);
+			if (end != NULL)
+				l = end - bp;
+			cget += l;
+			cavail -= l;
+			bp += l;
+			*bp = '\0';
+			if (end != NULL) {
+				bp -= 2;
+				if (strcmp(bp, "\r\n") == 0) {
+					*bp++ = '\n';
+					*bp++ = '\0';
+					--l;
+				}
+			}
+			total += l;
+		}
+	}
+	return total;
+}
+
+static size_t chunkFromCrlf(const char* in, size_t len, char* out)
+{
+	size_t total = 0;
+	size_t x = 0;
+	char cr = 0;
+	while (x < len) {
+		size_t n = (len - x > TEXT_CHUNK) ? TEXT_CHUNK : (len - x);
+		size_t off = 0;
+		if (cr)
+			out[total + off++] = '\r';
+		memcpy(out + total + off, in + x, n);
+		total += ftpClientTextFromCrlf(out + total, off + n, out + total, &cr);
+		x += n;
+	}
+	if (cr)
+		out[total++] = '\r';
+	return total;
+}
+
+static double rate(size_t (*fn)(const char*, size_t, char*), const char* in, size_t len,
+	char* out, size_t* outlen, int iterations)
+{
+	double best = 0;
+	for (int i = 0; i < iterations; i++) {
+		double t = nowSeconds();
+		*outlen = fn(in, len, out);
+		t = nowSeconds() - t;
+		if ((best == 0) || (t < best))
+			best = t;
+	}
+	return len / best / (1024 * 1024);
+}
+
+static void usage(const char* prog)
+{
+	printf("usage: %s [options]\n"
+		"  -s megabytes   text size (16)\n"
+		"  -n iterations  best of this many runs (5)\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	size_t size = 16;
+	int iterations = 5;
+	int c;
+	while ((c = getopt(argc, argv, "s:n:h")) != -1) {
+		switch (c) {
+			case 's': size = strtoul(optarg, NULL, 10); break;
+			case 'n': iterations = atoi(optarg); break;
+			default: usage(argv[0]); return (c == 'h') ? 0 : 1;
+		}
+	}
+	size *= 1024 * 1024;
+	if ((size == 0) || (iterations <= 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+	char* text = malloc(size);
+	char* crlf = malloc(size * 2);
+	char* out1 = malloc(size * 2 + 1);
+	char* out2 = malloc(size * 2 + 1);
+	if (!text || !crlf || !out1 || !out2) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	static const int lineLens[] = { 8, 40, 80, 200, 1000 };
+	int failed = 0;
+	printf("line   dir          per-byte(MB/s)   chunk(MB/s)   speedup\n");
+	for (size_t k = 0; k < sizeof(lineLens) / sizeof(lineLens[0]); k++) {
+		makeText(text, size, lineLens[k]);
+		size_t l1, l2;
+		double r1 = rate(perByteToCrlf, text, size, out1, &l1, iterations);
+		double r2 = rate(chunkToCrlf, text, size, out2, &l2, iterations);
+		if ((l1 != l2) || memcmp(out1, out2, l1)) {
+			printf("%-6d LF->CRLF     output differs\n", lineLens[k]);
+			failed = 1;
+		}
+		printf("%-6d LF->CRLF %14.1f %13.1f %8.1fx\n", lineLens[k], r1, r2, r2 / r1);
+		memcpy(crlf, out2, l2);
+		size_t clen = l2;
+		r1 = rate(perLineFromCrlf, crlf, clen, out1, &l1, iterations);
+		r2 = rate(chunkFromCrlf, crlf, clen, out2, &l2, iterations);
+		if ((l1 != l2) || (l2 != size) || memcmp(out1, out2, l1) || memcmp(text, out2, size)) {
+			printf("%-6d CRLF->LF     output differs\n", lineLens[k]);
+			failed = 1;
+		}
+		printf("%-6d CRLF->LF %14.1f %13.1f %8.1fx\n", lineLens[k], r1, r2, r2 / r1);
+	}
+	free(text);
+	free(crlf);
+	free(out1);
+	free(out2);
+	return failed;
+}
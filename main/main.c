@@ -461,6 +461,15 @@ esp_err_t mountSDCARD(char * mount_point, sdmmc_card_t * card) {
 }
 #endif // CONFIG_SPI_SDCARD || CONFIG_MMC_SDCARD
 
+static int printEntry(const FtpClientDirEntry_t* entry, void* arg)
+{
+	if (entry->type == FTP_CLIENT_ENTRY_DIR)
+		ESP_LOGI(TAG, "%-32s <DIR>", entry->name);
+	else
+		ESP_LOGI(TAG, "%-32s %10"PRIu64, entry->name, entry->size);
+	return 1;
+}
+
 void app_main(void)
 {
 	// Initialize NVS
@@ -512,10 +521,8 @@ void app_main(void)
 
 	char srcFileName[64];
 	char dstFileName[64];
-	char outFileName[64];
 	sprintf(srcFileName, "%s/hello.txt", MOUNT_POINT);
 	sprintf(dstFileName, "hello.txt");
-	sprintf(outFileName, "%s/out.txt", MOUNT_POINT);
 
 	// Open FTP server
 	ESP_LOGI(TAG, "ftp server:%s", CONFIG_FTP_SERVER);
@@ -541,29 +548,17 @@ void app_main(void)
 
 	// Remote Directory
 	char line[128];
-	//ftpClient->ftpClientDir(outFileName, "/", ftpClientNetBuf);
-	int result = ftpClient->ftpClientDir(outFileName, ".", ftpClientNetBuf);
+	//int result = ftpClient->ftpClientList("/", FTP_CLIENT_LIST_MLSD, printEntry, NULL, ftpClientNetBuf);
+	int result = ftpClient->ftpClientList(".", FTP_CLIENT_LIST_LIST, printEntry, NULL, ftpClientNetBuf);
 	if (result != 1) {
-		ESP_LOGE(TAG, "ftpClientDir Fail. result=%d", result);
-		return;
-	}
-	
-	FILE* f = fopen(outFileName, "r");
-	if (f == NULL) {
-		ESP_LOGE(TAG, "Failed to open file for reading");
+		ESP_LOGE(TAG, "ftpClientList Fail. result=%d", result);
 		return;
 	}
-	while (fgets(line, sizeof(line), f) != NULL) {
-		int len = strlen(line);
-		line[len-1] = 0;
-		ESP_LOGI(TAG, "%s", line);
-	}
-	fclose(f);
 	ESP_LOGI(TAG, "");
 
 	// Use POSIX and C standard library functions to work with files.
 	// Create file
-	f = fopen(srcFileName, "w");
+	FILE* f = fopen(srcFileName, "w");
 	if (f == NULL) {
 		ESP_LOGE(TAG, "Failed to open file for writing");
 		return;
@@ -37,7 +37,7 @@ def main():
 	parser = argparse.ArgumentParser()
 	parser.add_argument('--user', default="ftpuser", help='ftp user name')
 	parser.add_argument('--password', default="ftppass", help='ftp user password')
-	parser.add_argument('--port', default=2121, help='ftp port')
+	parser.add_argument('--port', type=int, default=2121, help='ftp port')
 	args = parser.parse_args()
 	print("args.user={}".format(args.user))
 	print("args.password={}".format(args.password))
@@ -60,7 +60,7 @@ def main():
 	#server = pyftpdlib.servers.FTPServer(("127.0.0.1", 2121), handler)
 
 	# Enable remote connection
-	server = FTPServer(("0.0.0.0", 2121), handler)
+	server = FTPServer(("0.0.0.0", args.port), handler)
 
 	# start ftp server
 	server.serve_forever()